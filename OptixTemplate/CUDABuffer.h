@@ -59,11 +59,6 @@ namespace osc {
         upload((const T*)vt.data(), vt.size());
     }
 
-    void alloc_and_upload(const OptixAabb& vt)
-    {
-        alloc(sizeof(OptixAabb));
-        upload(&vt, 1);
-    }
     
     template<typename T>
     void upload(const T *t, size_t count)
@@ -83,6 +78,29 @@ namespace osc {
                         count*sizeof(T), cudaMemcpyDeviceToHost));
     }
     
+    /*! asynchronous versions of upload/download; the host memory
+        has to be pinned (and stay alive) for these to actually
+        overlap with anything */
+    template<typename T>
+    void upload_async(const T *t, size_t count, CUstream stream)
+    {
+      assert(d_ptr != nullptr);
+      assert(sizeInBytes == count*sizeof(T));
+      CUDA_CHECK(MemcpyAsync(d_ptr, (void *)t,
+                             count*sizeof(T), cudaMemcpyHostToDevice, stream));
+    }
+    
+    /*! may read back just the first count elements, if the buffer
+        holds more */
+    template<typename T>
+    void download_async(T *t, size_t count, CUstream stream)
+    {
+      assert(d_ptr != nullptr);
+      assert(sizeInBytes >= count*sizeof(T));
+      CUDA_CHECK(MemcpyAsync((void *)t, d_ptr,
+                             count*sizeof(T), cudaMemcpyDeviceToHost, stream));
+    }
+    
     size_t sizeInBytes { 0 };
     void  *d_ptr { nullptr };
   };
@@ -0,0 +1,591 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "Distributed.h"
+#include "gdt/profile/Profiler.h"
+#include <cstring>
+#ifdef _WIN32
+# include <winsock2.h>
+# include <ws2tcpip.h>
+# include <process.h>
+  typedef int socklen_t;
+#else
+# include <arpa/inet.h>
+# include <netinet/in.h>
+# include <netinet/tcp.h>
+# include <spawn.h>
+# include <sys/select.h>
+# include <sys/socket.h>
+# include <sys/wait.h>
+# include <unistd.h>
+extern char **environ;
+#endif
+
+namespace osc {
+
+  enum {
+    /*! coordinator -> worker: the serialized scene */
+    MSG_SCENE = 1,
+    /*! worker -> coordinator: renderer is set up */
+    MSG_READY,
+    /*! coordinator -> worker: camera and size for the tiles to come */
+    MSG_FRAME,
+    /*! coordinator -> worker: tile ID and rows to render */
+    MSG_TILE,
+    /*! worker -> coordinator: tile ID, rows, and compressed pixels */
+    MSG_TILE_DONE,
+    /*! coordinator -> worker: exit */
+    MSG_QUIT
+  };
+
+  struct FrameMessage {
+    Camera camera;
+    vec2i  frameSize;
+  };
+  
+  struct TileMessage {
+    uint32_t tileID;
+    RowRange rows;
+  };
+  
+  // ------------------------------------------------------------------
+  // scene and pixel encoding
+  // ------------------------------------------------------------------
+
+  static const char sceneMagic[8] = { 'O','S','C','S','C','N','E','3' };
+  
+  struct ByteWriter {
+    template<typename T>
+    void write(const T &t)
+    { bytes.append((const char *)&t,sizeof(t)); }
+    template<typename T>
+    void write(const std::vector<T> &v)
+    {
+      write(uint64_t(v.size()));
+      bytes.append((const char *)v.data(),v.size()*sizeof(T));
+    }
+    void write(const TriangleMesh &mesh)
+    {
+      write(mesh.vertex);
+      write(mesh.index);
+      write(mesh.color);
+      write(mesh.triangleColor);
+      write(mesh.vertexColor);
+      write(mesh.normal);
+      write(mesh.texcoord);
+      write(mesh.bakedLight);
+    }
+    std::string bytes;
+  };
+
+  struct ByteReader {
+    ByteReader(const std::string &bytes) : bytes(bytes) {}
+    
+    void read(void *data, size_t numBytes)
+    {
+      if (numBytes > bytes.size()-pos)
+        throw std::runtime_error("truncated scene data");
+      memcpy(data,bytes.data()+pos,numBytes);
+      pos += numBytes;
+    }
+    template<typename T>
+    void read(T &t) { read(&t,sizeof(t)); }
+    template<typename T>
+    void read(std::vector<T> &v)
+    {
+      uint64_t size = 0;
+      read(size);
+      if (size > (bytes.size()-pos)/sizeof(T))
+        throw std::runtime_error("truncated scene data");
+      v.resize(size);
+      read(v.data(),size*sizeof(T));
+    }
+    void read(TriangleMesh &mesh)
+    {
+      read(mesh.vertex);
+      read(mesh.index);
+      read(mesh.color);
+      read(mesh.triangleColor);
+      read(mesh.vertexColor);
+      read(mesh.normal);
+      read(mesh.texcoord);
+      read(mesh.bakedLight);
+      // attribute streams are either empty, or complete
+      auto check = [](size_t size, size_t expected) {
+        if (size != 0 && size != expected)
+          throw std::runtime_error("invalid attribute stream in scene data");
+      };
+      check(mesh.triangleColor.size(),mesh.index.size());
+      check(mesh.vertexColor.size(),mesh.vertex.size());
+      check(mesh.normal.size(),mesh.vertex.size());
+      check(mesh.texcoord.size(),mesh.vertex.size());
+      check(mesh.bakedLight.size(),mesh.vertex.size());
+      for (auto &idx : mesh.index)
+        if (reduce_min(idx) < 0 || reduce_max(idx) >= (int)mesh.vertex.size())
+          throw std::runtime_error("invalid vertex index in scene data");
+    }
+    
+    const std::string &bytes;
+    size_t pos = 0;
+  };
+  
+  std::string serializeScene(const Geometry &scene)
+  {
+    ByteWriter out;
+    out.bytes.append(sceneMagic,sizeof(sceneMagic));
+    out.write(uint64_t(scene.meshes.size()));
+    for (auto &mesh : scene.meshes)
+      out.write(mesh);
+    out.write(scene.spheres);
+    out.write(uint64_t(scene.instancedMeshes.size()));
+    for (auto &lodMesh : scene.instancedMeshes) {
+      out.write(uint64_t(lodMesh.levels.size()));
+      for (auto &level : lodMesh.levels)
+        out.write(level);
+    }
+    out.write(scene.instances);
+    return out.bytes;
+  }
+  
+  Geometry deserializeScene(const std::string &bytes)
+  {
+    ByteReader in(bytes);
+    char magic[sizeof(sceneMagic)];
+    in.read(magic,sizeof(magic));
+    if (memcmp(magic,sceneMagic,sizeof(magic)) != 0)
+      throw std::runtime_error("not a serialized scene");
+    
+    Geometry scene;
+    uint64_t numMeshes = 0;
+    in.read(numMeshes);
+    for (uint64_t i=0;i<numMeshes;i++) {
+      scene.meshes.push_back(TriangleMesh());
+      in.read(scene.meshes.back());
+    }
+    in.read(scene.spheres);
+    uint64_t numInstancedMeshes = 0;
+    in.read(numInstancedMeshes);
+    for (uint64_t i=0;i<numInstancedMeshes;i++) {
+      scene.instancedMeshes.push_back(LODMesh());
+      uint64_t numLevels = 0;
+      in.read(numLevels);
+      for (uint64_t l=0;l<numLevels;l++) {
+        scene.instancedMeshes.back().levels.push_back(TriangleMesh());
+        in.read(scene.instancedMeshes.back().levels.back());
+      }
+      if (numLevels == 0)
+        throw std::runtime_error("instanced mesh without levels in scene data");
+    }
+    in.read(scene.instances);
+    for (auto &instance : scene.instances)
+      if (instance.meshID < 0 || instance.meshID >= (int)scene.instancedMeshes.size())
+        throw std::runtime_error("invalid instance in scene data");
+    return scene;
+  }
+
+  /* pixels get encoded as a sequence of runs, each a 32-bit header
+     followed by pixels: with the top bit set, the next pixel repeats
+     (header & 0x7fffffff) times, otherwise 'header' pixels follow
+     literally */
+  static const uint32_t repeatFlag = 0x80000000u;
+  
+  std::string compressPixels(const uint32_t *pixels, size_t numPixels)
+  {
+    std::string bytes;
+    auto append = [&](const void *data, size_t numBytes)
+      { bytes.append((const char *)data,numBytes); };
+    size_t i = 0;
+    while (i < numPixels) {
+      size_t run = 1;
+      while (i+run < numPixels && pixels[i+run] == pixels[i] && run < repeatFlag-1)
+        run++;
+      if (run >= 3) {
+        const uint32_t header = repeatFlag | uint32_t(run);
+        append(&header,sizeof(header));
+        append(&pixels[i],sizeof(uint32_t));
+        i += run;
+        continue;
+      }
+      // literal run, up to where the next repeat of (at least) three
+      // starts
+      size_t end = i;
+      while (end < numPixels && end-i < repeatFlag-1
+             && !(end+2 < numPixels
+                  && pixels[end] == pixels[end+1] && pixels[end] == pixels[end+2]))
+        end++;
+      const uint32_t header = uint32_t(end-i);
+      append(&header,sizeof(header));
+      append(&pixels[i],(end-i)*sizeof(uint32_t));
+      i = end;
+    }
+    return bytes;
+  }
+  
+  void decompressPixels(const std::string &bytes, uint32_t *pixels, size_t numPixels)
+  {
+    ByteReader in(bytes);
+    size_t numDone = 0;
+    while (in.pos < bytes.size()) {
+      uint32_t header = 0;
+      in.read(header);
+      const size_t run = header & ~repeatFlag;
+      if (run > numPixels-numDone)
+        throw std::runtime_error("compressed tile has too many pixels");
+      if (header & repeatFlag) {
+        uint32_t pixel = 0;
+        in.read(pixel);
+        std::fill(pixels+numDone,pixels+numDone+run,pixel);
+      } else {
+        in.read(pixels+numDone,run*sizeof(uint32_t));
+      }
+      numDone += run;
+    }
+    if (numDone != numPixels)
+      throw std::runtime_error("compressed tile has too few pixels");
+  }
+
+  // ------------------------------------------------------------------
+  // transport
+  // ------------------------------------------------------------------
+
+#ifdef _WIN32
+  static void initSockets()
+  {
+    static bool initialized = false;
+    if (initialized) return;
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2,2),&wsaData) != 0)
+      throw std::runtime_error("could not initialize winsock");
+    initialized = true;
+  }
+  static void closeSocket(intptr_t handle) { closesocket((SOCKET)handle); }
+#else
+  static void initSockets() {}
+  static void closeSocket(intptr_t handle) { close((int)handle); }
+#endif
+
+#ifdef MSG_NOSIGNAL
+  // a worker that went away should give an error, not kill us
+  static const int sendFlags = MSG_NOSIGNAL;
+#else
+  static const int sendFlags = 0;
+#endif
+
+  /*! tiles are small, and each one is waited for, so don't let them
+      sit in the send buffer */
+  static void setNoDelay(intptr_t handle)
+  {
+    int one = 1;
+    setsockopt(handle,IPPROTO_TCP,TCP_NODELAY,(const char *)&one,sizeof(one));
+  }
+  
+  Socket &Socket::operator=(Socket &&other)
+  {
+    if (this != &other) {
+      if (valid()) closeSocket(handle);
+      handle = other.handle;
+      other.handle = -1;
+    }
+    return *this;
+  }
+  
+  Socket::~Socket()
+  {
+    if (valid()) closeSocket(handle);
+  }
+
+  Socket Socket::listen(int port)
+  {
+    initSockets();
+    Socket s((intptr_t)socket(AF_INET,SOCK_STREAM,0));
+    if (!s.valid())
+      throw std::runtime_error("could not create socket");
+    int one = 1;
+    setsockopt(s.handle,SOL_SOCKET,SO_REUSEADDR,(const char *)&one,sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = htons((uint16_t)port);
+    if (bind(s.handle,(const sockaddr *)&addr,sizeof(addr)) != 0
+        || ::listen(s.handle,64) != 0)
+      throw std::runtime_error("could not listen on port "+std::to_string(port));
+    return s;
+  }
+  
+  Socket Socket::connect(const std::string &host, int port)
+  {
+    initSockets();
+    Socket s((intptr_t)socket(AF_INET,SOCK_STREAM,0));
+    if (!s.valid())
+      throw std::runtime_error("could not create socket");
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons((uint16_t)port);
+    if (inet_pton(AF_INET,host.c_str(),&addr.sin_addr) != 1)
+      throw std::runtime_error("invalid address '"+host+"' (need a numeric IPv4 one)");
+    if (::connect(s.handle,(const sockaddr *)&addr,sizeof(addr)) != 0)
+      throw std::runtime_error("could not connect to "+host+":"+std::to_string(port));
+    setNoDelay(s.handle);
+    return s;
+  }
+
+  Socket Socket::accept()
+  {
+    Socket s((intptr_t)::accept(handle,nullptr,nullptr));
+    if (!s.valid())
+      throw std::runtime_error("accepting a connection failed");
+    setNoDelay(s.handle);
+    return s;
+  }
+
+  int Socket::port() const
+  {
+    sockaddr_in addr = {};
+    socklen_t size = sizeof(addr);
+    if (getsockname(handle,(sockaddr *)&addr,&size) != 0)
+      throw std::runtime_error("could not query socket port");
+    return ntohs(addr.sin_port);
+  }
+  
+  void Socket::send(const void *data, size_t numBytes)
+  {
+    const char *bytes = (const char *)data;
+    while (numBytes > 0) {
+      const int chunk = (int)std::min(numBytes,size_t(1)<<30);
+      const long sent = (long)::send(handle,bytes,chunk,sendFlags);
+      if (sent <= 0)
+        throw std::runtime_error("connection lost (send)");
+      bytes    += sent;
+      numBytes -= sent;
+    }
+  }
+  
+  void Socket::recv(void *data, size_t numBytes)
+  {
+    char *bytes = (char *)data;
+    while (numBytes > 0) {
+      const int chunk = (int)std::min(numBytes,size_t(1)<<30);
+      const long received = (long)::recv(handle,bytes,chunk,0);
+      if (received <= 0)
+        throw std::runtime_error("connection lost (recv)");
+      bytes    += received;
+      numBytes -= received;
+    }
+  }
+
+  struct MessageHeader {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t size;
+  };
+
+  /*! larger messages are taken as a corrupt header rather than
+      allocated for; the scene is the largest message by far */
+  static const uint64_t maxMessageSize = uint64_t(1)<<31;
+  
+  void Socket::sendMessage(uint32_t type, const std::string &payload)
+  {
+    if (payload.size() > maxMessageSize)
+      throw std::runtime_error("message too large to send ("
+                               +std::to_string(payload.size())+" bytes)");
+    const MessageHeader header = { type, 0, payload.size() };
+    send(&header,sizeof(header));
+    send(payload.data(),payload.size());
+  }
+  
+  uint32_t Socket::recvMessage(std::string &payload)
+  {
+    MessageHeader header;
+    recv(&header,sizeof(header));
+    if (header.size > maxMessageSize)
+      throw std::runtime_error("malformed message (claims "
+                               +std::to_string(header.size)+" bytes)");
+    payload.resize(header.size);
+    recv(&payload[0],header.size);
+    return header.type;
+  }
+
+  template<typename T>
+  static std::string asBytes(const T &t)
+  { return std::string((const char *)&t,sizeof(t)); }
+
+  template<typename T>
+  static T fromBytes(const std::string &bytes)
+  {
+    T t;
+    if (bytes.size() < sizeof(t))
+      throw std::runtime_error("malformed message");
+    memcpy((void *)&t,bytes.data(),sizeof(t));
+    return t;
+  }
+  
+  // ------------------------------------------------------------------
+  // coordinator and worker
+  // ------------------------------------------------------------------
+
+  void runWorker(const std::string &host, int port,
+                 const std::function<RenderRowsFunction(const Geometry &)> &makeRenderer)
+  {
+    Socket coordinator = Socket::connect(host,port);
+    RenderRowsFunction renderRows;
+    FrameMessage frame = {};
+    std::vector<uint32_t> pixels;
+    std::string payload;
+    while (1) {
+      switch (coordinator.recvMessage(payload)) {
+      case MSG_SCENE:
+        renderRows = makeRenderer(deserializeScene(payload));
+        coordinator.sendMessage(MSG_READY,"");
+        break;
+      case MSG_FRAME:
+        frame = fromBytes<FrameMessage>(payload);
+        break;
+      case MSG_TILE: {
+        GDT_PROFILE_SCOPE("workerTile");
+        const TileMessage tile = fromBytes<TileMessage>(payload);
+        if (!renderRows)
+          throw std::runtime_error("got a tile before the scene");
+        pixels.resize(size_t(tile.rows.numRows)*frame.frameSize.x);
+        renderRows(frame.camera,frame.frameSize,tile.rows,pixels.data());
+        coordinator.sendMessage(MSG_TILE_DONE,
+                                asBytes(tile)+compressPixels(pixels.data(),pixels.size()));
+      } break;
+      case MSG_QUIT:
+        return;
+      default:
+        throw std::runtime_error("unknown message from coordinator");
+      }
+    }
+  }
+
+  void spawnWorkers(const char *executable, int port, int numWorkers)
+  {
+    const std::string portString = std::to_string(port);
+    for (int i=0;i<numWorkers;i++) {
+      const char *args[] = { executable, "--worker", "127.0.0.1", portString.c_str(), nullptr };
+#ifdef _WIN32
+      if (_spawnv(_P_NOWAIT,executable,args) == -1)
+        throw std::runtime_error("could not start worker process");
+#else
+      pid_t pid;
+      if (posix_spawn(&pid,executable,nullptr,nullptr,(char *const *)args,environ) != 0)
+        throw std::runtime_error("could not start worker process");
+#endif
+    }
+  }
+
+  void waitForWorkers()
+  {
+#ifndef _WIN32
+    while (wait(nullptr) > 0);
+#endif
+  }
+  
+  Coordinator::Coordinator()
+    : listener(Socket::listen(0))
+  {}
+
+  Coordinator::~Coordinator()
+  {
+    for (auto &worker : workers)
+      try {
+        worker->socket.sendMessage(MSG_QUIT,"");
+      } catch (std::runtime_error &) {
+        // it's gone already; nothing to tell it
+      }
+  }
+
+  void Coordinator::addWorkers(int numWorkers, const std::string &sceneBytes)
+  {
+    GDT_PROFILE_SCOPE("addWorkers");
+    std::vector<Worker *> newWorkers;
+    for (int i=0;i<numWorkers;i++) {
+      workers.push_back(std::unique_ptr<Worker>(new Worker));
+      workers.back()->socket = listener.accept();
+      // send right away, so the first workers start setting up
+      // while we wait for the others to connect
+      workers.back()->socket.sendMessage(MSG_SCENE,sceneBytes);
+      newWorkers.push_back(workers.back().get());
+    }
+    std::string payload;
+    for (auto worker : newWorkers)
+      if (worker->socket.recvMessage(payload) != MSG_READY)
+        throw std::runtime_error("worker failed to set up");
+  }
+
+  void Coordinator::renderFrame(const Camera &camera, const vec2i &frameSize,
+                                int tileRows, uint32_t *pixels)
+  {
+    GDT_PROFILE_SCOPE("distributedFrame");
+    if (workers.empty())
+      throw std::runtime_error("no workers to render on");
+    
+    const FrameMessage frame = { camera, frameSize };
+    for (auto &worker : workers)
+      worker->socket.sendMessage(MSG_FRAME,asBytes(frame));
+
+    std::vector<RowRange> tiles;
+    for (int row=0;row<frameSize.y;row+=tileRows)
+      tiles.push_back({ row, std::min(tileRows,frameSize.y-row), 1 });
+
+    // keep two tiles queued per worker, so they never sit idle
+    // waiting for their next tile to arrive
+    const int maxPending = 2;
+    size_t nextTile = 0, numReceived = 0;
+    std::string payload;
+    while (numReceived < tiles.size()) {
+      for (auto &worker : workers)
+        while (worker->numPending < maxPending && nextTile < tiles.size()) {
+          const TileMessage tile = { (uint32_t)nextTile, tiles[nextTile] };
+          worker->socket.sendMessage(MSG_TILE,asBytes(tile));
+          worker->numPending++;
+          nextTile++;
+        }
+
+      fd_set readable;
+      FD_ZERO(&readable);
+      intptr_t maxHandle = 0;
+      for (auto &worker : workers)
+        if (worker->numPending) {
+          FD_SET(worker->socket.handle,&readable);
+          maxHandle = std::max(maxHandle,worker->socket.handle);
+        }
+      if (select(int(maxHandle+1),&readable,nullptr,nullptr,nullptr) < 0)
+        throw std::runtime_error("waiting for tiles failed");
+      
+      for (auto &worker : workers) {
+        if (!worker->numPending || !FD_ISSET(worker->socket.handle,&readable))
+          continue;
+        if (worker->socket.recvMessage(payload) != MSG_TILE_DONE)
+          throw std::runtime_error("unexpected message from worker");
+        const TileMessage tile = fromBytes<TileMessage>(payload);
+        if (tile.tileID >= tiles.size()
+            || memcmp(&tile.rows,&tiles[tile.tileID],sizeof(RowRange)) != 0)
+          throw std::runtime_error("worker sent an unknown tile");
+        const size_t numPixels = size_t(tile.rows.numRows)*frameSize.x;
+        decompressPixels(payload.substr(sizeof(tile)),
+                         pixels+size_t(tile.rows.rowOffset)*frameSize.x,
+                         numPixels);
+        compressedBytes   += payload.size()-sizeof(tile);
+        uncompressedBytes += numPixels*sizeof(uint32_t);
+        worker->numPending--;
+        numReceived++;
+      }
+    }
+  }
+  
+} // ::osc
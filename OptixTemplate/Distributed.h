@@ -0,0 +1,151 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "Geometry.h"
+#include "FrameSplit.h"
+#include <functional>
+#include <memory>
+#include <string>
+
+/*! coordinator/worker rendering across processes: the coordinator
+    sends the scene to every worker once, then farms out the tiles of
+    each frame (bands of whole rows, since that's what a renderer can
+    do a subset of; see SampleRenderer::setRows()) to whichever worker
+    is free, and workers stream back their tiles, compressed. all of
+    this only ever runs over the loopback interface, between processes
+    on the same machine, so there's no byte order conversion, and no
+    authentication */
+
+namespace osc {
+
+  // ------------------------------------------------------------------
+  // scene and pixel encoding
+  // ------------------------------------------------------------------
+  
+  /*! flatten all meshes, spheres, and instances into one byte string */
+  std::string serializeScene(const Geometry &scene);
+  /*! the inverse of serializeScene(); throws on malformed input */
+  Geometry deserializeScene(const std::string &bytes);
+
+  /*! run-length encodes pixels; flat shading gives long runs of
+      identical pixels, so this is cheap and usually compresses well */
+  std::string compressPixels(const uint32_t *pixels, size_t numPixels);
+  /*! the inverse of compressPixels(); throws unless that gives
+      exactly numPixels pixels */
+  void decompressPixels(const std::string &bytes, uint32_t *pixels, size_t numPixels);
+
+  // ------------------------------------------------------------------
+  // transport
+  // ------------------------------------------------------------------
+  
+  /*! a connected (or listening) TCP socket; closes itself */
+  struct Socket {
+    Socket() = default;
+    explicit Socket(intptr_t handle) : handle(handle) {}
+    Socket(Socket &&other) : handle(other.handle) { other.handle = -1; }
+    Socket &operator=(Socket &&other);
+    Socket(const Socket &) = delete;
+    Socket &operator=(const Socket &) = delete;
+    ~Socket();
+
+    /*! listen on the loopback interface; port 0 picks a free one,
+        and port() tells which */
+    static Socket listen(int port = 0);
+    static Socket connect(const std::string &host, int port);
+    Socket accept();
+    int port() const;
+    
+    /*! send or receive exactly numBytes, or throw */
+    void send(const void *data, size_t numBytes);
+    void recv(void *data, size_t numBytes);
+
+    /*! messages are a (type, size) header followed by the payload */
+    void sendMessage(uint32_t type, const std::string &payload);
+    uint32_t recvMessage(std::string &payload);
+
+    bool valid() const { return handle != -1; }
+    intptr_t handle { -1 };
+  };
+
+  // ------------------------------------------------------------------
+  // coordinator and worker
+  // ------------------------------------------------------------------
+
+  /*! renders the given rows of a frame of the given size, as seen
+      from the given camera, into pixels (which has room for exactly
+      those rows, packed) */
+  typedef std::function<void(const Camera &camera,
+                             const vec2i &frameSize,
+                             const RowRange &rows,
+                             uint32_t *pixels)> RenderRowsFunction;
+  
+  /*! connects to the coordinator at host:port, and renders whatever
+      it asks for until it says to quit. makeRenderer gets called
+      once, with the scene the coordinator sent */
+  void runWorker(const std::string &host, int port,
+                 const std::function<RenderRowsFunction(const Geometry &)> &makeRenderer);
+
+  /*! start numWorkers copies of the given executable as worker
+      processes; they get "--worker 127.0.0.1 <port>" as arguments,
+      and are expected to pass those on to runWorker() */
+  void spawnWorkers(const char *executable, int port, int numWorkers);
+  /*! wait for all worker processes spawned so far to exit, which they
+      do once their coordinator is gone (on windows, this doesn't
+      wait) */
+  void waitForWorkers();
+  
+  class Coordinator {
+  public:
+    /*! starts listening (on loopback) for workers */
+    Coordinator();
+    /*! tells all workers to quit */
+    ~Coordinator();
+
+    /*! the port workers have to connect to */
+    int port() const { return listener.port(); }
+    
+    /*! wait for numWorkers more workers to connect, send each of them
+        the (serialized) scene, and wait until all have set up their
+        renderers */
+    void addWorkers(int numWorkers, const std::string &sceneBytes);
+
+    /*! render one frame of the given size on all workers, in tiles of
+        tileRows rows each */
+    void renderFrame(const Camera &camera, const vec2i &frameSize,
+                     int tileRows, uint32_t *pixels);
+
+    int numWorkers() const { return (int)workers.size(); }
+    
+    /*! @{ total tile bytes received, and what they'd have been
+        uncompressed */
+    size_t compressedBytes   { 0 };
+    size_t uncompressedBytes { 0 };
+    /*! @} */
+    
+  private:
+    struct Worker {
+      Socket socket;
+      /*! tiles sent to this worker that didn't come back yet */
+      int    numPending { 0 };
+    };
+    Socket                              listener;
+    std::vector<std::unique_ptr<Worker>> workers;
+  };
+  
+} // ::osc
@@ -0,0 +1,65 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "DynamicResolution.h"
+#include <cmath>
+
+namespace osc {
+
+  ResolutionController::ResolutionController(double frameTimeBudget, float minScale)
+    : frameTimeBudget(frameTimeBudget),
+      minScale(minScale)
+  {}
+
+  void ResolutionController::update(double frameTime,
+                                    const vec2i &renderedSize,
+                                    const vec2i &fullSize)
+  {
+    const double numPixels = double(renderedSize.x)*renderedSize.y;
+    if (numPixels <= 0. || frameTime <= 0. || fullSize.x*fullSize.y <= 0) return;
+
+    // the first measurement replaces the initial guess outright
+    const double measured = frameTime/numPixels;
+    timePerPixel = (timePerPixel == 0.)
+      ? measured
+      : (1.-smoothing)*timePerPixel + smoothing*measured;
+
+    // any per-frame overhead shows up as a higher time per pixel at
+    // lower resolutions, so this settles where the frame time meets
+    // the budget, overhead included
+    const double fullPixels = double(fullSize.x)*fullSize.y;
+    const float target
+      = (float)std::sqrt(frameTimeBudget/(timePerPixel*fullPixels));
+    // round down, so the frame fits the budget, not just about; but
+    // only go up once there's some room to spare beyond the next
+    // step, so noise around a step doesn't flip back and forth
+    const float down = scaleStep*std::floor(target/scaleStep);
+    const float up   = scaleStep*std::floor((target-.25f*scaleStep)/scaleStep);
+    if (down < scale)
+      scale = down;
+    else if (up > scale)
+      scale = up;
+    scale = std::max(minScale,std::min(1.f,scale));
+  }
+
+  vec2i ResolutionController::renderSize(const vec2i &fullSize) const
+  {
+    return vec2i(std::max(1,int(fullSize.x*scale+.5f)),
+                 std::max(1,int(fullSize.y*scale+.5f)));
+  }
+  
+} // ::osc
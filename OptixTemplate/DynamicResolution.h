@@ -0,0 +1,60 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "gdt/math/vec.h"
+
+namespace osc {
+  using namespace gdt;
+
+  /*! picks the resolution to render at while the camera moves, so
+      frames stay within a frame time budget: from measured frame
+      times it estimates the cost per pixel, and scales the frame
+      (uniformly in x and y) to the pixel count that fits the
+      budget.
+
+      like FrameSplitter, this only does the arithmetic, so it can be
+      driven with simulated frame times just as well */
+  struct ResolutionController {
+    /*! frameTimeBudget is in seconds; the scale (of either axis)
+        never goes below minScale */
+    ResolutionController(double frameTimeBudget = 1./60., float minScale = .25f);
+
+    /*! feed back how long (in seconds) a frame rendered at
+        renderedSize took, when the full size is fullSize */
+    void update(double frameTime, const vec2i &renderedSize, const vec2i &fullSize);
+
+    /*! the size to render at for the given full size, at the current
+        scale */
+    vec2i renderSize(const vec2i &fullSize) const;
+
+    double frameTimeBudget;
+    float  minScale;
+    /*! the scale gets rounded to multiples of this, so small changes
+        in frame time don't change the resolution every frame */
+    float  scaleStep = 1.f/16.f;
+    /*! fraction of the full size (in x and y) to render at */
+    float  scale = 1.f;
+    /*! estimated seconds per pixel, smoothed */
+    double timePerPixel = 0.;
+    /*! how much a new measurement counts against the previous
+        estimate; lower is smoother, but slower to adapt */
+    double smoothing = .5;
+  };
+  
+} // ::osc
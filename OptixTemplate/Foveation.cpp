@@ -0,0 +1,149 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "Foveation.h"
+#include "LaunchParams.h"
+#include "gdt/parallel/parallel_for.h"
+#include "gdt/profile/Profiler.h"
+#include <stdexcept>
+
+namespace osc {
+
+  static vec2i numTiles(const vec2i &fullSize)
+  {
+    return vec2i(divRoundUp(fullSize.x,(int)FOVEATION_TILE_SIZE),
+                 divRoundUp(fullSize.y,(int)FOVEATION_TILE_SIZE));
+  }
+  
+  Foveation makeFovea(const vec2f &center, float size, int outerRate)
+  {
+    Foveation foveation;
+    const vec2f halfSize(.5f*size);
+    foveation.regions.push_back(box2f(center-halfSize,center+halfSize));
+    foveation.outerRate = outerRate;
+    return foveation;
+  }
+  
+  std::vector<uint8_t> buildRateMap(const Foveation &foveation, const vec2i &fullSize)
+  {
+    if (foveation.regions.empty() || fullSize.x <= 0 || fullSize.y <= 0)
+      return std::vector<uint8_t>();
+    const int outerRate = foveation.outerRate;
+    if (outerRate < 1 || outerRate > FOVEATION_TILE_SIZE || (outerRate & (outerRate-1)))
+      throw std::runtime_error("foveation rate has to be a power of two up to "
+                               +std::to_string((int)FOVEATION_TILE_SIZE));
+
+    const vec2i tiles = numTiles(fullSize);
+    std::vector<uint8_t> rateMap(tiles.x*tiles.y);
+    const float aspect = fullSize.x/float(fullSize.y);
+    for (int ty=0;ty<tiles.y;ty++)
+      for (int tx=0;tx<tiles.x;tx++) {
+        const box2f tile(vec2f(tx,ty)*float(FOVEATION_TILE_SIZE)/vec2f(fullSize),
+                         vec2f(tx+1,ty+1)*float(FOVEATION_TILE_SIZE)/vec2f(fullSize));
+        // distance from the tile to the closest region, in units of
+        // the frame height
+        float distance = 1e20f;
+        for (auto &region : foveation.regions) {
+          const vec2f gap = max(vec2f(0.f),max(region.lower-tile.upper,
+                                               tile.lower-region.upper));
+          const vec2f d(gap.x*aspect,gap.y);
+          distance = std::min(distance,sqrtf(d.x*d.x+d.y*d.y));
+        }
+        rateMap[tx+ty*tiles.x]
+          = distance <= 0.f                      ? 1
+          : distance <= foveation.transitionWidth ? std::min(2,outerRate)
+          : outerRate;
+      }
+    return rateMap;
+  }
+
+  double tracedFraction(const std::vector<uint8_t> &rateMap, const vec2i &fullSize)
+  {
+    if (rateMap.empty()) return 1.;
+    const vec2i tiles = numTiles(fullSize);
+    size_t numTraced = 0;
+    for (int y=0;y<fullSize.y;y++)
+      for (int x=0;x<fullSize.x;x++) {
+        const int rate = rateMap[x/FOVEATION_TILE_SIZE+(y/FOVEATION_TILE_SIZE)*tiles.x];
+        if (((x | y) & (rate-1)) == 0) numTraced++;
+      }
+    return numTraced/(double(fullSize.x)*fullSize.y);
+  }
+  
+  void reconstructFoveated(uint32_t *pixels, const vec2i &size,
+                           const std::vector<uint8_t> &rateMap,
+                           const vec2i &fullSize)
+  {
+    if (rateMap.empty()) return;
+    GDT_PROFILE_SCOPE("reconstructFoveated");
+    const int numTilesX = numTiles(fullSize).x;
+    auto rateAt = [&](int x, int y) {
+      return foveationRate(rateMap.data(),numTilesX,x,y,size,fullSize);
+    };
+    // whether the raygen traced the given pixel; decided from the
+    // rate map, not from the pixel, since pixels get filled in while
+    // others still look at them
+    auto traced = [&](int x, int y) {
+      if (x >= size.x || y >= size.y) return false;
+      const int rate = rateAt(x,y);
+      return ((x | y) & (rate-1)) == 0;
+    };
+    
+    parallel_for_blocked(0,size.y,FOVEATION_TILE_SIZE,[&](size_t begin, size_t end){
+        for (int y=(int)begin;y<(int)end;y++)
+          for (int x=0;x<size.x;x++) {
+            const int rate = rateAt(x,y);
+            if (((x | y) & (rate-1)) == 0) continue;
+            // the four traced pixels of this tile's lattice around
+            // this one; any of them may be in a tile with a coarser
+            // lattice (or outside the frame), and then get skipped.
+            // (at full resolution, the lower left one is always in
+            // this tile; at a lower one, tiles don't line up with the
+            // lattice, and it may not be)
+            const int x0 = x & ~(rate-1), y0 = y & ~(rate-1);
+            const int x1 = x0+rate,       y1 = y0+rate;
+            const float fx = (x-x0)/float(rate), fy = (y-y0)/float(rate);
+            const int   cornerX[4] = { x0, x1, x0, x1 };
+            const int   cornerY[4] = { y0, y0, y1, y1 };
+            const float weight[4]  = { (1.f-fx)*(1.f-fy), fx*(1.f-fy),
+                                       (1.f-fx)*fy,       fx*fy };
+            vec3f sum(0.f);
+            float sumWeights = 0.f;
+            for (int c=0;c<4;c++) {
+              if (weight[c] == 0.f || !traced(cornerX[c],cornerY[c])) continue;
+              const uint32_t rgba = pixels[cornerX[c]+cornerY[c]*size_t(size.x)];
+              sum += weight[c]*vec3f(float(rgba & 0xff),
+                                     float((rgba >> 8) & 0xff),
+                                     float((rgba >> 16) & 0xff));
+              sumWeights += weight[c];
+            }
+            if (sumWeights == 0.f) {
+              // every rate divides the tile size, so every lattice
+              // has this pixel
+              pixels[x+y*size_t(size.x)]
+                = pixels[(x & ~(FOVEATION_TILE_SIZE-1))
+                         +(y & ~(FOVEATION_TILE_SIZE-1))*size_t(size.x)];
+              continue;
+            }
+            const vec3i rgb = vec3i(sum/sumWeights+vec3f(.5f));
+            pixels[x+y*size_t(size.x)]
+              = 0xff000000 | (rgb.x<<0) | (rgb.y<<8) | (rgb.z<<16);
+          }
+      });
+  }
+  
+} // ::osc
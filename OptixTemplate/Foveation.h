@@ -0,0 +1,64 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "gdt/math/box.h"
+#include <vector>
+
+namespace osc {
+  using namespace gdt;
+
+  /*! which parts of the frame matter: inside any region of interest
+      every pixel gets traced; in a band around them every other
+      pixel (in x and y); and further out only every outerRate'th.
+      the pixels in between get interpolated from the traced ones */
+  struct Foveation {
+    /*! regions of interest, in normalized screen coordinates:
+        [0,1]^2, with (0,0) the bottom left of the frame. no regions
+        means no foveation: every pixel gets traced */
+    std::vector<box2f> regions;
+    /*! spacing of the traced pixels far from any region; a power of
+        two, at most FOVEATION_TILE_SIZE */
+    int   outerRate = 4;
+    /*! width of the band around each region that traces every other
+        pixel, relative to the frame height */
+    float transitionWidth = .1f;
+  };
+
+  /*! a single region of interest, covering the given fraction of
+      the frame in either axis, centered on the given point (such as
+      where the user looks) */
+  Foveation makeFovea(const vec2f &center, float size, int outerRate = 4);
+  
+  /*! per-tile rates for a frame of the given size (see
+      LaunchParams::foveation), or an empty map if there are no
+      regions of interest */
+  std::vector<uint8_t> buildRateMap(const Foveation &foveation, const vec2i &fullSize);
+
+  /*! fraction of a frame's pixels that the given rate map traces */
+  double tracedFraction(const std::vector<uint8_t> &rateMap, const vec2i &fullSize);
+  
+  /*! fill in the pixels of a (complete) frame that the given rate
+      map (for a full frame of fullSize) didn't trace, bilinearly
+      from the traced ones around them; the frame may have been
+      rendered at a lower resolution (size) than the full one */
+  void reconstructFoveated(uint32_t *pixels, const vec2i &size,
+                           const std::vector<uint8_t> &rateMap,
+                           const vec2i &fullSize);
+  
+} // ::osc
@@ -0,0 +1,64 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "gdt/gdt.h"
+
+namespace osc {
+
+  /*! bookkeeping for a pipeline of numSlots frames in flight: frame
+      i gets rendered into slot i%numSlots, and once frame i has been
+      submitted, frame i-(numSlots-1) is the one to display. this
+      lets the display of one frame overlap with rendering the next
+      numSlots-1 ones, with a fixed latency of numSlots-1 frames.
+
+      this class only does the slot arithmetic (so it doesn't need a
+      device, and the ordering can be checked on its own); the
+      renderer owns the per-slot buffers and synchronization */
+  struct FrameRing {
+    FrameRing(int numSlots = 2) : numSlots(numSlots) {}
+
+    /*! the slot the next frame gets rendered into. the caller has to
+        make sure whatever the previous frame in that slot was has
+        completed before overwriting it */
+    int beginFrame() const { return int(numSubmitted % numSlots); }
+
+    /*! mark the frame started by beginFrame() as submitted */
+    void endFrame() { numSubmitted++; }
+
+    /*! the slot holding the frame to display now, or -1 if the
+        pipeline isn't primed yet */
+    int displaySlot() const
+    {
+      if (numSubmitted < (size_t)numSlots) return -1;
+      return int((numSubmitted-numSlots) % numSlots);
+    }
+
+    /*! slot of the most recently submitted frame, or -1 if none */
+    int newestSlot() const
+    { return numSubmitted ? int((numSubmitted-1) % numSlots) : -1; }
+
+    /*! drop all frames in flight (eg, after a resize); the caller has
+        to have waited for them */
+    void reset() { numSubmitted = 0; }
+
+    const int numSlots;
+    size_t    numSubmitted { 0 };
+  };
+
+} // ::osc
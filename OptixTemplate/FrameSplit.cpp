@@ -0,0 +1,119 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "FrameSplit.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace osc {
+
+  FrameSplitter::FrameSplitter(int numDevices, FrameSplitMode mode)
+    : numDevices(numDevices),
+      mode(mode),
+      rowsPerSecond(numDevices,1.),
+      measured(numDevices,false)
+  {
+    if (numDevices < 1)
+      throw std::runtime_error("FrameSplitter: need at least one device");
+  }
+
+  std::vector<RowRange> FrameSplitter::split(int height) const
+  {
+    std::vector<RowRange> ranges(numDevices);
+    if (mode == SPLIT_INTERLEAVED) {
+      for (int d=0;d<numDevices;d++) {
+        ranges[d].rowOffset = d;
+        ranges[d].numRows   = d < height ? (height-d+numDevices-1)/numDevices : 0;
+        ranges[d].rowStride = numDevices;
+      }
+      return ranges;
+    }
+
+    // bands proportional to speed; first give every device its
+    // minimum of one row, then hand out the rest by (cumulative)
+    // weight, so the rounding never loses or duplicates a row
+    const int minRows = height >= numDevices ? 1 : 0;
+    const int numFree = height - minRows*numDevices;
+    double totalWeight = 0.;
+    for (auto w : rowsPerSecond) totalWeight += w;
+    double weightSoFar = 0.;
+    int row = 0;
+    for (int d=0;d<numDevices;d++) {
+      weightSoFar += rowsPerSecond[d];
+      const int end
+        = (d == numDevices-1)
+        ? height
+        : std::min(height,(d+1)*minRows + int(numFree*weightSoFar/totalWeight + .5));
+      ranges[d].rowOffset = row;
+      ranges[d].numRows   = end-row;
+      ranges[d].rowStride = 1;
+      row = end;
+    }
+    return ranges;
+  }
+
+  void FrameSplitter::update(const std::vector<RowRange> &ranges,
+                             const std::vector<double> &deviceTimes)
+  {
+    for (int d=0;d<numDevices;d++) {
+      // nothing to learn from a device that had nothing to do
+      if (ranges[d].numRows == 0 || deviceTimes[d] <= 0.) continue;
+      const double speed = ranges[d].numRows / deviceTimes[d];
+      // the initial guess is in arbitrary units, so the first
+      // measurement replaces it rather than getting averaged in
+      rowsPerSecond[d]
+        = measured[d]
+        ? (1.-smoothing)*rowsPerSecond[d] + smoothing*speed
+        : speed;
+      measured[d] = true;
+    }
+
+    // devices that haven't been measured yet can't keep the initial
+    // guess next to real rows/s values, so they get the others'
+    // average until they are
+    double sum = 0.;
+    int numMeasured = 0;
+    for (int d=0;d<numDevices;d++)
+      if (measured[d]) { sum += rowsPerSecond[d]; numMeasured++; }
+    if (numMeasured > 0)
+      for (int d=0;d<numDevices;d++)
+        if (!measured[d]) rowsPerSecond[d] = sum/numMeasured;
+  }
+
+  void compositeFrame(uint32_t *frame,
+                      const vec2i &fullSize,
+                      const std::vector<RowRange> &ranges,
+                      const std::vector<const uint32_t *> &devicePixels)
+  {
+    for (size_t d=0;d<ranges.size();d++) {
+      const RowRange &range = ranges[d];
+      const uint32_t *pixels = devicePixels[d];
+      if (!pixels) continue;
+      if (range.rowStride == 1) {
+        // a band is one contiguous block in both buffers
+        memcpy(frame + size_t(range.rowOffset)*fullSize.x,pixels,
+               size_t(range.numRows)*fullSize.x*sizeof(uint32_t));
+        continue;
+      }
+      for (int i=0;i<range.numRows;i++)
+        memcpy(frame + size_t(range.rowOffset + i*range.rowStride)*fullSize.x,
+               pixels + size_t(i)*fullSize.x,
+               fullSize.x*sizeof(uint32_t));
+    }
+  }
+  
+} // ::osc
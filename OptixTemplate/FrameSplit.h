@@ -0,0 +1,85 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "gdt/math/vec.h"
+#include <vector>
+
+namespace osc {
+  using namespace gdt;
+
+  /*! the rows of the full frame one device renders: numRows rows,
+      starting at row rowOffset, rowStride rows apart. the device's
+      frame buffer holds just those rows, packed */
+  struct RowRange {
+    int rowOffset;
+    int numRows;
+    int rowStride;
+  };
+
+  /*! how frames get split across devices */
+  enum FrameSplitMode {
+    /*! one band of consecutive rows per device; band heights follow
+        each device's measured speed */
+    SPLIT_BANDS,
+    /*! device d renders rows d, d+N, d+2N, ...; balanced by
+        construction as long as the devices are equally fast, and
+        never re-balanced */
+    SPLIT_INTERLEAVED
+  };
+
+  /*! decides which device renders which rows of a frame, and
+      re-balances that from measured per-device frame times.
+
+      this class (and compositeFrame()) only does the arithmetic, so
+      it doesn't need any devices, and can be driven with simulated
+      ones just as well; MultiDeviceRenderer does the rendering */
+  struct FrameSplitter {
+    FrameSplitter(int numDevices, FrameSplitMode mode = SPLIT_BANDS);
+
+    /*! the split to use for the next frame of the given height. every
+        device gets at least one row, if there are enough rows */
+    std::vector<RowRange> split(int height) const;
+
+    /*! feed back how long (in seconds) each device took for a frame
+        that was split as given */
+    void update(const std::vector<RowRange> &ranges,
+                const std::vector<double> &deviceTimes);
+
+    const int            numDevices;
+    const FrameSplitMode mode;
+    /*! each device's estimated speed, in rows per second (only
+        relative values matter) */
+    std::vector<double>  rowsPerSecond;
+    /*! how much a new measurement counts against the previous
+        estimate; lower is smoother, but slower to adapt */
+    double               smoothing = .25;
+    /*! which devices' speeds are measured ones yet, rather than the
+        initial guess */
+    std::vector<bool>    measured;
+  };
+
+  /*! assemble a full frame (of size fullSize) from the devices'
+      packed frame buffers, given the ranges they rendered. a null
+      device buffer leaves its rows untouched */
+  void compositeFrame(uint32_t *frame,
+                      const vec2i &fullSize,
+                      const std::vector<RowRange> &ranges,
+                      const std::vector<const uint32_t *> &devicePixels);
+  
+} // ::osc
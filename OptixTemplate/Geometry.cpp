@@ -0,0 +1,264 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Geometry.h"
+#include "MeshPreprocessing.h"
+#include "MeshSimplification.h"
+#include "gdt/parallel/parallel_for.h"
+#include <algorithm>
+
+namespace osc {
+
+  /*! corners and triangles of the unit cube [0,1]^3 */
+  static const vec3f unitCubeVertices[8] = {
+    vec3f(0.f,0.f,0.f), vec3f(1.f,0.f,0.f), vec3f(0.f,1.f,0.f), vec3f(1.f,1.f,0.f),
+    vec3f(0.f,0.f,1.f), vec3f(1.f,0.f,1.f), vec3f(0.f,1.f,1.f), vec3f(1.f,1.f,1.f)
+  };
+  static const int unitCubeIndices[36] = {
+    0,1,3, 2,3,0,
+    5,7,6, 5,6,4,
+    0,4,5, 0,5,1,
+    2,3,7, 2,7,6,
+    1,5,7, 1,7,3,
+    4,0,2, 4,2,6
+  };
+  
+  //! add aligned cube with front-lower-left corner and size
+  void Geometry::addCube(const vec3f &center, const vec3f &size, const vec3f& color)
+  {
+    PING;
+    affine3f xfm;
+    xfm.p = center - 0.5f*size;
+    xfm.l.vx = vec3f(size.x,0.f,0.f);
+    xfm.l.vy = vec3f(0.f,size.y,0.f);
+    xfm.l.vz = vec3f(0.f,0.f,size.z);
+    addUnitCube(xfm, color);
+  }
+  
+  /*! add a unit cube (subject to given xfm matrix) to the current
+      triangleMesh */
+  void Geometry::addUnitCube(const affine3f &xfm, const vec3f& color)
+  {
+    TriangleMesh cube;
+    cube.color = color;
+    int firstVertexID = (int)cube.vertex.size();
+    cube.vertex.resize(firstVertexID+8);
+    xfmPoints(xfm,unitCubeVertices,&cube.vertex[firstVertexID],8);
+    for (int i=0;i<12;i++)
+      cube.index.push_back(firstVertexID+vec3i(unitCubeIndices[3*i+0],
+                                               unitCubeIndices[3*i+1],
+                                               unitCubeIndices[3*i+2]));
+
+    meshes.push_back(cube);
+  }
+    
+  void Geometry::addSphere(const float r, const vec3f cen, const vec3f col) {
+      Sphere s;
+      s.radius = r;
+      s.color = col;
+      s.center = cen;
+      spheres.push_back(s);
+  }
+
+  /*! add numCubes axis-aligned cubes as one single mesh (with
+      per-triangle colors), filling in the vertex and index arrays in
+      parallel */
+  void Geometry::addCubes(const vec3f *center, const vec3f *size, const vec3f *color,
+                          size_t numCubes)
+  {
+    if (numCubes == 0) return;
+    
+    meshes.push_back(TriangleMesh());
+    TriangleMesh &mesh = meshes.back();
+    mesh.color = color[0];
+    mesh.vertex.resize(8*numCubes);
+    mesh.index.resize(12*numCubes);
+    mesh.triangleColor.resize(12*numCubes);
+
+    // every cube owns a fixed slice of the output arrays, so blocks
+    // of cubes can be written without any synchronization
+    parallel_for_blocked(0,numCubes,16*1024,[&](size_t begin, size_t end){
+        for (size_t cubeID=begin;cubeID<end;cubeID++) {
+          const vec3f lower = center[cubeID] - 0.5f*size[cubeID];
+          const int firstVertexID = int(8*cubeID);
+          for (int i=0;i<8;i++)
+            mesh.vertex[8*cubeID+i] = lower + unitCubeVertices[i]*size[cubeID];
+          for (int i=0;i<12;i++) {
+            mesh.index[12*cubeID+i] = firstVertexID+vec3i(unitCubeIndices[3*i+0],
+                                                          unitCubeIndices[3*i+1],
+                                                          unitCubeIndices[3*i+2]);
+            mesh.triangleColor[12*cubeID+i] = color[cubeID];
+          }
+        }
+      });
+  }
+
+  /*! add numSpheres spheres at once, filled in in parallel */
+  void Geometry::addSpheres(const float *radius, const vec3f *center, const vec3f *color,
+                            size_t numSpheres)
+  {
+    const size_t first = spheres.size();
+    spheres.resize(first+numSpheres);
+    parallel_for_blocked(0,numSpheres,64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++) {
+          Sphere &s = spheres[first+i];
+          s.radius = radius[i];
+          s.color  = color[i];
+          s.center = center[i];
+        }
+      });
+  }
+
+  /*! welds, cleans up, and reorders all meshes (in parallel) */
+  void Geometry::preprocess(const PreprocessOptions &options)
+  {
+    const double t0 = getCurrentTime();
+    std::vector<MeshPreprocessStats> stats(meshes.size());
+    parallel_for(meshes.size(),[&](size_t meshID){
+        stats[meshID] = preprocessMesh(meshes[meshID],options);
+      });
+
+    MeshPreprocessStats total;
+    for (auto &s : stats) total += s;
+    // drop meshes that ended up without any triangles at all; those
+    // would only produce empty build inputs
+    meshes.erase(std::remove_if(meshes.begin(),meshes.end(),
+                                [](const TriangleMesh &mesh)
+                                { return mesh.index.empty(); }),
+                 meshes.end());
+    const double t1 = getCurrentTime();
+    
+    std::cout << "#osc: preprocessed " << stats.size() << " meshes in "
+              << prettyDouble(t1-t0) << "s: "
+              << prettyNumber(total.numVerticesIn) << " -> "
+              << prettyNumber(total.numVerticesOut) << " vertices, "
+              << prettyNumber(total.numTrianglesIn) << " -> "
+              << prettyNumber(total.numTrianglesOut) << " triangles" << std::endl;
+
+    if (options.creaseAngle > 0.f)
+      computeNormals(options.creaseAngle,options.angleWeightedNormals);
+  }
+
+  /*! make all meshes fine enough for lighting baked per vertex to
+      show shadows */
+  void Geometry::tessellateForBaking(float maxEdgeLength)
+  {
+    const double t0 = getCurrentTime();
+    std::vector<size_t> trianglesIn(meshes.size()), trianglesOut(meshes.size());
+    parallel_for(meshes.size(),[&](size_t meshID){
+        TriangleMesh &mesh = meshes[meshID];
+        trianglesIn[meshID] = mesh.index.size();
+        mesh = osc::tessellateForBaking(mesh,maxEdgeLength);
+        trianglesOut[meshID] = mesh.index.size();
+      });
+    size_t numTrianglesIn = 0, numTrianglesOut = 0;
+    for (size_t meshID=0;meshID<meshes.size();meshID++) {
+      numTrianglesIn  += trianglesIn[meshID];
+      numTrianglesOut += trianglesOut[meshID];
+    }
+    std::cout << "#osc: tessellated " << meshes.size() << " meshes for baking in "
+              << prettyDouble(getCurrentTime()-t0) << "s: "
+              << prettyNumber(numTrianglesIn) << " -> "
+              << prettyNumber(numTrianglesOut) << " triangles" << std::endl;
+  }
+
+  void Geometry::mergeMeshes(size_t maxTriangles)
+  {
+    const double t0 = getCurrentTime();
+    const size_t numMeshesIn = meshes.size();
+    osc::mergeMeshes(meshes,maxTriangles);
+    std::cout << "#osc: merged " << numMeshesIn << " meshes into "
+              << meshes.size() << " in " << prettyDouble(getCurrentTime()-t0) << "s"
+              << std::endl;
+  }
+
+  /*! give all meshes that don't have normals yet smooth per-vertex
+      ones */
+  void Geometry::computeNormals(float creaseAngle, bool angleWeighted)
+  {
+    const double t0 = getCurrentTime();
+    std::vector<size_t> verticesIn(meshes.size(),0), verticesOut(meshes.size(),0);
+    parallel_for(meshes.size(),[&](size_t meshID){
+        TriangleMesh &mesh = meshes[meshID];
+        if (!mesh.normal.empty()) return;
+        verticesIn[meshID] = mesh.vertex.size();
+        computeVertexNormals(mesh,creaseAngle,angleWeighted);
+        verticesOut[meshID] = mesh.vertex.size();
+      });
+    size_t numMeshes = 0, numVerticesIn = 0, numVerticesOut = 0;
+    for (size_t meshID=0;meshID<meshes.size();meshID++) {
+      if (verticesOut[meshID] == 0) continue;
+      numMeshes++;
+      numVerticesIn  += verticesIn[meshID];
+      numVerticesOut += verticesOut[meshID];
+    }
+    std::cout << "#osc: computed normals for " << numMeshes << " meshes in "
+              << prettyDouble(getCurrentTime()-t0) << "s: "
+              << prettyNumber(numVerticesIn) << " -> "
+              << prettyNumber(numVerticesOut) << " vertices" << std::endl;
+  }
+
+  /*! add a mesh that can be instanced; returns its meshID */
+  int Geometry::addInstancedMesh(const TriangleMesh &mesh)
+  {
+    LODMesh lodMesh;
+    lodMesh.levels.push_back(mesh);
+    instancedMeshes.push_back(lodMesh);
+    return (int)instancedMeshes.size()-1;
+  }
+  
+  void Geometry::addInstance(int meshID, const affine3f &xfm)
+  {
+    MeshInstance instance;
+    instance.meshID = meshID;
+    instance.xfm    = xfm;
+    instances.push_back(instance);
+  }
+
+  void Geometry::append(const Geometry &other)
+  {
+    const int firstMeshID = (int)instancedMeshes.size();
+    meshes.insert(meshes.end(),other.meshes.begin(),other.meshes.end());
+    spheres.insert(spheres.end(),other.spheres.begin(),other.spheres.end());
+    instancedMeshes.insert(instancedMeshes.end(),
+                           other.instancedMeshes.begin(),other.instancedMeshes.end());
+    for (auto instance : other.instances) {
+      instance.meshID += firstMeshID;
+      instances.push_back(instance);
+    }
+  }
+
+  /*! (re-)build the levels of detail for all instanced meshes, in
+      parallel; see buildLODChain() */
+  void Geometry::buildLODs(int maxLevels, float reduction)
+  {
+    const double t0 = getCurrentTime();
+    parallel_for(instancedMeshes.size(),[&](size_t meshID){
+        LODMesh &lodMesh = instancedMeshes[meshID];
+        lodMesh.levels = buildLODChain(lodMesh.levels[0],maxLevels,reduction);
+      });
+    const double t1 = getCurrentTime();
+    
+    std::cout << "#osc: built levels of detail in " << prettyDouble(t1-t0) << "s:" << std::endl;
+    for (auto &lodMesh : instancedMeshes) {
+      std::cout << "#osc: -";
+      for (auto &level : lodMesh.levels)
+        std::cout << " " << prettyNumber(level.index.size());
+      std::cout << " triangles" << std::endl;
+    }
+  }
+
+} // ::osc
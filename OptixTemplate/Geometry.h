@@ -0,0 +1,155 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "gdt/math/AffineSpace.h"
+#include <vector>
+
+namespace osc {
+  using namespace gdt;
+
+  struct Camera {
+    /*! camera position - *from* where we are looking */
+    vec3f from;
+    /*! which point we are looking *at* */
+    vec3f at;
+    /*! general up-vector */
+    vec3f up;
+  };
+  
+  /*! a simple indexed triangle mesh that our sample renderer will
+      render */
+  struct TriangleMesh {
+    
+    std::vector<vec3f> vertex;
+    std::vector<vec3i> index;
+    vec3f              color { 0.f };
+    /*! optional per-triangle colors; if non-empty this has one entry
+        per index, and overrides 'color' */
+    std::vector<vec3f> triangleColor;
+    /*! @{ optional per-vertex attributes; each is either empty or
+        has one entry per vertex, looked up through the same indices
+        as the positions. a vertex that differs in any of them is a
+        separate vertex */
+    /*! colors, interpolated across triangles; override both
+        triangleColor and color */
+    std::vector<vec3f> vertexColor;
+    /*! shading normals, interpolated across triangles instead of
+        using the flat face normal */
+    std::vector<vec3f> normal;
+    /*! texture coordinates; kept through all processing, but nothing
+        shades with them yet */
+    std::vector<vec2f> texcoord;
+    /*! @} */
+    /*! optional baked lighting (see SampleRenderer::bakeLighting()),
+        one entry per vertex: x is the unoccluded fraction of the
+        hemisphere around the vertex's normal (ambient occlusion), y
+        the point light's direct light (its cosine, times its
+        visibility). if non-empty, shading interpolates this instead
+        of tracing shadow rays */
+    std::vector<vec2f> bakedLight;
+  };
+
+  struct Sphere {
+      float radius;
+      vec3f color;
+      vec3f center;
+  };
+
+  /*! options for the mesh preprocessing stage (see
+      MeshPreprocessing.h) */
+  struct PreprocessOptions {
+    /*! vertices closer than this get merged into one; 0 means only
+        bit-identical positions are merged */
+    float weldEpsilon    { 0.f };
+    /*! triangles with an area <= this get dropped */
+    float minTriangleArea{ 0.f };
+    /*! sort triangles along a morton curve, and vertices by first
+        use, for better memory locality during build and traversal */
+    bool  reorder        { true };
+    /*! if > 0, give meshes without normals smooth per-vertex ones,
+        keeping edges sharper than this many degrees (see
+        computeVertexNormals()) */
+    float creaseAngle    { 0.f };
+    /*! weight face normals by their angle at the vertex (rather
+        than by their area) when averaging */
+    bool  angleWeightedNormals { true };
+  };
+
+  /*! a mesh that gets rendered through instances, along with a
+      chain of successively simplified versions of it */
+  struct LODMesh {
+    /*! levels[0] is the original, full-detail mesh */
+    std::vector<TriangleMesh> levels;
+  };
+
+  /*! one placement of an LODMesh in the scene */
+  struct MeshInstance {
+    /*! index into Geometry::instancedMeshes */
+    int      meshID;
+    affine3f xfm;
+  };
+  
+  struct Geometry {
+      void addUnitCube(const affine3f& xfm, const vec3f& color);
+      void addCube(const vec3f& center, const vec3f& size, const vec3f& color);
+      void addSphere(const float r, const vec3f cen, const vec3f col);
+
+      /*! add numCubes axis-aligned cubes as one single mesh (with
+          per-triangle colors), filling in the vertex and index arrays
+          in parallel */
+      void addCubes(const vec3f *center, const vec3f *size, const vec3f *color,
+                    size_t numCubes);
+      /*! add numSpheres spheres at once, filled in in parallel */
+      void addSpheres(const float *radius, const vec3f *center, const vec3f *color,
+                      size_t numSpheres);
+
+      /*! welds, cleans up, and reorders all meshes (in parallel) */
+      void preprocess(const PreprocessOptions &options = PreprocessOptions());
+
+      /*! make all meshes fine enough for lighting baked per vertex to
+          show shadows; see tessellateForBaking() */
+      void tessellateForBaking(float maxEdgeLength);
+
+      /*! merge meshes of fewer than maxTriangles triangles into as
+          few as possible (of up to maxTriangles each), for fewer
+          build inputs and SBT records; see mergeMeshes() */
+      void mergeMeshes(size_t maxTriangles);
+
+      /*! give all meshes that don't have normals yet smooth
+          per-vertex ones; see computeVertexNormals() */
+      void computeNormals(float creaseAngle, bool angleWeighted = true);
+
+      /*! add a mesh that can be instanced; returns its meshID */
+      int addInstancedMesh(const TriangleMesh &mesh);
+      void addInstance(int meshID, const affine3f &xfm);
+
+      /*! (re-)build the levels of detail for all instanced meshes, in
+          parallel; see buildLODChain() */
+      void buildLODs(int maxLevels = 5, float reduction = .25f);
+
+      /*! add all of other's meshes, spheres, instanced meshes, and
+          instances (of those) */
+      void append(const Geometry &other);
+
+      std::vector<TriangleMesh> meshes;
+      std::vector<Sphere> spheres;
+      std::vector<LODMesh> instancedMeshes;
+      std::vector<MeshInstance> instances;
+  };
+
+} // ::osc
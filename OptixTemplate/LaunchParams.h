@@ -29,12 +29,23 @@ namespace osc {
     vec3f  color;
     vec3f *vertex;
     vec3i *index;
+    /*! per-triangle colors, or null to use 'color' for all */
+    vec3f *triangleColor;
+    /*! per-vertex colors, which override both of the above; or null */
+    vec3f *vertexColor;
+    /*! per-vertex shading normals, or null for flat shading */
+    vec3f *normal;
+    /*! per-vertex baked lighting (see TriangleMesh::bakedLight), or
+        null to trace shadow rays */
+    vec2f *bakedLight;
   };
   
+  /*! one record for all spheres; per-sphere data lives in separate
+      arrays, indexed by primitive ID */
   struct SphereSBTData {
-      vec3f color;
-      vec3f center;
-      float radius;
+      vec3f *center;
+      float *radius;
+      vec3f *color;
   };
 
   struct GeometrySBTData {
@@ -48,21 +59,213 @@ namespace osc {
   };
 
 
+  /*! per-frame ray statistics. BVH traversal and triangle tests run
+      in hardware and can't be observed from any program, so the
+      clock cycles each pixel took are the closest we get to a
+      traversal cost */
+  struct RayStats {
+    uint64_t primaryRays;
+    /*! primary rays that hit nothing */
+    uint64_t misses;
+    uint64_t shadowRays;
+    /*! shadow rays terminated early by __anyhit__shadow */
+    uint64_t shadowRaysOccluded;
+    /*! calls to intersection programs (ie, custom primitive tests) */
+    uint64_t primitiveTests;
+    /*! clock cycles spent in raygen, summed over all pixels */
+    uint64_t cycles;
+    /*! pixels that reused the last frame's color instead of tracing
+        a primary ray; see LaunchParams::reprojection */
+    uint64_t reusedPixels;
+    /*! diffuse bounce rays traced to fill the radiance cache; see
+        LaunchParams::radianceCache */
+    uint64_t bounceRays;
+    /*! shadow rays not traced because the light was behind the
+        surface; see LaunchParams::shadows */
+    uint64_t shadowRaysCulled;
+    /*! shadow rays not traced because the pixel's cached occluder was
+        still in the way */
+    uint64_t shadowRaysCached;
+  };
+
+  /*! pixels accumulate their stats into one of this many bins (to
+      keep atomics from all hitting the same address), which the host
+      then sums up */
+  enum { RAY_STATS_BINS = 256 };
+
+  /*! side length, in pixels, of the square tiles of the full frame
+      that a foveation rate map has one entry for */
+  enum { FOVEATION_TILE_SIZE = 16 };
+
+  /*! the rate that a rate map for a full frame of fullSize (see
+      LaunchParams::foveation) gives pixel (x,y) of that frame when
+      it gets rendered at renderSize: each rendered pixel goes by the
+      tile it lands in on the full frame */
+  inline __both__ int foveationRate(const uint8_t *rateMap, int numTilesX, int x, int y,
+                                    const vec2i &renderSize, const vec2i &fullSize)
+  {
+    const int fullX = int((long long)x*fullSize.x/renderSize.x);
+    const int fullY = int((long long)y*fullSize.y/renderSize.y);
+    return rateMap[(fullY/FOVEATION_TILE_SIZE)*numTilesX + fullX/FOVEATION_TILE_SIZE];
+  }
+
+  /*! a pinhole camera: the ray through normalized screen position
+      (x,y) in [0,1]^2 goes from position towards direction +
+      (x-.5)*horizontal + (y-.5)*vertical, all three orthogonal */
+  struct RayCamera {
+    vec3f position;
+    vec3f direction;
+    vec3f horizontal;
+    vec3f vertical;
+  };
+
+  /*! what a frame leaves behind for the next one to reproject, per
+      pixel of the full frame */
+  struct PixelHistory {
+    uint32_t *color;
+    /*! distance from the camera to what the pixel's ray hit; for a
+        miss REPROJECTION_MISS_DEPTH */
+    float    *depth;
+    /*! what the pixel's ray hit (which instance, mesh, and sphere);
+        0 for a miss, and REPROJECTION_INVALID for a pixel that
+        didn't get traced */
+    uint32_t *hitID;
+    /*! frames since the pixel got traced */
+    uint8_t  *age;
+  };
+  static const float REPROJECTION_MISS_DEPTH = 1e20f;
+  enum : uint32_t { REPROJECTION_INVALID = 0xffffffffu };
+
+  /*! one cell of the radiance cache: the diffuse light leaving
+      surfaces in one small region of space, facing one way */
+  struct RadianceCacheCell {
+    /*! a hash of the cell's key (other than the one that picked the
+        slot), never 0; 0 for a free slot */
+    uint32_t checksum;
+    uint32_t numSamples;
+    vec3f    radianceSum;
+  };
+
+  /*! a cell that isn't in its slot is in one of the next this many;
+      if none of those are free either, it doesn't get cached */
+  enum { RADIANCE_CACHE_PROBES = 8 };
+
+  /*! whatever blocked a pixel's shadow ray last time, in world space:
+      a sphere if radius is > 0, else the triangle (v0, v0+e1,
+      v0+e2); all zero for nothing */
+  struct CachedOccluder {
+    vec3f v0, e1, e2;
+    float radius;
+  };
+  
   struct LaunchParams
   {
     struct {
       uint32_t *colorBuffer;
+      /*! size of this launch (and of colorBuffer) */
       vec2i     size;
+      /*! the resolution the frame (which the camera spans) gets
+          rendered at; with more than one device, each launch covers
+          only some of its rows: launch row y is row
+          rowOffset+y*rowStride of it */
+      vec2i     renderSize;
+      /*! size of the full (window-sized) frame, which all per-pixel
+          state (history, cached occluders, the rate map) is laid out
+          for; renderSize is at most this, and less while dynamic
+          resolution lowers it. pixel (x,y) of the rendered frame
+          keeps its state at x+y*fullSize.x */
+      vec2i     fullSize;
+      int       rowOffset;
+      int       rowStride;
     } frame;
     
-    struct {
-      vec3f position;
-      vec3f direction;
-      vec3f horizontal;
-      vec3f vertical;
-    } camera;
+    RayCamera camera;
 
     OptixTraversableHandle traversable;
+
+    /*! if non-null, RAY_STATS_BINS bins to accumulate ray statistics
+        into */
+    RayStats *rayStats;
+    /*! if > 0, show per-pixel cost instead of shading; this many
+        clock cycles map to the hottest color */
+    float     heatmapScale;
+
+    struct {
+      /*! if non-null, one entry per FOVEATION_TILE_SIZE^2 tile of the
+          full frame (row by row, starting at the bottom): the
+          spacing of the pixels that get traced in that tile, a
+          power of two. pixels whose x or y isn't a multiple of it
+          get written as 0 (which has alpha 0), to be filled in on
+          the host; see reconstructFoveated() */
+      const uint8_t *rateMap;
+      int            numTilesX;
+    } foveation;
+
+    struct {
+      /*! where this frame leaves its history; all null without
+          reprojection */
+      PixelHistory        current;
+      /*! the last frame's history, and its camera and render size;
+          previous.color is null if there is none */
+      PixelHistory        previous;
+      RayCamera           previousCamera;
+      vec2i               previousSize;
+      /*! per pixel: the closest last-frame pixel that reprojects onto
+          it, as (depth bits << 32 | pixel index), or all ones if
+          none does; those are the pixels that get traced */
+      unsigned long long *reprojected;
+      /*! a pixel gets traced again after at most this many frames of
+          reuse, before small errors add up */
+      int                 maxAge;
+      uint32_t            frameIndex;
+    } reprojection;
+
+    /*! a world-space hash grid of the diffuse light leaving surfaces,
+        that every frame adds bounce samples to, and that bounces
+        look their own indirect light up in (which makes for any
+        number of bounces, at the cost of one ray per pixel); cells
+        grow with distance to the camera, by powers of two, and are
+        further split by which axis their normals mostly point
+        along */
+    struct {
+      /*! null without a cache */
+      RadianceCacheCell *cells;
+      /*! a power of two */
+      uint32_t           numCells;
+      /*! a cell's size per unit distance from the camera... */
+      float              cellScale;
+      /*! ... but no smaller than this */
+      float              minCellSize;
+      /*! cells with fewer samples than this aren't used yet, the
+          pixel's own sample is instead */
+      uint32_t           minSamples;
+      /*! cells with this many samples don't get any more (so cost no
+          more bounce rays) */
+      uint32_t           maxSamples;
+      uint32_t           frameIndex;
+    } radianceCache;
+
+    /*! only for __raygen__bakeVertices, which gets launched over the
+        vertices of one mesh at a time */
+    struct {
+      const vec3f *vertex;
+      const vec3f *normal;
+      /*! see TriangleMesh::bakedLight */
+      vec2f       *light;
+      /*! ambient occlusion rays per vertex */
+      int          numSamples;
+      /*! ... and how far those look for occluders */
+      float        aoRadius;
+    } bake;
+
+    struct {
+      /*! don't trace shadow rays from surfaces that face away from
+          the light, which could only ever find it occluded */
+      bool            cullBackFacing;
+      /*! one per pixel of the full frame, that the pixel's shadow ray
+          tests before it gets traced; null for none */
+      CachedOccluder *occluders;
+    } shadows;
   };
 
 } // ::osc
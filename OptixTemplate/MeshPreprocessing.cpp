@@ -0,0 +1,595 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "MeshPreprocessing.h"
+#include "gdt/math/box.h"
+#include "gdt/parallel/parallel_for.h"
+#include <unordered_map>
+#include <algorithm>
+#include <map>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <cstring>
+
+namespace osc {
+
+  /*! spread the lower 10 bits of x so there's two zero bits between
+      each pair of bits */
+  inline uint32_t mortonSpread(uint32_t x)
+  {
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x <<  8)) & 0x0300f00f;
+    x = (x | (x <<  4)) & 0x030c30c3;
+    x = (x | (x <<  2)) & 0x09249249;
+    return x;
+  }
+
+  inline uint32_t mortonCode(const vec3ui &cell)
+  {
+    return (mortonSpread(cell.x) << 2) | (mortonSpread(cell.y) << 1) | mortonSpread(cell.z);
+  }
+
+  /*! hash key of a (quantized) grid cell */
+  inline uint64_t cellKey(const vec3i &cell)
+  {
+    return
+      ((uint64_t)(cell.x & 0x1fffff) << 42) |
+      ((uint64_t)(cell.y & 0x1fffff) << 21) |
+      ((uint64_t)(cell.z & 0x1fffff));
+  }
+
+  /*! the weld grid cell coordinate x falls into; clamped, so huge
+      coordinates (or a tiny epsilon) can't overflow the int */
+  inline int cellCoord(float x)
+  {
+    return int(std::max(-1e9f,std::min(1e9f,floorf(x))));
+  }
+
+  inline uint64_t bitwiseKey(const vec3f &v)
+  {
+    uint32_t b[3];
+    memcpy(b,&v.x,sizeof(b));
+    // not collision-free; only used to find candidates, which then
+    // get compared exactly
+    return ((uint64_t)b[0] * 0x9e3779b97f4a7c15ull) ^ ((uint64_t)b[1] << 21) ^ b[2];
+  }
+
+  /*! put the entries of a per-vertex stream (unless it's empty) in
+      the given order, dropping those not in there */
+  template<typename T>
+  inline void gather(std::vector<T> &stream, const std::vector<int> &order)
+  {
+    if (stream.empty()) return;
+    std::vector<T> gathered(order.size());
+    for (size_t i=0;i<order.size();i++)
+      gathered[i] = stream[order[i]];
+    stream.swap(gathered);
+  }
+
+  /*! a per-vertex stream's value at barycentrics (u,v) of the
+      triangle idx */
+  template<typename T>
+  inline T interpolate(const std::vector<T> &stream, const vec3i &idx, float u, float v)
+  {
+    return (1.f-u-v)*stream[idx.x] + u*stream[idx.y] + v*stream[idx.z];
+  }
+  
+  void weldVertices(TriangleMesh &mesh, float epsilon)
+  {
+    const size_t numVertices = mesh.vertex.size();
+    std::vector<int> remap(numVertices);
+    std::unordered_multimap<uint64_t,int> grid;
+    grid.reserve(numVertices);
+    // vertices in the same place still stay apart if any of their
+    // attributes differ (such as along a crease, or a uv seam)
+    auto sameAttributes = [&](int a, int b) {
+      return (mesh.vertexColor.empty() || mesh.vertexColor[a] == mesh.vertexColor[b])
+        &&   (mesh.normal.empty()      || mesh.normal[a]      == mesh.normal[b])
+        &&   (mesh.texcoord.empty()    || mesh.texcoord[a]    == mesh.texcoord[b])
+        &&   (mesh.bakedLight.empty()  || mesh.bakedLight[a]  == mesh.bakedLight[b]);
+    };
+
+    if (epsilon <= 0.f) {
+      for (size_t i=0;i<numVertices;i++) {
+        const vec3f &v = mesh.vertex[i];
+        const uint64_t key = bitwiseKey(v);
+        int found = -1;
+        auto range = grid.equal_range(key);
+        for (auto it = range.first; it != range.second; ++it)
+          if (mesh.vertex[it->second] == v && sameAttributes(it->second,(int)i)) {
+            found = it->second;
+            break;
+          }
+        if (found < 0) {
+          grid.insert(std::make_pair(key,(int)i));
+          found = (int)i;
+        }
+        remap[i] = found;
+      }
+    } else {
+      // cells of size epsilon, so any match has to be in one of the
+      // 27 cells around the query point
+      const float rcpCellSize = 1.f/epsilon;
+      const float epsilon2 = epsilon*epsilon;
+      for (size_t i=0;i<numVertices;i++) {
+        const vec3f &v = mesh.vertex[i];
+        const vec3i cell(cellCoord(v.x*rcpCellSize),
+                         cellCoord(v.y*rcpCellSize),
+                         cellCoord(v.z*rcpCellSize));
+        int found = -1;
+        for (int dz=-1;dz<=1 && found<0;dz++)
+          for (int dy=-1;dy<=1 && found<0;dy++)
+            for (int dx=-1;dx<=1 && found<0;dx++) {
+              auto range = grid.equal_range(cellKey(cell+vec3i(dx,dy,dz)));
+              for (auto it = range.first; it != range.second; ++it) {
+                const vec3f d = mesh.vertex[it->second] - v;
+                if (dot(d,d) <= epsilon2 && sameAttributes(it->second,(int)i)) {
+                  found = it->second;
+                  break;
+                }
+              }
+            }
+        if (found < 0) {
+          grid.insert(std::make_pair(cellKey(cell),(int)i));
+          found = (int)i;
+        }
+        remap[i] = found;
+      }
+    }
+    
+    for (auto &idx : mesh.index)
+      idx = vec3i(remap[idx.x],remap[idx.y],remap[idx.z]);
+  }
+
+  size_t removeDegenerateTriangles(TriangleMesh &mesh, float minArea)
+  {
+    const size_t numTrianglesIn = mesh.index.size();
+    const bool   hasColors      = !mesh.triangleColor.empty();
+    size_t numTrianglesOut = 0;
+    for (size_t i=0;i<numTrianglesIn;i++) {
+      const vec3i idx = mesh.index[i];
+      if (idx.x == idx.y || idx.x == idx.z || idx.y == idx.z)
+        continue;
+      const vec3f &A = mesh.vertex[idx.x];
+      const vec3f &B = mesh.vertex[idx.y];
+      const vec3f &C = mesh.vertex[idx.z];
+      const float area = .5f*length(cross(B-A,C-A));
+      if (!(area > minArea))
+        continue;
+      if (hasColors)
+        mesh.triangleColor[numTrianglesOut] = mesh.triangleColor[i];
+      mesh.index[numTrianglesOut++] = idx;
+    }
+    mesh.index.resize(numTrianglesOut);
+    if (hasColors)
+      mesh.triangleColor.resize(numTrianglesOut);
+    return numTrianglesIn - numTrianglesOut;
+  }
+
+  void sortTrianglesMorton(TriangleMesh &mesh)
+  {
+    const size_t numTriangles = mesh.index.size();
+    if (numTriangles < 2) return;
+    
+    std::vector<vec3f> centroid(numTriangles);
+    box3f bounds;
+    for (size_t i=0;i<numTriangles;i++) {
+      const vec3i idx = mesh.index[i];
+      centroid[i] = (mesh.vertex[idx.x]+mesh.vertex[idx.y]+mesh.vertex[idx.z])*(1.f/3.f);
+      bounds.extend(centroid[i]);
+    }
+    
+    const vec3f scale = vec3f(1023.f) * rcp(max(bounds.span(),vec3f(1e-20f)));
+    std::vector<std::pair<uint32_t,int>> keys(numTriangles);
+    for (size_t i=0;i<numTriangles;i++) {
+      const vec3ui cell = vec3ui((centroid[i]-bounds.lower)*scale);
+      keys[i] = std::make_pair(mortonCode(cell),(int)i);
+    }
+    std::sort(keys.begin(),keys.end());
+
+    std::vector<vec3i> sorted(numTriangles);
+    for (size_t i=0;i<numTriangles;i++)
+      sorted[i] = mesh.index[keys[i].second];
+    mesh.index.swap(sorted);
+
+    if (!mesh.triangleColor.empty()) {
+      std::vector<vec3f> sortedColor(numTriangles);
+      for (size_t i=0;i<numTriangles;i++)
+        sortedColor[i] = mesh.triangleColor[keys[i].second];
+      mesh.triangleColor.swap(sortedColor);
+    }
+  }
+  
+  void compactVertices(TriangleMesh &mesh)
+  {
+    // old vertex IDs, in order of first use
+    std::vector<int> newID(mesh.vertex.size(),-1);
+    std::vector<int> order;
+    order.reserve(mesh.vertex.size());
+    for (auto &idx : mesh.index)
+      for (int c=0;c<3;c++) {
+        int &vID = idx[c];
+        if (newID[vID] < 0) {
+          newID[vID] = (int)order.size();
+          order.push_back(vID);
+        }
+        vID = newID[vID];
+      }
+    gather(mesh.vertex,order);
+    gather(mesh.vertexColor,order);
+    gather(mesh.normal,order);
+    gather(mesh.texcoord,order);
+    gather(mesh.bakedLight,order);
+  }
+
+  TriangleMesh tessellateForBaking(const TriangleMesh &mesh, float maxEdgeLength)
+  {
+    // (also catches NaNs)
+    if (!(maxEdgeLength > 0.f))
+      throw std::runtime_error("tessellateForBaking: maxEdgeLength has to be positive");
+    const size_t numTriangles = mesh.index.size();
+    // how finely to split each triangle, and where its vertices and
+    // triangles start in the output
+    std::vector<int>    rate(numTriangles);
+    std::vector<size_t> firstVertex(numTriangles+1,0);
+    std::vector<size_t> firstTriangle(numTriangles+1,0);
+    for (size_t i=0;i<numTriangles;i++) {
+      const vec3i idx = mesh.index[i];
+      const vec3f &A = mesh.vertex[idx.x];
+      const vec3f &B = mesh.vertex[idx.y];
+      const vec3f &C = mesh.vertex[idx.z];
+      const float longest = std::max(length(B-A),std::max(length(C-B),length(A-C)));
+      const int n = std::max(1,(int)ceilf(longest/maxEdgeLength));
+      rate[i] = n;
+      firstVertex[i+1]   = firstVertex[i]   + size_t(n+1)*(n+2)/2;
+      firstTriangle[i+1] = firstTriangle[i] + size_t(n)*n;
+    }
+
+    TriangleMesh fine;
+    fine.color = mesh.color;
+    fine.vertex.resize(firstVertex[numTriangles]);
+    fine.index.resize(firstTriangle[numTriangles]);
+    if (!mesh.triangleColor.empty())
+      fine.triangleColor.resize(firstTriangle[numTriangles]);
+    // vertex attributes get interpolated to the new vertices
+    const size_t numFineVertices = firstVertex[numTriangles];
+    if (!mesh.vertexColor.empty()) fine.vertexColor.resize(numFineVertices);
+    if (!mesh.normal.empty())      fine.normal.resize(numFineVertices);
+    if (!mesh.texcoord.empty())    fine.texcoord.resize(numFineVertices);
+    if (!mesh.bakedLight.empty())  fine.bakedLight.resize(numFineVertices);
+    
+    // every triangle owns a fixed slice of the output arrays
+    parallel_for_blocked(0,numTriangles,1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++) {
+          const vec3i idx = mesh.index[i];
+          const vec3f &A = mesh.vertex[idx.x];
+          const vec3f &B = mesh.vertex[idx.y];
+          const vec3f &C = mesh.vertex[idx.z];
+          const int n = rate[i];
+          // vertex (u,v), u+v <= n, is at A+(u/n)(B-A)+(v/n)(C-A);
+          // row v of those starts at v*(n+1)-v*(v-1)/2
+          const int v0 = (int)firstVertex[i];
+          auto vertexID = [&](int u, int v) { return v0 + v*(n+1) - v*(v-1)/2 + u; };
+          for (int v=0;v<=n;v++)
+            for (int u=0;u<=n-v;u++) {
+              const int   vID = vertexID(u,v);
+              const float fu  = u/float(n), fv = v/float(n);
+              fine.vertex[vID] = A + fu*(B-A) + fv*(C-A);
+              if (!mesh.vertexColor.empty())
+                fine.vertexColor[vID] = interpolate(mesh.vertexColor,idx,fu,fv);
+              if (!mesh.normal.empty())
+                fine.normal[vID] = normalize(interpolate(mesh.normal,idx,fu,fv));
+              if (!mesh.texcoord.empty())
+                fine.texcoord[vID] = interpolate(mesh.texcoord,idx,fu,fv);
+              if (!mesh.bakedLight.empty())
+                fine.bakedLight[vID] = interpolate(mesh.bakedLight,idx,fu,fv);
+            }
+          size_t t = firstTriangle[i];
+          for (int v=0;v<n;v++)
+            for (int u=0;u<n-v;u++) {
+              // same winding as the original triangle
+              fine.index[t++] = vec3i(vertexID(u,v),vertexID(u+1,v),vertexID(u,v+1));
+              if (u < n-v-1)
+                fine.index[t++] = vec3i(vertexID(u+1,v),vertexID(u+1,v+1),vertexID(u,v+1));
+            }
+          if (!mesh.triangleColor.empty())
+            std::fill(fine.triangleColor.begin()+firstTriangle[i],
+                      fine.triangleColor.begin()+firstTriangle[i+1],
+                      mesh.triangleColor[i]);
+        }
+      });
+    return fine;
+  }
+  
+  size_t computeVertexNormals(TriangleMesh &mesh, float creaseAngle, bool angleWeighted)
+  {
+    const size_t numVertices  = mesh.vertex.size();
+    const size_t numTriangles = mesh.index.size();
+    if (3*numTriangles > size_t(0xffffffffu))
+      throw std::runtime_error("computeVertexNormals: too many triangles");
+
+    // face normals, facing the same way as the flat ones
+    // __closesthit__radiance_mesh computes
+    std::vector<vec3f> faceNormal(numTriangles);
+    parallel_for_blocked(0,numTriangles,64*1024,[&](size_t begin, size_t end){
+        for (size_t t=begin;t<end;t++) {
+          const vec3i idx = mesh.index[t];
+          const vec3f &A = mesh.vertex[idx.x];
+          const vec3f N = cross(mesh.vertex[idx.z]-A,mesh.vertex[idx.y]-A);
+          const float len = length(N);
+          faceNormal[t] = len > 0.f ? N/len : vec3f(0.f);
+        }
+      });
+
+    // the corners (3*triangleID+c) around each vertex, as a
+    // compressed list: count, prefix-sum, then scatter
+    std::unique_ptr<std::atomic<uint32_t>[]> cursor(new std::atomic<uint32_t>[numVertices]);
+    parallel_for_blocked(0,numVertices,64*1024,[&](size_t begin, size_t end){
+        for (size_t v=begin;v<end;v++) cursor[v].store(0,std::memory_order_relaxed);
+      });
+    parallel_for_blocked(0,numTriangles,64*1024,[&](size_t begin, size_t end){
+        for (size_t t=begin;t<end;t++)
+          for (int c=0;c<3;c++)
+            cursor[mesh.index[t][c]].fetch_add(1,std::memory_order_relaxed);
+      });
+    std::vector<uint32_t> firstCorner(numVertices+1);
+    firstCorner[0] = 0;
+    for (size_t v=0;v<numVertices;v++) {
+      firstCorner[v+1] = firstCorner[v] + cursor[v].load(std::memory_order_relaxed);
+      cursor[v].store(firstCorner[v],std::memory_order_relaxed);
+    }
+    std::vector<uint32_t> corners(3*numTriangles);
+    parallel_for_blocked(0,numTriangles,64*1024,[&](size_t begin, size_t end){
+        for (size_t t=begin;t<end;t++)
+          for (int c=0;c<3;c++)
+            corners[cursor[mesh.index[t][c]].fetch_add(1,std::memory_order_relaxed)]
+              = uint32_t(3*t+c);
+      });
+    cursor.reset();
+
+    // how much a corner's face contributes to its vertex's normal:
+    // the angle at that corner, or the face's area
+    auto weightedNormal = [&](uint32_t corner) {
+      const size_t t = corner/3;
+      const int    c = corner%3;
+      const vec3i idx = mesh.index[t];
+      const vec3f &P = mesh.vertex[idx[c]];
+      const vec3f e0 = mesh.vertex[idx[(c+1)%3]]-P;
+      const vec3f e1 = mesh.vertex[idx[(c+2)%3]]-P;
+      if (!angleWeighted)
+        return .5f*length(cross(e0,e1))*faceNormal[t];
+      const float len = length(e0)*length(e1);
+      const float cosAngle = len > 0.f ? dot(e0,e1)/len : 1.f;
+      return acosf(std::max(-1.f,std::min(1.f,cosAngle)))*faceNormal[t];
+    };
+    
+    // for each corner of vertex v, the normal of the faces around v
+    // that are within the crease angle of the corner's own face (in
+    // a fixed order, so corners whose faces all smooth into each
+    // other get bit-identical normals); and the distinct ones of
+    // those, which each need a vertex of their own. a face that
+    // points away from the corner's own face is taken to be wound
+    // the other way (as some of addUnitCube()'s are), and counts
+    // flipped, so corners still end up facing the same way as their
+    // own faces; that also holds without any creases
+    constexpr float pi = 3.14159265358979f;
+    const float cosCrease = cosf(std::min(creaseAngle,180.f)*pi/180.f);
+    struct Scratch {
+      std::vector<vec3f> weighted, cornerNormal, groupNormal;
+      std::vector<int>   cornerGroup;
+    };
+    auto groupCorners = [&](size_t v, Scratch &scratch) {
+      uint32_t *begin = corners.data()+firstCorner[v];
+      uint32_t *end   = corners.data()+firstCorner[v+1];
+      std::sort(begin,end);
+      const size_t numCorners = end-begin;
+      scratch.weighted.resize(numCorners);
+      scratch.cornerNormal.resize(numCorners);
+      scratch.cornerGroup.resize(numCorners);
+      scratch.groupNormal.clear();
+      for (size_t i=0;i<numCorners;i++)
+        scratch.weighted[i] = weightedNormal(begin[i]);
+      for (size_t i=0;i<numCorners;i++) {
+        const vec3f &Ni = faceNormal[begin[i]/3];
+        vec3f N(0.f);
+        for (size_t j=0;j<numCorners;j++) {
+          const float d = dot(Ni,faceNormal[begin[j]/3]);
+          if (fabsf(d) < cosCrease) continue;
+          if (d >= 0.f)
+            N += scratch.weighted[j];
+          else
+            N -= scratch.weighted[j];
+        }
+        const float len = length(N);
+        // degenerate faces don't get a say; if all of them are,
+        // any normal will do
+        N = len > 0.f ? N/len : (Ni != vec3f(0.f) ? Ni : vec3f(0.f,1.f,0.f));
+        size_t g = 0;
+        while (g < scratch.groupNormal.size() && scratch.groupNormal[g] != N) g++;
+        if (g == scratch.groupNormal.size())
+          scratch.groupNormal.push_back(N);
+        scratch.cornerGroup[i] = (int)g;
+      }
+    };
+
+    // first pass: how many vertices each vertex splits into
+    std::vector<uint32_t> firstNewVertex(numVertices+1,0);
+    parallel_for_blocked(0,numVertices,16*1024,[&](size_t begin, size_t end){
+        Scratch scratch;
+        for (size_t v=begin;v<end;v++) {
+          groupCorners(v,scratch);
+          firstNewVertex[v+1]
+            = scratch.groupNormal.empty() ? 0 : uint32_t(scratch.groupNormal.size()-1);
+        }
+      });
+    for (size_t v=0;v<numVertices;v++)
+      firstNewVertex[v+1] += firstNewVertex[v];
+    const size_t numNewVertices = firstNewVertex[numVertices];
+
+    // second pass: the first group keeps the vertex, the others get
+    // copies of it appended. other threads still read the index
+    // buffer (for the angles), so the corners' new vertices go to a
+    // buffer of their own first; only needed if anything got split
+    std::vector<int> cornerVertex(numNewVertices ? 3*numTriangles : 0);
+    const size_t numVerticesOut = numVertices+numNewVertices;
+    mesh.vertex.resize(numVerticesOut);
+    if (!mesh.vertexColor.empty()) mesh.vertexColor.resize(numVerticesOut);
+    if (!mesh.texcoord.empty())    mesh.texcoord.resize(numVerticesOut);
+    if (!mesh.bakedLight.empty())  mesh.bakedLight.resize(numVerticesOut);
+    mesh.normal.assign(numVerticesOut,vec3f(0.f,1.f,0.f));
+    parallel_for_blocked(0,numVertices,16*1024,[&](size_t begin, size_t end){
+        Scratch scratch;
+        for (size_t v=begin;v<end;v++) {
+          groupCorners(v,scratch);
+          auto vertexID = [&](int g) {
+            return g == 0 ? (int)v : int(numVertices+firstNewVertex[v]+g-1);
+          };
+          for (size_t g=0;g<scratch.groupNormal.size();g++) {
+            const int vID = vertexID((int)g);
+            mesh.normal[vID] = scratch.groupNormal[g];
+            if (vID == (int)v) continue;
+            mesh.vertex[vID] = mesh.vertex[v];
+            if (!mesh.vertexColor.empty()) mesh.vertexColor[vID] = mesh.vertexColor[v];
+            if (!mesh.texcoord.empty())    mesh.texcoord[vID]    = mesh.texcoord[v];
+            if (!mesh.bakedLight.empty())  mesh.bakedLight[vID]  = mesh.bakedLight[v];
+          }
+          if (cornerVertex.empty()) continue;
+          const uint32_t *corner = corners.data()+firstCorner[v];
+          for (size_t i=0;i<scratch.cornerGroup.size();i++)
+            cornerVertex[corner[i]] = vertexID(scratch.cornerGroup[i]);
+        }
+      });
+    if (!cornerVertex.empty())
+      parallel_for_blocked(0,numTriangles,64*1024,[&](size_t begin, size_t end){
+          for (size_t t=begin;t<end;t++)
+            mesh.index[t] = vec3i(cornerVertex[3*t+0],cornerVertex[3*t+1],cornerVertex[3*t+2]);
+        });
+    return numNewVertices;
+  }
+
+  /*! which per-vertex streams a mesh has; only meshes that have the
+      same ones can be merged */
+  static int vertexStreams(const TriangleMesh &mesh)
+  {
+    return (mesh.vertexColor.empty() ? 0 : 1)
+      |    (mesh.normal.empty()      ? 0 : 2)
+      |    (mesh.texcoord.empty()    ? 0 : 4)
+      |    (mesh.bakedLight.empty()  ? 0 : 8);
+  }
+
+  /*! append all of 'from' to 'to'; with perTriangleColors, from's
+      color (or triangleColor) goes into to's triangleColor */
+  static void appendMesh(TriangleMesh &to, const TriangleMesh &from,
+                         bool perTriangleColors)
+  {
+    const vec3i firstVertex((int)to.vertex.size());
+    for (auto &idx : from.index)
+      to.index.push_back(idx+firstVertex);
+    to.vertex.insert(to.vertex.end(),from.vertex.begin(),from.vertex.end());
+    to.vertexColor.insert(to.vertexColor.end(),from.vertexColor.begin(),from.vertexColor.end());
+    to.normal.insert(to.normal.end(),from.normal.begin(),from.normal.end());
+    to.texcoord.insert(to.texcoord.end(),from.texcoord.begin(),from.texcoord.end());
+    to.bakedLight.insert(to.bakedLight.end(),from.bakedLight.begin(),from.bakedLight.end());
+    if (!perTriangleColors)
+      return;
+    if (from.triangleColor.empty())
+      to.triangleColor.insert(to.triangleColor.end(),from.index.size(),from.color);
+    else
+      to.triangleColor.insert(to.triangleColor.end(),
+                              from.triangleColor.begin(),from.triangleColor.end());
+  }
+
+  size_t mergeMeshes(std::vector<TriangleMesh> &meshes, size_t maxTriangles)
+  {
+    std::vector<TriangleMesh> merged;
+    // big meshes stay as they are; small ones get grouped by which
+    // streams they have
+    std::map<int,std::vector<size_t>> groups;
+    for (size_t meshID=0;meshID<meshes.size();meshID++)
+      if (meshes[meshID].index.size() >= maxTriangles)
+        merged.push_back(std::move(meshes[meshID]));
+      else
+        groups[vertexStreams(meshes[meshID])].push_back(meshID);
+
+    for (auto &group : groups) {
+      const std::vector<size_t> &meshIDs = group.second;
+      size_t begin = 0;
+      while (begin < meshIDs.size()) {
+        // as many meshes as fit into maxTriangles
+        size_t end = begin, numTriangles = 0, numVertices = 0;
+        while (end < meshIDs.size()
+               && (end == begin
+                   || numTriangles+meshes[meshIDs[end]].index.size() <= maxTriangles)) {
+          numTriangles += meshes[meshIDs[end]].index.size();
+          numVertices  += meshes[meshIDs[end]].vertex.size();
+          end++;
+        }
+        if (end-begin == 1) {
+          merged.push_back(std::move(meshes[meshIDs[begin]]));
+          begin = end;
+          continue;
+        }
+
+        // per-mesh colors only survive as per-triangle ones, unless
+        // per-vertex colors override them anyway
+        const TriangleMesh &first = meshes[meshIDs[begin]];
+        bool perTriangleColors = false;
+        for (size_t i=begin;i<end;i++) {
+          const TriangleMesh &mesh = meshes[meshIDs[i]];
+          perTriangleColors |= !mesh.triangleColor.empty() || mesh.color != first.color;
+        }
+        perTriangleColors &= first.vertexColor.empty();
+        
+        TriangleMesh mesh;
+        mesh.color = first.color;
+        mesh.vertex.reserve(numVertices);
+        mesh.index.reserve(numTriangles);
+        if (perTriangleColors)
+          mesh.triangleColor.reserve(numTriangles);
+        for (size_t i=begin;i<end;i++) {
+          appendMesh(mesh,meshes[meshIDs[i]],perTriangleColors);
+          meshes[meshIDs[i]] = TriangleMesh();
+        }
+        merged.push_back(std::move(mesh));
+        begin = end;
+      }
+    }
+    const size_t numMergedAway = meshes.size()-merged.size();
+    meshes.swap(merged);
+    return numMergedAway;
+  }
+
+  MeshPreprocessStats preprocessMesh(TriangleMesh &mesh,
+                                     const PreprocessOptions &options)
+  {
+    MeshPreprocessStats stats;
+    stats.numVerticesIn  = mesh.vertex.size();
+    stats.numTrianglesIn = mesh.index.size();
+
+    weldVertices(mesh,options.weldEpsilon);
+    removeDegenerateTriangles(mesh,options.minTriangleArea);
+    if (options.reorder)
+      sortTrianglesMorton(mesh);
+    compactVertices(mesh);
+    
+    stats.numVerticesOut  = mesh.vertex.size();
+    stats.numTrianglesOut = mesh.index.size();
+    return stats;
+  }
+  
+} // ::osc
@@ -0,0 +1,91 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "Geometry.h"
+
+namespace osc {
+
+  /*! before/after counts of a single preprocessing run */
+  struct MeshPreprocessStats {
+    size_t numVerticesIn   { 0 };
+    size_t numVerticesOut  { 0 };
+    size_t numTrianglesIn  { 0 };
+    size_t numTrianglesOut { 0 };
+
+    MeshPreprocessStats &operator+=(const MeshPreprocessStats &other)
+    {
+      numVerticesIn   += other.numVerticesIn;
+      numVerticesOut  += other.numVerticesOut;
+      numTrianglesIn  += other.numTrianglesIn;
+      numTrianglesOut += other.numTrianglesOut;
+      return *this;
+    }
+  };
+
+  /*! merge all vertices that are within 'epsilon' of each other
+      (exact duplicates only if epsilon is 0), and re-point the index
+      buffer to the merged vertices. unreferenced vertices are
+      left in place; compactVertices() removes those */
+  void weldVertices(TriangleMesh &mesh, float epsilon);
+
+  /*! drop all triangles that reference the same vertex more than
+      once, or whose area is <= minArea. returns number of
+      triangles removed */
+  size_t removeDegenerateTriangles(TriangleMesh &mesh, float minArea);
+
+  /*! sort triangles along a 30-bit morton curve over their
+      centroids */
+  void sortTrianglesMorton(TriangleMesh &mesh);
+
+  /*! renumber vertices in order of their first use in the index
+      buffer, dropping all vertices that are not referenced at all */
+  void compactVertices(TriangleMesh &mesh);
+
+  /*! a copy of the mesh that's fine enough to bake lighting into
+      its vertices: every triangle gets split into n^2 equal ones, n
+      large enough for their edges to be no longer than
+      maxEdgeLength. triangles don't share vertices (so neither do
+      faces with different normals), which welding would undo. runs
+      in parallel; throws if maxEdgeLength isn't positive */
+  TriangleMesh tessellateForBaking(const TriangleMesh &mesh, float maxEdgeLength);
+
+  /*! give the mesh smooth per-vertex normals (replacing any it had),
+      averaged over the faces around each vertex, weighted by either
+      their angle at the vertex or their area. edges whose faces are
+      more than creaseAngle degrees apart stay sharp, by splitting
+      their vertices. faces pointing away from each other count as
+      wound inconsistently, and get flipped for this, so 90 or more
+      smooths everything. normals face the same way as the flat ones
+      the hit program would compute. runs in parallel; returns the
+      number of vertices added */
+  size_t computeVertexNormals(TriangleMesh &mesh, float creaseAngle,
+                              bool angleWeighted = true);
+
+  /*! merge all meshes of fewer than maxTriangles triangles into as
+      few meshes of up to maxTriangles as possible; only meshes with
+      the same per-vertex attribute streams get merged with each
+      other. differing per-mesh colors turn into per-triangle ones.
+      meshes end up in a different order; returns how many fewer
+      there are */
+  size_t mergeMeshes(std::vector<TriangleMesh> &meshes, size_t maxTriangles);
+
+  /*! run all of the above on one mesh, as configured by options */
+  MeshPreprocessStats preprocessMesh(TriangleMesh &mesh,
+                                     const PreprocessOptions &options);
+  
+} // ::osc
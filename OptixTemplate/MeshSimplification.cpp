@@ -0,0 +1,273 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "MeshSimplification.h"
+#include "MeshPreprocessing.h"
+#include <queue>
+
+namespace osc {
+
+  /*! symmetric 4x4 error quadric, upper triangle only */
+  struct Quadric {
+    Quadric() { for (int i=0;i<10;i++) a[i] = 0.; }
+
+    /*! (weighted) squared distance to plane dot(n,x)+d=0 */
+    static Quadric fromPlane(const vec3f &n, float d, float weight)
+    {
+      Quadric q;
+      q.a[0] = weight*n.x*n.x; q.a[1] = weight*n.x*n.y; q.a[2] = weight*n.x*n.z; q.a[3] = weight*n.x*d;
+                               q.a[4] = weight*n.y*n.y; q.a[5] = weight*n.y*n.z; q.a[6] = weight*n.y*d;
+                                                        q.a[7] = weight*n.z*n.z; q.a[8] = weight*n.z*d;
+                                                                                 q.a[9] = weight*d*d;
+      return q;
+    }
+
+    Quadric &operator+=(const Quadric &other)
+    { for (int i=0;i<10;i++) a[i] += other.a[i]; return *this; }
+
+    double evaluate(const vec3f &v) const
+    {
+      const double x = v.x, y = v.y, z = v.z;
+      return
+        a[0]*x*x + 2*a[1]*x*y + 2*a[2]*x*z + 2*a[3]*x
+        +          a[4]*y*y   + 2*a[5]*y*z + 2*a[6]*y
+        +                         a[7]*z*z + 2*a[8]*z
+        +                                      a[9];
+    }
+
+    /*! position minimizing the error, if the system is well
+        conditioned */
+    bool optimum(vec3f &v) const
+    {
+      const double det
+        = a[0]*(a[4]*a[7]-a[5]*a[5])
+        - a[1]*(a[1]*a[7]-a[5]*a[2])
+        + a[2]*(a[1]*a[5]-a[4]*a[2]);
+      if (fabs(det) < 1e-12) return false;
+      const double bx = -a[3], by = -a[6], bz = -a[8];
+      // cramer's rule
+      v.x = float((bx*(a[4]*a[7]-a[5]*a[5]) - a[1]*(by*a[7]-a[5]*bz) + a[2]*(by*a[5]-a[4]*bz))/det);
+      v.y = float((a[0]*(by*a[7]-bz*a[5]) - bx*(a[1]*a[7]-a[5]*a[2]) + a[2]*(a[1]*bz-by*a[2]))/det);
+      v.z = float((a[0]*(a[4]*bz-a[5]*by) - a[1]*(a[1]*bz-by*a[2]) + bx*(a[1]*a[5]-a[4]*a[2]))/det);
+      return true;
+    }
+    
+    double a[10];
+  };
+
+  struct EdgeCollapse {
+    double cost;
+    int    v0, v1;
+    /*! vertex versions at the time this got computed; any
+        collapse touching either vertex since invalidates it */
+    int    version0, version1;
+    vec3f  position;
+
+    /*! inverted, so std::priority_queue hands out the cheapest first */
+    bool operator<(const EdgeCollapse &other) const { return cost > other.cost; }
+  };
+  
+  TriangleMesh simplifyMesh(const TriangleMesh &input, size_t targetTriangles)
+  {
+    TriangleMesh mesh = input;
+    // collapses only make sense on a connected mesh
+    weldVertices(mesh,0.f);
+    removeDegenerateTriangles(mesh,0.f);
+    
+    const size_t numVertices  = mesh.vertex.size();
+    const size_t numTriangles = mesh.index.size();
+    if (numTriangles <= targetTriangles) {
+      compactVertices(mesh);
+      return mesh;
+    }
+    
+    std::vector<Quadric>          quadric(numVertices);
+    std::vector<std::vector<int>> vertexTriangles(numVertices);
+    std::vector<int>              version(numVertices,0);
+    std::vector<bool>             vertexAlive(numVertices,true);
+    std::vector<bool>             triangleAlive(numTriangles,true);
+    std::vector<std::pair<int,int>> edges;
+    
+    for (size_t triID=0;triID<numTriangles;triID++) {
+      const vec3i idx = mesh.index[triID];
+      const vec3f &A = mesh.vertex[idx.x];
+      const vec3f &B = mesh.vertex[idx.y];
+      const vec3f &C = mesh.vertex[idx.z];
+      vec3f N = cross(B-A,C-A);
+      const float twiceArea = length(N);
+      N = N * (1.f/twiceArea);
+      const Quadric q = Quadric::fromPlane(N,-dot(N,A),.5f*twiceArea);
+      for (int c=0;c<3;c++) {
+        quadric[idx[c]] += q;
+        vertexTriangles[idx[c]].push_back((int)triID);
+        const int a = idx[c], b = idx[(c+1)%3];
+        edges.push_back(std::make_pair(min(a,b),max(a,b)));
+      }
+    }
+    std::sort(edges.begin(),edges.end());
+    edges.erase(std::unique(edges.begin(),edges.end()),edges.end());
+
+    auto computeCollapse = [&](int v0, int v1) {
+      EdgeCollapse collapse;
+      collapse.v0 = v0;
+      collapse.v1 = v1;
+      collapse.version0 = version[v0];
+      collapse.version1 = version[v1];
+      Quadric q = quadric[v0];
+      q += quadric[v1];
+      
+      const vec3f &p0 = mesh.vertex[v0];
+      const vec3f &p1 = mesh.vertex[v1];
+      const vec3f candidates[3] = { p0, p1, .5f*(p0+p1) };
+      collapse.position = candidates[2];
+      collapse.cost     = q.evaluate(candidates[2]);
+      for (int i=0;i<2;i++) {
+        const double cost = q.evaluate(candidates[i]);
+        if (cost < collapse.cost) { collapse.cost = cost; collapse.position = candidates[i]; }
+      }
+      vec3f opt;
+      if (q.optimum(opt)) {
+        const double cost = q.evaluate(opt);
+        if (cost < collapse.cost) { collapse.cost = cost; collapse.position = opt; }
+      }
+      return collapse;
+    };
+
+    /*! would moving vertex v to newPos flip any of its triangles that
+        do not also contain 'other' (those will vanish anyway)? */
+    auto flips = [&](int v, int other, const vec3f &newPos) {
+      for (int triID : vertexTriangles[v]) {
+        if (!triangleAlive[triID]) continue;
+        const vec3i idx = mesh.index[triID];
+        if (idx.x == other || idx.y == other || idx.z == other) continue;
+        vec3f P[3], Q[3];
+        for (int c=0;c<3;c++) {
+          P[c] = mesh.vertex[idx[c]];
+          Q[c] = (idx[c] == v) ? newPos : P[c];
+        }
+        const vec3f oldN = cross(P[1]-P[0],P[2]-P[0]);
+        const vec3f newN = cross(Q[1]-Q[0],Q[2]-Q[0]);
+        if (dot(oldN,newN) <= 0.f) return true;
+      }
+      return false;
+    };
+    
+    std::priority_queue<EdgeCollapse> heap;
+    for (auto &edge : edges)
+      heap.push(computeCollapse(edge.first,edge.second));
+
+    size_t numTrianglesAlive = numTriangles;
+    while (numTrianglesAlive > targetTriangles && !heap.empty()) {
+      const EdgeCollapse collapse = heap.top();
+      heap.pop();
+      const int v0 = collapse.v0, v1 = collapse.v1;
+      if (!vertexAlive[v0] || !vertexAlive[v1] ||
+          version[v0] != collapse.version0 || version[v1] != collapse.version1)
+        continue;
+      if (flips(v0,v1,collapse.position) || flips(v1,v0,collapse.position))
+        continue;
+
+      // merge v1 into v0
+      mesh.vertex[v0] = collapse.position;
+      quadric[v0]    += quadric[v1];
+      vertexAlive[v1] = false;
+      version[v0]++;
+      for (int triID : vertexTriangles[v1]) {
+        if (!triangleAlive[triID]) continue;
+        vec3i &idx = mesh.index[triID];
+        if (idx.x == v0 || idx.y == v0 || idx.z == v0) {
+          // this one contained the collapsed edge
+          triangleAlive[triID] = false;
+          numTrianglesAlive--;
+          continue;
+        }
+        for (int c=0;c<3;c++)
+          if (idx[c] == v1) idx[c] = v0;
+        vertexTriangles[v0].push_back(triID);
+      }
+      vertexTriangles[v1].clear();
+
+      // drop dead triangles from v0's list, and re-evaluate all
+      // edges around v0
+      std::vector<int> &triangles = vertexTriangles[v0];
+      triangles.erase(std::remove_if(triangles.begin(),triangles.end(),
+                                     [&](int triID) { return !triangleAlive[triID]; }),
+                      triangles.end());
+      std::vector<int> neighbors;
+      for (int triID : triangles)
+        for (int c=0;c<3;c++)
+          if (mesh.index[triID][c] != v0)
+            neighbors.push_back(mesh.index[triID][c]);
+      std::sort(neighbors.begin(),neighbors.end());
+      neighbors.erase(std::unique(neighbors.begin(),neighbors.end()),neighbors.end());
+      for (int n : neighbors)
+        heap.push(computeCollapse(v0,n));
+    }
+
+    const bool hasColors = !mesh.triangleColor.empty();
+    size_t numOut = 0;
+    for (size_t triID=0;triID<numTriangles;triID++)
+      if (triangleAlive[triID]) {
+        if (hasColors)
+          mesh.triangleColor[numOut] = mesh.triangleColor[triID];
+        mesh.index[numOut++] = mesh.index[triID];
+      }
+    mesh.index.resize(numOut);
+    if (hasColors)
+      mesh.triangleColor.resize(numOut);
+    compactVertices(mesh);
+    return mesh;
+  }
+
+  std::vector<TriangleMesh> buildLODChain(const TriangleMesh &mesh,
+                                          int maxLevels,
+                                          float reduction)
+  {
+    std::vector<TriangleMesh> levels;
+    levels.push_back(mesh);
+    while ((int)levels.size() < maxLevels) {
+      const size_t prevTriangles = levels.back().index.size();
+      const size_t target = size_t(prevTriangles*reduction);
+      if (target < 4) break;
+      TriangleMesh next = simplifyMesh(levels.back(),target);
+      // not worth another level if we couldn't get anywhere close
+      if (next.index.size() > (prevTriangles+target)/2) break;
+      levels.push_back(next);
+    }
+    return levels;
+  }
+
+  int selectLOD(const box3f &worldBounds,
+                const Camera &camera,
+                int fbHeight,
+                int numLevels,
+                float fullDetailPixels)
+  {
+    // same camera model as SampleRenderer::setCamera(): the screen
+    // spans cosFovy world units vertically at unit distance
+    if (fbHeight <= 0) return 0;
+    const float cosFovy  = 0.66f;
+    const float radius   = .5f*length(worldBounds.span());
+    const float distance = length(worldBounds.center()-camera.from);
+    if (distance <= radius) return 0;
+
+    const float projectedPixels = 2.f*radius/(cosFovy*distance) * fbHeight;
+    if (projectedPixels >= fullDetailPixels) return 0;
+    const int level = int(log2f(fullDetailPixels/projectedPixels));
+    return min(level,numLevels-1);
+  }
+  
+} // ::osc
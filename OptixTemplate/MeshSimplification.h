@@ -0,0 +1,51 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "Geometry.h"
+#include "gdt/math/box.h"
+
+namespace osc {
+
+  /*! simplify the given mesh down to (about) targetTriangles
+      triangles, using greedy edge collapses ordered by quadric error
+      (Garland/Heckbert '97). collapses that would flip a triangle
+      are skipped, so the result may retain more triangles than
+      requested */
+  TriangleMesh simplifyMesh(const TriangleMesh &mesh, size_t targetTriangles);
+
+  /*! build a chain of levels of detail for the given mesh: level 0 is
+      the input mesh, each following level has about 'reduction'
+      times as many triangles as the previous one. stops after
+      maxLevels levels, or once a level can't be reduced any
+      further */
+  std::vector<TriangleMesh> buildLODChain(const TriangleMesh &mesh,
+                                          int maxLevels,
+                                          float reduction);
+
+  /*! pick the level of detail for an object with given world-space
+      bounds, as seen by the given camera on a frame buffer that is
+      fbHeight pixels high: level 0 as long as the object covers at
+      least fullDetailPixels pixels, then one level coarser for each
+      halving of its projected size */
+  int selectLOD(const box3f &worldBounds,
+                const Camera &camera,
+                int fbHeight,
+                int numLevels,
+                float fullDetailPixels = 256.f);
+  
+} // ::osc
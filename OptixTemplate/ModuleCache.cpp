@@ -0,0 +1,232 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "ModuleCache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+# include <direct.h>
+# include <io.h>
+# include <sys/utime.h>
+#else
+# include <dirent.h>
+# include <unistd.h>
+# include <utime.h>
+#endif
+
+namespace osc {
+
+  static const char *const entryFileName = "entry.txt";
+
+  ModuleCacheKey &ModuleCacheKey::add(const void *data, size_t numBytes)
+  {
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i=0;i<numBytes;i++) {
+      hash ^= bytes[i];
+      hash *= 0x100000001b3ULL;
+      // a different multiplier, and folding the high bits back in,
+      // so this doesn't collide along with the FNV hash
+      check = (check ^ bytes[i]) * 0xff51afd7ed558ccdULL;
+      check ^= check >> 29;
+    }
+    return *this;
+  }
+  
+  ModuleCacheKey &ModuleCacheKey::add(const std::string &s)
+  {
+    // include the size, so that ("ab","c") and ("a","bc") differ
+    add(uint64_t(s.size()));
+    return add(s.data(),s.size());
+  }
+  
+  static std::string hexString(uint64_t value)
+  {
+    std::stringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << value;
+    return ss.str();
+  }
+
+  std::string ModuleCacheKey::str() const
+  {
+    return hexString(hash);
+  }
+  
+  std::string ModuleCacheKey::checkStr() const
+  {
+    return hexString(check);
+  }
+
+  /*! creates the given directory, and any missing parents */
+  static bool makeDirs(const std::string &dir)
+  {
+    for (size_t pos = dir.find_first_of("/\\",1);
+         ;
+         pos = dir.find_first_of("/\\",pos+1)) {
+      const std::string prefix = dir.substr(0,pos);
+#ifdef _WIN32
+      _mkdir(prefix.c_str());
+#else
+      mkdir(prefix.c_str(),0755);
+#endif
+      if (pos == std::string::npos) break;
+    }
+    struct stat info;
+    return stat(dir.c_str(),&info) == 0 && (info.st_mode & S_IFDIR);
+  }
+
+  /*! names of everything in the given directory, without '.' and
+      '..'; empty if it can't be read */
+  static std::vector<std::string> listDir(const std::string &dir)
+  {
+    std::vector<std::string> names;
+#ifdef _WIN32
+    _finddata_t data;
+    const intptr_t handle = _findfirst((dir+"/*").c_str(),&data);
+    if (handle == -1) return names;
+    do names.push_back(data.name); while (_findnext(handle,&data) == 0);
+    _findclose(handle);
+#else
+    DIR *d = opendir(dir.c_str());
+    if (!d) return names;
+    while (const struct dirent *entry = readdir(d))
+      names.push_back(entry->d_name);
+    closedir(d);
+#endif
+    names.erase(std::remove_if(names.begin(),names.end(),[](const std::string &name){
+          return name == "." || name == "..";
+        }),names.end());
+    return names;
+  }
+
+  /*! removes the given directory and the files in it */
+  static bool removeDir(const std::string &dir)
+  {
+    for (auto &name : listDir(dir))
+      std::remove((dir+"/"+name).c_str());
+#ifdef _WIN32
+    return _rmdir(dir.c_str()) == 0;
+#else
+    return rmdir(dir.c_str()) == 0;
+#endif
+  }
+
+  /*! whether the given name is that of a cache entry, ie, 16 hex
+      digits */
+  static bool isEntryName(const std::string &name)
+  {
+    return name.size() == 16
+      && name.find_first_not_of("0123456789abcdef") == std::string::npos;
+  }
+
+  ModuleCache::ModuleCache(const std::string &dir)
+    : baseDir(dir)
+  {
+    if (!baseDir.empty()) return;
+    
+    if (const char *env = getenv("OSC_CACHE_DIR"))
+      baseDir = env;
+    else if (const char *env = getenv("XDG_CACHE_HOME"))
+      baseDir = std::string(env)+"/osc";
+    else if (const char *env = getenv("HOME"))
+      baseDir = std::string(env)+"/.cache/osc";
+    else if (const char *env = getenv("LOCALAPPDATA"))
+      baseDir = std::string(env)+"/osc";
+    else
+      baseDir = "osc_cache";
+  }
+
+  std::string ModuleCache::entryDir(const ModuleCacheKey &key) const
+  {
+    return baseDir+"/"+key.str();
+  }
+  
+  bool ModuleCache::lookup(const ModuleCacheKey &key, double &coldCompileTime) const
+  {
+    const std::string fileName = entryDir(key)+"/"+entryFileName;
+    std::ifstream in(fileName);
+    std::string storedCheck;
+    if (!(in >> storedCheck >> coldCompileTime))
+      return false;
+    // guard against (ever so unlikely) collisions in the directory
+    // name, and against someone having copied entries around
+    if (storedCheck != key.checkStr())
+      return false;
+    // the entry's time stamp is what evict() goes by
+    in.close();
+#ifdef _WIN32
+    _utime(fileName.c_str(),nullptr);
+#else
+    utime(fileName.c_str(),nullptr);
+#endif
+    return true;
+  }
+
+  std::string ModuleCache::prepare(const ModuleCacheKey &key) const
+  {
+    const std::string dir = entryDir(key);
+    if (!makeDirs(dir))
+      throw std::runtime_error("could not create module cache directory '"+dir+"'");
+    return dir;
+  }
+  
+  void ModuleCache::store(const ModuleCacheKey &key, double compileTime) const
+  {
+    // write to a temporary first, so that a concurrently starting
+    // process never sees a half-written entry
+    const std::string fileName = entryDir(key)+"/"+entryFileName;
+    {
+      std::ofstream out(fileName+".tmp");
+      out << key.checkStr() << " " << std::setprecision(9) << compileTime << std::endl;
+      if (!out.good())
+        throw std::runtime_error("could not write module cache entry '"+fileName+"'");
+    }
+    std::remove(fileName.c_str());
+    if (std::rename((fileName+".tmp").c_str(),fileName.c_str()) != 0)
+      throw std::runtime_error("could not write module cache entry '"+fileName+"'");
+    // (the entry we just wrote is the newest, so it stays)
+    evict(std::max(maxEntries,size_t(1)));
+  }
+
+  void ModuleCache::evict(size_t maxEntries) const
+  {
+    // entries by when they were last used; incomplete ones (no entry
+    // file yet, eg because some other process is compiling) by when
+    // they got created
+    std::vector<std::pair<time_t,std::string>> entries;
+    for (auto &name : listDir(baseDir)) {
+      if (!isEntryName(name)) continue;
+      const std::string dir = baseDir+"/"+name;
+      struct stat info;
+      if (stat((dir+"/"+entryFileName).c_str(),&info) != 0
+          && stat(dir.c_str(),&info) != 0)
+        continue;
+      entries.push_back(std::make_pair(info.st_mtime,dir));
+    }
+    if (entries.size() <= maxEntries) return;
+    
+    std::sort(entries.begin(),entries.end());
+    for (size_t i=0;i<entries.size()-maxEntries;i++)
+      removeDir(entries[i].second);
+  }
+  
+} // ::osc
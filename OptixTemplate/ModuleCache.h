@@ -0,0 +1,85 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "gdt/gdt.h"
+#include <string>
+
+namespace osc {
+
+  /*! incrementally hashes everything that determines what compiling
+      a module gives: ptx, compile options, driver and optix version,
+      device. there's two independent 64-bit hashes: one (FNV-1a)
+      names the cache entry, the other gets stored in it, to tell
+      when two keys collide in the first */
+  struct ModuleCacheKey {
+    ModuleCacheKey &add(const void *data, size_t numBytes);
+    ModuleCacheKey &add(const std::string &s);
+    /*! only for plain-old-data without pointers or padding; hash
+        strings (and whatever else gets pointed to) separately */
+    template<typename T>
+    ModuleCacheKey &add(const T &t) { return add(&t,sizeof(t)); }
+
+    /*! the hash, as 16 hex digits */
+    std::string str() const;
+    /*! the second hash, as 16 hex digits */
+    std::string checkStr() const;
+    
+    uint64_t hash  = 0xcbf29ce484222325ULL;
+    uint64_t check = 0x9e3779b97f4a7c15ULL;
+  };
+
+  /*! on-disk cache of compiled modules and programs. optix can't hand
+      those out to us, but it has its own disk cache; we give it a
+      directory of its own for every key, so that anything that
+      changes the key starts from a clean (cold) cache, and record
+      there what the cold compile cost, for comparison. only the
+      maxEntries most recently used entries are kept */
+  struct ModuleCache {
+    /*! cache in the given directory; empty for the default, which is
+        $OSC_CACHE_DIR, else $XDG_CACHE_HOME/osc, else ~/.cache/osc */
+    ModuleCache(const std::string &baseDir = "");
+
+    /*! the directory for the given key (without creating it) */
+    std::string entryDir(const ModuleCacheKey &key) const;
+    
+    /*! whether there's a complete entry for this key; if so, also
+        returns how long compiling took when it was created, and
+        marks the entry as used */
+    bool lookup(const ModuleCacheKey &key, double &coldCompileTime) const;
+
+    /*! create the directory for the given key, and return it; throws
+        if that fails */
+    std::string prepare(const ModuleCacheKey &key) const;
+
+    /*! mark the given key's entry complete, after a cold compile that
+        took the given time, and evict old entries; throws if writing
+        the entry fails */
+    void store(const ModuleCacheKey &key, double compileTime) const;
+
+    /*! remove the least recently used entries (with all of optix'
+        files in them), until at most the given number are left.
+        entries that can't be removed (eg, because another process
+        has them open) are skipped */
+    void evict(size_t maxEntries) const;
+
+    std::string baseDir;
+    size_t      maxEntries = 8;
+  };
+  
+} // ::osc
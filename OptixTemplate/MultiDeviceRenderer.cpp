@@ -0,0 +1,214 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "MultiDeviceRenderer.h"
+#include "gdt/profile/Profiler.h"
+
+namespace osc {
+
+  /*! the given device IDs, or all devices if none are given */
+  static std::vector<int> resolveDeviceIDs(const std::vector<int> &deviceIDs)
+  {
+    if (!deviceIDs.empty()) return deviceIDs;
+    int numCudaDevices = 0;
+    cudaGetDeviceCount(&numCudaDevices);
+    std::vector<int> all;
+    for (int i=0;i<std::max(1,numCudaDevices);i++)
+      all.push_back(i);
+    return all;
+  }
+  
+  MultiDeviceRenderer::MultiDeviceRenderer(const Geometry &scene,
+                                           int numFramesInFlight,
+                                           const std::vector<int> &deviceIDs,
+                                           FrameSplitMode splitMode)
+    : deviceIDs(resolveDeviceIDs(deviceIDs)),
+      splitter((int)this->deviceIDs.size(),splitMode),
+      frameRing(numFramesInFlight),
+      frameRanges(numFramesInFlight),
+      frameRenderSizes(numFramesInFlight)
+  {
+    // one after the other: optix initialization isn't safe to run
+    // concurrently, and all but the first find their programs in
+    // the module cache anyway
+    for (auto deviceID : this->deviceIDs)
+      devices.push_back(std::unique_ptr<SampleRenderer>
+                        (new SampleRenderer(scene,numFramesInFlight,deviceID)));
+    
+    mappedDeviceTimes.resize(devices.size());
+    if (devices.size() > 1)
+      std::cout << "#osc: rendering on " << devices.size() << " devices, "
+                << (splitMode == SPLIT_BANDS ? "in balanced bands" : "interleaved")
+                << std::endl;
+  }
+
+  void MultiDeviceRenderer::render()
+  {
+    GDT_PROFILE_SCOPE("multiDeviceRender");
+    if (fullSize.x == 0) return;
+    
+    const int slot = frameRing.beginFrame();
+    std::vector<RowRange> &ranges = frameRanges[slot];
+    ranges = splitter.split(renderSize.y);
+    frameRenderSizes[slot] = renderSize;
+    for (size_t d=0;d<devices.size();d++) {
+      devices[d]->setRows(ranges[d].rowOffset,ranges[d].numRows,ranges[d].rowStride);
+      devices[d]->render();
+    }
+    frameRing.endFrame();
+  }
+
+  const uint32_t *MultiDeviceRenderer::mapFrame(vec2i &size)
+  {
+    GDT_PROFILE_SCOPE("multiDeviceMapFrame");
+    const int slot = frameRing.displaySlot();
+    if (slot < 0) return nullptr;
+    const std::vector<RowRange> &ranges = frameRanges[slot];
+    const vec2i frameSize = frameRenderSizes[slot];
+    
+    std::vector<const uint32_t *> devicePixels(devices.size());
+    for (size_t d=0;d<devices.size();d++) {
+      vec2i deviceSize;
+      devicePixels[d] = devices[d]->mapFrame(deviceSize);
+      mappedDeviceTimes[d] = devices[d]->getMappedFrameTime();
+    }
+    splitter.update(ranges,mappedDeviceTimes);
+
+    haveMappedRayStats = false;
+    mappedRayStats = RayStats();
+    for (auto &device : devices)
+      if (const RayStats *stats = device->getRayStats()) {
+        haveMappedRayStats = true;
+        mappedRayStats.primaryRays        += stats->primaryRays;
+        mappedRayStats.misses             += stats->misses;
+        mappedRayStats.shadowRays         += stats->shadowRays;
+        mappedRayStats.shadowRaysOccluded += stats->shadowRaysOccluded;
+        mappedRayStats.primitiveTests     += stats->primitiveTests;
+        mappedRayStats.cycles             += stats->cycles;
+        mappedRayStats.reusedPixels       += stats->reusedPixels;
+        mappedRayStats.bounceRays         += stats->bounceRays;
+        mappedRayStats.shadowRaysCulled   += stats->shadowRaysCulled;
+        mappedRayStats.shadowRaysCached   += stats->shadowRaysCached;
+      }
+
+    size = frameSize;
+    // a single device renders all rows, so there's nothing to
+    // composite
+    if (devices.size() == 1)
+      return devicePixels[0];
+    compositeFrame(compositedPixels.data(),frameSize,ranges,devicePixels);
+    // no single device had all the rows to fill in untraced pixels
+    // from, so that happens here
+    reconstructFoveated(compositedPixels.data(),frameSize,devices[0]->getRateMap(),
+                        fullSize);
+    return compositedPixels.data();
+  }
+
+  void MultiDeviceRenderer::setRenderSize(const vec2i &newRenderSize)
+  {
+    // each device's rows get set per frame anyway
+    renderSize = newRenderSize;
+    for (auto &device : devices)
+      device->setRenderSize(newRenderSize);
+  }
+
+  void MultiDeviceRenderer::resize(const vec2i &newSize)
+  {
+    fullSize   = newSize;
+    renderSize = newSize;
+    for (auto &device : devices)
+      device->resize(newSize);
+    frameRing.reset();
+    if (devices.size() > 1)
+      compositedPixels.resize(size_t(newSize.x)*newSize.y);
+  }
+
+  void MultiDeviceRenderer::setFoveation(const Foveation &foveation)
+  {
+    for (auto &device : devices)
+      device->setFoveation(foveation);
+  }
+
+  void MultiDeviceRenderer::setReprojectionEnabled(bool enabled)
+  {
+    for (auto &device : devices)
+      device->setReprojectionEnabled(enabled);
+  }
+
+  void MultiDeviceRenderer::setRadianceCacheEnabled(bool enabled)
+  {
+    for (auto &device : devices)
+      device->setRadianceCacheEnabled(enabled);
+  }
+
+  void MultiDeviceRenderer::setShadowRayPolicy(const ShadowRayPolicy &policy)
+  {
+    for (auto &device : devices)
+      device->setShadowRayPolicy(policy);
+  }
+
+  double MultiDeviceRenderer::bakeLighting(int numSamples, float aoRadius)
+  {
+    const double bakeTime = devices[0]->bakeLighting(numSamples,aoRadius);
+    for (size_t d=1;d<devices.size();d++)
+      devices[d]->setMeshes(devices[0]->getMeshes());
+    return bakeTime;
+  }
+
+  void MultiDeviceRenderer::setCamera(const Camera &camera)
+  {
+    for (auto &device : devices)
+      device->setCamera(camera);
+  }
+
+  void MultiDeviceRenderer::setMeshes(const std::vector<TriangleMesh> &meshes)
+  {
+    for (auto &device : devices)
+      device->setMeshes(meshes);
+  }
+
+  void MultiDeviceRenderer::setStreamedMeshes(const std::vector<std::shared_ptr<const TriangleMesh>> &meshes)
+  {
+    for (auto &device : devices)
+      device->setStreamedMeshes(meshes);
+  }
+
+  void MultiDeviceRenderer::setRayStatsEnabled(bool enabled)
+  {
+    for (auto &device : devices)
+      device->setRayStatsEnabled(enabled);
+  }
+
+  void MultiDeviceRenderer::setHeatmapEnabled(bool enabled)
+  {
+    for (auto &device : devices)
+      device->setHeatmapEnabled(enabled);
+  }
+
+  const RayStats *MultiDeviceRenderer::getRayStats() const
+  {
+    return haveMappedRayStats ? &mappedRayStats : nullptr;
+  }
+
+  const std::vector<RowRange> &MultiDeviceRenderer::getMappedRanges() const
+  {
+    static const std::vector<RowRange> none;
+    const int slot = frameRing.displaySlot();
+    return slot < 0 ? none : frameRanges[slot];
+  }
+  
+} // ::osc
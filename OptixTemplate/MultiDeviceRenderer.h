@@ -0,0 +1,94 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "SampleRenderer.h"
+#include "FrameSplit.h"
+#include <memory>
+
+namespace osc {
+
+  /*! renders each frame on several devices at once - one
+      SampleRenderer (with its own context, stream, accels, and
+      frames in flight) per device, each rendering only its share of
+      the rows - and composites their pieces on the host. with a
+      single device this just passes through to that one's renderer */
+  class MultiDeviceRenderer
+  {
+  public:
+    /*! a renderer on each of the given devices; empty means all */
+    MultiDeviceRenderer(const Geometry &scene,
+                        int numFramesInFlight = 2,
+                        const std::vector<int> &deviceIDs = std::vector<int>(),
+                        FrameSplitMode splitMode = SPLIT_BANDS);
+
+    /*! @{ same as SampleRenderer's, but for all devices */
+    void render();
+    const uint32_t *mapFrame(vec2i &size);
+    void resize(const vec2i &newSize);
+    void setRenderSize(const vec2i &renderSize);
+    void setCamera(const Camera &camera);
+    void setMeshes(const std::vector<TriangleMesh> &meshes);
+    void setStreamedMeshes(const std::vector<std::shared_ptr<const TriangleMesh>> &meshes);
+    void setRayStatsEnabled(bool enabled);
+    void setHeatmapEnabled(bool enabled);
+    void setFoveation(const Foveation &foveation);
+    /*! this only has an effect with a single device, which is the
+        only one that has all rows to reproject */
+    void setReprojectionEnabled(bool enabled);
+    /*! each device has a cache of its own */
+    void setRadianceCacheEnabled(bool enabled);
+    /*! each device caches occluders for the rows it renders */
+    void setShadowRayPolicy(const ShadowRayPolicy &policy);
+    /*! bakes on the first device only, and hands the results to the
+        others */
+    double bakeLighting(int numSamples, float aoRadius);
+    double getTracedFraction() const { return devices[0]->getTracedFraction(); }
+    /*! summed over all devices */
+    const RayStats *getRayStats() const;
+    /*! @} */
+
+    int numDevices() const { return (int)devices.size(); }
+
+    /*! each device's share of the rows of the frame last returned by
+        mapFrame(), and how long it took */
+    const std::vector<RowRange> &getMappedRanges() const;
+    const std::vector<double>   &getMappedDeviceTimes() const { return mappedDeviceTimes; }
+
+  private:
+    const std::vector<int>                       deviceIDs;
+    /*! (each frees its own device's resources when we go away) */
+    std::vector<std::unique_ptr<SampleRenderer>> devices;
+    FrameSplitter splitter;
+    vec2i         fullSize   { 0 };
+    vec2i         renderSize { 0 };
+    
+    /*! the split (and render size) each frame in flight got rendered
+        with; all devices' rings run in lock step with this one */
+    FrameRing                          frameRing;
+    std::vector<std::vector<RowRange>> frameRanges;
+    std::vector<vec2i>                 frameRenderSizes;
+
+    /*! the full frame the devices' pieces get composited into */
+    std::vector<uint32_t> compositedPixels;
+    std::vector<double>   mappedDeviceTimes;
+    RayStats              mappedRayStats;
+    bool                  haveMappedRayStats { false };
+  };
+  
+} // ::osc
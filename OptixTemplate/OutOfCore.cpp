@@ -0,0 +1,359 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "OutOfCore.h"
+#include <algorithm>
+#include <cstring>
+
+namespace osc {
+
+  static const char chunkFileMagic[8] = { 'O','S','C','C','H','N','K','3' };
+
+  template<typename T>
+  static void writeField(std::ostream &out, const T &t)
+  { out.write((const char *)&t,sizeof(t)); }
+
+  template<typename T>
+  static void readField(std::istream &in, T &t)
+  { in.read((char *)&t,sizeof(t)); }
+
+  static void writeTableEntry(std::ostream &out, const MeshChunk &chunk)
+  {
+    writeField(out,chunk.bounds.lower.x);
+    writeField(out,chunk.bounds.lower.y);
+    writeField(out,chunk.bounds.lower.z);
+    writeField(out,chunk.bounds.upper.x);
+    writeField(out,chunk.bounds.upper.y);
+    writeField(out,chunk.bounds.upper.z);
+    writeField(out,chunk.color.x);
+    writeField(out,chunk.color.y);
+    writeField(out,chunk.color.z);
+    writeField(out,chunk.offset);
+    writeField(out,chunk.numVertices);
+    writeField(out,chunk.numTriangles);
+    writeField(out,chunk.hasTriangleColors);
+    writeField(out,chunk.hasVertexColors);
+    writeField(out,chunk.hasNormals);
+    writeField(out,chunk.hasTexcoords);
+  }
+
+  static void readTableEntry(std::istream &in, MeshChunk &chunk)
+  {
+    readField(in,chunk.bounds.lower.x);
+    readField(in,chunk.bounds.lower.y);
+    readField(in,chunk.bounds.lower.z);
+    readField(in,chunk.bounds.upper.x);
+    readField(in,chunk.bounds.upper.y);
+    readField(in,chunk.bounds.upper.z);
+    readField(in,chunk.color.x);
+    readField(in,chunk.color.y);
+    readField(in,chunk.color.z);
+    readField(in,chunk.offset);
+    readField(in,chunk.numVertices);
+    readField(in,chunk.numTriangles);
+    readField(in,chunk.hasTriangleColors);
+    readField(in,chunk.hasVertexColors);
+    readField(in,chunk.hasNormals);
+    readField(in,chunk.hasTexcoords);
+  }
+
+  /*! recursively split the given triangles (of mesh) at the object
+      median of their centroids until each set has at most
+      maxTriangles, and write each leaf set as one chunk */
+  static void writeChunks(std::ofstream &out,
+                          const TriangleMesh &mesh,
+                          const std::vector<vec3f> &centroid,
+                          int *begin, int *end,
+                          size_t maxTriangles,
+                          std::vector<MeshChunk> &chunks)
+  {
+    const size_t numTriangles = end-begin;
+    if (numTriangles > maxTriangles) {
+      box3f centroidBounds;
+      for (int *it=begin;it!=end;it++)
+        centroidBounds.extend(centroid[*it]);
+      const vec3f span = centroidBounds.span();
+      const int dim = span.x > span.y
+        ? (span.x > span.z ? 0 : 2)
+        : (span.y > span.z ? 1 : 2);
+      int *mid = begin + numTriangles/2;
+      std::nth_element(begin,mid,end,[&](int a, int b)
+                       { return centroid[a][dim] < centroid[b][dim]; });
+      writeChunks(out,mesh,centroid,begin,mid,maxTriangles,chunks);
+      writeChunks(out,mesh,centroid,mid,end,maxTriangles,chunks);
+      return;
+    }
+
+    // leaf: build a self-contained little mesh with local vertex IDs
+    std::map<int,int> localID;
+    std::vector<vec3f> vertex;
+    std::vector<vec3i> index;
+    std::vector<vec3f> triangleColor;
+    std::vector<vec3f> vertexColor, normal;
+    std::vector<vec2f> texcoord;
+    MeshChunk chunk;
+    for (int *it=begin;it!=end;it++) {
+      vec3i idx = mesh.index[*it];
+      for (int c=0;c<3;c++) {
+        auto found = localID.find(idx[c]);
+        if (found == localID.end()) {
+          found = localID.insert(std::make_pair(idx[c],(int)vertex.size())).first;
+          vertex.push_back(mesh.vertex[idx[c]]);
+          chunk.bounds.extend(vertex.back());
+          if (!mesh.vertexColor.empty()) vertexColor.push_back(mesh.vertexColor[idx[c]]);
+          if (!mesh.normal.empty())      normal.push_back(mesh.normal[idx[c]]);
+          if (!mesh.texcoord.empty())    texcoord.push_back(mesh.texcoord[idx[c]]);
+        }
+        idx[c] = found->second;
+      }
+      index.push_back(idx);
+      if (!mesh.triangleColor.empty())
+        triangleColor.push_back(mesh.triangleColor[*it]);
+    }
+    
+    chunk.color        = mesh.color;
+    chunk.offset       = (uint64_t)out.tellp();
+    chunk.numVertices  = (uint32_t)vertex.size();
+    chunk.numTriangles = (uint32_t)index.size();
+    chunk.hasTriangleColors = !triangleColor.empty();
+    chunk.hasVertexColors   = !vertexColor.empty();
+    chunk.hasNormals        = !normal.empty();
+    chunk.hasTexcoords      = !texcoord.empty();
+    out.write((const char *)vertex.data(),vertex.size()*sizeof(vec3f));
+    out.write((const char *)index.data(),index.size()*sizeof(vec3i));
+    out.write((const char *)triangleColor.data(),triangleColor.size()*sizeof(vec3f));
+    out.write((const char *)vertexColor.data(),vertexColor.size()*sizeof(vec3f));
+    out.write((const char *)normal.data(),normal.size()*sizeof(vec3f));
+    out.write((const char *)texcoord.data(),texcoord.size()*sizeof(vec2f));
+    chunks.push_back(chunk);
+  }
+  
+  ChunkFileWriter::ChunkFileWriter(const std::string &fileName,
+                                   size_t maxTrianglesPerChunk)
+    : fileName(fileName),
+      maxTrianglesPerChunk(maxTrianglesPerChunk),
+      out(fileName,std::ios::binary)
+  {
+    if (!out.good())
+      throw std::runtime_error("could not open chunk file '"+fileName+"' for writing");
+
+    // header: magic, plus number of chunks and offset of the chunk
+    // table, which close() patches in at the end
+    const uint64_t numChunks = 0, tableOffset = 0;
+    out.write(chunkFileMagic,sizeof(chunkFileMagic));
+    writeField(out,numChunks);
+    writeField(out,tableOffset);
+  }
+
+  ChunkFileWriter::~ChunkFileWriter()
+  {
+    if (out.is_open())
+      try { close(); } catch (std::runtime_error &) {}
+  }
+
+  void ChunkFileWriter::add(const TriangleMesh &mesh)
+  {
+    if (mesh.index.empty()) return;
+    std::vector<vec3f> centroid(mesh.index.size());
+    std::vector<int>   triangleIDs(mesh.index.size());
+    for (size_t i=0;i<mesh.index.size();i++) {
+      const vec3i idx = mesh.index[i];
+      centroid[i] = (mesh.vertex[idx.x]+mesh.vertex[idx.y]+mesh.vertex[idx.z])*(1.f/3.f);
+      triangleIDs[i] = (int)i;
+    }
+    writeChunks(out,mesh,centroid,
+                triangleIDs.data(),triangleIDs.data()+triangleIDs.size(),
+                maxTrianglesPerChunk,chunks);
+  }
+
+  void ChunkFileWriter::close()
+  {
+    const uint64_t numChunks   = chunks.size();
+    const uint64_t tableOffset = (uint64_t)out.tellp();
+    for (auto &chunk : chunks)
+      writeTableEntry(out,chunk);
+    out.seekp(sizeof(chunkFileMagic));
+    writeField(out,numChunks);
+    writeField(out,tableOffset);
+    const bool good = out.good();
+    out.close();
+    if (!good)
+      throw std::runtime_error("error writing chunk file '"+fileName+"'");
+
+    std::cout << "#osc: wrote " << chunks.size() << " chunks to '" << fileName << "'" << std::endl;
+  }
+
+  void writeChunkFile(const std::string &fileName,
+                      const Geometry &scene,
+                      size_t maxTrianglesPerChunk)
+  {
+    ChunkFileWriter writer(fileName,maxTrianglesPerChunk);
+    for (auto &mesh : scene.meshes)
+      writer.add(mesh);
+    writer.close();
+  }
+
+  ChunkFile::ChunkFile(const std::string &fileName)
+    : in(fileName,std::ios::binary)
+  {
+    char magic[sizeof(chunkFileMagic)];
+    uint64_t numChunks = 0, tableOffset = 0;
+    in.read(magic,sizeof(magic));
+    readField(in,numChunks);
+    readField(in,tableOffset);
+    if (!in.good() || memcmp(magic,chunkFileMagic,sizeof(magic)) != 0)
+      throw std::runtime_error("'"+fileName+"' is not a valid chunk file");
+    // (the writer only patches in the table offset once it's done)
+    if (tableOffset == 0)
+      throw std::runtime_error("chunk file '"+fileName+"' is incomplete");
+    
+    chunks.resize(numChunks);
+    in.seekg(tableOffset);
+    for (auto &chunk : chunks)
+      readTableEntry(in,chunk);
+    if (!in.good())
+      throw std::runtime_error("could not read chunk table from '"+fileName+"'");
+  }
+
+  std::shared_ptr<const TriangleMesh> ChunkFile::load(size_t chunkID)
+  {
+    const MeshChunk &chunk = chunks[chunkID];
+    std::shared_ptr<TriangleMesh> mesh = std::make_shared<TriangleMesh>();
+    mesh->color = chunk.color;
+    mesh->vertex.resize(chunk.numVertices);
+    mesh->index.resize(chunk.numTriangles);
+    in.seekg(chunk.offset);
+    in.read((char *)mesh->vertex.data(),chunk.numVertices*sizeof(vec3f));
+    in.read((char *)mesh->index.data(),chunk.numTriangles*sizeof(vec3i));
+    if (chunk.hasTriangleColors) {
+      mesh->triangleColor.resize(chunk.numTriangles);
+      in.read((char *)mesh->triangleColor.data(),chunk.numTriangles*sizeof(vec3f));
+    }
+    if (chunk.hasVertexColors) {
+      mesh->vertexColor.resize(chunk.numVertices);
+      in.read((char *)mesh->vertexColor.data(),chunk.numVertices*sizeof(vec3f));
+    }
+    if (chunk.hasNormals) {
+      mesh->normal.resize(chunk.numVertices);
+      in.read((char *)mesh->normal.data(),chunk.numVertices*sizeof(vec3f));
+    }
+    if (chunk.hasTexcoords) {
+      mesh->texcoord.resize(chunk.numVertices);
+      in.read((char *)mesh->texcoord.data(),chunk.numVertices*sizeof(vec2f));
+    }
+    if (!in.good())
+      throw std::runtime_error("could not read chunk data");
+    return mesh;
+  }
+
+  ChunkCache::ChunkCache(ChunkFile &file, size_t memoryBudgetInBytes)
+    : file(file),
+      memoryBudget(memoryBudgetInBytes)
+  {}
+
+  void ChunkCache::beginFrame()
+  {
+    stats = ChunkCacheStats();
+    ++frameID;
+  }
+  
+  std::shared_ptr<const TriangleMesh> ChunkCache::get(size_t chunkID)
+  {
+    stats.numRequests++;
+    auto found = resident.find(chunkID);
+    if (found != resident.end()) {
+      stats.numHits++;
+      lru.splice(lru.begin(),lru,found->second.lru);
+      found->second.lastFrame = frameID;
+      return found->second.mesh;
+    }
+
+    // make room, but never evict anything that's been requested in
+    // this very frame (those are the ones at the front of the list)
+    const size_t chunkSize = file.chunks[chunkID].sizeInBytes();
+    while (memoryUsed + chunkSize > memoryBudget && !lru.empty()) {
+      auto victim = resident.find(lru.back());
+      if (victim->second.lastFrame == frameID) break;
+      memoryUsed -= file.chunks[victim->first].sizeInBytes();
+      lru.pop_back();
+      resident.erase(victim);
+      stats.numEvictions++;
+    }
+    if (memoryUsed + chunkSize > memoryBudget) {
+      stats.numSkipped++;
+      return nullptr;
+    }
+    
+    const double t0 = getCurrentTime();
+    Entry entry;
+    entry.mesh = file.load(chunkID);
+    const double t1 = getCurrentTime();
+    stats.numPageIns++;
+    stats.bytesPagedIn += chunkSize;
+    stats.pageInTime   += t1-t0;
+    memoryUsed         += chunkSize;
+    
+    lru.push_front(chunkID);
+    entry.lru       = lru.begin();
+    entry.lastFrame = frameID;
+    resident[chunkID] = entry;
+    return entry.mesh;
+  }
+
+  std::vector<size_t> ChunkCache::findVisibleChunks(const Camera &camera,
+                                                    float aspect) const
+  {
+    // same camera model as SampleRenderer::setCamera()
+    const float cosFovy = 0.66f;
+    const vec3f dir = normalize(camera.at-camera.from);
+    const vec3f du  = cosFovy * aspect * normalize(cross(dir,camera.up));
+    const vec3f dv  = cosFovy * normalize(cross(du,dir));
+    const vec3f corner[4] = {
+      dir - .5f*du - .5f*dv,
+      dir + .5f*du - .5f*dv,
+      dir + .5f*du + .5f*dv,
+      dir - .5f*du + .5f*dv
+    };
+    // the four side planes through the camera position, normals
+    // pointing inwards
+    vec3f N[4];
+    for (int i=0;i<4;i++) {
+      N[i] = cross(corner[i],corner[(i+1)%4]);
+      if (dot(N[i],dir) < 0.f) N[i] = -N[i];
+    }
+
+    std::vector<std::pair<float,size_t>> visible;
+    for (size_t chunkID=0;chunkID<file.chunks.size();chunkID++) {
+      const box3f &box = file.chunks[chunkID].bounds;
+      bool culled = false;
+      for (int i=0;i<4 && !culled;i++) {
+        // the box corner that's furthest along the plane normal
+        const vec3f p(N[i].x > 0.f ? box.upper.x : box.lower.x,
+                      N[i].y > 0.f ? box.upper.y : box.lower.y,
+                      N[i].z > 0.f ? box.upper.z : box.lower.z);
+        culled = dot(N[i],p-camera.from) < 0.f;
+      }
+      if (!culled)
+        visible.push_back(std::make_pair(length(box.center()-camera.from),chunkID));
+    }
+    std::sort(visible.begin(),visible.end());
+
+    std::vector<size_t> result;
+    for (auto &v : visible) result.push_back(v.second);
+    return result;
+  }
+  
+} // ::osc
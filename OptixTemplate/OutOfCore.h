@@ -0,0 +1,159 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "Geometry.h"
+#include "gdt/math/box.h"
+#include <fstream>
+#include <list>
+#include <map>
+#include <memory>
+
+namespace osc {
+
+  /*! table entry for one chunk in a chunk file. the table of all
+      chunks (and thus, all chunk bounds) stays resident, the actual
+      vertex/index data gets paged in on demand. (in the file, the
+      table gets stored field by field, so it doesn't depend on
+      this struct's layout) */
+  struct MeshChunk {
+    box3f    bounds;
+    vec3f    color             { 0.f };
+    /*! byte offset of this chunk's vertex data in the file; index
+        data (and per-triangle colors, and per-vertex colors,
+        normals, and texture coordinates, if any, in that order)
+        follow right after that */
+    uint64_t offset            { 0 };
+    uint32_t numVertices       { 0 };
+    uint32_t numTriangles      { 0 };
+    uint32_t hasTriangleColors { 0 };
+    uint32_t hasVertexColors   { 0 };
+    uint32_t hasNormals        { 0 };
+    uint32_t hasTexcoords      { 0 };
+
+    size_t sizeInBytes() const
+    {
+      return numVertices*sizeof(vec3f) + numTriangles*sizeof(vec3i)
+        + (hasTriangleColors ? numTriangles*sizeof(vec3f) : 0)
+        + (hasVertexColors   ? numVertices*sizeof(vec3f)  : 0)
+        + (hasNormals        ? numVertices*sizeof(vec3f)  : 0)
+        + (hasTexcoords      ? numVertices*sizeof(vec2f)  : 0);
+    }
+  };
+
+  /*! writes a chunk file one mesh at a time, so the meshes can be
+      streamed in (eg, loaded and preprocessed one file at a time)
+      without ever having all of them in memory; each mesh gets split
+      into spatially coherent chunks of at most maxTrianglesPerChunk
+      triangles each. only the (small) chunk table stays in memory
+      until close() writes it */
+  struct ChunkFileWriter {
+    ChunkFileWriter(const std::string &fileName,
+                    size_t maxTrianglesPerChunk = 64*1024);
+    /*! closes the file if that hasn't happened yet (but then can't
+        report errors) */
+    ~ChunkFileWriter();
+
+    void add(const TriangleMesh &mesh);
+    /*! write the chunk table; the file is complete only after this */
+    void close();
+
+    size_t numChunks() const { return chunks.size(); }
+  private:
+    const std::string      fileName;
+    const size_t           maxTrianglesPerChunk;
+    std::ofstream          out;
+    std::vector<MeshChunk> chunks;
+  };
+
+  /*! writes all meshes of the given scene to the given chunk file;
+      see ChunkFileWriter */
+  void writeChunkFile(const std::string &fileName,
+                      const Geometry &scene,
+                      size_t maxTrianglesPerChunk = 64*1024);
+
+  /*! read-only view of a chunk file written by ChunkFileWriter */
+  struct ChunkFile {
+    ChunkFile(const std::string &fileName);
+
+    /*! read the given chunk's data from disk */
+    std::shared_ptr<const TriangleMesh> load(size_t chunkID);
+
+    std::vector<MeshChunk> chunks;
+  private:
+    std::ifstream in;
+  };
+
+  /*! per-frame statistics of a chunk cache */
+  struct ChunkCacheStats {
+    size_t numRequests  { 0 };
+    size_t numHits      { 0 };
+    size_t numPageIns   { 0 };
+    size_t numEvictions { 0 };
+    size_t numSkipped   { 0 };
+    size_t bytesPagedIn { 0 };
+    double pageInTime   { 0. };
+
+    float  hitRate() const
+    { return numRequests ? numHits/float(numRequests) : 1.f; }
+    /*! in bytes per second */
+    double pageInBandwidth() const
+    { return pageInTime > 0. ? bytesPagedIn/pageInTime : 0.; }
+  };
+  
+  /*! LRU cache of chunks paged in from a chunk file, subject to a
+      fixed memory budget */
+  struct ChunkCache {
+    ChunkCache(ChunkFile &file, size_t memoryBudgetInBytes);
+
+    /*! reset the per-frame statistics */
+    void beginFrame();
+    
+    /*! request the given chunk, paging it in (and evicting least
+        recently used chunks to stay within budget) if required. in
+        the unlikely case that the chunk doesn't fit into the budget
+        at all - even after evicting everything not requested this
+        frame - this returns a null pointer. the chunk is the
+        cache's own, not a copy; don't hold on to it past the frame,
+        or it'll outlive its share of the budget */
+    std::shared_ptr<const TriangleMesh> get(size_t chunkID);
+
+    /*! find all chunks whose bounds overlap the given camera's view
+        frustum, sorted front to back */
+    std::vector<size_t> findVisibleChunks(const Camera &camera,
+                                          float aspect) const;
+    
+    ChunkFile      &file;
+    const size_t    memoryBudget;
+    size_t          memoryUsed { 0 };
+    ChunkCacheStats stats;
+    
+  private:
+    struct Entry {
+      std::shared_ptr<const TriangleMesh> mesh;
+      /*! position in the lru list */
+      std::list<size_t>::iterator         lru;
+      /*! frame in which this chunk got requested last */
+      size_t                              lastFrame;
+    };
+    std::map<size_t,Entry> resident;
+    /*! resident chunk IDs, most recently used first */
+    std::list<size_t>      lru;
+    size_t                 frameID { 0 };
+  };
+  
+} // ::osc
@@ -15,6 +15,12 @@
 // ======================================================================== //
 
 #include "SampleRenderer.h"
+#include "MeshSimplification.h"
+#include "Scenes.h"
+#include "gdt/parallel/parallel_for.h"
+#include "gdt/parallel/TaskGraph.h"
+#include "gdt/profile/Profiler.h"
+#include <cstring>
 // this include may only appear in a single source file:
 #include <optix_function_table_definition.h>
 
@@ -48,90 +54,116 @@ namespace osc {
   };
 
 
-  //! add aligned cube with front-lower-left corner and size
-  void Geometry::addCube(const vec3f &center, const vec3f &size, const vec3f& color)
+  /*! (uploads work on pointers, so that meshes owned by somebody
+      else don't need to get copied into a vector of our own first) */
+  static std::vector<const TriangleMesh *> pointersTo(const std::vector<TriangleMesh> &meshes)
   {
-    PING;
-    affine3f xfm;
-    xfm.p = center - 0.5f*size;
-    xfm.l.vx = vec3f(size.x,0.f,0.f);
-    xfm.l.vy = vec3f(0.f,size.y,0.f);
-    xfm.l.vz = vec3f(0.f,0.f,size.z);
-    addUnitCube(xfm, color);
+    std::vector<const TriangleMesh *> pointers;
+    for (auto &mesh : meshes) pointers.push_back(&mesh);
+    return pointers;
   }
-  
-  /*! add a unit cube (subject to given xfm matrix) to the current
-      triangleMesh */
-  void Geometry::addUnitCube(const affine3f &xfm, const vec3f& color)
-  {
-    TriangleMesh cube;
-    cube.color = color;
-    int firstVertexID = (int)cube.vertex.size();
-    cube.vertex.push_back(xfmPoint(xfm,vec3f(0.f,0.f,0.f)));
-    cube.vertex.push_back(xfmPoint(xfm,vec3f(1.f,0.f,0.f)));
-    cube.vertex.push_back(xfmPoint(xfm,vec3f(0.f,1.f,0.f)));
-    cube.vertex.push_back(xfmPoint(xfm,vec3f(1.f,1.f,0.f)));
-    cube.vertex.push_back(xfmPoint(xfm,vec3f(0.f,0.f,1.f)));
-    cube.vertex.push_back(xfmPoint(xfm,vec3f(1.f,0.f,1.f)));
-    cube.vertex.push_back(xfmPoint(xfm,vec3f(0.f,1.f,1.f)));
-    cube.vertex.push_back(xfmPoint(xfm,vec3f(1.f,1.f,1.f)));
-
-
-    int indices[] = {0,1,3, 2,3,0,
-                     5,7,6, 5,6,4,
-                     0,4,5, 0,5,1,
-                     2,3,7, 2,7,6,
-                     1,5,7, 1,7,3,
-                     4,0,2, 4,2,6
-                     };
-    for (int i=0;i<12;i++)
-     cube.index.push_back(firstVertexID+vec3i(indices[3*i+0],
-                                          indices[3*i+1],
-                                          indices[3*i+2]));
-
-    meshes.push_back(cube);
-  }
-    
-  void Geometry::addSphere(const float r, const vec3f cen, const vec3f col) {
-      Sphere s;
-      s.radius = r;
-      s.color = col;
-      s.center = cen;
-      spheres.push_back(s);
-  }
-  
+
   /*! constructor - performs all setup, including initializing
-    optix, creates module, pipeline, programs, SBT, etc. */
-  SampleRenderer::SampleRenderer(const Geometry &scene)
-    : scene(scene)
+    optix, creates module, pipeline, programs, SBT, etc. (as far as
+    they don't depend on each other, concurrently) */
+  SampleRenderer::SampleRenderer(const Geometry &scene, int numFramesInFlight,
+                                 int deviceID)
+    : deviceID(deviceID),
+      frameRing(numFramesInFlight),
+      scene(scene)
   {
-    initOptix();
-      
-    std::cout << "#osc: creating optix context ..." << std::endl;
-    createContext();
-      
-    std::cout << "#osc: setting up module ..." << std::endl;
-    createModule();
-
-    std::cout << "#osc: creating raygen programs ..." << std::endl;
-    createRaygenPrograms();
-    std::cout << "#osc: creating miss programs ..." << std::endl;
-    createMissPrograms();
-    std::cout << "#osc: creating hitgroup programs ..." << std::endl;
-    createHitgroupPrograms();
-
-    OptixTraversableHandle meshesGAS = buildAccelMeshes();
-    OptixTraversableHandle spheresGAS = buildAccelSpheres();
-    OptixTraversableHandle sceneTAS = buildAccelInstances(meshesGAS, spheresGAS);
-    launchParams.traversable = sceneTAS;
+    // setup is a graph of tasks, so that compiling programs (which
+    // is mostly host work in the driver) overlaps with preparing,
+    // uploading, and building the geometry
+    TaskGraph init;
+    // all tasks but the first run on the context that one creates;
+    // each thread needs to make that current before using it
+    auto onContext = [this](const std::function<void()> &task) {
+      return [this,task]() {
+        makeCurrent();
+        task();
+      };
+    };
     
-    std::cout << "#osc: setting up optix pipeline ..." << std::endl;
-    createPipeline();
-
-    std::cout << "#osc: building SBT ..." << std::endl;
-    buildSBT();
+    const TaskGraph::TaskID context
+      = init.add("context",[this](){
+          initOptix();
+          std::cout << "#osc: creating optix context ..." << std::endl;
+          createContext();
+        });
+    
+    const TaskGraph::TaskID module
+      = init.add("module",onContext([this](){ createModule(); }),{context});
+    const TaskGraph::TaskID raygenPrograms
+      = init.add("raygenPrograms",onContext([this](){ createRaygenPrograms(); }),{module});
+    const TaskGraph::TaskID missPrograms
+      = init.add("missPrograms",onContext([this](){ createMissPrograms(); }),{module});
+    const TaskGraph::TaskID hitgroupPrograms
+      = init.add("hitgroupPrograms",onContext([this](){ createHitgroupPrograms(); }),{module});
+    const TaskGraph::TaskID pipeline
+      = init.add("pipeline",onContext([this](){ createPipeline(); }),
+                 {raygenPrograms,missPrograms,hitgroupPrograms});
+
+    const TaskGraph::TaskID meshAccel
+      = init.add("meshAccel",onContext([this](){
+            meshesGAS = buildAccelMeshes(pointersTo(this->scene.meshes));
+          }),{context});
+    const TaskGraph::TaskID sphereAccel
+      = init.add("sphereAccel",onContext([this](){ spheresGAS = buildAccelSpheres(); }),{context});
+    const TaskGraph::TaskID lodAccels
+      = init.add("lodAccels",onContext([this](){ buildAccelLODs(); }),{context});
+    const TaskGraph::TaskID instanceAccel
+      = init.add("instanceAccel",onContext([this](){
+            launchParams.traversable = buildAccelInstances(meshesGAS, spheresGAS);
+          }),{meshAccel,sphereAccel,lodAccels});
+
+    // the SBT needs the program groups (for the record headers), and
+    // the geometry's device buffers (for the record data)
+    init.add("SBT",onContext([this](){ buildSBT(); }),
+             {raygenPrograms,missPrograms,hitgroupPrograms,
+              meshAccel,sphereAccel,lodAccels});
+    
+    init.add("frames",onContext([this,numFramesInFlight](){
+          frames.resize(numFramesInFlight);
+          for (auto &frame : frames) {
+            frame.launchParamsBuffer.alloc(sizeof(LaunchParams));
+            CUDA_CHECK(MallocHost((void**)&frame.hostLaunchParams,sizeof(LaunchParams)));
+            frame.rayStatsBuffer.alloc(RAY_STATS_BINS*sizeof(RayStats));
+            CUDA_CHECK(MallocHost((void**)&frame.hostRayStats,RAY_STATS_BINS*sizeof(RayStats)));
+            CUDA_CHECK(EventCreate(&frame.begin));
+            CUDA_CHECK(EventCreate(&frame.done));
+          }
+        }),{context});
+
+    // most tasks wait on the driver or the gpu rather than compute,
+    // so run (at least) as many threads as there are independent
+    // chains of tasks
+    init.run(std::max(getNumThreads(),size_t(4)));
+    // the calling thread may not have run 'context'
+    makeCurrent();
+    init.printTimings(std::cout,"#osc: setup ");
+
+    compileTime = init.span({module,raygenPrograms,missPrograms,hitgroupPrograms,pipeline});
+    accelBuildTime = init.span({meshAccel,sphereAccel,lodAccels,instanceAccel});
+    if (moduleCacheWarm) {
+      std::cout << "#osc: module, programs, and pipeline took " << prettyDouble(compileTime)
+                << "s (warm start; cold start took " << prettyDouble(coldCompileTime)
+                << "s)" << std::endl;
+    } else {
+      std::cout << "#osc: module, programs, and pipeline took " << prettyDouble(compileTime)
+                << "s (cold start)" << std::endl;
+      if (moduleCacheEnabled) {
+        try {
+          moduleCache.store(moduleCacheKey,compileTime);
+        } catch (std::runtime_error &e) {
+          // the next start will just be a cold one again
+          std::cout << GDT_TERMINAL_RED << "#osc: warning: " << e.what()
+                    << GDT_TERMINAL_DEFAULT << std::endl;
+        }
+      }
+    }
+    std::cout << "#osc: accel builds took " << prettyDouble(accelBuildTime) << "s" << std::endl;
 
-    launchParamsBuffer.alloc(sizeof(launchParams));
     std::cout << "#osc: context, module, pipeline, etc, all set up ..." << std::endl;
 
     std::cout << GDT_TERMINAL_GREEN;
@@ -139,23 +171,136 @@ namespace osc {
     std::cout << GDT_TERMINAL_DEFAULT;
   }
 
-  OptixTraversableHandle SampleRenderer::buildAccelMeshes()
+  /*! (nothing here throws: there's nobody left to handle errors, so
+      we just go on with freeing the rest) */
+  SampleRenderer::~SampleRenderer()
   {
-    vertexBuffer.resize(scene.meshes.size());
-    indexBuffer.resize(scene.meshes.size());
+    if (!cudaContext || cuCtxSetCurrent(cudaContext) != CUDA_SUCCESS)
+      return;
+    if (stream)
+      cudaStreamSynchronize(stream);
+
+    auto release = [](CUDABuffer &buffer) {
+      if (buffer.d_ptr) cudaFree(buffer.d_ptr);
+      buffer.d_ptr = nullptr;
+      buffer.sizeInBytes = 0;
+    };
+    auto releaseAll = [&](std::vector<CUDABuffer> &buffers) {
+      for (auto &buffer : buffers) release(buffer);
+    };
+    auto releaseAttributes = [&](std::vector<MeshAttributeBuffers> &buffers) {
+      for (auto &attributes : buffers) {
+        release(attributes.triangleColor);
+        release(attributes.vertexColor);
+        release(attributes.normal);
+      }
+    };
     
+    for (auto &frame : frames) {
+      release(frame.colorBuffer);
+      release(frame.launchParamsBuffer);
+      release(frame.rayStatsBuffer);
+      if (frame.hostLaunchParams) cudaFreeHost(frame.hostLaunchParams);
+      if (frame.hostPixels)       cudaFreeHost(frame.hostPixels);
+      if (frame.hostRayStats)     cudaFreeHost(frame.hostRayStats);
+      if (frame.begin) cudaEventDestroy(frame.begin);
+      if (frame.done)  cudaEventDestroy(frame.done);
+    }
+    frames.clear();
+
+    // geometry and accels
+    releaseAll(vertexBuffer);
+    releaseAll(indexBuffer);
+    releaseAttributes(attributeBuffer);
+    releaseAll(bakedLightBuffer);
+    release(sphereCenterBuffer);
+    release(sphereRadiusBuffer);
+    release(sphereColorBuffer);
+    release(meshBlasBuffer);
+    release(sphereBlasBuffer);
+    release(sceneTlasBuffer);
+    releaseAll(lodVertexBuffer);
+    releaseAll(lodIndexBuffer);
+    releaseAttributes(lodAttributeBuffer);
+    releaseAll(lodBlasBuffer);
+
+    // per-pixel state
+    release(rateMapBuffer);
+    for (auto &h : history) {
+      release(h.color);
+      release(h.depth);
+      release(h.hitID);
+      release(h.age);
+    }
+    release(reprojectedBuffer);
+    release(radianceCacheBuffer);
+    release(occluderBuffer);
+
+    // SBT, pipeline, programs, module, and the contexts
+    release(raygenRecordsBuffer);
+    release(missRecordsBuffer);
+    release(hitgroupRecordsBuffer);
+    if (pipeline) optixPipelineDestroy(pipeline);
+    for (auto pg : raygenPGs)   optixProgramGroupDestroy(pg);
+    for (auto pg : missPGs)     optixProgramGroupDestroy(pg);
+    for (auto pg : hitgroupPGs) optixProgramGroupDestroy(pg);
+    if (module) optixModuleDestroy(module);
+    if (optixContext) optixDeviceContextDestroy(optixContext);
+    if (stream) cudaStreamDestroy(stream);
+    // (the cuda context is the device's primary one, which the
+    // runtime owns, and other renderers may share)
+  }
+
+  OptixTraversableHandle SampleRenderer::buildAccelMeshes(const std::vector<const TriangleMesh *> &meshes)
+  {
+    vertexBuffer.resize(meshes.size());
+    indexBuffer.resize(meshes.size());
+    attributeBuffer.resize(meshes.size());
+    // only needed for shading, and only these meshes can have it
+    bakedLightBuffer.resize(meshes.size());
+    for (size_t meshID=0;meshID<meshes.size();meshID++)
+      if (!meshes[meshID]->bakedLight.empty())
+        bakedLightBuffer[meshID].alloc_and_upload(meshes[meshID]->bakedLight);
+    return buildAccelTriangles(meshes.data(),meshes.size(),
+                               vertexBuffer.data(),indexBuffer.data(),
+                               attributeBuffer.data(),
+                               meshBlasBuffer);
+  }
+
+  /*! build a (compacted) acceleration structure over the given
+      triangle meshes, uploading their vertices, indices, and
+      attribute streams (if any) to the given (one per mesh)
+      buffers */
+  OptixTraversableHandle SampleRenderer::buildAccelTriangles(const TriangleMesh *const *meshes,
+                                                             size_t numMeshes,
+                                                             CUDABuffer *vertexBuffer,
+                                                             CUDABuffer *indexBuffer,
+                                                             MeshAttributeBuffers *attributeBuffer,
+                                                             CUDABuffer &blasBuffer)
+  {
+    GDT_PROFILE_SCOPE("buildAccelTriangles");
     OptixTraversableHandle asHandle { 0 };
+    // optix doesn't allow builds without any build inputs
+    if (numMeshes == 0) return asHandle;
     
-	std::vector<OptixBuildInput> geometryInput(scene.meshes.size());
-    std::vector<CUdeviceptr> d_vertices(scene.meshes.size());
-	std::vector<CUdeviceptr> d_indices(scene.meshes.size());
-	std::vector<uint32_t> geometryInputFlags(scene.meshes.size());
+	std::vector<OptixBuildInput> geometryInput(numMeshes);
+    std::vector<CUdeviceptr> d_vertices(numMeshes);
+	std::vector<CUdeviceptr> d_indices(numMeshes);
+	std::vector<uint32_t> geometryInputFlags(numMeshes);
 
-    for (int meshID=0;meshID< scene.meshes.size();meshID++) {
-        TriangleMesh& mesh = scene.meshes[meshID];
+    for (int meshID=0;meshID< numMeshes;meshID++) {
+        const TriangleMesh& mesh = *meshes[meshID];
         // upload the model to the device: the builder
         vertexBuffer[meshID].alloc_and_upload(mesh.vertex);
         indexBuffer[meshID].alloc_and_upload(mesh.index);
+        // only needed for shading, but this is where all mesh data
+        // goes to the device
+        if (!mesh.triangleColor.empty())
+          attributeBuffer[meshID].triangleColor.alloc_and_upload(mesh.triangleColor);
+        if (!mesh.vertexColor.empty())
+          attributeBuffer[meshID].vertexColor.alloc_and_upload(mesh.vertexColor);
+        if (!mesh.normal.empty())
+          attributeBuffer[meshID].normal.alloc_and_upload(mesh.normal);
 
         geometryInput[meshID] = {};
         geometryInput[meshID].type
@@ -202,7 +347,7 @@ namespace osc {
                 (optixContext,
                  &accelOptions,
                  geometryInput.data(),
-                 (int)scene.meshes.size(),  // num_build_inputs
+                 (int)numMeshes,  // num_build_inputs
                  &blasBufferSizes
                  ));
     
@@ -231,7 +376,7 @@ namespace osc {
                                 /* stream */0,
                                 &accelOptions,
                                 geometryInput.data(),
-                                (int)scene.meshes.size(),
+                                (int)numMeshes,
                                 tempBuffer.d_pointer(),
                                 tempBuffer.sizeInBytes,
                                 
@@ -250,12 +395,12 @@ namespace osc {
     uint64_t compactedSize;
     compactedSizeBuffer.download(&compactedSize,1);
     
-    meshBlasBuffer.alloc(compactedSize);
+    blasBuffer.alloc(compactedSize);
     OPTIX_CHECK(optixAccelCompact(optixContext,
                                   /*stream:*/0,
                                   asHandle,
-                                  meshBlasBuffer.d_pointer(),
-                                  meshBlasBuffer.sizeInBytes,
+                                  blasBuffer.d_pointer(),
+                                  blasBuffer.sizeInBytes,
                                   &asHandle));
     CUDA_SYNC_CHECK();
     
@@ -272,43 +417,55 @@ namespace osc {
 
   OptixTraversableHandle SampleRenderer::buildAccelSpheres()
   {
-      aabbBuffer.resize(scene.spheres.size());
-
+    GDT_PROFILE_SCOPE("buildAccelSpheres");
       OptixTraversableHandle asHandle{ 0 };
+      // optix doesn't allow builds without any build inputs
+      if (scene.spheres.empty()) return asHandle;
 
       // ==================================================================
-      // triangle inputs
+      // sphere inputs: all spheres go into a single build input, with
+      // center, radius and color each in their own array, indexed by
+      // primitive ID. optix still needs one aabb per primitive for the
+      // build, but we only keep those around until the build is done.
       // ==================================================================
-      std::vector<OptixBuildInput> geometryInput(scene.spheres.size());
-      std::vector<CUdeviceptr> d_vertices(scene.spheres.size());
-      std::vector<uint32_t> geometryInputFlags(scene.spheres.size());
-
-      for (int sphereID = 0; sphereID < scene.spheres.size(); sphereID++) {
-            Sphere& model = scene.spheres[sphereID];
-            vec3f lowerbound = model.center - vec3f(-model.radius, -model.radius, -model.radius);
-            OptixAabb   aabb = { model.center.x -model.radius,  model.center.y -model.radius,  model.center.z -model.radius,  model.center.x + model.radius,  model.center.y + model.radius,  model.center.z + model.radius };
-            aabbBuffer[sphereID].alloc_and_upload(aabb);
-
-            geometryInput[sphereID] = {};
-            geometryInput[sphereID].type
-                = OPTIX_BUILD_INPUT_TYPE_CUSTOM_PRIMITIVES;
-
-            d_vertices[sphereID] = aabbBuffer[sphereID].d_pointer();
-
-            geometryInput[sphereID].aabbArray.aabbBuffers = &d_vertices[sphereID];
-            geometryInput[sphereID].aabbArray.numPrimitives = 1;
-            geometryInput[sphereID].aabbArray.strideInBytes = 0;
-
-
-            geometryInputFlags[sphereID] = OPTIX_GEOMETRY_FLAG_NONE;
+      const size_t numSpheres = scene.spheres.size();
+      std::vector<vec3f>     center(numSpheres);
+      std::vector<float>     radius(numSpheres);
+      std::vector<vec3f>     color(numSpheres);
+      std::vector<OptixAabb> aabbs(numSpheres);
+      parallel_for_blocked(0,numSpheres,16*1024,[&](size_t begin, size_t end){
+          for (size_t sphereID = begin; sphereID < end; sphereID++) {
+              const Sphere &sphere = scene.spheres[sphereID];
+              center[sphereID] = sphere.center;
+              radius[sphereID] = sphere.radius;
+              color[sphereID]  = sphere.color;
+              const vec3f lower = sphere.center - vec3f(sphere.radius);
+              const vec3f upper = sphere.center + vec3f(sphere.radius);
+              aabbs[sphereID] = { lower.x, lower.y, lower.z, upper.x, upper.y, upper.z };
+          }
+      });
+      sphereCenterBuffer.alloc_and_upload(center);
+      sphereRadiusBuffer.alloc_and_upload(radius);
+      sphereColorBuffer.alloc_and_upload(color);
+      
+      CUDABuffer aabbBuffer;
+      aabbBuffer.alloc_and_upload(aabbs);
+      CUdeviceptr d_aabbs = aabbBuffer.d_pointer();
+      uint32_t geometryInputFlags = OPTIX_GEOMETRY_FLAG_NONE;
+
+      std::vector<OptixBuildInput> geometryInput(1);
+      geometryInput[0] = {};
+      geometryInput[0].type = OPTIX_BUILD_INPUT_TYPE_CUSTOM_PRIMITIVES;
+      geometryInput[0].aabbArray.aabbBuffers = &d_aabbs;
+      geometryInput[0].aabbArray.numPrimitives = (int)numSpheres;
+      geometryInput[0].aabbArray.strideInBytes = 0;
+      geometryInput[0].aabbArray.flags = &geometryInputFlags;
+      geometryInput[0].aabbArray.numSbtRecords = 1;
+      geometryInput[0].aabbArray.sbtIndexOffsetBuffer = 0;
+      geometryInput[0].aabbArray.sbtIndexOffsetSizeInBytes = 0;
+      geometryInput[0].aabbArray.sbtIndexOffsetStrideInBytes = 0;
+      geometryInput[0].aabbArray.primitiveIndexOffset = 0;
 
-            geometryInput[sphereID].aabbArray.flags = &geometryInputFlags[sphereID];
-            geometryInput[sphereID].aabbArray.numSbtRecords = 1;
-            geometryInput[sphereID].aabbArray.sbtIndexOffsetBuffer = 0;
-            geometryInput[sphereID].aabbArray.sbtIndexOffsetSizeInBytes = 0;
-            geometryInput[sphereID].aabbArray.sbtIndexOffsetStrideInBytes = 0;
-            geometryInput[sphereID].aabbArray.primitiveIndexOffset = 0;
-      }
       // ==================================================================
       // BLAS setup
       // ==================================================================
@@ -325,7 +482,7 @@ namespace osc {
       (optixContext,
           &accelOptions,
           geometryInput.data(),
-          (int)scene.spheres.size(),  // num_build_inputs
+          1,  // num_build_inputs
           &blasBufferSizes
       ));
 
@@ -354,7 +511,7 @@ namespace osc {
           /* stream */0,
           &accelOptions,
           geometryInput.data(),
-          (int)scene.spheres.size(),
+          1,
           tempBuffer.d_pointer(),
           tempBuffer.sizeInBytes,
 
@@ -388,12 +545,86 @@ namespace osc {
       outputBuffer.free(); // << the UNcompacted, temporary output buffer
       tempBuffer.free();
       compactedSizeBuffer.free();
+      aabbBuffer.free();
 
       return asHandle;
   }
 
+  /*! build one acceleration structure for every level of detail of
+      every instanced mesh */
+  void SampleRenderer::buildAccelLODs()
+  {
+    GDT_PROFILE_SCOPE("buildAccelLODs");
+    size_t numLevels = 0;
+    lodFirstLevel.clear();
+    for (auto &lodMesh : scene.instancedMeshes) {
+      lodFirstLevel.push_back((int)numLevels);
+      numLevels += lodMesh.levels.size();
+    }
+    lodVertexBuffer.resize(numLevels);
+    lodIndexBuffer.resize(numLevels);
+    lodAttributeBuffer.resize(numLevels);
+    lodBlasBuffer.resize(numLevels);
+    lodGAS.resize(numLevels);
+
+    size_t totalBytes = 0;
+    for (size_t meshID=0;meshID<scene.instancedMeshes.size();meshID++) {
+      const LODMesh &lodMesh = scene.instancedMeshes[meshID];
+      for (size_t level=0;level<lodMesh.levels.size();level++) {
+        const int flatID = lodFirstLevel[meshID]+(int)level;
+        const TriangleMesh *levelMesh = &lodMesh.levels[level];
+        lodGAS[flatID] = buildAccelTriangles(&levelMesh,1,
+                                             &lodVertexBuffer[flatID],
+                                             &lodIndexBuffer[flatID],
+                                             &lodAttributeBuffer[flatID],
+                                             lodBlasBuffer[flatID]);
+        totalBytes += lodBlasBuffer[flatID].sizeInBytes;
+      }
+    }
+
+    // world-space bounds of all instances, for picking their LODs
+    std::vector<box3f> meshBounds(scene.instancedMeshes.size());
+    for (size_t meshID=0;meshID<meshBounds.size();meshID++)
+      for (auto &v : scene.instancedMeshes[meshID].levels[0].vertex)
+        meshBounds[meshID].extend(v);
+    instanceBounds.clear();
+    for (auto &instance : scene.instances)
+      instanceBounds.push_back(xfmBox(instance.xfm,meshBounds[instance.meshID]));
+    selectedLOD.assign(scene.instances.size(),0);
+    
+    if (numLevels)
+      std::cout << "#osc: built " << numLevels << " LOD accels ("
+                << prettyNumber(totalBytes) << "B)" << std::endl;
+  }
+
+  /*! pick the level of detail for each instance, based on the last
+      set camera; returns true if any instance's level changed */
+  bool SampleRenderer::updateLODSelection()
+  {
+    bool changed = false;
+    size_t numTriangles = 0;
+    size_t numBytes = 0;
+    for (size_t instID=0;instID<scene.instances.size();instID++) {
+      const int meshID = scene.instances[instID].meshID;
+      const LODMesh &lodMesh = scene.instancedMeshes[meshID];
+      const int level = selectLOD(instanceBounds[instID],lastSetCamera,
+                                  launchParams.frame.fullSize.y,
+                                  (int)lodMesh.levels.size());
+      changed |= (level != selectedLOD[instID]);
+      selectedLOD[instID] = level;
+      numTriangles += lodMesh.levels[level].index.size();
+      numBytes     += lodBlasBuffer[lodFirstLevel[meshID]+level].sizeInBytes;
+    }
+    if (changed)
+      std::cout << "#osc: LOD selection changed; instances now reference "
+                << prettyNumber(numTriangles) << " triangles, "
+                << prettyNumber(numBytes) << "B of accels" << std::endl;
+    return changed;
+  }
+
   OptixTraversableHandle SampleRenderer::buildAccelInstances(OptixTraversableHandle meshes, OptixTraversableHandle spheres)
   {
+    GDT_PROFILE_SCOPE("buildAccelInstances");
       OptixTraversableHandle asHandle{ 0 };
 
       OptixBuildInput buildInput = {};
@@ -413,7 +644,8 @@ namespace osc {
       meshInstance.flags = OPTIX_INSTANCE_FLAG_NONE;
       meshInstance.traversableHandle = meshes;
 
-      instances.push_back(meshInstance);
+      if (meshes)
+          instances.push_back(meshInstance);
 
       OptixInstance sphereInstance;
       memcpy(sphereInstance.transform, transform, sizeof(float) * 12);
@@ -423,13 +655,35 @@ namespace osc {
       sphereInstance.flags = OPTIX_INSTANCE_FLAG_NONE;
       sphereInstance.traversableHandle = spheres;
 
-      instances.push_back(sphereInstance);
+      if (spheres)
+          instances.push_back(sphereInstance);
+
+      // SBT records of the LOD levels come after all the mesh and
+      // sphere records
+      const int firstLODRecord = int(scene.meshes.size() + (spheres ? 1 : 0)) * RAY_TYPE_COUNT;
+      for (size_t instID=0;instID<scene.instances.size();instID++) {
+          const MeshInstance &instance = scene.instances[instID];
+          const int flatID = lodFirstLevel[instance.meshID]+selectedLOD[instID];
+          const affine3f &xfm = instance.xfm;
+          
+          OptixInstance lodInstance;
+          const float lodTransform[12] = { xfm.l.vx.x, xfm.l.vy.x, xfm.l.vz.x, xfm.p.x,
+                                           xfm.l.vx.y, xfm.l.vy.y, xfm.l.vz.y, xfm.p.y,
+                                           xfm.l.vx.z, xfm.l.vy.z, xfm.l.vz.z, xfm.p.z };
+          memcpy(lodInstance.transform, lodTransform, sizeof(float) * 12);
+          lodInstance.instanceId = 2 + (unsigned)instID;
+          lodInstance.visibilityMask = 255;
+          lodInstance.sbtOffset = firstLODRecord + flatID * RAY_TYPE_COUNT;
+          lodInstance.flags = OPTIX_INSTANCE_FLAG_NONE;
+          lodInstance.traversableHandle = lodGAS[flatID];
+          instances.push_back(lodInstance);
+      }
 
       CUDABuffer instanceBuffer;
       instanceBuffer.alloc_and_upload(instances);
 
       buildInput.instanceArray.instances = instanceBuffer.d_pointer();
-      buildInput.instanceArray.numInstances = 2;
+      buildInput.instanceArray.numInstances = (int)instances.size();
       buildInput.instanceArray.aabbs = 0;
       buildInput.instanceArray.numAabbs = 0;
 
@@ -508,6 +762,7 @@ namespace osc {
       outputBuffer.free(); // << the UNcompacted, temporary output buffer
       tempBuffer.free();
       compactedSizeBuffer.free();
+      instanceBuffer.free();
 
       return asHandle;
 
@@ -515,6 +770,7 @@ namespace osc {
   /*! helper function that initializes optix and checks for errors */
   void SampleRenderer::initOptix()
   {
+    GDT_PROFILE_SCOPE("initOptix");
     std::cout << "#osc: initializing optix..." << std::endl;
       
     // -------------------------------------------------------
@@ -536,6 +792,14 @@ namespace osc {
               << GDT_TERMINAL_DEFAULT << std::endl;
   }
 
+  /*! make our device's context the calling thread's current one */
+  void SampleRenderer::makeCurrent()
+  {
+    CUresult cuRes = cuCtxSetCurrent(cudaContext);
+    if (cuRes != CUDA_SUCCESS)
+      throw std::runtime_error("could not make cuda context current");
+  }
+
   static void context_log_cb(unsigned int level,
                              const char *tag,
                              const char *message,
@@ -548,8 +812,8 @@ namespace osc {
     example, only for the primary GPU device) */
   void SampleRenderer::createContext()
   {
-    // for this sample, do everything on one device
-    const int deviceID = 0;
+    GDT_PROFILE_SCOPE("createContext");
+    // everything this renderer does runs on this one device
     CUDA_CHECK(SetDevice(deviceID));
     CUDA_CHECK(StreamCreate(&stream));
       
@@ -572,6 +836,7 @@ namespace osc {
     single .cu file, using a single embedded ptx string */
   void SampleRenderer::createModule()
   {
+    GDT_PROFILE_SCOPE("createModule");
     moduleCompileOptions.maxRegisterCount  = 50;
     moduleCompileOptions.optLevel          = OPTIX_COMPILE_OPTIMIZATION_DEFAULT;
     moduleCompileOptions.debugLevel        = OPTIX_COMPILE_DEBUG_LEVEL_NONE;
@@ -585,9 +850,12 @@ namespace osc {
     pipelineCompileOptions.pipelineLaunchParamsVariableName = "optixLaunchParams";
       
     pipelineLinkOptions.overrideUsesMotionBlur = false;
-    pipelineLinkOptions.maxTraceDepth          = 2;
+    // only raygen traces rays (hit programs leave their shadow rays
+    // to it), so nothing recurses
+    pipelineLinkOptions.maxTraceDepth          = 1;
       
     const std::string ptxCode = embedded_ptx_code;
+    moduleCacheWarm = setupModuleCache();
       
     char log[2048];
     size_t sizeof_log = sizeof( log );
@@ -604,139 +872,152 @@ namespace osc {
     
 
 
+  /*! sets up the module cache for the current module and pipeline
+      compile options; returns whether it already has an entry */
+  bool SampleRenderer::setupModuleCache()
+  {
+    GDT_PROFILE_SCOPE("setupModuleCache");
+    int driverVersion = 0;
+    CUDA_CHECK(DriverGetVersion(&driverVersion));
+
+    // hash field by field, since the option structs have pointers
+    // (and padding) in them
+    moduleCacheKey = ModuleCacheKey();
+    moduleCacheKey
+      .add(std::string(embedded_ptx_code))
+      .add(int(OPTIX_VERSION))
+      .add(driverVersion)
+      .add(std::string(deviceProps.name))
+      .add(deviceProps.major)
+      .add(deviceProps.minor)
+      .add(moduleCompileOptions.maxRegisterCount)
+      .add(int(moduleCompileOptions.optLevel))
+      .add(int(moduleCompileOptions.debugLevel))
+      .add(pipelineCompileOptions.usesMotionBlur)
+      .add(pipelineCompileOptions.traversableGraphFlags)
+      .add(pipelineCompileOptions.numPayloadValues)
+      .add(pipelineCompileOptions.numAttributeValues)
+      .add(pipelineCompileOptions.exceptionFlags)
+      .add(std::string(pipelineCompileOptions.pipelineLaunchParamsVariableName))
+      .add(pipelineLinkOptions.maxTraceDepth)
+      .add(int(pipelineLinkOptions.debugLevel));
+
+    const bool warm = moduleCache.lookup(moduleCacheKey,coldCompileTime);
+    try {
+      const std::string dir = moduleCache.prepare(moduleCacheKey);
+      OPTIX_CHECK(optixDeviceContextSetCacheLocation(optixContext,dir.c_str()));
+      OPTIX_CHECK(optixDeviceContextSetCacheEnabled(optixContext,1));
+      moduleCacheEnabled = true;
+      std::cout << "#osc: module cache " << dir
+                << (warm ? " (warm)" : " (cold)") << std::endl;
+    } catch (std::runtime_error &e) {
+      // not being able to cache only costs time, so go on without
+      std::cout << GDT_TERMINAL_RED << "#osc: warning: " << e.what()
+                << "; not caching programs" << GDT_TERMINAL_DEFAULT << std::endl;
+      moduleCacheEnabled = false;
+    }
+    return moduleCacheEnabled && warm;
+  }
+  
+  /*! creates one program group per descriptor; all in parallel,
+      since compiling them is what takes the time, and optix allows
+      creating them concurrently on the same context */
+  std::vector<OptixProgramGroup>
+  SampleRenderer::createProgramGroups(const std::vector<OptixProgramGroupDesc> &pgDescs)
+  {
+    std::vector<OptixProgramGroup> programGroups(pgDescs.size());
+    std::vector<std::string>       logs(pgDescs.size());
+    parallel_for(pgDescs.size(),[&](size_t pgID){
+        OptixProgramGroupOptions pgOptions = {};
+        char log[2048];
+        size_t sizeof_log = sizeof( log );
+        OPTIX_CHECK(optixProgramGroupCreate(optixContext,
+                                            &pgDescs[pgID],
+                                            1,
+                                            &pgOptions,
+                                            log,&sizeof_log,
+                                            &programGroups[pgID]
+                                            ));
+        if (sizeof_log > 1) logs[pgID] = log;
+      });
+    for (auto &log : logs)
+      if (!log.empty()) PRINT(log);
+    return programGroups;
+  }
+  
   /*! does all setup for the raygen program(s) we are going to use */
   void SampleRenderer::createRaygenPrograms()
   {
-    // we do a single ray gen program in this example:
-    raygenPGs.resize(1);
-      
-    OptixProgramGroupOptions pgOptions = {};
-    OptixProgramGroupDesc pgDesc    = {};
-    pgDesc.kind                     = OPTIX_PROGRAM_GROUP_KIND_RAYGEN;
-    pgDesc.raygen.module            = module;           
-    pgDesc.raygen.entryFunctionName = "__raygen__renderFrame";
-
-    // OptixProgramGroup raypg;
-    char log[2048];
-    size_t sizeof_log = sizeof( log );
-    OPTIX_CHECK(optixProgramGroupCreate(optixContext,
-                                        &pgDesc,
-                                        1,
-                                        &pgOptions,
-                                        log,&sizeof_log,
-                                        &raygenPGs[0]
-                                        ));
-    if (sizeof_log > 1) PRINT(log);
+    GDT_PROFILE_SCOPE("createRaygenPrograms");
+    // the one that renders a frame:
+    std::vector<OptixProgramGroupDesc> pgDescs(2);
+    pgDescs[0].kind                     = OPTIX_PROGRAM_GROUP_KIND_RAYGEN;
+    pgDescs[0].raygen.module            = module;           
+    pgDescs[0].raygen.entryFunctionName = "__raygen__renderFrame";
+    // and one that moves the last frame's pixels to the new camera,
+    // launched just before it when reprojecting
+    pgDescs[1].kind                     = OPTIX_PROGRAM_GROUP_KIND_RAYGEN;
+    pgDescs[1].raygen.module            = module;           
+    pgDescs[1].raygen.entryFunctionName = "__raygen__reproject";
+    // and one that bakes lighting into vertices; see bakeLighting()
+    pgDescs.push_back(pgDescs[1]);
+    pgDescs[2].raygen.entryFunctionName = "__raygen__bakeVertices";
+
+    raygenPGs = createProgramGroups(pgDescs);
   }
     
   /*! does all setup for the miss program(s) we are going to use */
   void SampleRenderer::createMissPrograms()
   {
-    // we do a single ray gen program in this example:
-    missPGs.resize(2);
-      
-    OptixProgramGroupOptions pgOptions = {};
-    OptixProgramGroupDesc pgDesc    = {};
-    pgDesc.kind                     = OPTIX_PROGRAM_GROUP_KIND_MISS;
-    pgDesc.miss.module            = module;           
-    pgDesc.miss.entryFunctionName = "__miss__radiance";
-
-    // OptixProgramGroup raypg;
-    char log[2048];
-    size_t sizeof_log = sizeof( log );
-    OPTIX_CHECK(optixProgramGroupCreate(optixContext,
-                                        &pgDesc,
-                                        1,
-                                        &pgOptions,
-                                        log,&sizeof_log,
-                                        &missPGs[0]
-                                        ));
-
-    pgDesc.miss.entryFunctionName = "__miss__empty";
-
-    OPTIX_CHECK(optixProgramGroupCreate(optixContext,
-        &pgDesc,
-        1,
-        &pgOptions,
-        log, &sizeof_log,
-        &missPGs[1]
-    ));
+    GDT_PROFILE_SCOPE("createMissPrograms");
+    // one for radiance rays, one for shadow rays
+    std::vector<OptixProgramGroupDesc> pgDescs(2);
+    for (auto &pgDesc : pgDescs) {
+      pgDesc.kind        = OPTIX_PROGRAM_GROUP_KIND_MISS;
+      pgDesc.miss.module = module;           
+    }
+    pgDescs[0].miss.entryFunctionName = "__miss__radiance";
+    pgDescs[1].miss.entryFunctionName = "__miss__empty";
 
-    if (sizeof_log > 1) PRINT(log);
+    missPGs = createProgramGroups(pgDescs);
   }
     
   /*! does all setup for the hitgroup program(s) we are going to use */
   void SampleRenderer::createHitgroupPrograms()
   {
-    hitgroupPGs.resize(4);
+    GDT_PROFILE_SCOPE("createHitgroupPrograms");
+    // radiance mesh, radiance sphere, shadow mesh, shadow sphere
+    std::vector<OptixProgramGroupDesc> pgDescs(4);
+    for (auto &pgDesc : pgDescs) {
+      pgDesc.kind                         = OPTIX_PROGRAM_GROUP_KIND_HITGROUP;
+      pgDesc.hitgroup.moduleCH            = module;
+      pgDesc.hitgroup.moduleAH            = module;
+      pgDesc.hitgroup.moduleIS            = module;
+    }
+    pgDescs[0].hitgroup.entryFunctionNameCH = "__closesthit__radiance_mesh";
+    pgDescs[0].hitgroup.entryFunctionNameAH = "__anyhit__empty";
+    pgDescs[0].hitgroup.entryFunctionNameIS = "__intersection__empty";
 
-    OptixProgramGroupOptions pgOptions = {};
-    OptixProgramGroupDesc pgDesc    = {};
-    pgDesc.kind                     = OPTIX_PROGRAM_GROUP_KIND_HITGROUP;
-    pgDesc.hitgroup.moduleCH            = module;
-    pgDesc.hitgroup.entryFunctionNameCH = "__closesthit__radiance_mesh";
-    pgDesc.hitgroup.moduleAH            = module;
-    pgDesc.hitgroup.entryFunctionNameAH = "__anyhit__empty";
-    pgDesc.hitgroup.moduleIS            = module;
-    pgDesc.hitgroup.entryFunctionNameIS = "__intersection__empty";
-     
+    pgDescs[1].hitgroup.entryFunctionNameCH = "__closesthit__radiance_sphere";
+    pgDescs[1].hitgroup.entryFunctionNameAH = "__anyhit__empty";
+    pgDescs[1].hitgroup.entryFunctionNameIS = "__intersection__sphere";
 
-    char log[2048];
-    size_t sizeof_log = sizeof( log );
-    OPTIX_CHECK(optixProgramGroupCreate(optixContext,
-                                        &pgDesc,
-                                        1,
-                                        &pgOptions,
-                                        log,&sizeof_log,
-                                        &hitgroupPGs[0]
-                                        ));
-    if (sizeof_log > 1) PRINT(log);
+    pgDescs[2].hitgroup.entryFunctionNameCH = "__closesthit__empty";
+    pgDescs[2].hitgroup.entryFunctionNameAH = "__anyhit__shadow";
+    pgDescs[2].hitgroup.entryFunctionNameIS = "__intersection__empty";
 
+    pgDescs[3].hitgroup.entryFunctionNameCH = "__closesthit__empty";
+    pgDescs[3].hitgroup.entryFunctionNameAH = "__anyhit__shadow";
+    pgDescs[3].hitgroup.entryFunctionNameIS = "__intersection__sphere";
 
-    pgDesc.hitgroup.entryFunctionNameCH = "__closesthit__radiance_sphere";
-    pgDesc.hitgroup.entryFunctionNameIS = "__intersection__sphere";
-
-    char log2[2048];
-    OPTIX_CHECK(optixProgramGroupCreate(optixContext,
-        &pgDesc,
-        1,
-        &pgOptions,
-        log2, &sizeof_log,
-        &hitgroupPGs[1]
-    ));
-    if (sizeof_log > 1) PRINT(log2);
-
-    pgDesc.hitgroup.entryFunctionNameCH = "__closesthit__empty";
-    pgDesc.hitgroup.entryFunctionNameAH = "__anyhit__shadow";
-    pgDesc.hitgroup.entryFunctionNameIS = "__intersection__empty";
-
-    char log3[2048];
-    OPTIX_CHECK(optixProgramGroupCreate(optixContext,
-        &pgDesc,
-        1,
-        &pgOptions,
-        log3, &sizeof_log,
-        &hitgroupPGs[2]
-    ));
-    if (sizeof_log > 1) PRINT(log3);
-
-    pgDesc.hitgroup.entryFunctionNameIS = "__intersection__sphere";
-
-    char log4[2048];
-    OPTIX_CHECK(optixProgramGroupCreate(optixContext,
-        &pgDesc,
-        1,
-        &pgOptions,
-        log4, &sizeof_log,
-        &hitgroupPGs[3]
-    ));
-    if (sizeof_log > 1) PRINT(log4);
+    hitgroupPGs = createProgramGroups(pgDescs);
   }
     
 
   /*! assembles the full pipeline of all programs */
   void SampleRenderer::createPipeline()
   {
+    GDT_PROFILE_SCOPE("createPipeline");
     std::vector<OptixProgramGroup> programGroups;
     for (auto pg : raygenPGs)
       programGroups.push_back(pg);
@@ -778,6 +1059,7 @@ namespace osc {
   /*! constructs the shader binding table */
   void SampleRenderer::buildSBT()
   {
+    GDT_PROFILE_SCOPE("buildSBT");
     // ------------------------------------------------------------------
     // build raygen records
     // ------------------------------------------------------------------
@@ -818,6 +1100,10 @@ namespace osc {
         rec_radiance.data.triangle_data.color = scene.meshes[meshID].color;
         rec_radiance.data.triangle_data.vertex = (vec3f*)vertexBuffer[meshID].d_pointer();
         rec_radiance.data.triangle_data.index = (vec3i*)indexBuffer[meshID].d_pointer();
+        rec_radiance.data.triangle_data.triangleColor = (vec3f*)attributeBuffer[meshID].triangleColor.d_pointer();
+        rec_radiance.data.triangle_data.vertexColor = (vec3f*)attributeBuffer[meshID].vertexColor.d_pointer();
+        rec_radiance.data.triangle_data.normal = (vec3f*)attributeBuffer[meshID].normal.d_pointer();
+        rec_radiance.data.triangle_data.bakedLight = (vec2f*)bakedLightBuffer[meshID].d_pointer();
         hitgroupRecords.push_back(rec_radiance);
 
         HitgroupRecord rec_shadow;                                                     // TODO: empty record?
@@ -825,23 +1111,45 @@ namespace osc {
         rec_shadow.data.triangle_data.color = scene.meshes[meshID].color;
         rec_shadow.data.triangle_data.vertex = (vec3f*)vertexBuffer[meshID].d_pointer();
         rec_shadow.data.triangle_data.index = (vec3i*)indexBuffer[meshID].d_pointer();
+        rec_shadow.data.triangle_data.triangleColor = (vec3f*)attributeBuffer[meshID].triangleColor.d_pointer();
+        rec_shadow.data.triangle_data.vertexColor = (vec3f*)attributeBuffer[meshID].vertexColor.d_pointer();
+        rec_shadow.data.triangle_data.normal = (vec3f*)attributeBuffer[meshID].normal.d_pointer();
+        rec_shadow.data.triangle_data.bakedLight = (vec2f*)bakedLightBuffer[meshID].d_pointer();
         hitgroupRecords.push_back(rec_shadow);
     }
-    for (int sphereID = 0; sphereID < numSpheres; sphereID++) {
+    if (numSpheres > 0) {
+        // one record (per ray type) for all spheres; the programs look
+        // up per-sphere data by primitive ID
         HitgroupRecord rec_radiance;
         OPTIX_CHECK(optixSbtRecordPackHeader(hitgroupPGs[1], &rec_radiance));
-        rec_radiance.data.sphere_data.color = scene.spheres[sphereID].color;
-        rec_radiance.data.sphere_data.radius = scene.spheres[sphereID].radius;
-        rec_radiance.data.sphere_data.center = scene.spheres[sphereID].center;
+        rec_radiance.data.sphere_data.center = (vec3f*)sphereCenterBuffer.d_pointer();
+        rec_radiance.data.sphere_data.radius = (float*)sphereRadiusBuffer.d_pointer();
+        rec_radiance.data.sphere_data.color  = (vec3f*)sphereColorBuffer.d_pointer();
         hitgroupRecords.push_back(rec_radiance);
 
-        HitgroupRecord rec_shadow;                                               // TODO: empty record?
+        HitgroupRecord rec_shadow = rec_radiance;
         OPTIX_CHECK(optixSbtRecordPackHeader(hitgroupPGs[3], &rec_shadow)); 
-        rec_shadow.data.sphere_data.color = scene.spheres[sphereID].color;
-        rec_shadow.data.sphere_data.radius = scene.spheres[sphereID].radius;
-        rec_shadow.data.sphere_data.center = scene.spheres[sphereID].center;
         hitgroupRecords.push_back(rec_shadow);
     }
+    for (size_t meshID = 0; meshID < scene.instancedMeshes.size(); meshID++) {
+        const LODMesh &lodMesh = scene.instancedMeshes[meshID];
+        for (size_t level = 0; level < lodMesh.levels.size(); level++) {
+            const int flatID = lodFirstLevel[meshID] + (int)level;
+            HitgroupRecord rec_radiance;
+            OPTIX_CHECK(optixSbtRecordPackHeader(hitgroupPGs[0], &rec_radiance));
+            rec_radiance.data.triangle_data.color = lodMesh.levels[level].color;
+            rec_radiance.data.triangle_data.vertex = (vec3f*)lodVertexBuffer[flatID].d_pointer();
+            rec_radiance.data.triangle_data.index = (vec3i*)lodIndexBuffer[flatID].d_pointer();
+            rec_radiance.data.triangle_data.triangleColor = (vec3f*)lodAttributeBuffer[flatID].triangleColor.d_pointer();
+            rec_radiance.data.triangle_data.vertexColor = (vec3f*)lodAttributeBuffer[flatID].vertexColor.d_pointer();
+            rec_radiance.data.triangle_data.normal = (vec3f*)lodAttributeBuffer[flatID].normal.d_pointer();
+            hitgroupRecords.push_back(rec_radiance);
+
+            HitgroupRecord rec_shadow = rec_radiance;
+            OPTIX_CHECK(optixSbtRecordPackHeader(hitgroupPGs[2], &rec_shadow));
+            hitgroupRecords.push_back(rec_shadow);
+        }
+    }
     hitgroupRecordsBuffer.alloc_and_upload(hitgroupRecords);
     sbt.hitgroupRecordBase          = hitgroupRecordsBuffer.d_pointer();
     sbt.hitgroupRecordStrideInBytes = sizeof(HitgroupRecord);
@@ -850,69 +1158,516 @@ namespace osc {
 
 
 
-  /*! render one frame */
+  /*! replace all triangle meshes, and rebuild everything that
+      depends on them */
+  void SampleRenderer::setMeshes(const std::vector<TriangleMesh> &meshes)
+  {
+    GDT_PROFILE_SCOPE("setMeshes");
+    makeCurrent();
+    scene.meshes   = meshes;
+    meshesStreamed = false;
+    replaceMeshes(pointersTo(scene.meshes));
+  }
+
+  void SampleRenderer::setStreamedMeshes(const std::vector<std::shared_ptr<const TriangleMesh>> &meshes)
+  {
+    GDT_PROFILE_SCOPE("setStreamedMeshes");
+    makeCurrent();
+    std::vector<const TriangleMesh *> pointers;
+    scene.meshes.assign(meshes.size(),TriangleMesh());
+    for (size_t meshID=0;meshID<meshes.size();meshID++) {
+      pointers.push_back(meshes[meshID].get());
+      scene.meshes[meshID].color = meshes[meshID]->color;
+    }
+    meshesStreamed = true;
+    replaceMeshes(pointers);
+  }
+
+  void SampleRenderer::replaceMeshes(const std::vector<const TriangleMesh *> &meshes)
+  {
+    // frames in flight may still be using what we're about to free
+    CUDA_CHECK(StreamSynchronize(stream));
+    for (auto &buffer : vertexBuffer) buffer.free();
+    for (auto &buffer : indexBuffer) buffer.free();
+    for (auto &buffers : attributeBuffer) buffers.free();
+    for (auto &buffer : bakedLightBuffer) buffer.free();
+    meshBlasBuffer.free();
+    sceneTlasBuffer.free();
+    raygenRecordsBuffer.free();
+    missRecordsBuffer.free();
+    hitgroupRecordsBuffer.free();
+
+    meshesGAS = buildAccelMeshes(meshes);
+    launchParams.traversable = buildAccelInstances(meshesGAS, spheresGAS);
+    buildSBT();
+    historyValid = false;
+    occludersValid = false;
+    clearRadianceCache();
+  }
+
+  double SampleRenderer::bakeLighting(int numSamples, float aoRadius)
+  {
+    GDT_PROFILE_SCOPE("bakeLighting");
+    if (meshesStreamed)
+      throw std::runtime_error("can't bake lighting into streamed meshes");
+    makeCurrent();
+    // frames in flight may still be using the buffers we replace
+    CUDA_CHECK(StreamSynchronize(stream));
+    const double t0 = getCurrentTime();
+
+    // the meshes' own shading normals, or else area-weighted vertex
+    // normals, facing the same way as the ones
+    // __closesthit__radiance_mesh computes
+    std::vector<std::vector<vec3f>> normals(scene.meshes.size());
+    parallel_for(scene.meshes.size(),[&](size_t meshID){
+        const TriangleMesh &mesh = scene.meshes[meshID];
+        std::vector<vec3f> &normal = normals[meshID];
+        if (!mesh.normal.empty()) {
+          normal = mesh.normal;
+          return;
+        }
+        normal.assign(mesh.vertex.size(),vec3f(0.f));
+        for (auto &idx : mesh.index) {
+          const vec3f &A = mesh.vertex[idx.x];
+          const vec3f N = cross(mesh.vertex[idx.z]-A,mesh.vertex[idx.y]-A);
+          normal[idx.x] += N;
+          normal[idx.y] += N;
+          normal[idx.z] += N;
+        }
+        for (auto &n : normal) {
+          const float len = length(n);
+          n = len > 0.f ? n/len : vec3f(0.f,1.f,0.f);
+        }
+      });
+
+    // the third raygen record, with launch params of its own
+    OptixShaderBindingTable bakeSBT = sbt;
+    bakeSBT.raygenRecord = sbt.raygenRecord + 2*sizeof(RaygenRecord);
+    LaunchParams params = launchParams;
+    params.bake.numSamples = numSamples;
+    params.bake.aoRadius   = aoRadius;
+    CUDABuffer paramsBuffer;
+    paramsBuffer.alloc(sizeof(LaunchParams));
+    size_t numVertices = 0;
+    for (size_t meshID=0;meshID<scene.meshes.size();meshID++) {
+      TriangleMesh &mesh = scene.meshes[meshID];
+      if (mesh.vertex.empty()) continue;
+      CUDABuffer normalBuffer;
+      normalBuffer.alloc_and_upload(normals[meshID]);
+      bakedLightBuffer[meshID].resize(mesh.vertex.size()*sizeof(vec2f));
+      params.bake.vertex = (const vec3f *)vertexBuffer[meshID].d_pointer();
+      params.bake.normal = (const vec3f *)normalBuffer.d_pointer();
+      params.bake.light  = (vec2f *)bakedLightBuffer[meshID].d_pointer();
+      paramsBuffer.upload(&params,1);
+      OPTIX_CHECK(optixLaunch(pipeline,stream,
+                              paramsBuffer.d_pointer(),
+                              paramsBuffer.sizeInBytes,
+                              &bakeSBT,
+                              (unsigned)mesh.vertex.size(),1,1));
+      CUDA_CHECK(StreamSynchronize(stream));
+      mesh.bakedLight.resize(mesh.vertex.size());
+      bakedLightBuffer[meshID].download(mesh.bakedLight.data(),mesh.vertex.size());
+      normalBuffer.free();
+      numVertices += mesh.vertex.size();
+    }
+    paramsBuffer.free();
+
+    // the hit programs find the baked lighting through the SBT
+    raygenRecordsBuffer.free();
+    missRecordsBuffer.free();
+    hitgroupRecordsBuffer.free();
+    buildSBT();
+    historyValid = false;
+    occludersValid = false;
+    clearRadianceCache();
+
+    const double bakeTime = getCurrentTime()-t0;
+    std::cout << "#osc: baked lighting into " << prettyNumber(numVertices)
+              << " vertices (" << numSamples << " occlusion rays each) in "
+              << prettyDouble(bakeTime) << "s: "
+              << prettyDouble(numVertices/bakeTime) << " vertices/s, "
+              << prettyDouble(numVertices*(numSamples+1.)/bakeTime) << " rays/s"
+              << std::endl;
+    return bakeTime;
+  }
+
+  /*! start rendering one frame */
   void SampleRenderer::render()
   {
+    GDT_PROFILE_SCOPE("render");
     // sanity check: make sure we launch only after first resize is
     // already done:
-    if (launchParams.frame.size.x == 0) return;
-      
-    launchParamsBuffer.upload(&launchParams,1);
+    if (launchParams.frame.fullSize.x == 0) return;
+    makeCurrent();
+
+    // this slot's previous frame should have been displayed long
+    // ago, but its readback may still be pending
+    InFlightFrame &frame = frames[frameRing.beginFrame()];
+    CUDA_CHECK(EventSynchronize(frame.done));
+    CUDA_CHECK(EventRecord(frame.begin,stream));
+    frame.size = launchParams.frame.size;
+    const bool allRows
+      =  launchParams.frame.rowOffset == 0
+      && launchParams.frame.rowStride == 1
+      && frame.size.y == launchParams.frame.renderSize.y;
+    frame.needsReconstruction = !rateMap.empty() && allRows;
+    // with our rows split across devices, we may not have any; the
+    // frame still goes through the ring, to stay in step with the
+    // other devices
+    if (frame.size.y == 0) {
+      frame.hasRayStats = false;
+      CUDA_CHECK(EventRecord(frame.done,stream));
+      frameRing.endFrame();
+      return;
+    }
+
+    launchParams.frame.colorBuffer = (uint32_t*)frame.colorBuffer.d_pointer();
+    frame.hasRayStats = rayStatsEnabled || heatmapEnabled;
+    launchParams.rayStats = nullptr;
+    if (frame.hasRayStats) {
+      CUDA_CHECK(MemsetAsync(frame.rayStatsBuffer.d_ptr,0,
+                             frame.rayStatsBuffer.sizeInBytes,stream));
+      launchParams.rayStats = (RayStats*)frame.rayStatsBuffer.d_pointer();
+    }
+
+    // temporal reprojection: write this frame's history, and if the
+    // last frame left any, reproject that first
+    const bool reproject = reprojectionEnabled && !heatmapEnabled && allRows;
+    const bool haveHistory = reproject && historyValid;
+    const vec2i fullSize = launchParams.frame.fullSize;
+    const size_t numPixels = size_t(fullSize.x)*fullSize.y;
+    launchParams.reprojection.current  = PixelHistory();
+    launchParams.reprojection.previous = PixelHistory();
+    if (reproject) {
+      allocHistory(numPixels);
+      auto params = [](HistoryBuffers &buffers) {
+        PixelHistory history;
+        history.color = (uint32_t *)buffers.color.d_pointer();
+        history.depth = (float    *)buffers.depth.d_pointer();
+        history.hitID = (uint32_t *)buffers.hitID.d_pointer();
+        history.age   = (uint8_t  *)buffers.age.d_pointer();
+        return history;
+      };
+      launchParams.reprojection.current     = params(history[currentHistory]);
+      launchParams.reprojection.reprojected
+        = (unsigned long long *)reprojectedBuffer.d_pointer();
+      launchParams.reprojection.maxAge      = maxReprojectionAge;
+      launchParams.reprojection.frameIndex  = frameIndex++;
+      if (haveHistory) {
+        launchParams.reprojection.previous       = params(history[1-currentHistory]);
+        launchParams.reprojection.previousCamera = historyCamera;
+        launchParams.reprojection.previousSize   = historySize;
+        CUDA_CHECK(MemsetAsync(reprojectedBuffer.d_ptr,0xff,
+                               numPixels*sizeof(unsigned long long),stream));
+      }
+    }
+    launchParams.radianceCache.frameIndex = radianceCacheFrame++;
+
+    // cached occluders are in world space, so stay valid as the
+    // camera moves; only until the geometry changes
+    launchParams.shadows.cullBackFacing = shadowRayPolicy.cullBackFacing;
+    launchParams.shadows.occluders      = nullptr;
+    if (shadowRayPolicy.occluderCache) {
+      if (occluderBuffer.sizeInBytes < numPixels*sizeof(CachedOccluder)) {
+        occluderBuffer.resize(numPixels*sizeof(CachedOccluder));
+        occludersValid = false;
+      }
+      if (!occludersValid)
+        CUDA_CHECK(MemsetAsync(occluderBuffer.d_ptr,0,
+                               occluderBuffer.sizeInBytes,stream));
+      occludersValid = true;
+      launchParams.shadows.occluders = (CachedOccluder *)occluderBuffer.d_pointer();
+    }
+
+    *frame.hostLaunchParams = launchParams;
+    frame.launchParamsBuffer.upload_async(frame.hostLaunchParams,1,stream);
+
+    if (haveHistory) {
+      // same launch params, but the second raygen record
+      OptixShaderBindingTable reprojectSBT = sbt;
+      reprojectSBT.raygenRecord = sbt.raygenRecord + sizeof(RaygenRecord);
+      OPTIX_CHECK(optixLaunch(pipeline,stream,
+                              frame.launchParamsBuffer.d_pointer(),
+                              frame.launchParamsBuffer.sizeInBytes,
+                              &reprojectSBT,
+                              historySize.x,historySize.y,1));
+    }
+    if (reproject) {
+      historyCamera  = launchParams.camera;
+      historySize    = launchParams.frame.renderSize;
+      currentHistory = 1-currentHistory;
+    }
+    historyValid = reproject;
       
     OPTIX_CHECK(optixLaunch(/*! pipeline we're launching launch: */
                             pipeline,stream,
                             /*! parameters and SBT */
-                            launchParamsBuffer.d_pointer(),
-                            launchParamsBuffer.sizeInBytes,
+                            frame.launchParamsBuffer.d_pointer(),
+                            frame.launchParamsBuffer.sizeInBytes,
                             &sbt,
                             /*! dimensions of the launch: */
                             launchParams.frame.size.x,
                             launchParams.frame.size.y,
-                            2
+                            1
                             ));
-    // sync - make sure the frame is rendered before we download and
-    // display (obviously, for a high-performance application you
-    // want to use streams and double-buffering, but for this simple
-    // example, this will have to do)
-    CUDA_SYNC_CHECK();
+    // no sync here: the readback goes onto the same stream, and the
+    // event tells mapFrame() when it's safe to look at the pixels
+    GDT_PROFILE_COUNTER("primaryRays",frame.size.x*frame.size.y
+                        *rateMapTracedFraction);
+    frame.colorBuffer.download_async(frame.hostPixels,
+                                     frame.size.x*frame.size.y,stream);
+    if (frame.hasRayStats)
+      frame.rayStatsBuffer.download_async(frame.hostRayStats,RAY_STATS_BINS,stream);
+    CUDA_CHECK(EventRecord(frame.done,stream));
+    frameRing.endFrame();
+  }
+
+  /*! the frame to display now, or null if there is none yet */
+  const uint32_t *SampleRenderer::mapFrame(vec2i &size)
+  {
+    GDT_PROFILE_SCOPE("mapFrame");
+    const int slot = frameRing.displaySlot();
+    if (slot < 0) return nullptr;
+    
+    makeCurrent();
+    InFlightFrame &frame = frames[slot];
+    CUDA_CHECK(EventSynchronize(frame.done));
+    float milliseconds = 0.f;
+    CUDA_CHECK(EventElapsedTime(&milliseconds,frame.begin,frame.done));
+    mappedFrameTime = 1e-3*milliseconds;
+
+    haveMappedRayStats = frame.hasRayStats;
+    if (frame.hasRayStats) {
+      mappedRayStats = RayStats();
+      for (int i=0;i<RAY_STATS_BINS;i++) {
+        const RayStats &bin = frame.hostRayStats[i];
+        mappedRayStats.primaryRays        += bin.primaryRays;
+        mappedRayStats.misses             += bin.misses;
+        mappedRayStats.shadowRays         += bin.shadowRays;
+        mappedRayStats.shadowRaysOccluded += bin.shadowRaysOccluded;
+        mappedRayStats.primitiveTests     += bin.primitiveTests;
+        mappedRayStats.cycles             += bin.cycles;
+        mappedRayStats.reusedPixels       += bin.reusedPixels;
+        mappedRayStats.bounceRays         += bin.bounceRays;
+        mappedRayStats.shadowRaysCulled   += bin.shadowRaysCulled;
+        mappedRayStats.shadowRaysCached   += bin.shadowRaysCached;
+      }
+      // scale the heatmap so the average pixel ends up in the blue
+      // to green range, and outliers show up red
+      if (heatmapEnabled && mappedRayStats.primaryRays)
+        launchParams.heatmapScale
+          = 4.f*mappedRayStats.cycles/float(mappedRayStats.primaryRays);
+    }
+    
+    if (frame.needsReconstruction)
+      reconstructFoveated(frame.hostPixels,frame.size,rateMap,
+                          launchParams.frame.fullSize);
+    
+    size = frame.size;
+    return frame.hostPixels;
+  }
+
+  void SampleRenderer::setRayStatsEnabled(bool enabled)
+  {
+    rayStatsEnabled = enabled;
+  }
+
+  void SampleRenderer::setHeatmapEnabled(bool enabled)
+  {
+    heatmapEnabled = enabled;
+    // until we have stats to scale it by, start from something
+    // plausible
+    launchParams.heatmapScale = enabled ? 1e5f : 0.f;
+  }
+
+  void SampleRenderer::setReprojectionEnabled(bool enabled)
+  {
+    reprojectionEnabled = enabled;
+  }
+
+  void SampleRenderer::setShadowRayPolicy(const ShadowRayPolicy &policy)
+  {
+    shadowRayPolicy = policy;
+  }
+
+  void SampleRenderer::setRadianceCacheEnabled(bool enabled)
+  {
+    makeCurrent();
+    // frames in flight may still be using the cache
+    CUDA_CHECK(StreamSynchronize(stream));
+    launchParams.radianceCache.cells = nullptr;
+    if (!enabled) return;
+    
+    // 20 bytes a cell; the table only ever fills up if the camera
+    // goes around a big scene
+    const uint32_t numCells = 1u<<20;
+    if (!radianceCacheBuffer.d_ptr)
+      radianceCacheBuffer.alloc(numCells*sizeof(RadianceCacheCell));
+    auto &cache = launchParams.radianceCache;
+    cache.cells       = (RadianceCacheCell *)radianceCacheBuffer.d_pointer();
+    cache.numCells    = numCells;
+    // a few pixels wide (at the default resolution), and no smaller
+    // than 1/4096th of the scene
+    const box3f bounds = computeBounds(scene);
+    cache.cellScale   = .004f;
+    cache.minCellSize = bounds.empty() ? 1e-3f : length(bounds.span())/4096.f;
+    cache.minSamples  = 16;
+    cache.maxSamples  = 1024;
+    radianceCacheFrame = 0;
+    clearRadianceCache();
+  }
+
+  void SampleRenderer::clearRadianceCache()
+  {
+    if (!launchParams.radianceCache.cells) return;
+    makeCurrent();
+    CUDA_CHECK(MemsetAsync(radianceCacheBuffer.d_ptr,0,
+                           radianceCacheBuffer.sizeInBytes,stream));
+  }
+
+  void SampleRenderer::allocHistory(size_t numPixels)
+  {
+    // like the frame buffers, these only ever grow
+    if (reprojectedBuffer.sizeInBytes >= numPixels*sizeof(unsigned long long))
+      return;
+    makeCurrent();
+    for (auto &buffers : history) {
+      buffers.color.resize(numPixels*sizeof(uint32_t));
+      buffers.depth.resize(numPixels*sizeof(float));
+      buffers.hitID.resize(numPixels*sizeof(uint32_t));
+      buffers.age.resize(numPixels*sizeof(uint8_t));
+    }
+    reprojectedBuffer.resize(numPixels*sizeof(unsigned long long));
+    historyValid = false;
+  }
+
+  const RayStats *SampleRenderer::getRayStats() const
+  {
+    return haveMappedRayStats ? &mappedRayStats : nullptr;
+  }
+
+  void SampleRenderer::setFoveation(const Foveation &foveation)
+  {
+    this->foveation = foveation;
+    updateRateMap();
+  }
+  
+  void SampleRenderer::updateRateMap()
+  {
+    makeCurrent();
+    rateMap = buildRateMap(foveation,launchParams.frame.fullSize);
+    rateMapTracedFraction = tracedFraction(rateMap,launchParams.frame.fullSize);
+    // untraced pixels have no history
+    historyValid = false;
+    // frames in flight may still read the old map
+    CUDA_CHECK(StreamSynchronize(stream));
+    if (rateMapBuffer.d_ptr)
+      rateMapBuffer.free();
+    launchParams.foveation.rateMap   = nullptr;
+    launchParams.foveation.numTilesX = 0;
+    if (rateMap.empty()) return;
+    rateMapBuffer.alloc_and_upload(rateMap);
+    launchParams.foveation.rateMap   = (const uint8_t *)rateMapBuffer.d_pointer();
+    launchParams.foveation.numTilesX
+      = divRoundUp(launchParams.frame.fullSize.x,(int)FOVEATION_TILE_SIZE);
   }
 
   /*! set camera to render with */
   void SampleRenderer::setCamera(const Camera &camera)
   {
+    GDT_PROFILE_SCOPE("setCamera");
     lastSetCamera = camera;
     launchParams.camera.position  = camera.from;
     launchParams.camera.direction = normalize(camera.at-camera.from);
     const float cosFovy = 0.66f;
-    const float aspect = launchParams.frame.size.x / float(launchParams.frame.size.y);
+    const float aspect = launchParams.frame.fullSize.x / float(launchParams.frame.fullSize.y);
     launchParams.camera.horizontal
       = cosFovy * aspect * normalize(cross(launchParams.camera.direction,
                                            camera.up));
     launchParams.camera.vertical
       = cosFovy * normalize(cross(launchParams.camera.horizontal,
                                   launchParams.camera.direction));
+
+    // instance levels of detail depend on the camera, too; we only
+    // need to rebuild the (cheap) instance accel if any changed
+    if (updateLODSelection() && sceneTlasBuffer.d_ptr) {
+      makeCurrent();
+      CUDA_CHECK(StreamSynchronize(stream));
+      sceneTlasBuffer.free();
+      launchParams.traversable = buildAccelInstances(meshesGAS, spheresGAS);
+      historyValid = false;
+      occludersValid = false;
+    }
   }
   
   /*! resize frame buffer to given resolution */
   void SampleRenderer::resize(const vec2i &newSize)
   {
-    // resize our cuda frame buffer
-    colorBuffer.resize(newSize.x*newSize.y*sizeof(uint32_t));
+    GDT_PROFILE_SCOPE("resize");
+    makeCurrent();
+    // resize the frame buffers (and their host staging memory) of
+    // all frames in flight; any frames still in flight are of the
+    // old size, so wait for, and then drop them. buffers are always
+    // big enough for the full frame, so neither setRows() nor
+    // setRenderSize() ever have to reallocate; and they only ever
+    // grow, so the window shrinking (and growing back) doesn't
+    // either
+    CUDA_CHECK(StreamSynchronize(stream));
+    const size_t sizeInBytes = newSize.x*newSize.y*sizeof(uint32_t);
+    for (auto &frame : frames) {
+      if (frame.colorBuffer.sizeInBytes >= sizeInBytes) continue;
+      frame.colorBuffer.resize(sizeInBytes);
+      if (frame.hostPixels)
+        CUDA_CHECK(FreeHost(frame.hostPixels));
+      CUDA_CHECK(MallocHost((void**)&frame.hostPixels,sizeInBytes));
+    }
+    frameRing.reset();
 
     // update the launch parameters that we'll pass to the optix
-    // launch:
-    launchParams.frame.size  = newSize;
-    launchParams.frame.colorBuffer = (uint32_t*)colorBuffer.d_pointer();
+    // launch (the color buffer gets set per frame):
+    launchParams.frame.fullSize = newSize;
+    setRenderSize(newSize);
+    updateRateMap();
+    historyValid = false;
 
     // and re-set the camera, since aspect may have changed
     setCamera(lastSetCamera);
   }
 
-  /*! download the rendered color buffer */
+  /*! render the frame at the given resolution from now on */
+  void SampleRenderer::setRenderSize(const vec2i &renderSize)
+  {
+    const vec2i fullSize = launchParams.frame.fullSize;
+    if (renderSize.x < 0 || renderSize.y < 0
+        || renderSize.x > fullSize.x || renderSize.y > fullSize.y)
+      throw std::runtime_error("SampleRenderer::setRenderSize: larger than the frame");
+    launchParams.frame.renderSize = renderSize;
+    setRows(0,renderSize.y,1);
+  }
+
+  /*! render only the given rows of the frame from now on */
+  void SampleRenderer::setRows(int rowOffset, int numRows, int rowStride)
+  {
+    const vec2i renderSize = launchParams.frame.renderSize;
+    if (rowOffset < 0 || rowStride < 1 || numRows < 0
+        || (numRows > 0 && rowOffset+(numRows-1)*rowStride >= renderSize.y))
+      throw std::runtime_error("SampleRenderer::setRows: rows outside the frame");
+    launchParams.frame.size      = vec2i(renderSize.x,numRows);
+    launchParams.frame.rowOffset = rowOffset;
+    launchParams.frame.rowStride = rowStride;
+  }
+
+  /*! download the most recently rendered frame */
   void SampleRenderer::downloadPixels(uint32_t h_pixels[])
   {
-    colorBuffer.download(h_pixels,
-                         launchParams.frame.size.x*launchParams.frame.size.y);
+    GDT_PROFILE_SCOPE("downloadPixels");
+    const int slot = frameRing.newestSlot();
+    if (slot < 0) return;
+
+    makeCurrent();
+    InFlightFrame &frame = frames[slot];
+    CUDA_CHECK(EventSynchronize(frame.done));
+    memcpy(h_pixels,frame.hostPixels,frame.size.x*frame.size.y*sizeof(uint32_t));
   }
   
 } // ::osc
@@ -19,43 +19,22 @@
 // our own classes, partly shared between host and device
 #include "CUDABuffer.h"
 #include "LaunchParams.h"
-#include "gdt/math/AffineSpace.h"
+#include "Geometry.h"
+#include "FrameRing.h"
+#include "ModuleCache.h"
+#include "Foveation.h"
 
 namespace osc {
 
-  struct Camera {
-    /*! camera position - *from* where we are looking */
-    vec3f from;
-    /*! which point we are looking *at* */
-    vec3f at;
-    /*! general up-vector */
-    vec3f up;
+  /*! which shadow rays get traced at all; see LaunchParams::shadows */
+  struct ShadowRayPolicy {
+    /*! skip shadow rays from surfaces that face away from the light */
+    bool cullBackFacing { true };
+    /*! remember, per pixel, what blocked its shadow ray, and test
+        that before tracing the next one */
+    bool occluderCache  { false };
   };
-  
-  /*! a simple indexed triangle mesh that our sample renderer will
-      render */
-
-  struct TriangleMesh {
-    
-    std::vector<vec3f> vertex;
-    std::vector<vec3i> index;
-    vec3f              color;
-  };
-
-  struct Sphere {
-      float radius;
-      vec3f color;
-      vec3f center;
-  };
-
-  struct Geometry {
-      void addUnitCube(const affine3f& xfm, const vec3f& color);
-      void addCube(const vec3f& center, const vec3f& size, const vec3f& color);
-      void addSphere(const float r, const vec3f cen, const vec3f col);
 
-      std::vector<TriangleMesh> meshes;
-      std::vector<Sphere> spheres;
-  };
   /*! a sample OptiX-7 renderer that demonstrates how to set up
       context, module, programs, pipeline, SBT, etc, and perform a
       valid launch that renders some pixel (using a simple test
@@ -67,20 +46,127 @@ namespace osc {
     // ------------------------------------------------------------------
   public:
     /*! constructor - performs all setup, including initializing
-      optix, creates module, pipeline, programs, SBT, etc. */
-    SampleRenderer(const Geometry &scene);
+      optix, creates module, pipeline, programs, SBT, etc. up to
+      numFramesInFlight frames can be rendering (or be read back) at
+      the same time. everything runs on the given CUDA device */
+    SampleRenderer(const Geometry &scene, int numFramesInFlight = 2,
+                   int deviceID = 0);
+    /*! waits for the frames in flight, then frees all device and
+        pinned host memory, the events and stream, and the optix
+        pipeline, programs, module, and context */
+    ~SampleRenderer();
+    SampleRenderer(const SampleRenderer &) = delete;
+    SampleRenderer &operator=(const SampleRenderer &) = delete;
 
-    /*! render one frame */
+    /*! start rendering one frame; this only enqueues the launch and
+        the readback on our stream, and returns right away (unless
+        all frames are still in flight) */
     void render();
 
-    /*! resize frame buffer to given resolution */
+    /*! the frame to display now, in pinned host memory, or null if
+        not enough frames have been rendered yet. with N frames in
+        flight this is the frame started N-1 render() calls ago; we
+        wait for it to be done if it isn't yet. the pointer stays
+        valid until the next render() */
+    const uint32_t *mapFrame(vec2i &size);
+
+    /*! resize frame buffer to given resolution; this renders all
+        rows of it, at full resolution, until setRows() or
+        setRenderSize() say otherwise */
     void resize(const vec2i &newSize);
 
-    /*! download the rendered color buffer */
+    /*! from the next render() on, render the frame at the given
+        resolution (at most the one from resize()), for mapFrame() to
+        return and the display to scale up; renders all rows of it,
+        until setRows() says otherwise. this only changes the next
+        launches: frames in flight, frame buffers, and all per-pixel
+        state (reprojection history, rate map, cached occluders) stay
+        as they are, so it's cheap enough to change every frame */
+    void setRenderSize(const vec2i &renderSize);
+
+    /*! from the next render() on, render only numRows rows of the
+        frame (at its render size), starting at rowOffset, rowStride
+        rows apart; those end up packed in the frames mapFrame()
+        returns. frames already in flight keep the rows they were
+        started with */
+    void setRows(int rowOffset, int numRows, int rowStride = 1);
+
+    /*! seconds the device spent on the frame last returned by
+        mapFrame(), from its launch to the end of its readback */
+    double getMappedFrameTime() const { return mappedFrameTime; }
+
+    /*! collect ray statistics for the frames to come */
+    void setRayStatsEnabled(bool enabled);
+    /*! show per-pixel cost instead of the shaded image (this needs
+        ray statistics, so turns those on, too) */
+    void setHeatmapEnabled(bool enabled);
+    /*! ray statistics of the frame last returned by mapFrame(), or
+        null if that frame didn't collect any */
+    const RayStats *getRayStats() const;
+
+    /*! trace fewer pixels outside the given regions of interest; no
+        regions traces all pixels again. frames that cover all rows
+        get the untraced pixels filled in by mapFrame(); otherwise
+        that's up to whoever composites them */
+    void setFoveation(const Foveation &foveation);
+    /*! the rate map (see LaunchParams::foveation) of the frames to
+        come, for the current size; empty without foveation */
+    const std::vector<uint8_t> &getRateMap() const { return rateMap; }
+    /*! fraction of the pixels that rate map traces */
+    double getTracedFraction() const { return rateMapTracedFraction; }
+
+    /*! reuse the last frame's pixels where they're still visible
+        (moved to where the camera sees them now), and trace only the
+        rest. this needs the whole frame, so frames that render only
+        some rows, and heatmap frames, always trace all pixels */
+    void setReprojectionEnabled(bool enabled);
+
+    /*! take diffuse indirect light from a world-space radiance cache
+        (see LaunchParams::radianceCache) instead of a constant
+        ambient term. turning it on starts with an empty cache; it
+        also gets emptied whenever the geometry changes */
+    void setRadianceCacheEnabled(bool enabled);
+
+    /*! which shadow rays to trace, from the next render() on */
+    void setShadowRayPolicy(const ShadowRayPolicy &policy);
+
+    /*! seconds the constructor spent building all accels */
+    double getAccelBuildTime() const { return accelBuildTime; }
+
+    /*! seconds the constructor spent creating module, program
+        groups, and pipeline */
+    double getCompileTime() const { return compileTime; }
+    /*! whether those came from a warm module cache */
+    bool wasModuleCacheWarm() const { return moduleCacheWarm; }
+
+    /*! download the most recently rendered frame, waiting for it to
+        complete */
     void downloadPixels(uint32_t h_pixels[]);
 
     /*! set camera to render with */
     void setCamera(const Camera &camera);
+
+    /*! replace all triangle meshes, and rebuild accels and SBT */
+    void setMeshes(const std::vector<TriangleMesh> &meshes);
+    /*! same as setMeshes(), but for meshes somebody else keeps in
+        memory (eg, the resident out-of-core chunks): these only get
+        uploaded, and we don't keep a host copy of our own, except
+        for their colors. getMeshes() then only has those colors, and
+        bakeLighting() doesn't work */
+    void setStreamedMeshes(const std::vector<std::shared_ptr<const TriangleMesh>> &meshes);
+    /*! the triangle meshes we render */
+    const std::vector<TriangleMesh> &getMeshes() const { return scene.meshes; }
+
+    /*! bake ambient occlusion (numSamples rays per vertex, looking
+        for occluders up to aoRadius away) and the point light's
+        direct light into all vertices of all triangle meshes (but not
+        instanced ones), and from then on shade those from that
+        instead of tracing shadow rays. the results end up in the
+        meshes' bakedLight, so other renderers can get them through
+        getMeshes() and setMeshes(). meshes need to be fine enough
+        for that to show shadows; see Geometry::tessellateForBaking().
+        returns the seconds the bake took */
+    double bakeLighting(int numSamples, float aoRadius);
   protected:
     // ------------------------------------------------------------------
     // internal helper functions
@@ -88,6 +174,12 @@ namespace osc {
 
     /*! helper function that initializes optix and checks for errors */
     void initOptix();
+
+    /*! make our device's context the calling thread's current one;
+        every public function that touches the device calls this
+        first, so that renderers on different devices can be used
+        from the same thread */
+    void makeCurrent();
   
     /*! creates and configures a optix device context (in this simple
       example, only for the primary GPU device) */
@@ -98,6 +190,14 @@ namespace osc {
       single .cu file, using a single embedded ptx string */
     void createModule();
     
+    /*! sets up the module cache for the current module and pipeline
+        compile options; returns whether it already has an entry */
+    bool setupModuleCache();
+
+    /*! creates one program group per descriptor, in parallel */
+    std::vector<OptixProgramGroup>
+    createProgramGroups(const std::vector<OptixProgramGroupDesc> &pgDescs);
+    
     /*! does all setup for the raygen program(s) we are going to use */
     void createRaygenPrograms();
     
@@ -113,8 +213,56 @@ namespace osc {
     /*! constructs the shader binding table */
     void buildSBT();
 
-    /*! build an acceleration structure for the given triangle mesh */
-    OptixTraversableHandle buildAccelMeshes();
+    /*! build an acceleration structure for the given triangle
+        meshes */
+    OptixTraversableHandle buildAccelMeshes(const std::vector<const TriangleMesh *> &meshes);
+
+    /*! free the current meshes' device buffers, upload the given ones
+        instead, and rebuild everything that depends on them;
+        scene.meshes needs to have their colors (for the SBT) */
+    void replaceMeshes(const std::vector<const TriangleMesh *> &meshes);
+
+    /*! device copies of a mesh's optional shading attribute streams
+        (see TriangleMesh); those the mesh doesn't have stay
+        unallocated, so the hit programs find null pointers */
+    struct MeshAttributeBuffers {
+      CUDABuffer triangleColor;
+      CUDABuffer vertexColor;
+      CUDABuffer normal;
+
+      void free()
+      {
+        triangleColor.free();
+        vertexColor.free();
+        normal.free();
+      }
+    };
+
+    /*! build a (compacted) acceleration structure over the given
+        triangle meshes, uploading their vertices, indices, and
+        attribute streams to the given (one per mesh) buffers */
+    OptixTraversableHandle buildAccelTriangles(const TriangleMesh *const *meshes,
+                                               size_t numMeshes,
+                                               CUDABuffer *vertexBuffer,
+                                               CUDABuffer *indexBuffer,
+                                               MeshAttributeBuffers *attributeBuffer,
+                                               CUDABuffer &blasBuffer);
+
+    /*! build one acceleration structure for every level of detail of
+        every instanced mesh */
+    void buildAccelLODs();
+
+    /*! make sure the history buffers and the reprojection target
+        can hold numPixels pixels */
+    void allocHistory(size_t numPixels);
+    
+    /*! rebuild and upload the rate map, for the current foveation
+        and size */
+    void updateRateMap();
+
+    /*! pick the level of detail for each instance, based on the last
+        set camera; returns true if any instance's level changed */
+    bool updateLODSelection();
 
     /*! build an acceleration structure for the given triangle mesh */
     OptixTraversableHandle buildAccelSpheres();
@@ -124,22 +272,23 @@ namespace osc {
   protected:
     /*! @{ CUDA device context and stream that optix pipeline will run
         on, as well as device properties for this device */
-    CUcontext          cudaContext;
-    CUstream           stream;
+    int                deviceID;
+    CUcontext          cudaContext { nullptr };
+    CUstream           stream      { nullptr };
     cudaDeviceProp     deviceProps;
     /*! @} */
 
     //! the optix context that our pipeline will run in.
-    OptixDeviceContext optixContext;
+    OptixDeviceContext optixContext { nullptr };
 
     /*! @{ the pipeline we're building */
-    OptixPipeline               pipeline;
+    OptixPipeline               pipeline { nullptr };
     OptixPipelineCompileOptions pipelineCompileOptions;
     OptixPipelineLinkOptions    pipelineLinkOptions;
     /*! @} */
 
     /*! @{ the module that contains out device programs */
-    OptixModule                 module;
+    OptixModule                 module { nullptr };
     OptixModuleCompileOptions   moduleCompileOptions;
     /* @} */
 
@@ -153,29 +302,152 @@ namespace osc {
     CUDABuffer hitgroupRecordsBuffer;
     OptixShaderBindingTable sbt = {};
 
-    /*! @{ our launch parameters, on the host, and the buffer to store
-        them on the device */
-    LaunchParams launchParams;
-    CUDABuffer   launchParamsBuffer;
+    /*! our launch parameters, on the host; each frame in flight has
+        its own copy of them on the device */
+    LaunchParams launchParams {};
+
+    /*! everything one frame in flight needs: its device color buffer
+        and launch params, the pinned host memory both get staged
+        through, and an event that fires once the frame is read
+        back */
+    struct InFlightFrame {
+      CUDABuffer    colorBuffer;
+      CUDABuffer    launchParamsBuffer;
+      LaunchParams *hostLaunchParams { nullptr };
+      uint32_t     *hostPixels       { nullptr };
+      vec2i         size             { 0 };
+      /*! mark launch start and readback end, for timing */
+      cudaEvent_t   begin            { nullptr };
+      cudaEvent_t   done             { nullptr };
+      /*! RAY_STATS_BINS bins, on the device and pinned on the host */
+      CUDABuffer    rayStatsBuffer;
+      RayStats     *hostRayStats     { nullptr };
+      bool          hasRayStats      { false };
+      /*! whether this frame covers all rows, and got rendered with a
+          rate map, so mapFrame() has pixels to fill in */
+      bool          needsReconstruction { false };
+    };
+    FrameRing                  frameRing;
+    std::vector<InFlightFrame> frames;
+
+    /*! @{ ray statistics and heatmap state; see setRayStatsEnabled()
+        and setHeatmapEnabled() */
+    bool         rayStatsEnabled { false };
+    bool         heatmapEnabled  { false };
+    /*! stats of the frame last returned by mapFrame() */
+    RayStats     mappedRayStats;
+    bool         haveMappedRayStats { false };
     /*! @} */
 
-    CUDABuffer colorBuffer;
+    /*! @{ see setFoveation(); the rate map lives on the device, too */
+    Foveation            foveation;
+    std::vector<uint8_t> rateMap;
+    CUDABuffer           rateMapBuffer;
+    double               rateMapTracedFraction { 1. };
+    /*! @} */
+
+    /*! @{ temporal reprojection; see setReprojectionEnabled(). frames
+        alternate between writing history[0] and history[1], and
+        reproject the other one */
+    struct HistoryBuffers {
+      CUDABuffer color;
+      CUDABuffer depth;
+      CUDABuffer hitID;
+      CUDABuffer age;
+    };
+    bool           reprojectionEnabled { false };
+    HistoryBuffers history[2];
+    int            currentHistory { 0 };
+    /*! whether the last frame launched left history to reproject;
+        anything that changes what's visible without moving the
+        camera clears this */
+    bool           historyValid { false };
+    RayCamera      historyCamera;
+    /*! the render size the last frame's history is at */
+    vec2i          historySize { 0 };
+    CUDABuffer     reprojectedBuffer;
+    uint32_t       frameIndex { 0 };
+    /*! reprojected pixels drift by up to half a pixel each frame, so
+        each one gets traced again after at most this many frames */
+    int            maxReprojectionAge { 8 };
+    /*! @} */
+
+    /*! @{ radiance cache; see setRadianceCacheEnabled() */
+    CUDABuffer     radianceCacheBuffer;
+    uint32_t       radianceCacheFrame { 0 };
+    /*! @} */
+    /*! empty the radiance cache, if there is one */
+    void clearRadianceCache();
+
+    /*! @{ shadow rays; see setShadowRayPolicy() */
+    ShadowRayPolicy shadowRayPolicy;
+    CUDABuffer      occluderBuffer;
+    /*! whether occluderBuffer holds only geometry we still have;
+        cleared whenever that changes */
+    bool            occludersValid { false };
+    /*! @} */
+
+    /*! see getMappedFrameTime() */
+    double       mappedFrameTime { 0. };
 
     /*! the camera we are to render with. */
     Camera lastSetCamera;
     
     /*! the model we are going to trace rays against */
     Geometry scene;
+    /*! whether scene.meshes only has the colors of the meshes we
+        trace against; see setStreamedMeshes() */
+    bool     meshesStreamed { false };
+
+    /*! see getAccelBuildTime() */
+    double accelBuildTime = 0.;
+    /*! see getCompileTime() */
+    double compileTime = 0.;
+
+    /*! @{ on-disk cache of compiled programs; see ModuleCache */
+    ModuleCache    moduleCache;
+    ModuleCacheKey moduleCacheKey;
+    /*! whether optix got a cache directory at all */
+    bool           moduleCacheEnabled = false;
+    /*! whether that directory had a complete entry already */
+    bool           moduleCacheWarm = false;
+    /*! what compiling took when that entry was made */
+    double         coldCompileTime = 0.;
+    /*! @} */
     /*! one buffer per input mesh */
     std::vector<CUDABuffer> vertexBuffer;
     /*! one buffer per input mesh */
     std::vector<CUDABuffer> indexBuffer;
-    /*! one buffer per input sphere*/
-    std::vector<CUDABuffer> aabbBuffer;
+    /*! one set per input mesh */
+    std::vector<MeshAttributeBuffers> attributeBuffer;
+    /*! one buffer per input mesh; stays empty for meshes without
+        baked lighting */
+    std::vector<CUDABuffer> bakedLightBuffer;
+    /*! @{ per-sphere attributes, indexed by primitive ID */
+    CUDABuffer sphereCenterBuffer;
+    CUDABuffer sphereRadiusBuffer;
+    CUDABuffer sphereColorBuffer;
+    /*! @} */
     //! buffer that keeps the (final, compacted) accel structure
     CUDABuffer meshBlasBuffer;
     CUDABuffer sphereBlasBuffer;
     CUDABuffer sceneTlasBuffer;
+    OptixTraversableHandle meshesGAS  { 0 };
+    OptixTraversableHandle spheresGAS { 0 };
+
+    /*! @{ one entry per level of each instanced mesh, flattened; the
+        levels of instanced mesh i start at lodFirstLevel[i] */
+    std::vector<int>                    lodFirstLevel;
+    std::vector<CUDABuffer>             lodVertexBuffer;
+    std::vector<CUDABuffer>             lodIndexBuffer;
+    std::vector<MeshAttributeBuffers>   lodAttributeBuffer;
+    std::vector<CUDABuffer>             lodBlasBuffer;
+    std::vector<OptixTraversableHandle> lodGAS;
+    /*! @} */
+    /*! @{ one per instance */
+    std::vector<box3f>                  instanceBounds;
+    std::vector<int>                    selectedLOD;
+    /*! @} */
   };
 
 } // ::osc
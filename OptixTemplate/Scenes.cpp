@@ -0,0 +1,340 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "Scenes.h"
+#include "gdt/random/random.h"
+#include "3rdParty/ply.h"
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "3rdParty/tiny_obj_loader.h"
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <tuple>
+
+namespace osc {
+
+  /*! a finely tessellated (uv-)sphere mesh, as a 'heavy' mesh to
+      instance */
+  TriangleMesh makeTessellatedSphere(const vec3f &center,
+                                     float radius,
+                                     const vec3f &color,
+                                     int numSegments)
+  {
+    TriangleMesh mesh;
+    mesh.color = color;
+    const int numRings = numSegments/2;
+    constexpr float pi = 3.14159265358979f;
+    for (int j=0;j<=numRings;j++)
+      for (int i=0;i<numSegments;i++) {
+        const float theta = pi*j/numRings;
+        const float phi   = 2.f*pi*i/numSegments;
+        mesh.vertex.push_back(center + radius*vec3f(sinf(theta)*cosf(phi),
+                                                    cosf(theta),
+                                                    sinf(theta)*sinf(phi)));
+      }
+    for (int j=0;j<numRings;j++)
+      for (int i=0;i<numSegments;i++) {
+        const int i00 = j*numSegments+i;
+        const int i01 = j*numSegments+(i+1)%numSegments;
+        const int i10 = i00+numSegments;
+        const int i11 = i01+numSegments;
+        if (j > 0)          mesh.index.push_back(vec3i(i00,i01,i11));
+        if (j < numRings-1) mesh.index.push_back(vec3i(i00,i11,i10));
+      }
+    return mesh;
+  }
+
+  void addDemoScene(Geometry &scene)
+  {
+    scene.addCube(vec3f(0.f, -1.5f, 0.f),        // Position
+                  vec3f(10.f, .1f, 10.f),        // Size
+                  vec3f(1.0f, 1.0f, 1.0f));      // Color
+
+    scene.addSphere(0.3f,                        // Radius
+                    vec3f(3.0f, 1.0f, 0.0f),     // Center
+                    vec3f(1.f, 1.f, 1.f));       // Color
+    scene.addSphere(1.0f, vec3f(0.0f, 0.0f, 0.0f), vec3f(1.f, 0.5f, 0.5f));
+    scene.addCube(vec3f(4.0f, 0.0f, 0.0f), vec3f(1.5f, 1.5f, 1.5f), vec3f(0.2f, 0.9f, 0.2f));
+  }
+
+  void addRandomPrims(Geometry &scene, int numPrims)
+  {
+    // all cubes end up in one mesh, and all spheres in one build
+    // input
+    LCG<16> random(0,0);
+    const size_t numCubes = numPrims/2, numSpheres = numPrims-numCubes;
+    std::vector<vec3f> center(numPrims), size(numCubes), color(numPrims);
+    std::vector<float> radius(numSpheres);
+    for (int i=0;i<numPrims;i++) {
+      const float r = .02f + .08f*random();
+      center[i] = vec3f(10.f*random()-5.f, -1.45f+r, 10.f*random()-5.f);
+      color[i]  = vec3f(random(),random(),random());
+      if (i < (int)numCubes) size[i] = vec3f(2.f*r);
+      else radius[i-numCubes] = r;
+    }
+    scene.addCubes(center.data(),size.data(),color.data(),numCubes);
+    scene.addSpheres(radius.data(),center.data()+numCubes,color.data()+numCubes,
+                     numSpheres);
+  }
+
+  void addInstanceGrid(Geometry &scene, int numInstances)
+  {
+    const int meshID
+      = scene.addInstancedMesh(makeTessellatedSphere(vec3f(0.f),.4f,
+                                                     vec3f(.3f,.5f,.9f),
+                                                     512));
+    const int gridSize = (int)ceilf(sqrtf((float)numInstances));
+    for (int i=0;i<numInstances;i++) {
+      const vec3f pos(6.f + (i % gridSize), -1.f, float(i / gridSize) - .5f*gridSize);
+      scene.addInstance(meshID,affine3f::translate(pos));
+    }
+    scene.buildLODs();
+  }
+
+  static void loadOBJ(Geometry &scene, const std::string &fileName,
+                      const vec3f &defaultColor)
+  {
+    tinyobj::attrib_t                attrib;
+    std::vector<tinyobj::shape_t>    shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string                      warn, err;
+    const std::string baseDir = fileName.substr(0,fileName.rfind('/')+1);
+    if (!tinyobj::LoadObj(&attrib,&shapes,&materials,&warn,&err,
+                          fileName.c_str(),baseDir.c_str(),/*triangulate*/true))
+      throw std::runtime_error("could not read OBJ file '"+fileName+"': "+err);
+
+    auto materialColor = [&](int materialID) {
+      if (materialID < 0 || materialID >= (int)materials.size())
+        return defaultColor;
+      const tinyobj::material_t &material = materials[materialID];
+      return vec3f(material.diffuse[0],material.diffuse[1],material.diffuse[2]);
+    };
+    
+    for (auto &shape : shapes) {
+      TriangleMesh mesh;
+      const std::vector<int> &materialIDs = shape.mesh.material_ids;
+      mesh.color = materialColor(materialIDs.empty() ? -1 : materialIDs[0]);
+      // shapes with more than one material get per-triangle colors
+      const bool perTriangleColors
+        = std::find_if(materialIDs.begin(),materialIDs.end(),
+                       [&](int id) { return id != materialIDs[0]; }) != materialIDs.end();
+      
+      // normals and texture coordinates only if every corner has
+      // one; obj indexes those separately from positions, so a
+      // vertex is a unique combination of all three
+      const std::vector<tinyobj::index_t> &indices = shape.mesh.indices;
+      bool hasNormals = !attrib.normals.empty(), hasTexcoords = !attrib.texcoords.empty();
+      for (auto &index : indices) {
+        hasNormals   &= index.normal_index   >= 0;
+        hasTexcoords &= index.texcoord_index >= 0;
+      }
+      
+      // obj indices are global to the file; give each shape its own
+      // compact set of vertices
+      std::map<std::tuple<int,int,int>,int> localID;
+      for (size_t i=0;i+2<indices.size();i+=3) {
+        vec3i idx;
+        for (int c=0;c<3;c++) {
+          const tinyobj::index_t &index = indices[i+c];
+          const int vID = index.vertex_index;
+          const int nID = hasNormals   ? index.normal_index   : -1;
+          const int tID = hasTexcoords ? index.texcoord_index : -1;
+          const std::tuple<int,int,int> key(vID,nID,tID);
+          auto found = localID.find(key);
+          if (found == localID.end()) {
+            found = localID.insert(std::make_pair(key,(int)mesh.vertex.size())).first;
+            mesh.vertex.push_back(vec3f(attrib.vertices[3*vID+0],
+                                        attrib.vertices[3*vID+1],
+                                        attrib.vertices[3*vID+2]));
+            if (hasNormals)
+              mesh.normal.push_back(normalize(vec3f(attrib.normals[3*nID+0],
+                                                    attrib.normals[3*nID+1],
+                                                    attrib.normals[3*nID+2])));
+            if (hasTexcoords)
+              mesh.texcoord.push_back(vec2f(attrib.texcoords[2*tID+0],
+                                            attrib.texcoords[2*tID+1]));
+          }
+          idx[c] = found->second;
+        }
+        mesh.index.push_back(idx);
+        if (perTriangleColors)
+          mesh.triangleColor.push_back(materialColor(materialIDs[i/3]));
+      }
+      if (!mesh.index.empty())
+        scene.meshes.push_back(mesh);
+    }
+  }
+
+  // 'other' receives all properties we don't ask for, if there are
+  // any
+  struct PlyVertex {
+    float x, y, z;
+    float nx, ny, nz;
+    unsigned char red, green, blue;
+    void *other;
+  };
+  struct PlyFace   { unsigned char numVertices; int *vertices; void *other; };
+  
+  static void loadPLY(Geometry &scene, const std::string &fileName,
+                      const vec3f &defaultColor)
+  {
+    PlyProperty vertexProps[] = {
+      { (char*)"x", PLY_FLOAT, PLY_FLOAT, offsetof(PlyVertex,x), 0, 0, 0, 0 },
+      { (char*)"y", PLY_FLOAT, PLY_FLOAT, offsetof(PlyVertex,y), 0, 0, 0, 0 },
+      { (char*)"z", PLY_FLOAT, PLY_FLOAT, offsetof(PlyVertex,z), 0, 0, 0, 0 },
+    };
+    // optional, both all or nothing
+    PlyProperty normalProps[] = {
+      { (char*)"nx", PLY_FLOAT, PLY_FLOAT, offsetof(PlyVertex,nx), 0, 0, 0, 0 },
+      { (char*)"ny", PLY_FLOAT, PLY_FLOAT, offsetof(PlyVertex,ny), 0, 0, 0, 0 },
+      { (char*)"nz", PLY_FLOAT, PLY_FLOAT, offsetof(PlyVertex,nz), 0, 0, 0, 0 },
+    };
+    PlyProperty colorProps[] = {
+      { (char*)"red",   PLY_UCHAR, PLY_UCHAR, offsetof(PlyVertex,red),   0, 0, 0, 0 },
+      { (char*)"green", PLY_UCHAR, PLY_UCHAR, offsetof(PlyVertex,green), 0, 0, 0, 0 },
+      { (char*)"blue",  PLY_UCHAR, PLY_UCHAR, offsetof(PlyVertex,blue),  0, 0, 0, 0 },
+    };
+    PlyProperty faceProp =
+      { (char*)"vertex_indices", PLY_INT, PLY_INT, offsetof(PlyFace,vertices),
+        1, PLY_UCHAR, PLY_UCHAR, offsetof(PlyFace,numVertices) };
+    
+    int numElements, fileType;
+    char **elementNames;
+    float version;
+    PlyFile *ply = ply_open_for_reading((char*)fileName.c_str(),&numElements,
+                                        &elementNames,&fileType,&version);
+    if (!ply)
+      throw std::runtime_error("could not read PLY file '"+fileName+"'");
+
+    TriangleMesh mesh;
+    mesh.color = defaultColor;
+    for (int e=0;e<numElements;e++) {
+      int numItems, numProps;
+      char *elementName = elementNames[e];
+      PlyProperty **props = ply_get_element_description(ply,elementName,&numItems,&numProps);
+      auto hasAll = [&](PlyProperty (&wanted)[3]) {
+        int numFound = 0;
+        for (auto &w : wanted)
+          for (int p=0;p<numProps;p++)
+            if (equal_strings(w.name,props[p]->name)) { numFound++; break; }
+        return numFound == 3;
+      };
+      if (equal_strings("vertex",elementName)) {
+        const bool hasNormals = hasAll(normalProps);
+        const bool hasColors  = hasAll(colorProps);
+        for (auto &prop : vertexProps)
+          ply_get_property(ply,elementName,&prop);
+        if (hasNormals)
+          for (auto &prop : normalProps)
+            ply_get_property(ply,elementName,&prop);
+        if (hasColors)
+          for (auto &prop : colorProps)
+            ply_get_property(ply,elementName,&prop);
+        ply_get_other_properties(ply,elementName,offsetof(PlyVertex,other));
+        for (int i=0;i<numItems;i++) {
+          PlyVertex v = {};
+          ply_get_element(ply,&v);
+          mesh.vertex.push_back(vec3f(v.x,v.y,v.z));
+          if (hasNormals)
+            mesh.normal.push_back(normalize(vec3f(v.nx,v.ny,v.nz)));
+          if (hasColors)
+            mesh.vertexColor.push_back(vec3f(v.red,v.green,v.blue)*(1.f/255.f));
+          free(v.other);
+        }
+      } else if (equal_strings("face",elementName)) {
+        ply_get_property(ply,elementName,&faceProp);
+        ply_get_other_properties(ply,elementName,offsetof(PlyFace,other));
+        for (int i=0;i<numItems;i++) {
+          PlyFace f = {};
+          ply_get_element(ply,&f);
+          // triangulate polygons as fans
+          for (int c=2;c<f.numVertices;c++)
+            mesh.index.push_back(vec3i(f.vertices[0],f.vertices[c-1],f.vertices[c]));
+          free(f.vertices);
+          free(f.other);
+        }
+      } else {
+        ply_get_other_element(ply,elementName,numItems);
+      }
+      for (int p=0;p<numProps;p++) {
+        free(props[p]->name);
+        free(props[p]);
+      }
+      free(props);
+    }
+    ply_close(ply);
+
+    for (auto &idx : mesh.index)
+      if (reduce_min(idx) < 0 || reduce_max(idx) >= (int)mesh.vertex.size())
+        throw std::runtime_error("invalid vertex index in PLY file '"+fileName+"'");
+    if (!mesh.index.empty())
+      scene.meshes.push_back(mesh);
+  }
+  
+  void loadMeshFile(Geometry &scene, const std::string &fileName,
+                    const vec3f &defaultColor)
+  {
+    if (hasSuffix(fileName,".obj"))
+      loadOBJ(scene,fileName,defaultColor);
+    else if (hasSuffix(fileName,".ply"))
+      loadPLY(scene,fileName,defaultColor);
+    else
+      throw std::runtime_error("don't know how to load '"+fileName+"' (only .obj and .ply)");
+  }
+
+  box3f computeBounds(const Geometry &scene)
+  {
+    box3f bounds;
+    for (auto &mesh : scene.meshes)
+      for (auto &v : mesh.vertex)
+        bounds.extend(v);
+    for (auto &sphere : scene.spheres) {
+      bounds.extend(sphere.center - vec3f(sphere.radius));
+      bounds.extend(sphere.center + vec3f(sphere.radius));
+    }
+    std::vector<box3f> meshBounds(scene.instancedMeshes.size());
+    for (size_t meshID=0;meshID<meshBounds.size();meshID++)
+      for (auto &v : scene.instancedMeshes[meshID].levels[0].vertex)
+        meshBounds[meshID].extend(v);
+    for (auto &instance : scene.instances)
+      bounds.extend(xfmBox(instance.xfm,meshBounds[instance.meshID]));
+    return bounds;
+  }
+
+  Camera demoCamera()
+  {
+    Camera camera = { /*from*/vec3f(-10.f,2.f,-12.f),
+                      /* at */vec3f(0.f,0.f,0.f),
+                      /* up */vec3f(0.f,1.f,0.f) };
+    return camera;
+  }
+  
+  Camera cameraFor(const box3f &bounds)
+  {
+    const Camera demo   = demoCamera();
+    const vec3f  dir    = normalize(demo.from - demo.at);
+    const float  radius = .5f*length(bounds.span());
+    Camera camera;
+    camera.at   = bounds.center();
+    // far enough that the bounding sphere fits into the (roughly 67
+    // degree) field of view
+    camera.from = camera.at + 1.8f*radius*dir;
+    camera.up   = demo.up;
+    return camera;
+  }
+  
+} // ::osc
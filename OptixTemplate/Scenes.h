@@ -0,0 +1,58 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "Geometry.h"
+#include "gdt/math/box.h"
+
+namespace osc {
+
+  /*! a finely tessellated (uv-)sphere mesh, as a 'heavy' mesh to
+      instance; has about numSegments^2 triangles */
+  TriangleMesh makeTessellatedSphere(const vec3f &center,
+                                     float radius,
+                                     const vec3f &color,
+                                     int numSegments);
+
+  /*! the demo scene: a floor, a cube, and two spheres */
+  void addDemoScene(Geometry &scene);
+
+  /*! scatter numPrims small cubes and spheres (half of each) over
+      the demo scene's floor; always the same ones */
+  void addRandomPrims(Geometry &scene, int numPrims);
+
+  /*! numInstances instances of a heavy sphere mesh, on a grid next
+      to the demo scene, with levels of detail */
+  void addInstanceGrid(Geometry &scene, int numInstances);
+
+  /*! load all triangles from the given .obj or .ply file, as one
+      mesh per obj shape (or one mesh for a ply file) */
+  void loadMeshFile(Geometry &scene, const std::string &fileName,
+                    const vec3f &defaultColor = vec3f(.8f));
+
+  /*! bounds of all meshes, spheres, and instances */
+  box3f computeBounds(const Geometry &scene);
+
+  /*! the camera the demo scene gets looked at from */
+  Camera demoCamera();
+  
+  /*! a camera looking at all of the given bounds from the same
+      direction as demoCamera() */
+  Camera cameraFor(const box3f &bounds);
+  
+} // ::osc
@@ -0,0 +1,595 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/*! a headless benchmark: builds a fixed set of reproducible scenes,
+    and for each measures scene (and accel) build times, primary and
+    shadow ray rates, and end-to-end frame time. results can be
+    written to a json file, and compared against one written earlier
+    (the baseline), with any metric more than a given tolerance worse
+    than the baseline being reported - and failing the run */
+
+#include "SampleRenderer.h"
+#include "Scenes.h"
+#include "MeshPreprocessing.h"
+#include "gdt/random/random.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <functional>
+
+namespace osc {
+
+  /*! metric name -> value, for one scene */
+  typedef std::map<std::string,double> Metrics;
+  /*! scene name -> metrics, in the order the scenes were run */
+  typedef std::vector<std::pair<std::string,Metrics>> Results;
+
+  struct BenchScene {
+    std::string name;
+    std::function<void(Geometry &)> build;
+    /*! no regions (the default) traces all pixels */
+    Foveation   foveation;
+    /*! if set, the camera orbits the scene a bit every frame, instead
+        of staying put */
+    bool        cameraPath;
+    /*! reuse the last frame's pixels where possible */
+    bool        reproject;
+    /*! diffuse indirect light from the radiance cache */
+    bool        radianceCache;
+    /*! tessellate the meshes, and bake lighting into them */
+    bool        bake;
+    /*! test each pixel's last shadow ray occluder before tracing */
+    bool        occluderCache;
+  };
+
+  /*! the camera for the given frame of the scripted path: orbiting
+      around start.at, a quarter of a degree per frame */
+  Camera pathCamera(const Camera &start, int frame)
+  {
+    constexpr float pi = 3.14159265358979f;
+    const float angle = frame*.25f*pi/180.f;
+    const vec3f offset = start.from-start.at;
+    Camera camera = start;
+    camera.from = start.at + vec3f(cosf(angle)*offset.x - sinf(angle)*offset.z,
+                                   offset.y,
+                                   sinf(angle)*offset.x + cosf(angle)*offset.z);
+    return camera;
+  }
+
+  /*! times, per-frame costs, and ray counts are 'the lower the
+      better'; everything else (rates) is 'the higher the better' */
+  inline bool lowerIsBetter(const std::string &metric)
+  {
+    return hasSuffix(metric,"Time") || hasSuffix(metric,"PerFrame")
+      || hasSuffix(metric,"Rays");
+  }
+
+  /*! numCubes small cubes of random colors on the demo scene's floor,
+      each one a mesh of its own (as if loaded from a file that has
+      many small objects) */
+  void addSeparateCubes(Geometry &scene, int numCubes)
+  {
+    LCG<16> random(0,0);
+    for (int i=0;i<numCubes;i++) {
+      const float size = .04f + .16f*random();
+      affine3f xfm = affine3f::scale(vec3f(size));
+      xfm.p = vec3f(10.f*random()-5.f, -1.45f, 10.f*random()-5.f);
+      scene.addUnitCube(xfm,vec3f(random(),random(),random()));
+    }
+  }
+
+  /*! about numTriangles triangles, in one mesh, on the demo scene's
+      floor */
+  void addProceduralMesh(Geometry &scene, int numTriangles)
+  {
+    scene.addCube(vec3f(0.f,-1.5f,0.f),vec3f(10.f,.1f,10.f),vec3f(1.f));
+    scene.meshes.push_back(makeTessellatedSphere(vec3f(0.f,1.5f,0.f),3.f,vec3f(.8f,.6f,.3f),
+                                                 (int)sqrtf((float)numTriangles)));
+  }
+
+  /*! numSpheres small random spheres, on the demo scene's floor;
+      always the same ones */
+  void addRandomSpheres(Geometry &scene, int numSpheres)
+  {
+    scene.addCube(vec3f(0.f,-1.5f,0.f),vec3f(10.f,.1f,10.f),vec3f(1.f));
+    LCG<16> random(0,0);
+    std::vector<vec3f> center(numSpheres), color(numSpheres);
+    std::vector<float> radius(numSpheres);
+    for (int i=0;i<numSpheres;i++) {
+      radius[i] = .01f + .02f*random();
+      center[i] = vec3f(10.f*random()-5.f, 3.f*random()-1.45f, 10.f*random()-5.f);
+      color[i]  = vec3f(random(),random(),random());
+    }
+    scene.addSpheres(radius.data(),center.data(),color.data(),numSpheres);
+  }
+
+  /*! how the radiance cache converges, starting out empty: the rms
+      difference of the frames after 1, 2, 4, ... frames to the last
+      of numFrames (which stands in for the converged image), against
+      the bounce rays traced up to them. returns the bounce rays it
+      took to get within 1% (of full intensity) rms of that */
+  double reportCacheConvergence(SampleRenderer &renderer,
+                                const std::string &name,
+                                int numFrames)
+  {
+    renderer.setRadianceCacheEnabled(true);
+    renderer.setRayStatsEnabled(true);
+    std::vector<std::vector<uint32_t>> checkpoints;
+    std::vector<int>    checkpointFrames;
+    std::vector<double> checkpointRays;
+    double numBounceRays = 0.;
+    vec2i size;
+    for (int i=1;i<=numFrames;i++) {
+      renderer.render();
+      const uint32_t *pixels = renderer.mapFrame(size);
+      const RayStats *stats  = renderer.getRayStats();
+      if (!pixels || !stats)
+        throw std::runtime_error("no frame to measure convergence on for scene '"+name+"'");
+      numBounceRays += stats->bounceRays;
+      if ((i & (i-1)) == 0 || i == numFrames) {
+        checkpoints.push_back(std::vector<uint32_t>(pixels,pixels+size_t(size.x)*size.y));
+        checkpointFrames.push_back(i);
+        checkpointRays.push_back(numBounceRays);
+      }
+    }
+    renderer.setRayStatsEnabled(false);
+
+    const std::vector<uint32_t> &converged = checkpoints.back();
+    double raysToConverge = numBounceRays;
+    std::cout << "#osc.bench: " << name << " radiance cache convergence:" << std::endl;
+    for (size_t c=0;c+1<checkpoints.size();c++) {
+      double sum = 0.;
+      for (size_t i=0;i<converged.size();i++)
+        for (int channel=0;channel<3;channel++) {
+          const int shift = 8*channel;
+          const double diff = double((checkpoints[c][i] >> shift) & 0xff)
+            - double((converged[i] >> shift) & 0xff);
+          sum += diff*diff;
+        }
+      const double rms = sqrt(sum/(3.*converged.size()))/255.;
+      if (rms < .01 && raysToConverge == numBounceRays)
+        raysToConverge = checkpointRays[c];
+      std::cout << "#osc.bench:   " << checkpointFrames[c] << " frames, "
+                << prettyNumber((size_t)checkpointRays[c]) << " bounce rays: rms "
+                << prettyDouble(rms) << std::endl;
+    }
+    return raysToConverge;
+  }
+
+  /*! build, render, and measure one scene */
+  Metrics runScene(const BenchScene &benchScene,
+                   const vec2i &frameSize,
+                   int numWarmupFrames,
+                   int numFrames)
+  {
+    Metrics metrics;
+    std::cout << "#osc.bench: ---------- " << benchScene.name << " ----------" << std::endl;
+    
+    const double t0 = getCurrentTime();
+    Geometry scene;
+    benchScene.build(scene);
+    scene.preprocess();
+    const float sceneSize
+      = benchScene.bake ? length(computeBounds(scene).span()) : 0.f;
+    if (benchScene.bake)
+      scene.tessellateForBaking(sceneSize/200.f);
+    metrics["sceneBuildTime"] = getCurrentTime()-t0;
+
+    // (frees its device memory again at the end of this scene)
+    SampleRenderer renderer(scene,/*numFramesInFlight*/1);
+    metrics["accelBuildTime"] = renderer.getAccelBuildTime();
+    renderer.resize(frameSize);
+    renderer.setFoveation(benchScene.foveation);
+    renderer.setReprojectionEnabled(benchScene.reproject);
+    ShadowRayPolicy shadowRayPolicy;
+    shadowRayPolicy.occluderCache = benchScene.occluderCache;
+    renderer.setShadowRayPolicy(shadowRayPolicy);
+    const Camera camera = benchScene.name.compare(0,4,"demo") == 0
+      ? demoCamera()
+      : cameraFor(computeBounds(scene));
+    renderer.setCamera(camera);
+    // (this leaves the cache converged for the frames we time, as
+    // it would be after a while of interactive use)
+    if (benchScene.radianceCache)
+      metrics["cacheConvergenceRays"]
+        = reportCacheConvergence(renderer,benchScene.name,256);
+
+    // with a single frame in flight, mapFrame() waits for each
+    // frame's launch and readback, so this is the end-to-end time
+    vec2i size;
+    int frameID = 0;
+    auto renderFrame = [&]() {
+      if (benchScene.cameraPath)
+        renderer.setCamera(pathCamera(camera,frameID++));
+      renderer.render();
+      renderer.mapFrame(size);
+    };
+    auto timeFrames = [&]() {
+      for (int i=0;i<numWarmupFrames;i++)
+        renderFrame();
+      const double t1 = getCurrentTime();
+      for (int i=0;i<numFrames;i++)
+        renderFrame();
+      return (getCurrentTime()-t1)/numFrames;
+    };
+    
+    // the same (tessellated) scene unbaked first, for what baking
+    // saves
+    if (benchScene.bake) {
+      metrics["unbakedFrameTime"] = timeFrames();
+      const double bakeTime = renderer.bakeLighting(64,.1f*sceneSize);
+      size_t numVertices = 0;
+      for (auto &mesh : renderer.getMeshes())
+        numVertices += mesh.vertex.size();
+      metrics["bakeTime"] = bakeTime;
+      metrics["bakeMVerticesPerSec"] = numVertices/bakeTime*1e-6;
+    }
+    const double frameTime = timeFrames();
+    metrics["frameTime"] = frameTime;
+    if (benchScene.bake)
+      std::cout << "#osc.bench: " << benchScene.name << " baking takes the frame time from "
+                << prettyDouble(metrics["unbakedFrameTime"]) << "s to "
+                << prettyDouble(frameTime) << "s ("
+                << int(100.*(1.-frameTime/metrics["unbakedFrameTime"])+.5) << "% less)"
+                << std::endl;
+
+    // counting rays slows the frame down, so count them in frames
+    // of their own (one, unless the camera moves; then further
+    // along the same path), and relate them to the uncounted frame
+    // time
+    renderer.setRayStatsEnabled(true);
+    const int numCountedFrames = benchScene.cameraPath ? numFrames : 1;
+    RayStats sum = {};
+    for (int i=0;i<numCountedFrames;i++) {
+      renderFrame();
+      const RayStats *stats = renderer.getRayStats();
+      if (!stats)
+        throw std::runtime_error("no ray statistics for scene '"+benchScene.name+"'");
+      sum.primaryRays  += stats->primaryRays;
+      sum.shadowRays   += stats->shadowRays;
+      sum.shadowRaysCulled += stats->shadowRaysCulled;
+      sum.shadowRaysCached += stats->shadowRaysCached;
+      sum.reusedPixels += stats->reusedPixels;
+      sum.bounceRays   += stats->bounceRays;
+    }
+    const double primaryRays = sum.primaryRays/double(numCountedFrames);
+    metrics["primaryMRaysPerSec"]  = primaryRays/frameTime*1e-6;
+    metrics["shadowMRaysPerSec"]   = sum.shadowRays/double(numCountedFrames)/frameTime*1e-6;
+    metrics["primaryRaysPerFrame"] = primaryRays;
+    metrics["shadowRaysPerFrame"]  = sum.shadowRays/double(numCountedFrames);
+    if (benchScene.radianceCache)
+      metrics["bounceRaysPerFrame"] = sum.bounceRays/double(numCountedFrames);
+    if (benchScene.reproject)
+      std::cout << "#osc.bench: " << benchScene.name << " reprojects "
+                << int(100.*sum.reusedPixels/double(sum.reusedPixels+sum.primaryRays)+.5)
+                << "% of pixels" << std::endl;
+    const uint64_t skippedShadowRays = sum.shadowRaysCulled+sum.shadowRaysCached;
+    if (skippedShadowRays)
+      std::cout << "#osc.bench: " << benchScene.name << " skips "
+                << int(100.*skippedShadowRays/double(skippedShadowRays+sum.shadowRays)+.5)
+                << "% of shadow rays (" << prettyNumber(sum.shadowRaysCulled/numCountedFrames)
+                << " culled, " << prettyNumber(sum.shadowRaysCached/numCountedFrames)
+                << " by cached occluders per frame)" << std::endl;
+    
+    if (!benchScene.foveation.regions.empty())
+      std::cout << "#osc.bench: " << benchScene.name << " traces "
+                << int(100.*renderer.getTracedFraction()+.5) << "% of pixels" << std::endl;
+    for (auto &metric : metrics)
+      std::cout << "#osc.bench: " << benchScene.name << "." << metric.first
+                << " = " << prettyDouble(metric.second) << std::endl;
+    return metrics;
+  }
+
+  void writeJSON(const std::string &fileName,
+                 const vec2i &frameSize,
+                 int numFrames,
+                 const Results &results)
+  {
+    std::ofstream out(fileName);
+    if (!out.good())
+      throw std::runtime_error("could not open '"+fileName+"' for writing");
+    out.precision(9);
+    out << "{\n"
+        << "  \"config\": { \"width\": " << frameSize.x
+        << ", \"height\": " << frameSize.y
+        << ", \"frames\": " << numFrames << " },\n"
+        << "  \"scenes\": {";
+    for (size_t i=0;i<results.size();i++) {
+      out << (i ? ",\n" : "\n") << "    \"" << results[i].first << "\": {";
+      int j=0;
+      for (auto &metric : results[i].second)
+        out << (j++ ? ", " : " ") << "\"" << metric.first << "\": " << metric.second;
+      out << " }";
+    }
+    out << "\n  }\n}\n";
+    std::cout << "#osc.bench: results written to " << fileName << std::endl;
+  }
+
+  /*! just enough of a json reader for what writeJSON() writes: all
+      numbers in nested objects, by their dotted path (such as
+      "scenes.demo.frameTime"); strings, booleans, and arrays get
+      skipped */
+  struct JSONReader {
+    JSONReader(const std::string &text) : text(text) {}
+
+    void skipSpace()
+    {
+      while (pos < text.size() && isspace((unsigned char)text[pos])) pos++;
+    }
+    void expect(char c)
+    {
+      skipSpace();
+      if (pos >= text.size() || text[pos] != c)
+        throw std::runtime_error(std::string("json: expected '")+c+"' at offset "
+                                 +std::to_string(pos));
+      pos++;
+    }
+    std::string readString()
+    {
+      expect('"');
+      std::string s;
+      while (pos < text.size() && text[pos] != '"') {
+        if (text[pos] == '\\') pos++;
+        if (pos < text.size()) s += text[pos++];
+      }
+      expect('"');
+      return s;
+    }
+    void readValue(const std::string &path)
+    {
+      skipSpace();
+      if (pos >= text.size())
+        throw std::runtime_error("json: unexpected end of file");
+      const char c = text[pos];
+      if (c == '{') {
+        pos++;
+        skipSpace();
+        if (text[pos] == '}') { pos++; return; }
+        while (1) {
+          const std::string key = readString();
+          expect(':');
+          readValue(path.empty() ? key : path+"."+key);
+          skipSpace();
+          if (pos < text.size() && text[pos] == ',') { pos++; continue; }
+          expect('}');
+          return;
+        }
+      } else if (c == '[') {
+        pos++;
+        skipSpace();
+        if (text[pos] == ']') { pos++; return; }
+        while (1) {
+          readValue("[]");
+          skipSpace();
+          if (pos < text.size() && text[pos] == ',') { pos++; continue; }
+          expect(']');
+          return;
+        }
+      } else if (c == '"') {
+        readString();
+      } else if (isalpha((unsigned char)c)) {
+        while (pos < text.size() && isalpha((unsigned char)text[pos])) pos++;
+      } else {
+        size_t end = 0;
+        const double value = std::stod(text.substr(pos,64),&end);
+        pos += end;
+        if (!path.empty() && path.find("[]") == std::string::npos)
+          values[path] = value;
+      }
+    }
+
+    const std::string text;
+    size_t pos = 0;
+    std::map<std::string,double> values;
+  };
+
+  std::map<std::string,double> readJSON(const std::string &fileName)
+  {
+    std::ifstream in(fileName);
+    if (!in.good())
+      throw std::runtime_error("could not read baseline '"+fileName+"'");
+    std::stringstream text;
+    text << in.rdbuf();
+    const std::string s = text.str();
+    JSONReader reader(s);
+    reader.readValue("");
+    return reader.values;
+  }
+
+  /*! host-only: how long computing smooth per-vertex normals (once
+      without, once with a 60 degree crease angle) takes for a
+      (welded) mesh of about numTriangles triangles */
+  Metrics runNormals(size_t numTriangles)
+  {
+    Metrics metrics;
+    std::cout << "#osc.bench: ---------- normals ----------" << std::endl;
+    TriangleMesh sphere = makeTessellatedSphere(vec3f(0.f),1.f,vec3f(1.f),
+                                                (int)sqrt((double)numTriangles));
+    preprocessMesh(sphere,PreprocessOptions());
+    const double numMTriangles = sphere.index.size()*1e-6;
+
+    const char *names[2] = { "smoothNormalsTime", "creaseNormalsTime" };
+    const float creaseAngles[2] = { 180.f, 60.f };
+    for (int i=0;i<2;i++) {
+      // (one copy at a time, so 100M-triangle meshes still fit)
+      TriangleMesh mesh = sphere;
+      const double t0 = getCurrentTime();
+      computeVertexNormals(mesh,creaseAngles[i]);
+      metrics[names[i]] = getCurrentTime()-t0;
+    }
+    metrics["normalsMTrianglesPerSec"] = numMTriangles/metrics["smoothNormalsTime"];
+
+    std::cout << "#osc.bench: normals on " << prettyNumber(sphere.index.size())
+              << " triangles" << std::endl;
+    for (auto &metric : metrics)
+      std::cout << "#osc.bench: normals." << metric.first
+                << " = " << prettyDouble(metric.second) << std::endl;
+    return metrics;
+  }
+
+  /*! returns the number of metrics more than 'tolerance' (relative)
+      worse than in the baseline */
+  int compareToBaseline(const Results &results,
+                        const std::string &baselineFileName,
+                        float tolerance)
+  {
+    const std::map<std::string,double> baseline = readJSON(baselineFileName);
+    std::cout << "#osc.bench: comparing against " << baselineFileName
+              << " (tolerance " << int(100.f*tolerance) << "%)" << std::endl;
+    int numRegressions = 0;
+    for (auto &result : results)
+      for (auto &metric : result.second) {
+        const std::string path = result.first+"."+metric.first;
+        auto found = baseline.find("scenes."+path);
+        if (found == baseline.end()) {
+          std::cout << "#osc.bench:   " << path << ": not in baseline" << std::endl;
+          continue;
+        }
+        const double base = found->second, current = metric.second;
+        const bool regressed
+          = lowerIsBetter(metric.first)
+          ? current > base*(1.+tolerance)
+          : current < base*(1.-tolerance);
+        const double change = base != 0. ? 100.*(current-base)/base : 0.;
+        std::cout << (regressed ? GDT_TERMINAL_RED : "")
+                  << "#osc.bench:   " << path << ": " << prettyDouble(base)
+                  << " -> " << prettyDouble(current)
+                  << " (" << (change >= 0. ? "+" : "") << int(change) << "%)"
+                  << (regressed ? " REGRESSION" GDT_TERMINAL_DEFAULT : "") << std::endl;
+        if (regressed) numRegressions++;
+      }
+    return numRegressions;
+  }
+  
+  extern "C" int main(int ac, char **av)
+  {
+    try {
+      vec2i frameSize(1024,768);
+      int numWarmupFrames = 5;
+      int numFrames = 50;
+      std::string jsonFileName;
+      std::string baselineFileName;
+      /*! relative amount by which a metric may be worse than the
+          baseline before it counts as a regression */
+      float tolerance = .1f;
+      /*! if non-empty, only run scenes with these names */
+      std::vector<std::string> onlyScenes;
+      std::vector<std::string> meshFileNames;
+      /*! mesh size for the (host-only) normals benchmark */
+      size_t numNormalsTriangles = 10000000;
+      for (int i=1;i<ac;i++) {
+        const std::string arg = av[i];
+        if (arg == "--size" && i+2 < ac) {
+          frameSize.x = std::stoi(av[++i]);
+          frameSize.y = std::stoi(av[++i]);
+        } else if (arg == "--frames" && i+1 < ac)
+          numFrames = std::max(1,std::stoi(av[++i]));
+        else if (arg == "--warmup" && i+1 < ac)
+          numWarmupFrames = std::max(0,std::stoi(av[++i]));
+        else if (arg == "--json" && i+1 < ac)
+          jsonFileName = av[++i];
+        else if (arg == "--baseline" && i+1 < ac)
+          baselineFileName = av[++i];
+        else if (arg == "--tolerance" && i+1 < ac)
+          tolerance = std::stof(av[++i]);
+        else if (arg == "--scene" && i+1 < ac)
+          onlyScenes.push_back(av[++i]);
+        else if (arg == "--load" && i+1 < ac)
+          meshFileNames.push_back(av[++i]);
+        else if (arg == "--normals-triangles" && i+1 < ac)
+          numNormalsTriangles = std::stoul(av[++i]);
+        else
+          throw std::runtime_error("unknown cmdline argument '"+arg+"'");
+      }
+
+      std::vector<BenchScene> benchScenes = {
+        { "demo",         [](Geometry &scene){ addDemoScene(scene); } },
+        // the same, tracing all pixels only in the middle of the
+        // frame, for what that saves
+        { "demoFoveated", [](Geometry &scene){ addDemoScene(scene); },
+          makeFovea(vec2f(.5f),.3f) },
+        // the camera orbiting the scene, without and with reusing
+        // the last frame's pixels
+        { "demoPath",            [](Geometry &scene){ addDemoScene(scene); },
+          Foveation(), true, false },
+        { "demoPathReprojected", [](Geometry &scene){ addDemoScene(scene); },
+          Foveation(), true, true },
+        // diffuse indirect light from the radiance cache
+        { "demoRadianceCache",   [](Geometry &scene){ addDemoScene(scene); },
+          Foveation(), false, false, true },
+        // with lighting baked into (finely tessellated) vertices
+        { "demoBaked",           [](Geometry &scene){ addDemoScene(scene); },
+          Foveation(), false, false, false, true },
+        // the camera orbiting the scene, testing each pixel's last
+        // shadow ray occluder first
+        { "demoPathOccluderCache", [](Geometry &scene){ addDemoScene(scene); },
+          Foveation(), true, false, false, false, true },
+        { "mesh1M",       [](Geometry &scene){ addProceduralMesh(scene,1000000); } },
+        // the same, shaded with smooth per-vertex normals
+        { "mesh1MSmooth", [](Geometry &scene){
+            addProceduralMesh(scene,1000000);
+            scene.computeNormals(60.f);
+          } },
+        { "spheres1M",    [](Geometry &scene){ addRandomSpheres(scene,1000000); } },
+        { "instances10k", [](Geometry &scene){ addDemoScene(scene); addInstanceGrid(scene,10000); } },
+        // many small meshes, as they are and merged into one, for
+        // what fewer build inputs and SBT records save
+        { "cubes10k",       [](Geometry &scene){ addSeparateCubes(scene,10000); } },
+        { "cubes10kMerged", [](Geometry &scene){
+            addSeparateCubes(scene,10000);
+            scene.mergeMeshes(1<<20);
+          } },
+      };
+      for (auto &fileName : meshFileNames) {
+        const std::string name = fileName.substr(fileName.rfind('/')+1);
+        benchScenes.push_back({ name, [fileName](Geometry &scene){ loadMeshFile(scene,fileName); } });
+      }
+
+      Results results;
+      for (auto &benchScene : benchScenes) {
+        if (!onlyScenes.empty()
+            && std::find(onlyScenes.begin(),onlyScenes.end(),benchScene.name) == onlyScenes.end())
+          continue;
+        results.push_back(std::make_pair(benchScene.name,
+                                         runScene(benchScene,frameSize,
+                                                  numWarmupFrames,numFrames)));
+      }
+      if (onlyScenes.empty()
+          || std::find(onlyScenes.begin(),onlyScenes.end(),"normals") != onlyScenes.end())
+        results.push_back(std::make_pair("normals",runNormals(numNormalsTriangles)));
+      
+      if (!jsonFileName.empty())
+        writeJSON(jsonFileName,frameSize,numFrames,results);
+      if (!baselineFileName.empty()) {
+        const int numRegressions = compareToBaseline(results,baselineFileName,tolerance);
+        if (numRegressions) {
+          std::cout << GDT_TERMINAL_RED << "#osc.bench: " << numRegressions
+                    << " regression(s)" << GDT_TERMINAL_DEFAULT << std::endl;
+          return 1;
+        }
+        std::cout << "#osc.bench: no regressions" << std::endl;
+      }
+    } catch (std::runtime_error& e) {
+      std::cout << GDT_TERMINAL_RED << "FATAL ERROR: " << e.what()
+                << GDT_TERMINAL_DEFAULT << std::endl;
+      exit(1);
+    }
+    return 0;
+  }
+  
+} // ::osc
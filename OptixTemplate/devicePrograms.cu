@@ -17,6 +17,7 @@
 #include <optix_device.h>
 
 #include "LaunchParams.h"
+#include "gdt/random/random.h"
 
 using namespace osc;
 
@@ -28,6 +29,41 @@ namespace osc {
   extern "C" __constant__ LaunchParams optixLaunchParams;
 
   __device__ vec3f lightPos;
+
+  /*! what radiance rays carry back to raygen */
+  struct RadiancePRD {
+    vec3f    color;
+    /*! distance to the hit; REPROJECTION_MISS_DEPTH for a miss */
+    float    depth;
+    /*! see PixelHistory::hitID */
+    uint32_t hitID;
+    /*! @{ the hit, for the radiance cache: where it is, its normal
+        (facing the ray), and its color; for a miss, albedo is 0 */
+    vec3f    position;
+    vec3f    normal;
+    vec3f    albedo;
+    /*! @} */
+    /*! color without the constant ambient term, which the radiance
+        cache's indirect light replaces; for a miss, the sky */
+    vec3f    direct;
+    /*! @{ the shadow ray towards the light, from position, for
+        raygen to trace (see traceShadowRay()), and the light it lets
+        through if nothing's in the way; shadowTMax is 0 if there's
+        no shadow ray to trace */
+    vec3f    shadowDir;
+    float    shadowTMax;
+    vec3f    unshadowed;
+    /*! @} */
+  };
+
+  /*! what shadow rays carry back */
+  struct ShadowPRD {
+    /*! 1 if the ray got through, 0 if it didn't */
+    float          visibility;
+    /*! what blocked it, if anything did (and there's an occluder
+        cache to put that in) */
+    CachedOccluder occluder;
+  };
   
   static __forceinline__ __device__
   void *unpackPointer( uint32_t i0, uint32_t i1 )
@@ -53,14 +89,66 @@ namespace osc {
       return reinterpret_cast<T*>(unpackPointer(u0, u1));
   }
 
-  template<typename T>
-  static __forceinline__ __device__ T* getHitNormal()
+  /*! the ray statistics of the current pixel, carried along in
+      payload 2 and 3 (by shadow rays as well); null unless they're
+      being collected */
+  static __forceinline__ __device__ RayStats *getRayStats()
   {
       const uint32_t u2 = optixGetPayload_2();
       const uint32_t u3 = optixGetPayload_3();
-      return reinterpret_cast<T*>(unpackPointer(u2, u3));
+      return reinterpret_cast<RayStats*>(unpackPointer(u2, u3));
+  }
+
+  static __forceinline__ __device__ void atomicAddNonZero(uint64_t &dst, uint64_t value)
+  {
+      if (value) atomicAdd((unsigned long long *)&dst, (unsigned long long)value);
+  }
+
+  /*! an ID for the surface the current hit is on: the instance, and
+      the SBT record (so, the mesh, or level of detail) in it, plus,
+      for spheres, which sphere. triangles of the same mesh share
+      one, so that only a mesh's outline counts as an edge for
+      reprojection. never 0, which stands for a miss */
+  static __forceinline__ __device__ uint32_t surfaceID(uint32_t sphereID = 0)
+  {
+      const uint64_t sbtData = (uint64_t)optixGetSbtDataPointer();
+      const uint32_t id
+          = optixGetInstanceIndex()*0x9e3779b1u
+          ^ uint32_t(sbtData ^ (sbtData >> 32))*0x85ebca6bu
+          ^ sphereID*0xc2b2ae35u;
+      return id == 0 || id == REPROJECTION_INVALID ? 1 : id;
+  }
+
+  /*! cheap blue-green-yellow-red ramp for t in [0,1] */
+  static __forceinline__ __device__ vec3f heatmapColor(float t)
+  {
+      t = fminf(fmaxf(t, 0.f), 1.f);
+      return vec3f(fminf(fmaxf(1.5f - fabsf(4.f*t - 3.f), 0.f), 1.f),
+                   fminf(fmaxf(1.5f - fabsf(4.f*t - 2.f), 0.f), 1.f),
+                   fminf(fmaxf(1.5f - fabsf(4.f*t - 1.f), 0.f), 1.f));
   }
   
+  /*! set up the shadow ray from pos towards the light, and the
+      light that gets through it, as 0.8 times the cosine to the
+      normal; unless that's 0 anyway and we're culling those */
+  static __forceinline__ __device__ void setupShadowRay(RadiancePRD &prd,
+                                                        const vec3f &pos,
+                                                        const vec3f &normal,
+                                                        const vec3f &color)
+  {
+      vec3f lightDir = lightPos - pos;
+      float tempcos = dot(normalize(lightDir), normal);
+      tempcos = tempcos > 0 ? tempcos : 0;
+      prd.shadowDir  = normalize(lightDir);
+      prd.shadowTMax = length(lightDir);
+      prd.unshadowed = 0.8f * tempcos * color;
+      if (tempcos == 0.f && optixLaunchParams.shadows.cullBackFacing) {
+          prd.shadowTMax = 0.f;
+          if (RayStats *stats = getRayStats())
+              stats->shadowRaysCulled++;
+      }
+  }
+
   //------------------------------------------------------------------------------
   // closest hit and anyhit programs for radiance-type rays.
   //
@@ -86,40 +174,51 @@ namespace osc {
       // compute normal:
       const int   primID = optixGetPrimitiveIndex();
       const vec3i index = sbtData.index[primID];
-      const vec3f& A = sbtData.vertex[index.x];
-      const vec3f& B = sbtData.vertex[index.y];
-      const vec3f& C = sbtData.vertex[index.z];
-      normal = normalize(cross(C - A, B - A));
-      color = sbtData.color;
+      // (in world space: instanced meshes have their own transforms)
+      const vec3f A = optixTransformPointFromObjectToWorldSpace(sbtData.vertex[index.x]);
+      const vec3f B = optixTransformPointFromObjectToWorldSpace(sbtData.vertex[index.y]);
+      const vec3f C = optixTransformPointFromObjectToWorldSpace(sbtData.vertex[index.z]);
       const float u = optixGetTriangleBarycentrics().x;
       const float v = optixGetTriangleBarycentrics().y;
-
-      const vec3f pos = (1.f - u - v) * sbtData.vertex[index.x]
-          + u * sbtData.vertex[index.y]
-          + v * sbtData.vertex[index.z];
-      vec3f lightDir = lightPos-pos;
-      float tempcos = dot(normalize(lightDir), normal);
-      tempcos = tempcos > 0 ? tempcos : 0;
-      vec3f& prd = *(vec3f*)getPRD<vec3f>();
-
-      vec3f lightVisibility = vec3f(1.0f);
-
-      uint32_t u0, u1;
-      packPointer(&lightVisibility, u0, u1);
-
-      optixTrace(optixLaunchParams.traversable,
-          pos,
-          normalize(lightDir),
-          1e-3f,    // tmin
-          length(lightDir),  // tmax
-          0.0f,   // rayTime
-          OptixVisibilityMask(255),
-          OPTIX_RAY_FLAG_NONE,//OPTIX_RAY_FLAG_NONE,
-          SHADOW_RAY_TYPE,             // SBT offset
-          RAY_TYPE_COUNT,               // SBT stride
-          SHADOW_RAY_TYPE,             // missSBTIndex 
-          u0, u1);
-      prd = (0.2f + 0.8f * tempcos * lightVisibility) * color;
+      // attribute streams are looked up through the same indices as
+      // the positions (or the primitive ID), and interpolated
+      if (sbtData.normal) {
+          const vec3f objectNormal = (1.f - u - v) * sbtData.normal[index.x]
+              + u * sbtData.normal[index.y]
+              + v * sbtData.normal[index.z];
+          normal = normalize(vec3f(optixTransformNormalFromObjectToWorldSpace(objectNormal)));
+      } else
+          normal = normalize(cross(C - A, B - A));
+      if (sbtData.vertexColor)
+          color = (1.f - u - v) * sbtData.vertexColor[index.x]
+              + u * sbtData.vertexColor[index.y]
+              + v * sbtData.vertexColor[index.z];
+      else
+          color = sbtData.triangleColor ? sbtData.triangleColor[primID] : sbtData.color;
+
+      const vec3f pos = (1.f - u - v) * A + u * B + v * C;
+      RadiancePRD &prd = *getPRD<RadiancePRD>();
+
+      if (sbtData.bakedLight) {
+          // what __raygen__bakeVertices computed for the corners,
+          // with the ambient term darkened by occlusion
+          const vec2f light = (1.f - u - v) * sbtData.bakedLight[index.x]
+              + u * sbtData.bakedLight[index.y]
+              + v * sbtData.bakedLight[index.z];
+          prd.color      = (0.2f * light.x + 0.8f * light.y) * color;
+          prd.direct     = 0.8f * light.y * color;
+          prd.shadowTMax = 0.f;
+          prd.unshadowed = vec3f(0.f);
+      } else {
+          prd.color  = 0.2f * color;
+          prd.direct = vec3f(0.f);
+          setupShadowRay(prd, pos, normal, color);
+      }
+      prd.depth = optixGetRayTmax();
+      prd.hitID = surfaceID();
+      prd.position = pos;
+      prd.normal   = dot(normal, vec3f(optixGetWorldRayDirection())) > 0.f ? -normal : normal;
+      prd.albedo   = color;
   }
 
   extern "C" __global__ void __closesthit__radiance_sphere()
@@ -129,36 +228,23 @@ namespace osc {
 
       vec3f normal, color;
       const SphereSBTData sbtData = geometrySbtData.sphere_data;
-      normal = *(vec3f*)getHitNormal<vec3f>();
-      color = sbtData.color;
-      vec3f rayOrigin = optixGetWorldRayOrigin();
-      vec3f rayDirection = optixGetWorldRayDirection();
-      vec3f pos = sbtData.center + normal * sbtData.radius;
-      vec3f lightDir = lightPos - pos;
-      float tempcos = dot(normalize(lightDir), normal);
-      tempcos = tempcos > 0 ? tempcos : 0;
-      const float cosDN = 0.2f + .8f * tempcos;
-      vec3f& prd = *(vec3f*)getPRD<vec3f>();
-
-      vec3f lightVisibility = vec3f(1.0f);
-
-      uint32_t u0, u1;
-      packPointer(&lightVisibility, u0, u1);
-
-      optixTrace(optixLaunchParams.traversable,
-          pos,
-          normalize(lightDir),
-          1e-3f,    // tmin
-          length(lightDir),  // tmax
-          0.0f,   // rayTime
-          OptixVisibilityMask(255),
-          OPTIX_RAY_FLAG_NONE,//OPTIX_RAY_FLAG_NONE,
-          SHADOW_RAY_TYPE,             // SBT offset
-          RAY_TYPE_COUNT,               // SBT stride
-          SHADOW_RAY_TYPE,             // missSBTIndex 
-          u0, u1);
-
-      prd = (0.2f + 0.8f * cosDN * lightVisibility) * color;
+      const int primID = optixGetPrimitiveIndex();
+      // the intersection program passes the normal as attributes
+      normal = vec3f(__uint_as_float(optixGetAttribute_0()),
+                     __uint_as_float(optixGetAttribute_1()),
+                     __uint_as_float(optixGetAttribute_2()));
+      color = sbtData.color[primID];
+      vec3f pos = sbtData.center[primID] + normal * sbtData.radius[primID];
+      RadiancePRD &prd = *getPRD<RadiancePRD>();
+
+      prd.color  = 0.2f * color;
+      prd.direct = vec3f(0.f);
+      setupShadowRay(prd, pos, normal, color);
+      prd.depth = optixGetRayTmax();
+      prd.hitID = surfaceID(primID);
+      prd.position = pos;
+      prd.normal   = normal;
+      prd.albedo   = color;
   }
   
   extern "C" __global__ void __anyhit__empty()
@@ -166,7 +252,34 @@ namespace osc {
 
   extern "C" __global__ void __anyhit__shadow()
   { 
-      *getPRD<vec3f>() = vec3f(0.f);
+      ShadowPRD &prd = *getPRD<ShadowPRD>();
+      prd.visibility = 0.f;
+      if (optixLaunchParams.shadows.occluders) {
+          // remember what blocked the ray, in world space
+          const GeometrySBTData& geometrySbtData
+              = *(const GeometrySBTData*)optixGetSbtDataPointer();
+          const int primID = optixGetPrimitiveIndex();
+          CachedOccluder &occluder = prd.occluder;
+          if (optixIsTriangleHit()) {
+              const TriangleMeshSBTData &sbtData = geometrySbtData.triangle_data;
+              const vec3i index = sbtData.index[primID];
+              const vec3f A = optixTransformPointFromObjectToWorldSpace(sbtData.vertex[index.x]);
+              const vec3f B = optixTransformPointFromObjectToWorldSpace(sbtData.vertex[index.y]);
+              const vec3f C = optixTransformPointFromObjectToWorldSpace(sbtData.vertex[index.z]);
+              occluder.v0     = A;
+              occluder.e1     = B - A;
+              occluder.e2     = C - A;
+              occluder.radius = 0.f;
+          } else {
+              const SphereSBTData &sbtData = geometrySbtData.sphere_data;
+              occluder.v0     = optixTransformPointFromObjectToWorldSpace(sbtData.center[primID]);
+              occluder.e1     = vec3f(0.f);
+              occluder.e2     = vec3f(0.f);
+              occluder.radius = sbtData.radius[primID];
+          }
+      }
+      if (RayStats *stats = getRayStats())
+          stats->shadowRaysOccluded++;
       optixTerminateRay();
   }
 
@@ -177,13 +290,16 @@ namespace osc {
   {
       const GeometrySBTData& geometrySbtData
           = *(const GeometrySBTData*)optixGetSbtDataPointer();
-      const SphereSBTData sbtData = geometrySbtData.sphere_data;
+      const SphereSBTData &sbtData = geometrySbtData.sphere_data;
+      const int primID = optixGetPrimitiveIndex();
+      if (RayStats *stats = getRayStats())
+          stats->primitiveTests++;
 
       const vec3f orig = optixGetWorldRayOrigin();
       const vec3f dir = optixGetWorldRayDirection();
 
-      const vec3f center = sbtData.center;
-      const float  radius = sbtData.radius;
+      const vec3f center = sbtData.center[primID];
+      const float  radius = sbtData.radius[primID];
       const vec3f O = orig - center;
       const float  l = 1 / length(dir);
       const vec3f D = dir * l;
@@ -195,15 +311,16 @@ namespace osc {
       {
           const float sdisc = sqrtf(disc);
           const float root1 = (-b - sdisc);
-          const float        root11 = 0.0f;
-          const vec3f       shading_normal = (O + (root1 + root11) * D) / radius;
-          vec3f& normal = *(vec3f*)getHitNormal<vec3f>();
-          normal = normalize(shading_normal);
+          const vec3f normal = normalize((O + root1 * D) / radius);
 
+          // report the normal as attributes rather than through the
+          // payload: shadow rays don't carry a normal pointer
           optixReportIntersection(
               root1,      // t hit
               0,          // user hit kind
-              optixGetPayload_0(), optixGetPayload_1(), optixGetPayload_2(), optixGetPayload_3()
+              __float_as_uint(normal.x),
+              __float_as_uint(normal.y),
+              __float_as_uint(normal.z)
           );
       }
   }
@@ -222,7 +339,9 @@ namespace osc {
 
   extern "C" __global__ void __miss__radiance()
   {
-    vec3f &prd = *(vec3f*)getPRD<vec3f>();
+    RadiancePRD &prd = *getPRD<RadiancePRD>();
+    if (RayStats *stats = getRayStats())
+        stats->misses++;
 
     const vec3f rayDir = optixGetWorldRayDirection();
 
@@ -231,7 +350,233 @@ namespace osc {
     float t = 0.5f*(rayDir.y + 1.0f); 
 
     // set to constant white as background color
-    prd = t*color2 + (1-t)*color1;
+    prd.color = t*color2 + (1-t)*color1;
+    prd.depth = REPROJECTION_MISS_DEPTH;
+    prd.hitID = 0;
+    prd.albedo = vec3f(0.f);
+    prd.direct = prd.color;
+    prd.shadowTMax = 0.f;
+    prd.unshadowed = vec3f(0.f);
+  }
+
+  //------------------------------------------------------------------------------
+  // shadow rays; the hit programs only set them up, raygen traces them
+  // (so that no program traces from within another one), after
+  // checking the occluder cache
+  //------------------------------------------------------------------------------
+
+  /*! whether the cached occluder is in the way of the ray between
+      tmin and tmax; dir has to be normalized. for spheres this takes
+      the same (near) hit as __intersection__sphere does */
+  static __forceinline__ __device__ bool occludes(const CachedOccluder &occluder,
+                                                  const vec3f &org,
+                                                  const vec3f &dir,
+                                                  float tmin, float tmax)
+  {
+      if (occluder.radius > 0.f) {
+          const vec3f O = org - occluder.v0;
+          const float b = dot(O, dir);
+          const float c = dot(O, O) - occluder.radius * occluder.radius;
+          const float disc = b * b - c;
+          if (disc <= 0.f) return false;
+          const float t = -b - sqrtf(disc);
+          return t > tmin && t < tmax;
+      }
+      // moeller-trumbore; a free entry (all zero) has det 0
+      const vec3f p = cross(dir, occluder.e2);
+      const float det = dot(occluder.e1, p);
+      if (det == 0.f) return false;
+      const float rcpDet = 1.f / det;
+      const vec3f s = org - occluder.v0;
+      const float u = dot(s, p) * rcpDet;
+      if (u < 0.f || u > 1.f) return false;
+      const vec3f q = cross(s, occluder.e1);
+      const float v = dot(dir, q) * rcpDet;
+      if (v < 0.f || u + v > 1.f) return false;
+      const float t = dot(occluder.e2, q) * rcpDet;
+      return t > tmin && t < tmax;
+  }
+
+  /*! trace the shadow ray the hit program set up in prd (if any), and
+      add the light that gets through it. if given an occluder cache
+      entry, test that first, which saves the ray if it's still in
+      the way; and put whatever did block the ray there */
+  static __device__ void traceShadowRay(RadiancePRD &prd,
+                                        RayStats *stats,
+                                        CachedOccluder *cached)
+  {
+      if (prd.shadowTMax <= 0.f)
+          return;
+      if (cached && occludes(*cached, prd.position, prd.shadowDir, 1e-3f, prd.shadowTMax)) {
+          if (stats)
+              stats->shadowRaysCached++;
+          return;
+      }
+
+      ShadowPRD shadow;
+      shadow.visibility = 1.f;
+      uint32_t u0, u1, u2, u3;
+      packPointer(&shadow, u0, u1);
+      packPointer(stats, u2, u3);
+      if (stats)
+          stats->shadowRays++;
+      optixTrace(optixLaunchParams.traversable,
+                 prd.position,
+                 prd.shadowDir,
+                 1e-3f,            // tmin
+                 prd.shadowTMax,   // tmax
+                 0.0f,             // rayTime
+                 OptixVisibilityMask(255),
+                 OPTIX_RAY_FLAG_NONE,
+                 SHADOW_RAY_TYPE,             // SBT offset
+                 RAY_TYPE_COUNT,               // SBT stride
+                 SHADOW_RAY_TYPE,             // missSBTIndex 
+                 u0, u1, u2, u3);
+      prd.color  += shadow.visibility * prd.unshadowed;
+      prd.direct += shadow.visibility * prd.unshadowed;
+      if (cached && shadow.visibility == 0.f)
+          *cached = shadow.occluder;
+  }
+
+  //------------------------------------------------------------------------------
+  // radiance cache; see LaunchParams::radianceCache
+  //------------------------------------------------------------------------------
+
+  static __forceinline__ __device__ uint32_t hashCacheKey(uint32_t seed,
+                                                          const vec3i &cell,
+                                                          uint32_t rest)
+  {
+      uint32_t hash = hash32(seed ^ uint32_t(cell.x));
+      hash = hash32(hashCombine(hash, uint32_t(cell.y)));
+      hash = hash32(hashCombine(hash, uint32_t(cell.z)));
+      return hash32(hashCombine(hash, rest));
+  }
+
+  /*! the cache cell for the given surface point, inserting it if it
+      isn't there yet (and insert is set); null if it isn't there,
+      or there's no room for it */
+  static __device__ RadianceCacheCell *findCacheCell(const vec3f &position,
+                                                     const vec3f &normal,
+                                                     bool insert)
+  {
+      const auto &cache = optixLaunchParams.radianceCache;
+      // the smallest power of two multiple of minCellSize that's at
+      // least as large as cells should be at this distance (clamped
+      // before the log, which is -inf at distance 0)
+      const float distance = length(position - optixLaunchParams.camera.position);
+      const int   level
+          = int(ceilf(log2f(fmaxf(distance*cache.cellScale/cache.minCellSize, 1.f))));
+      const vec3f p = position / ldexpf(cache.minCellSize, level);
+      const vec3i cell(int(floorf(p.x)), int(floorf(p.y)), int(floorf(p.z)));
+      // which of the six axis directions the normal is closest to
+      const vec3f a(fabsf(normal.x), fabsf(normal.y), fabsf(normal.z));
+      const int axis = (a.x >= a.y && a.x >= a.z) ? 0 : (a.y >= a.z ? 1 : 2);
+      const uint32_t rest = uint32_t(level)*6 + 2*axis + (normal[axis] < 0.f);
+
+      const uint32_t slot     = hashCacheKey(0, cell, rest);
+      const uint32_t checksum = hashCacheKey(0x9e3779b9u, cell, rest) | 1u;
+      for (int i = 0; i < RADIANCE_CACHE_PROBES; i++) {
+          RadianceCacheCell &candidate = cache.cells[(slot + i) & (cache.numCells - 1)];
+          const uint32_t found = insert
+              ? atomicCAS(&candidate.checksum, 0u, checksum)
+              : *(volatile uint32_t *)&candidate.checksum;
+          if (found == checksum || (insert && found == 0))
+              return &candidate;
+          // cells never get removed, so a free slot ends the search
+          if (found == 0)
+              return nullptr;
+      }
+      return nullptr;
+  }
+
+  /*! average of a cell's samples so far. the sums get added to before
+      the count, so while other threads add samples this may be a
+      bit high, never wildly off */
+  static __forceinline__ __device__ vec3f cacheCellMean(const RadianceCacheCell &cell,
+                                                        uint32_t numSamples)
+  {
+      const volatile float *sum = &cell.radianceSum.x;
+      return vec3f(float(sum[0]), float(sum[1]), float(sum[2])) / float(numSamples);
+  }
+
+  /*! a cosine-distributed direction around n, from two numbers in
+      [0,1) */
+  static __forceinline__ __device__ vec3f cosineSampleHemisphere(const vec3f &n,
+                                                                 float u1, float u2)
+  {
+      const vec3f t = normalize(fabsf(n.x) > .5f
+                                ? cross(n, vec3f(0.f, 1.f, 0.f))
+                                : cross(n, vec3f(1.f, 0.f, 0.f)));
+      const vec3f b = cross(n, t);
+      constexpr float pi = 3.14159265358979f;
+      const float r = sqrtf(u1), phi = 2.f*pi*u2;
+      return r*cosf(phi)*t + r*sinf(phi)*b + sqrtf(fmaxf(0.f, 1.f - u1))*n;
+  }
+
+  /*! the diffuse light arriving at the given hit, (cosine-weighted)
+      averaged over its hemisphere: from the hit's cache cell once
+      that has enough samples, otherwise from the one bounce ray
+      this traces. a bounce also gets traced to add to the cell until
+      it has all its samples; where that bounce ends up, the cache
+      (if it has enough there) stands in for all further bounces */
+  static __device__ vec3f cachedIndirect(const RadiancePRD &hit,
+                                         uint32_t seed,
+                                         RayStats *stats)
+  {
+      const auto &cache = optixLaunchParams.radianceCache;
+      RadianceCacheCell *cell = findCacheCell(hit.position, hit.normal, true);
+      const uint32_t numSamples = cell ? *(volatile uint32_t *)&cell->numSamples : 0;
+      if (cell && numSamples >= cache.maxSamples)
+          return cacheCellMean(*cell, numSamples);
+
+      const vec3f dir = cosineSampleHemisphere(hit.normal,
+                                               sobolOwen(cache.frameIndex, 0, seed),
+                                               sobolOwen(cache.frameIndex, 1, seed));
+      RadiancePRD bounce;
+      // the bounce's shadow rays count towards the pixel's stats, its
+      // miss doesn't count as a primary one
+      RayStats bounceStats = {};
+      uint32_t u0, u1, u2, u3;
+      packPointer(&bounce, u0, u1);
+      packPointer(stats ? &bounceStats : nullptr, u2, u3);
+      optixTrace(optixLaunchParams.traversable,
+                 hit.position,
+                 dir,
+                 1e-3f,  // tmin
+                 1e20f,  // tmax
+                 0.0f,   // rayTime
+                 OptixVisibilityMask(255),
+                 OPTIX_RAY_FLAG_DISABLE_ANYHIT,
+                 SURFACE_RAY_TYPE,             // SBT offset
+                 RAY_TYPE_COUNT,               // SBT stride
+                 SURFACE_RAY_TYPE,             // missSBTIndex 
+                 u0, u1, u2, u3);
+      traceShadowRay(bounce, stats ? &bounceStats : nullptr, nullptr);
+      if (stats) {
+          stats->bounceRays++;
+          stats->shadowRays         += bounceStats.shadowRays;
+          stats->shadowRaysOccluded += bounceStats.shadowRaysOccluded;
+          stats->shadowRaysCulled   += bounceStats.shadowRaysCulled;
+          stats->primitiveTests     += bounceStats.primitiveTests;
+      }
+
+      vec3f sample = bounce.direct;
+      if (bounce.hitID != 0)
+          if (const RadianceCacheCell *next = findCacheCell(bounce.position, bounce.normal, false)) {
+              const uint32_t nextSamples = *(volatile uint32_t *)&next->numSamples;
+              if (nextSamples >= cache.minSamples)
+                  sample += bounce.albedo * cacheCellMean(*next, nextSamples);
+          }
+
+      if (!cell)
+          return sample;
+      atomicAdd(&cell->radianceSum.x, sample.x);
+      atomicAdd(&cell->radianceSum.y, sample.y);
+      atomicAdd(&cell->radianceSum.z, sample.z);
+      atomicAdd(&cell->numSamples, 1u);
+      return numSamples >= cache.minSamples
+          ? cacheCellMean(*cell, numSamples + 1)
+          : sample;
   }
 
   //------------------------------------------------------------------------------
@@ -244,23 +589,71 @@ namespace osc {
     const int iy = optixGetLaunchIndex().y;
 
     const auto &camera = optixLaunchParams.camera;
+    const long long beginCycles = clock64();
+
+    // the row this launch index stands for in the rendered frame
+    const int fullY = optixLaunchParams.frame.rowOffset
+      + iy*optixLaunchParams.frame.rowStride;
+    const uint32_t fbIndex = ix+iy*optixLaunchParams.frame.size.x;
+    // history is kept only for frames that cover all rows
+    const PixelHistory &history = optixLaunchParams.reprojection.current;
+    const uint32_t historyIndex = ix+fullY*optixLaunchParams.frame.fullSize.x;
+
+    // outside the regions of interest only every rate'th pixel (in
+    // x and y) gets traced; leave the others for the host to fill in
+    if (optixLaunchParams.foveation.rateMap) {
+      const int rate = foveationRate(optixLaunchParams.foveation.rateMap,
+                                     optixLaunchParams.foveation.numTilesX,
+                                     ix,fullY,
+                                     optixLaunchParams.frame.renderSize,
+                                     optixLaunchParams.frame.fullSize);
+      if ((ix | fullY) & (rate-1)) {
+        optixLaunchParams.frame.colorBuffer[fbIndex] = 0;
+        if (history.color)
+          history.hitID[historyIndex] = REPROJECTION_INVALID;
+        return;
+      }
+    }
+
+    // if any pixel of the last frame reprojects onto this one, take
+    // the closest one's color instead of tracing
+    if (history.color && optixLaunchParams.reprojection.previous.color) {
+      const unsigned long long reprojected
+        = optixLaunchParams.reprojection.reprojected[historyIndex];
+      if (reprojected != ~0ull) {
+        const PixelHistory &previous = optixLaunchParams.reprojection.previous;
+        const uint32_t from = uint32_t(reprojected);
+        const uint32_t rgba = previous.color[from];
+        history.color[historyIndex] = rgba;
+        history.depth[historyIndex] = __uint_as_float(uint32_t(reprojected >> 32));
+        history.hitID[historyIndex] = previous.hitID[from];
+        history.age[historyIndex]   = previous.age[from]+1;
+        optixLaunchParams.frame.colorBuffer[fbIndex] = rgba;
+        if (optixLaunchParams.rayStats)
+          atomicAddNonZero(optixLaunchParams.rayStats[fbIndex % RAY_STATS_BINS].reusedPixels,1);
+        return;
+      }
+    }
 
     // our per-ray data for this example. what we initialize it to
     // won't matter, since this value will be overwritten by either
     // the miss or hit program, anyway
-    vec3f pixelColorPRD = vec3f(0.f);
+    RadiancePRD pixelPRD;
 
-    vec3f hitNormal = vec3f(0.f);
+    // this pixel's ray statistics, if we collect any (the heatmap
+    // needs them for its scale)
+    RayStats rayStats = {};
+    const bool collectStats
+      = optixLaunchParams.rayStats || optixLaunchParams.heatmapScale > 0.f;
 
     // the values we store the PRD pointer in:
     uint32_t u0, u1, u2, u3;
-    packPointer(&pixelColorPRD, u0, u1);
-
-    packPointer(&hitNormal, u2, u3);
+    packPointer(&pixelPRD, u0, u1);
+    packPointer(collectStats ? &rayStats : nullptr, u2, u3);
 
     // normalized screen plane position, in [0,1]^2
-    const vec2f screen(vec2f(ix+.5f,iy+.5f)
-                       / vec2f(optixLaunchParams.frame.size));
+    const vec2f screen(vec2f(ix+.5f,fullY+.5f)
+                       / vec2f(optixLaunchParams.frame.renderSize));
     
     // generate ray direction
     vec3f rayDir = normalize(camera.direction
@@ -282,9 +675,44 @@ namespace osc {
                SURFACE_RAY_TYPE,             // missSBTIndex 
                u0, u1, u2, u3 );
 
-    const int r = int(255.99f*pixelColorPRD.x);
-    const int g = int(255.99f*pixelColorPRD.y);
-    const int b = int(255.99f*pixelColorPRD.z);
+    // whatever the primary ray hit last time blocked this pixel's
+    // shadow ray is likely to do so again
+    CachedOccluder *occluder = optixLaunchParams.shadows.occluders
+      ? &optixLaunchParams.shadows.occluders[historyIndex] : nullptr;
+    traceShadowRay(pixelPRD,collectStats ? &rayStats : nullptr,occluder);
+
+    // diffuse indirect light from the radiance cache, instead of a
+    // constant ambient term
+    if (optixLaunchParams.radianceCache.cells && pixelPRD.hitID != 0) {
+      const uint32_t seed
+        = hash32(hashCombine(hash32(ix),uint32_t(fullY)));
+      pixelPRD.color = pixelPRD.direct
+        + pixelPRD.albedo*cachedIndirect(pixelPRD,seed,collectStats ? &rayStats : nullptr);
+    }
+
+    if (collectStats) {
+      rayStats.primaryRays = 1;
+      rayStats.cycles      = clock64()-beginCycles;
+      if (optixLaunchParams.heatmapScale > 0.f)
+        pixelPRD.color = heatmapColor(rayStats.cycles/optixLaunchParams.heatmapScale);
+      if (optixLaunchParams.rayStats) {
+        RayStats &bin = optixLaunchParams.rayStats[fbIndex % RAY_STATS_BINS];
+        atomicAddNonZero(bin.primaryRays,        rayStats.primaryRays);
+        atomicAddNonZero(bin.misses,             rayStats.misses);
+        atomicAddNonZero(bin.shadowRays,         rayStats.shadowRays);
+        atomicAddNonZero(bin.shadowRaysOccluded, rayStats.shadowRaysOccluded);
+        atomicAddNonZero(bin.shadowRaysCulled,   rayStats.shadowRaysCulled);
+        atomicAddNonZero(bin.shadowRaysCached,   rayStats.shadowRaysCached);
+        atomicAddNonZero(bin.primitiveTests,     rayStats.primitiveTests);
+        atomicAddNonZero(bin.cycles,             rayStats.cycles);
+        atomicAddNonZero(bin.bounceRays,         rayStats.bounceRays);
+      }
+    }
+
+    // (with indirect light, colors can go above one)
+    const int r = min(255,int(255.99f*pixelPRD.color.x));
+    const int g = min(255,int(255.99f*pixelPRD.color.y));
+    const int b = min(255,int(255.99f*pixelPRD.color.z));
 
     // convert to 32-bit rgba value (we explicitly set alpha to 0xff
     // to make stb_image_write happy ...
@@ -292,8 +720,146 @@ namespace osc {
       | (r<<0) | (g<<8) | (b<<16);
 
     // and write to frame buffer ...
-    const uint32_t fbIndex = ix+iy*optixLaunchParams.frame.size.x;
     optixLaunchParams.frame.colorBuffer[fbIndex] = rgba;
+
+    if (history.color) {
+      history.color[historyIndex] = rgba;
+      history.depth[historyIndex] = pixelPRD.depth;
+      history.hitID[historyIndex] = pixelPRD.hitID;
+      // start pixels at different ages, so they don't all come up
+      // for tracing again in the same frame
+      const uint32_t hash = (ix*0x9e3779b1u) ^ (fullY*0x85ebca6bu)
+        ^ (optixLaunchParams.reprojection.frameIndex*0xc2b2ae35u);
+      history.age[historyIndex] = (hash >> 16) % optixLaunchParams.reprojection.maxAge;
+    }
+  }
+
+  /*! bakes ambient occlusion and direct light into the vertices of
+      one mesh (see TriangleMesh::bakedLight); launched over its
+      vertices. both get computed just like __closesthit__radiance_mesh
+      would, with the same normal, so baked and traced shading match */
+  extern "C" __global__ void __raygen__bakeVertices()
+  {
+    const auto &bake = optixLaunchParams.bake;
+    const uint32_t vertexID = optixGetLaunchIndex().x;
+    const vec3f pos    = bake.vertex[vertexID];
+    const vec3f normal = bake.normal[vertexID];
+    // the same light __raygen__renderFrame uses
+    lightPos = vec3f(0.0f, 3.0f, 0.0f);
+
+    // these are all shadow rays, which only ever clear visibility;
+    // no ray statistics
+    ShadowPRD shadow;
+    uint32_t u0, u1, u2 = 0, u3 = 0;
+    packPointer(&shadow, u0, u1);
+
+    int numUnoccluded = 0;
+    const uint32_t seed = hash32(vertexID);
+    for (int i = 0; i < bake.numSamples; i++) {
+      const vec3f dir = cosineSampleHemisphere(normal,
+                                               sobolOwen(i, 0, seed),
+                                               sobolOwen(i, 1, seed));
+      shadow.visibility = 1.f;
+      optixTrace(optixLaunchParams.traversable,
+                 pos,
+                 dir,
+                 1e-3f,          // tmin
+                 bake.aoRadius,  // tmax
+                 0.0f,           // rayTime
+                 OptixVisibilityMask(255),
+                 OPTIX_RAY_FLAG_NONE,
+                 SHADOW_RAY_TYPE,             // SBT offset
+                 RAY_TYPE_COUNT,               // SBT stride
+                 SHADOW_RAY_TYPE,             // missSBTIndex 
+                 u0, u1, u2, u3);
+      if (shadow.visibility > 0.f)
+        numUnoccluded++;
+    }
+
+    const vec3f lightDir = lightPos - pos;
+    float direct = fmaxf(dot(normalize(lightDir), normal), 0.f);
+    // no need for a shadow ray where the light is behind the surface
+    if (direct > 0.f) {
+      shadow.visibility = 1.f;
+      optixTrace(optixLaunchParams.traversable,
+                 pos,
+                 normalize(lightDir),
+                 1e-3f,             // tmin
+                 length(lightDir),  // tmax
+                 0.0f,              // rayTime
+                 OptixVisibilityMask(255),
+                 OPTIX_RAY_FLAG_NONE,
+                 SHADOW_RAY_TYPE,             // SBT offset
+                 RAY_TYPE_COUNT,               // SBT stride
+                 SHADOW_RAY_TYPE,             // missSBTIndex 
+                 u0, u1, u2, u3);
+      direct *= shadow.visibility;
+    }
+    bake.light[vertexID] = vec2f(numUnoccluded / float(max(bake.numSamples, 1)), direct);
+  }
+
+  /*! runs before __raygen__renderFrame, over the last frame's pixels:
+      moves each to where its hit point ends up with the new camera,
+      keeping the closest one where several land on the same pixel.
+      pixels nothing lands on (disocclusions, and where surfaces got
+      magnified) then get traced */
+  extern "C" __global__ void __raygen__reproject()
+  {
+    const int ix = optixGetLaunchIndex().x;
+    const int iy = optixGetLaunchIndex().y;
+    // the last frame may have been rendered at a different
+    // resolution than this one; both keep their pixels at the same
+    // pitch, though
+    const vec2i size    = optixLaunchParams.reprojection.previousSize;
+    const vec2i newSize = optixLaunchParams.frame.renderSize;
+    const int   pitch   = optixLaunchParams.frame.fullSize.x;
+    const PixelHistory &previous = optixLaunchParams.reprojection.previous;
+    const uint32_t from = ix+iy*pitch;
+
+    const uint32_t hitID = previous.hitID[from];
+    if (hitID == REPROJECTION_INVALID
+        || previous.age[from] >= optixLaunchParams.reprojection.maxAge)
+      return;
+    
+    // only pixels in the middle of a surface get reused; on an edge,
+    // the pixel partly shows something else, which may have moved
+    // differently
+    const float depth = previous.depth[from];
+    const int dx[4] = { -1, +1, 0, 0 };
+    const int dy[4] = { 0, 0, -1, +1 };
+    for (int n=0;n<4;n++) {
+      const int nx = ix+dx[n], ny = iy+dy[n];
+      if (nx < 0 || ny < 0 || nx >= size.x || ny >= size.y) continue;
+      const uint32_t neighbor = nx+ny*pitch;
+      if (previous.hitID[neighbor] != hitID
+          || fabsf(previous.depth[neighbor]-depth) > .05f*depth)
+        return;
+    }
+
+    // where the hit point is (for a miss, just which direction)...
+    const RayCamera &last = optixLaunchParams.reprojection.previousCamera;
+    const vec2f screen(vec2f(ix+.5f,iy+.5f) / vec2f(size));
+    const vec3f rayDir = normalize(last.direction
+                                   + (screen.x - 0.5f) * last.horizontal
+                                   + (screen.y - 0.5f) * last.vertical);
+    const RayCamera &camera = optixLaunchParams.camera;
+    const bool  miss    = (hitID == 0);
+    const vec3f toPoint = miss ? rayDir : last.position + depth*rayDir - camera.position;
+
+    // ... and where that is on the new camera's screen
+    const float along = dot(toPoint,camera.direction);
+    if (along <= 0.f) return;
+    const vec3f onScreen = toPoint/along - camera.direction;
+    const vec2f newScreen(dot(onScreen,camera.horizontal)/dot(camera.horizontal,camera.horizontal) + .5f,
+                          dot(onScreen,camera.vertical)/dot(camera.vertical,camera.vertical) + .5f);
+    const int tx = int(floorf(newScreen.x*newSize.x));
+    const int ty = int(floorf(newScreen.y*newSize.y));
+    if (tx < 0 || ty < 0 || tx >= newSize.x || ty >= newSize.y) return;
+
+    // positive floats sort like their bits, so the closest wins
+    const float newDepth = miss ? REPROJECTION_MISS_DEPTH : length(toPoint);
+    atomicMin(&optixLaunchParams.reprojection.reprojected[tx+ty*pitch],
+              ((unsigned long long)__float_as_uint(newDepth) << 32) | from);
   }
   
 } // ::osc
@@ -0,0 +1,186 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/*! headless rendering across worker processes: run without --worker,
+    this is the coordinator, which builds the scene, starts worker
+    processes (copies of itself, with --worker), and has them render
+    each frame in tiles; see Distributed.h. everything stays on the
+    loopback interface */
+
+#include "Distributed.h"
+#include "SampleRenderer.h"
+#include "Scenes.h"
+#include <cstring>
+#include <iomanip>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "3rdParty/stb_image_write.h"
+
+namespace osc {
+
+  /*! a worker's end of things: one renderer, re-used for all tiles,
+      with a single frame in flight so mapFrame() hands back the
+      tile we just rendered */
+  RenderRowsFunction makeGPURenderer(const Geometry &scene)
+  {
+    std::shared_ptr<SampleRenderer> renderer
+      = std::make_shared<SampleRenderer>(scene,/*numFramesInFlight*/1);
+    std::shared_ptr<vec2i> currentSize = std::make_shared<vec2i>(0);
+    return [renderer,currentSize](const Camera &camera, const vec2i &frameSize,
+                                  const RowRange &rows, uint32_t *pixels) {
+      if (*currentSize != frameSize) {
+        renderer->resize(frameSize);
+        *currentSize = frameSize;
+      }
+      renderer->setCamera(camera);
+      renderer->setRows(rows.rowOffset,rows.numRows,rows.rowStride);
+      renderer->render();
+      vec2i size;
+      const uint32_t *frame = renderer->mapFrame(size);
+      if (!frame)
+        throw std::runtime_error("renderer gave no frame");
+      memcpy(pixels,frame,size_t(rows.numRows)*frameSize.x*sizeof(uint32_t));
+    };
+  }
+
+  /*! start numWorkers workers, render numFrames frames on them, and
+      return the average frame time */
+  double runFrames(const char *executable,
+                   const std::string &sceneBytes,
+                   const Camera &camera,
+                   const vec2i &frameSize,
+                   int numWorkers,
+                   int tileRows,
+                   int numFrames,
+                   std::vector<uint32_t> &pixels)
+  {
+    Coordinator coordinator;
+    spawnWorkers(executable,coordinator.port(),numWorkers);
+    coordinator.addWorkers(numWorkers,sceneBytes);
+
+    pixels.resize(size_t(frameSize.x)*frameSize.y);
+    // the renderers are all set up by now (addWorkers() waits for
+    // that), but the first frame still pays for each worker's first
+    // resize() and launch, so don't count it
+    coordinator.renderFrame(camera,frameSize,tileRows,pixels.data());
+    const double t0 = getCurrentTime();
+    for (int i=0;i<numFrames;i++)
+      coordinator.renderFrame(camera,frameSize,tileRows,pixels.data());
+    const double frameTime = (getCurrentTime()-t0)/numFrames;
+
+    std::cout << "#osc.dist: " << numWorkers << " worker(s): "
+              << prettyDouble(frameTime) << "s/frame, tiles compressed to "
+              << int(100.*coordinator.compressedBytes/std::max(size_t(1),coordinator.uncompressedBytes))
+              << "%" << std::endl;
+    return frameTime;
+  }
+  
+  extern "C" int main(int ac, char **av)
+  {
+    try {
+      if (ac == 4 && std::string(av[1]) == "--worker") {
+        runWorker(av[2],std::stoi(av[3]),makeGPURenderer);
+        return 0;
+      }
+      
+      vec2i frameSize(1024,768);
+      int numWorkers = 2;
+      /*! if set, time 1..8 workers instead of just numWorkers */
+      bool scaling = false;
+      int tileRows = 32;
+      int numFrames = 20;
+      std::string outFileName;
+      int numInstances = 0;
+      int numRandomPrims = 0;
+      std::vector<std::string> meshFileNames;
+      for (int i=1;i<ac;i++) {
+        const std::string arg = av[i];
+        if (arg == "--size" && i+2 < ac) {
+          frameSize.x = std::stoi(av[++i]);
+          frameSize.y = std::stoi(av[++i]);
+        } else if (arg == "--workers" && i+1 < ac)
+          numWorkers = std::max(1,std::stoi(av[++i]));
+        else if (arg == "--scaling")
+          scaling = true;
+        else if (arg == "--tile-rows" && i+1 < ac)
+          tileRows = std::max(1,std::stoi(av[++i]));
+        else if (arg == "--frames" && i+1 < ac)
+          numFrames = std::max(1,std::stoi(av[++i]));
+        else if (arg == "--out" && i+1 < ac)
+          outFileName = av[++i];
+        else if (arg == "--instances" && i+1 < ac)
+          numInstances = std::stoi(av[++i]);
+        else if (arg == "--random-prims" && i+1 < ac)
+          numRandomPrims = std::stoi(av[++i]);
+        else if (arg == "--load" && i+1 < ac)
+          meshFileNames.push_back(av[++i]);
+        else
+          throw std::runtime_error("unknown cmdline argument '"+arg+"'");
+      }
+
+      Geometry scene;
+      addDemoScene(scene);
+      if (numRandomPrims > 0)
+        addRandomPrims(scene,numRandomPrims);
+      if (numInstances > 0)
+        addInstanceGrid(scene,numInstances);
+      for (auto &fileName : meshFileNames)
+        loadMeshFile(scene,fileName);
+      scene.preprocess();
+      const std::string sceneBytes = serializeScene(scene);
+      std::cout << "#osc.dist: scene is " << prettyNumber(sceneBytes.size())
+                << " bytes serialized" << std::endl;
+      const Camera camera = meshFileNames.empty() ? demoCamera() : cameraFor(computeBounds(scene));
+
+      std::vector<uint32_t> pixels;
+      if (scaling) {
+        std::vector<double> frameTimes;
+        for (int n=1;n<=8;n++)
+          frameTimes.push_back(runFrames(av[0],sceneBytes,camera,frameSize,
+                                         n,tileRows,numFrames,pixels));
+        std::cout << "#osc.dist: workers   s/frame   speedup" << std::endl;
+        for (int n=1;n<=8;n++)
+          std::cout << "#osc.dist: " << std::setw(7) << n
+                    << std::setw(10) << prettyDouble(frameTimes[n-1])
+                    << std::setw(10) << std::setprecision(3) << frameTimes[0]/frameTimes[n-1]
+                    << std::endl;
+      } else
+        runFrames(av[0],sceneBytes,camera,frameSize,
+                  numWorkers,tileRows,numFrames,pixels);
+
+      if (!outFileName.empty()) {
+        // the frame buffer's first row is the bottom one
+        std::vector<uint32_t> flipped(pixels.size());
+        for (int y=0;y<frameSize.y;y++)
+          memcpy(&flipped[size_t(frameSize.y-1-y)*frameSize.x],
+                 &pixels[size_t(y)*frameSize.x],frameSize.x*sizeof(uint32_t));
+        if (!stbi_write_png(outFileName.c_str(),frameSize.x,frameSize.y,4,
+                            flipped.data(),frameSize.x*sizeof(uint32_t)))
+          throw std::runtime_error("could not write '"+outFileName+"'");
+        std::cout << "#osc.dist: frame written to " << outFileName << std::endl;
+      }
+
+      waitForWorkers();
+    } catch (std::runtime_error& e) {
+      std::cout << GDT_TERMINAL_RED << "FATAL ERROR: " << e.what()
+                << GDT_TERMINAL_DEFAULT << std::endl;
+      exit(1);
+    }
+    return 0;
+  }
+  
+} // ::osc
@@ -14,22 +14,38 @@
 // limitations under the License.                                           //
 // ======================================================================== //
 
-#include "SampleRenderer.h"
+#include "DynamicResolution.h"
+#include "MultiDeviceRenderer.h"
+#include "OutOfCore.h"
+#include "Scenes.h"
+#include "gdt/profile/Profiler.h"
 
 // our helper library for window handling
 #include "glfWindow/GLFWindow.h"
-#include <GL/gl.h>
+#include "glfWindow/GLDisplay.h"
+#include <functional>
 
 namespace osc {
 
-  struct SampleWindow : public GLFCameraWindow
+  struct SampleWindow final : public GLFCameraWindow
   {
     SampleWindow(const std::string &title,
                  const Geometry &scene,
                  const Camera &camera,
-                 const float worldScale)
+                 const float worldScale,
+                 ChunkCache *chunkCache = nullptr,
+                 int numFramesInFlight = 2,
+                 int numPBOs = 3,
+                 const std::vector<int> &deviceIDs = std::vector<int>(1,0),
+                 FrameSplitMode splitMode = SPLIT_BANDS,
+                 double frameTimeBudget = 0.)
       : GLFCameraWindow(title,camera.from,camera.at,camera.up,worldScale),
-        sample(scene)
+        sample(scene,numFramesInFlight,deviceIDs,splitMode),
+        display(numPBOs),
+        title(title),
+        resolution(frameTimeBudget),
+        dynamicResolution(frameTimeBudget > 0.),
+        chunkCache(chunkCache)
     {
       sample.setCamera(camera);
     }
@@ -37,73 +53,274 @@ namespace osc {
     virtual void render() override
     {
       if (cameraFrame.modified) {
-        sample.setCamera(Camera{ cameraFrame.get_from(),
-                                 cameraFrame.get_at(),
-                                 cameraFrame.get_up() });
+        const Camera camera{ cameraFrame.get_from(),
+                             cameraFrame.get_at(),
+                             cameraFrame.get_up() };
+        sample.setCamera(camera);
+        if (chunkCache)
+          updateResidentChunks(camera);
         cameraFrame.modified = false;
+        lastCameraMove = getCurrentTime();
       }
+      updateRenderSize();
+      // render() only enqueues the frame, so measure from one frame
+      // to the next instead
+      const double now = getCurrentTime();
+      if (lastFrameStart > 0.)
+        frameTime += now-lastFrameStart;
+      lastFrameStart = now;
       sample.render();
+
+      // report throughput every couple of frames, so changes to the
+      // scene/bvh layout can be compared; the time spent waiting for
+      // frames to display tells how well rendering and display
+      // overlap
+      if (++numFramesRendered == 100) {
+        const double secondsPerFrame = frameTime / (numFramesRendered-1);
+        std::cout << "#osc: avg frame time " << prettyDouble(secondsPerFrame) << "s, "
+                  << prettyDouble(renderSize.x*renderSize.y*sample.getTracedFraction()
+                                  /secondsPerFrame) << " primary rays/s, ";
+        if (foveationEnabled)
+          std::cout << int(100.*sample.getTracedFraction()+.5) << "% of pixels traced, ";
+        std::cout << int(100.*displayWaitTime/frameTime) << "% waiting for frames, "
+                  << prettyDouble(display.uploadTime/max(display.numFramesUploaded,1))
+                  << "s/frame uploading to GL" << std::endl;
+        if (const RayStats *stats = sample.getRayStats())
+          printRayStats(*stats);
+        frameTime = 0.;
+        displayWaitTime = 0.;
+        display.uploadTime = 0.;
+        display.numFramesUploaded = 0;
+        lastFrameStart = 0.;
+        numFramesRendered = 0;
+      }
     }
     
-    virtual void draw() override
+    /*! while the camera moves (or moved only just now), render at
+        whatever fraction of the window size the resolution
+        controller says fits the frame time budget, and let the
+        display scale that up; once it stops, go back to full
+        resolution. this only changes what the next frames get
+        launched at: frames in flight, and everything the renderer
+        keeps per pixel, stay as they are */
+    void updateRenderSize()
+    {
+      const bool moving
+        = dynamicResolution && getCurrentTime()-lastCameraMove < cameraSettleTime;
+      const vec2i wanted = moving ? resolution.renderSize(fbSize) : fbSize;
+      if (wanted == renderSize) return;
+      renderSize = wanted;
+      sample.setRenderSize(renderSize);
+    }
+    
+    /*! ray statistics of one frame */
+    void printRayStats(const RayStats &stats)
+    {
+      const double numPrimary = double(max(stats.primaryRays,uint64_t(1)));
+      std::cout << "#osc: rays: " << prettyNumber(stats.primaryRays) << " primary ("
+                << int(100.*stats.misses/numPrimary) << "% misses), "
+                << prettyNumber(stats.shadowRays) << " shadow ("
+                << int(100.*stats.shadowRaysOccluded/max(double(stats.shadowRays),1.))
+                << "% terminated early, "
+                << prettyNumber(stats.shadowRaysCulled) << " culled, "
+                << prettyNumber(stats.shadowRaysCached) << " skipped by cached occluders), "
+                << prettyNumber(stats.reusedPixels) << " pixels reprojected, "
+                << prettyNumber(stats.bounceRays) << " bounce, "
+                << prettyDouble(stats.primitiveTests/numPrimary) << " primitive tests/pixel, "
+                << prettyDouble(stats.cycles/numPrimary) << " cycles/pixel" << std::endl;
+    }
+    
+    virtual void key(int key, int mods) override
+    {
+      switch(key) {
+      case 'r':
+      case 'R':
+        rayStatsEnabled = !rayStatsEnabled;
+        std::cout << "#osc: ray statistics " << (rayStatsEnabled ? "on" : "off") << std::endl;
+        sample.setRayStatsEnabled(rayStatsEnabled);
+        break;
+      case 'h':
+      case 'H':
+        heatmapEnabled = !heatmapEnabled;
+        std::cout << "#osc: heatmap " << (heatmapEnabled ? "on" : "off") << std::endl;
+        sample.setHeatmapEnabled(heatmapEnabled);
+        break;
+      case 't':
+      case 'T':
+        reprojectionEnabled = !reprojectionEnabled;
+        std::cout << "#osc: temporal reprojection " << (reprojectionEnabled ? "on" : "off") << std::endl;
+        sample.setReprojectionEnabled(reprojectionEnabled);
+        break;
+      case 'g':
+      case 'G':
+        radianceCacheEnabled = !radianceCacheEnabled;
+        std::cout << "#osc: radiance cache " << (radianceCacheEnabled ? "on" : "off") << std::endl;
+        sample.setRadianceCacheEnabled(radianceCacheEnabled);
+        break;
+      case 'o':
+      case 'O':
+        shadowRayPolicy.occluderCache = !shadowRayPolicy.occluderCache;
+        std::cout << "#osc: occluder cache " << (shadowRayPolicy.occluderCache ? "on" : "off") << std::endl;
+        sample.setShadowRayPolicy(shadowRayPolicy);
+        break;
+      case 'v':
+      case 'V':
+        foveationEnabled = !foveationEnabled;
+        std::cout << "#osc: foveation " << (foveationEnabled ? "on" : "off") << std::endl;
+        sample.setFoveation(foveationEnabled ? foveation : Foveation());
+        break;
+      case 'd':
+      case 'D':
+        dynamicResolution = !dynamicResolution;
+        // without a budget from the command line, aim for 60 fps
+        if (dynamicResolution && resolution.frameTimeBudget <= 0.)
+          resolution.frameTimeBudget = 1./60.;
+        std::cout << "#osc: dynamic resolution " << (dynamicResolution ? "on" : "off") << std::endl;
+        break;
+      default:
+        GLFCameraWindow::key(key,mods);
+      }
+    }
+    
+    /*! out-of-core mode: page in all chunks visible from the given
+        camera, and hand them to the renderer if that set changed */
+    void updateResidentChunks(const Camera &camera)
     {
-      sample.downloadPixels(pixels.data());
-      if (fbTexture == 0)
-        glGenTextures(1, &fbTexture);
+      GDT_PROFILE_SCOPE("updateResidentChunks");
+      chunkCache->beginFrame();
+      const std::vector<size_t> visible
+        = chunkCache->findVisibleChunks(camera,fbSize.x/float(fbSize.y));
+      std::vector<size_t> resident;
+      std::vector<std::shared_ptr<const TriangleMesh>> meshes;
+      for (auto chunkID : visible) {
+        std::shared_ptr<const TriangleMesh> mesh = chunkCache->get(chunkID);
+        if (!mesh) continue;
+        resident.push_back(chunkID);
+        meshes.push_back(mesh);
+      }
+
+      const ChunkCacheStats &stats = chunkCache->stats;
+      GDT_PROFILE_COUNTER("chunkBytesPagedIn",stats.bytesPagedIn);
+      std::cout << "#osc: chunks: " << stats.numRequests << " requested, "
+                << int(100.f*stats.hitRate()) << "% hits, "
+                << stats.numPageIns << " paged in ("
+                << prettyNumber(stats.bytesPagedIn) << "B at "
+                << prettyNumber((size_t)stats.pageInBandwidth()) << "B/s), "
+                << stats.numEvictions << " evicted, "
+                << stats.numSkipped << " over budget, "
+                << prettyNumber(chunkCache->memoryUsed) << "B resident" << std::endl;
       
-      glBindTexture(GL_TEXTURE_2D, fbTexture);
-      GLenum texFormat = GL_RGBA;
-      GLenum texelType = GL_UNSIGNED_BYTE;
-      glTexImage2D(GL_TEXTURE_2D, 0, texFormat, fbSize.x, fbSize.y, 0, GL_RGBA,
-                   texelType, pixels.data());
-
-      glDisable(GL_LIGHTING);
-      glColor3f(1, 1, 1);
-
-      glMatrixMode(GL_MODELVIEW);
-      glLoadIdentity();
-
-      glEnable(GL_TEXTURE_2D);
-      glBindTexture(GL_TEXTURE_2D, fbTexture);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      if (resident != residentChunks) {
+        residentChunks = resident;
+        sample.setStreamedMeshes(meshes);
+      }
+    }
+    
+    virtual void draw() override
+    {
+      // shows the frame from N-1 render() calls ago, while the more
+      // recent ones are still rendering
+      const double t0 = getCurrentTime();
+      vec2i frameSize;
+      const uint32_t *framePixels = sample.mapFrame(frameSize);
+      displayWaitTime += getCurrentTime()-t0;
+      if (framePixels) {
+        // what the devices took for the frame (not what it took to
+        // get here, which depends on how many frames are in flight),
+        // at the resolution it was rendered at
+        const std::vector<double> &deviceTimes = sample.getMappedDeviceTimes();
+        resolution.update(*std::max_element(deviceTimes.begin(),deviceTimes.end()),
+                          frameSize,fbSize);
+      }
+      if (const RayStats *stats = sample.getRayStats()) {
+        GDT_PROFILE_COUNTER("shadowRays",stats->shadowRays);
+        GDT_PROFILE_COUNTER("primitiveTests",stats->primitiveTests);
+      }
       
-      glDisable(GL_DEPTH_TEST);
+      {
+        GDT_PROFILE_SCOPE("display");
+        display.draw(framePixels,frameSize,fbSize);
+      }
+      updateOverlay();
+    }
 
-      glViewport(0, 0, fbSize.x, fbSize.y);
+    /*! show rolling frame rate and per-stage times of the last second
+        in the window title (there's no text rendering here) */
+    void updateOverlay()
+    {
+      const double now = getCurrentTime();
+      if (now - lastOverlayUpdate < .5) return;
+      lastOverlayUpdate = now;
 
-      glMatrixMode(GL_PROJECTION);
-      glLoadIdentity();
-      glOrtho(0.f, (float)fbSize.x, 0.f, (float)fbSize.y, -1.f, 1.f);
+      const double window = 1.;
+      const std::vector<profile::StageStats> stats = profile::summarize(window);
+      if (stats.empty()) return;
 
-      glBegin(GL_QUADS);
-      {
-        glTexCoord2f(0.f, 0.f);
-        glVertex3f(0.f, 0.f, 0.f);
-      
-        glTexCoord2f(0.f, 1.f);
-        glVertex3f(0.f, (float)fbSize.y, 0.f);
-      
-        glTexCoord2f(1.f, 1.f);
-        glVertex3f((float)fbSize.x, (float)fbSize.y, 0.f);
-      
-        glTexCoord2f(1.f, 0.f);
-        glVertex3f((float)fbSize.x, 0.f, 0.f);
+      std::stringstream text;
+      for (auto &s : stats)
+        if (std::string(s.name) == "multiDeviceRender")
+          text << " | " << prettyDouble(s.count/window) << " fps";
+      for (auto &s : stats) {
+        text << " | " << s.name << " ";
+        if (s.isCounter)
+          text << prettyDouble(s.total/window) << "/s";
+        else
+          text << prettyDouble(s.total/s.count) << "s";
       }
-      glEnd();
+      // how the frame is split across devices, which should follow
+      // their speeds
+      if (sample.numDevices() > 1) {
+        const std::vector<RowRange> &ranges = sample.getMappedRanges();
+        text << " | rows";
+        for (size_t d=0;d<ranges.size();d++)
+          text << (d ? "/" : " ") << ranges[d].numRows;
+      }
+      if (renderSize != fbSize)
+        text << " | " << renderSize.x << "x" << renderSize.y;
+      glfwSetWindowTitle(handle,(title+text.str()).c_str());
     }
     
     virtual void resize(const vec2i &newSize) 
     {
       fbSize = newSize;
+      renderSize = newSize;
       sample.resize(newSize);
-      pixels.resize(newSize.x*newSize.y);
     }
 
     vec2i                 fbSize;
-    GLuint                fbTexture {0};
-    SampleRenderer        sample;
-    std::vector<uint32_t> pixels;
+    MultiDeviceRenderer   sample;
+    GLDisplay             display;
+    const std::string     title;
+    bool                  rayStatsEnabled { false };
+    bool                  heatmapEnabled  { false };
+    double                lastOverlayUpdate { 0. };
+
+    /*! the size frames currently get rendered at; less than fbSize
+        while the camera moves */
+    vec2i                 renderSize        { 0 };
+    ResolutionController  resolution;
+    bool                  dynamicResolution;
+
+    /*! regions of interest to use when foveation is on */
+    Foveation             foveation { makeFovea(vec2f(.5f),.3f) };
+    bool                  foveationEnabled  { false };
+    bool                  reprojectionEnabled { false };
+    bool                  radianceCacheEnabled { false };
+    ShadowRayPolicy       shadowRayPolicy;
+    double                lastCameraMove    { 0. };
+    /*! how long after the last camera change frames stay at reduced
+        resolution; camera changes only come with mouse motion, so a
+        drag that pauses for a frame or two isn't over yet */
+    const double          cameraSettleTime  { .2 };
+
+    /*! only set in out-of-core mode */
+    ChunkCache           *chunkCache;
+    std::vector<size_t>   residentChunks;
+
+    double                frameTime         { 0. };
+    double                displayWaitTime   { 0. };
+    double                lastFrameStart    { 0. };
+    int                   numFramesRendered { 0 };
   };
   
   
@@ -112,30 +329,230 @@ namespace osc {
   extern "C" int main(int ac, char **av)
   {
     try {
+      bool preprocess = true;
+      /*! if > 0, merge meshes smaller than this many triangles */
+      size_t mergeMaxTriangles = 0;
+      /*! if > 0, give meshes smooth normals with this crease angle */
+      float creaseAngle = 0.f;
+      /*! memory budget for out-of-core mode; 0 means in-core */
+      size_t outOfCoreBudget = 0;
+      /*! chunk file to render from in out-of-core mode; gets written
+          first if it doesn't exist yet */
+      std::string chunkFileName = "scene.chunks";
+      /*! if set, only write the scene to this chunk file, then exit */
+      std::string writeChunksFileName;
+      /*! if set, where to write a chrome trace of the session to */
+      std::string traceFileName;
+      bool rayStats = false;
+      bool reproject = false;
+      bool radianceCache = false;
+      ShadowRayPolicy shadowRayPolicy;
+      /*! if > 0, bake lighting into the meshes' vertices, with this
+          many occlusion rays each */
+      int bakeSamples = 0;
+      /*! number of instances of a heavy mesh to add, on a grid */
+      int numInstances = 0;
+      /*! number of random small cubes and spheres to scatter */
+      int numRandomPrims = 0;
+      int numFramesInFlight = 2;
+      /*! number of pixel buffer objects to upload frames through; 0
+          uploads straight from client memory */
+      int numPBOs = 3;
+      /*! devices to render on; empty means all of them */
+      std::vector<int> deviceIDs(1,0);
+      FrameSplitMode splitMode = SPLIT_BANDS;
+      /*! frame time to aim for while the camera moves, in seconds;
+          0 (the default) always renders at full resolution */
+      double frameTimeBudget = 0.;
+      /*! regions of interest; if any, foveation starts out on */
+      Foveation foveation;
+      /*! .obj/.ply files to add to the scene */
+      std::vector<std::string> meshFileNames;
+      for (int i=1;i<ac;i++) {
+        const std::string arg = av[i];
+        if (arg == "--no-preprocess")
+          preprocess = false;
+        else if (arg == "--merge" && i+1 < ac)
+          mergeMaxTriangles = std::stoul(av[++i]);
+        else if (arg == "--smooth-normals" && i+1 < ac)
+          creaseAngle = std::stof(av[++i]);
+        else if (arg == "--out-of-core" && i+1 < ac)
+          outOfCoreBudget = size_t(std::stoul(av[++i])) << 20;
+        else if (arg == "--chunk-file" && i+1 < ac)
+          chunkFileName = av[++i];
+        else if (arg == "--write-chunks" && i+1 < ac)
+          writeChunksFileName = av[++i];
+        else if (arg == "--instances" && i+1 < ac)
+          numInstances = std::stoi(av[++i]);
+        else if (arg == "--random-prims" && i+1 < ac)
+          numRandomPrims = std::stoi(av[++i]);
+        else if (arg == "--frames-in-flight" && i+1 < ac)
+          numFramesInFlight = std::max(1,std::stoi(av[++i]));
+        else if (arg == "--ray-stats")
+          rayStats = true;
+        else if (arg == "--reproject")
+          reproject = true;
+        else if (arg == "--radiance-cache")
+          radianceCache = true;
+        else if (arg == "--no-shadow-culling")
+          shadowRayPolicy.cullBackFacing = false;
+        else if (arg == "--occluder-cache")
+          shadowRayPolicy.occluderCache = true;
+        else if (arg == "--bake" && i+1 < ac)
+          bakeSamples = std::max(1,std::stoi(av[++i]));
+        else if (arg == "--trace" && i+1 < ac)
+          traceFileName = av[++i];
+        else if (arg == "--pbos" && i+1 < ac)
+          numPBOs = std::max(0,std::stoi(av[++i]));
+        else if (arg == "--devices" && i+1 < ac) {
+          // a count (0 for all), or a comma-separated list of IDs
+          const std::string devices = av[++i];
+          deviceIDs.clear();
+          if (devices.find(',') == std::string::npos) {
+            for (int d=0;d<std::stoi(devices);d++) deviceIDs.push_back(d);
+          } else {
+            std::stringstream ss(devices);
+            std::string id;
+            while (std::getline(ss,id,',')) deviceIDs.push_back(std::stoi(id));
+          }
+        } else if (arg == "--split" && i+1 < ac) {
+          const std::string mode = av[++i];
+          if (mode == "bands") splitMode = SPLIT_BANDS;
+          else if (mode == "interleaved") splitMode = SPLIT_INTERLEAVED;
+          else throw std::runtime_error("unknown split mode '"+mode+"' (bands or interleaved)");
+        } else if (arg == "--frame-budget" && i+1 < ac)
+          frameTimeBudget = std::max(0.,std::stod(av[++i])*1e-3);
+        else if (arg == "--roi" && i+4 < ac) {
+          // in [0,1]^2 screen coordinates, (0,0) the bottom left
+          const vec2f lower(std::stof(av[i+1]),std::stof(av[i+2]));
+          const vec2f upper(std::stof(av[i+3]),std::stof(av[i+4]));
+          foveation.regions.push_back(box2f(lower,upper));
+          i += 4;
+        } else if (arg == "--fovea" && i+1 < ac)
+          foveation.regions.push_back(makeFovea(vec2f(.5f),std::stof(av[++i])).regions[0]);
+        else if (arg == "--outer-rate" && i+1 < ac)
+          foveation.outerRate = std::stoi(av[++i]);
+        else if (arg == "--load" && i+1 < ac)
+          meshFileNames.push_back(av[++i]);
+        else
+          throw std::runtime_error("unknown cmdline argument '"+arg+"'");
+      }
+      
+      const bool outOfCore = outOfCoreBudget || !writeChunksFileName.empty();
+      if (bakeSamples > 0 && outOfCore)
+        throw std::runtime_error("can't bake lighting in out-of-core mode");
+
+      // the procedural parts of the scene; the mesh files come after
+      // those
+      std::vector<std::function<void(Geometry &)>> sceneParts;
+      sceneParts.push_back([](Geometry &part){ addDemoScene(part); });
+      if (numRandomPrims > 0)
+        sceneParts.push_back([=](Geometry &part){ addRandomPrims(part,numRandomPrims); });
+      if (numInstances > 0)
+        sceneParts.push_back([=](Geometry &part){ addInstanceGrid(part,numInstances); });
+
+      auto prepare = [&](Geometry &geometry) {
+        if (preprocess) {
+          PreprocessOptions options;
+          options.creaseAngle = creaseAngle;
+          geometry.preprocess(options);
+        } else if (creaseAngle > 0.f)
+          geometry.computeNormals(creaseAngle);
+        if (mergeMaxTriangles > 0)
+          geometry.mergeMeshes(mergeMaxTriangles);
+      };
+      
       Geometry scene;
-      TriangleMesh plane;
-      Sphere s;
-      scene.addCube(vec3f(0.f, -1.5f, 0.f),        // Position
-                    vec3f(10.f, .1f, 10.f),        // Size
-                    vec3f(1.0f, 1.0f, 1.0f));      // Color
-
-      scene.addSphere(0.3f,                        // Radius
-                      vec3f(3.0f, 1.0f, 0.0f),     // Center
-                      vec3f(1.f, 1.f, 1.f));       // Color
-      scene.addSphere(1.0f, vec3f(0.0f, 0.0f, 0.0f), vec3f(1.f, 0.5f, 0.5f));
-      scene.addCube(vec3f(4.0f, 0.0f, 0.0f), vec3f(1.5f, 1.5f, 1.5f), vec3f(0.2f, 0.9f, 0.2f));
-
-      Camera camera = { /*from*/vec3f(-10.f,2.f,-12.f),
-                        /* at */vec3f(0.f,0.f,0.f),
-                        /* up */vec3f(0.f,1.f,0.f) };
+      std::unique_ptr<ChunkFile>  chunkFile;
+      std::unique_ptr<ChunkCache> chunkCache;
+      if (outOfCore) {
+        // all mesh data goes to disk, one part of the scene at a
+        // time, and only gets paged back in (by the window) as the
+        // camera sees it; spheres and instances stay in core. an
+        // existing chunk file gets used as is, without loading any
+        // meshes at all
+        const bool writeOnly = !writeChunksFileName.empty();
+        const std::string fileName = writeOnly ? writeChunksFileName : chunkFileName;
+        std::unique_ptr<ChunkFileWriter> writer;
+        if (writeOnly || !std::ifstream(fileName).good())
+          writer.reset(new ChunkFileWriter(fileName));
+        else
+          std::cout << "#osc: using existing chunk file '" << fileName
+                    << "' (see --write-chunks)" << std::endl;
+
+        for (auto &addPart : sceneParts) {
+          Geometry part;
+          addPart(part);
+          if (writer) {
+            prepare(part);
+            for (auto &mesh : part.meshes) writer->add(mesh);
+          }
+          part.meshes.clear();
+          scene.append(part);
+        }
+        if (writer) {
+          for (auto &meshFileName : meshFileNames) {
+            Geometry part;
+            loadMeshFile(part,meshFileName);
+            prepare(part);
+            for (auto &mesh : part.meshes) writer->add(mesh);
+          }
+          writer->close();
+        }
+        if (writeOnly) return 0;
+        
+        chunkFile.reset(new ChunkFile(fileName));
+        chunkCache.reset(new ChunkCache(*chunkFile,outOfCoreBudget));
+      } else {
+        for (auto &addPart : sceneParts)
+          addPart(scene);
+        for (auto &fileName : meshFileNames)
+          loadMeshFile(scene,fileName);
+        prepare(scene);
+      }
+
+      // baked lighting needs finer meshes than the demo scene's (and
+      // preprocessing would weld their faces back together)
+      float sceneSize = 0.f;
+      if (bakeSamples > 0) {
+        sceneSize = length(computeBounds(scene).span());
+        scene.tessellateForBaking(sceneSize/200.f);
+      }
+
+      const Camera camera = demoCamera();
       // something approximating the scale of the world, so the
       // camera knows how much to move for any given user interaction:
       const float worldScale = 10.f;
 
       SampleWindow *window = new SampleWindow("Optix Template",
-                                              scene,camera,worldScale);
+                                              scene,camera,worldScale,
+                                              chunkCache.get(),
+                                              numFramesInFlight,
+                                              numPBOs,
+                                              deviceIDs,
+                                              splitMode,
+                                              frameTimeBudget);
+      window->rayStatsEnabled = rayStats;
+      window->sample.setRayStatsEnabled(rayStats);
+      window->reprojectionEnabled = reproject;
+      window->sample.setReprojectionEnabled(reproject);
+      window->radianceCacheEnabled = radianceCache;
+      window->sample.setRadianceCacheEnabled(radianceCache);
+      window->shadowRayPolicy = shadowRayPolicy;
+      window->sample.setShadowRayPolicy(shadowRayPolicy);
+      if (bakeSamples > 0)
+        window->sample.bakeLighting(bakeSamples,.1f*sceneSize);
+      if (!foveation.regions.empty()) {
+        window->foveation = foveation;
+        window->foveationEnabled = true;
+        window->sample.setFoveation(foveation);
+      } else
+        window->foveation.outerRate = foveation.outerRate;
       window->run();
-      
+      delete window;
+
+      if (!traceFileName.empty())
+        profile::writeChromeTrace(traceFileName);
     } catch (std::runtime_error& e) {
       std::cout << GDT_TERMINAL_RED << "FATAL ERROR: " << e.what()
                 << GDT_TERMINAL_DEFAULT << std::endl;
@@ -0,0 +1,378 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/*! micro-benchmarks for the host-side math in gdt: for each kernel,
+    runs the generic (scalar) vec_t templates and the SIMD versions
+    from gdt/math/simd.h over the same data, and reports time per
+    element, speedup, and the largest difference between the two
+    results (which should be zero). then does the same for the batch
+    transforms in gdt/math/AffineSpace.h, against calling xfmPoint
+    etc per element, in G(points)/s; and finally measures throughput
+    of the random number generators in gdt/random/random.h (whose
+    quality tests/RandomTest.cpp checks) */
+
+#include "gdt/math/AffineSpace.h"
+#include "gdt/random/random.h"
+#include <iomanip>
+#include <vector>
+
+namespace osc {
+  using namespace gdt;
+
+  struct Options {
+    size_t count;
+    int    reps;
+  };
+
+  /*! number of points (normals, boxes) for the batch transforms, and
+      how often to run them */
+  struct XfmOptions {
+    size_t count;
+    int    reps;
+  };
+  
+  /*! seconds per element, for running 'kernel' (which processes
+      'count' elements) 'reps' times, after one warm-up run */
+  template<typename Lambda>
+  double timePerElement(const Options &options, const Lambda &kernel)
+  {
+    kernel();
+    const double t0 = getCurrentTime();
+    for (int r=0;r<options.reps;r++)
+      kernel();
+    return (getCurrentTime()-t0)/(double(options.reps)*options.count);
+  }
+
+  inline float maxDiff(float a, float b) { return fabsf(a-b); }
+  inline float maxDiff(const vec3f &a, const vec3f &b)
+  { return reduce_max(abs(vec3f(a)-vec3f(b))); }
+  inline float maxDiff(const vec4f &a, const vec4f &b)
+  { return reduce_max(abs(a-b)); }
+  inline float maxDiff(const box3fa &a, const box3fa &b)
+  { return std::max(maxDiff(a.lower,b.lower),maxDiff(a.upper,b.upper)); }
+  inline float maxDiff(const box3f &a, const box3f &b)
+  { return std::max(maxDiff(a.lower,b.lower),maxDiff(a.upper,b.upper)); }
+
+  template<typename T>
+  float maxDiff(const std::vector<T> &a, const std::vector<T> &b)
+  {
+    float diff = 0.f;
+    for (size_t i=0;i<a.size();i++)
+      diff = std::max(diff,maxDiff(a[i],b[i]));
+    return diff;
+  }
+  
+  void report(const std::string &kernel, double scalarTime, double simdTime, float diff)
+  {
+    std::cout << "#osc.mathbench: " << kernel << std::string(std::max(1,24-(int)kernel.size()),' ')
+              << "scalar " << prettyDouble(scalarTime) << "s"
+              << "  simd " << prettyDouble(simdTime) << "s"
+              << "  (" << std::fixed << std::setprecision(2) << scalarTime/simdTime
+              << std::defaultfloat << "x)"
+              << "  max diff " << diff << std::endl;
+  }
+
+  /*! runs the scalar and simd version of an element-wise kernel into
+      separate outputs, and reports */
+  template<typename T, typename ScalarLambda, typename SimdLambda>
+  void compare(const Options &options, const std::string &name,
+               const ScalarLambda &scalarKernel, const SimdLambda &simdKernel)
+  {
+    std::vector<T> scalarResult(options.count), simdResult(options.count);
+    const double scalarTime = timePerElement(options,[&](){
+        for (size_t i=0;i<options.count;i++) scalarResult[i] = scalarKernel(i);
+      });
+    const double simdTime = timePerElement(options,[&](){
+        for (size_t i=0;i<options.count;i++) simdResult[i] = simdKernel(i);
+      });
+    report(name,scalarTime,simdTime,maxDiff(scalarResult,simdResult));
+  }
+  
+  /*! seconds per element for running 'kernel' over all elements */
+  template<typename Lambda>
+  double timePerElement(const XfmOptions &options, const Lambda &kernel)
+  {
+    Options asOptions;
+    asOptions.count = options.count;
+    asOptions.reps  = options.reps;
+    return timePerElement(asOptions,kernel);
+  }
+
+  /*! diff < 0 means there's nothing to compare against */
+  void reportRate(const std::string &kernel, const std::string &unit,
+                  double time, float diff = -1.f)
+  {
+    std::cout << "#osc.mathbench: " << kernel << std::string(std::max(1,32-(int)kernel.size()),' ')
+              << std::fixed << std::setprecision(2) << 1e-9/time << std::defaultfloat
+              << " G" << unit << "/s";
+    if (diff >= 0.f) std::cout << "  max diff " << diff;
+    std::cout << std::endl;
+  }
+  
+  void runTransforms(const XfmOptions &options)
+  {
+    std::cout << "#osc.mathbench: batch transforms, " << prettyNumber(options.count)
+              << " elements, " << options.reps << " reps, "
+              << getNumThreads() << " threads" << std::endl;
+    const size_t N = options.count;
+    const affine3f xfm
+      = affine3f::translate(vec3f(1.f,-2.f,3.f))
+      * affine3f::rotate(normalize(vec3f(1.f,2.f,3.f)),.7f)
+      * affine3f::scale(vec3f(2.f,.5f,3.f));
+    
+    LCG<16> random(0,0);
+    std::vector<vec3f> in(N), out(N), ref(N);
+    std::vector<float> inX(N), inY(N), inZ(N), outX(N), outY(N), outZ(N);
+    std::vector<box3f> boxes(N), outBoxes(N), refBoxes(N);
+    for (size_t i=0;i<N;i++) {
+      in[i] = vec3f(2.f*random()-1.f,2.f*random()-1.f,2.f*random()-1.f);
+      inX[i] = in[i].x; inY[i] = in[i].y; inZ[i] = in[i].z;
+      boxes[i] = box3f(in[i],in[i]+.1f*vec3f(random(),random(),random()));
+    }
+    auto soaResult = [&]() {
+      std::vector<vec3f> result(N);
+      for (size_t i=0;i<N;i++) result[i] = vec3f(outX[i],outY[i],outZ[i]);
+      return result;
+    };
+
+    double t;
+    t = timePerElement(options,[&](){
+        for (size_t i=0;i<N;i++) ref[i] = xfmPoint(xfm,in[i]); });
+    reportRate("xfmPoint (per point)","points",t);
+    t = timePerElement(options,[&](){ xfmPoints(xfm,in.data(),out.data(),N); });
+    reportRate("xfmPoints (AoS)","points",t,maxDiff(ref,out));
+    t = timePerElement(options,[&](){
+        xfmPoints(xfm,inX.data(),inY.data(),inZ.data(),
+                  outX.data(),outY.data(),outZ.data(),N); });
+    reportRate("xfmPoints (SoA)","points",t,maxDiff(ref,soaResult()));
+    t = timePerElement(options,[&](){ parallel_xfmPoints(xfm,in.data(),out.data(),N); });
+    reportRate("parallel_xfmPoints (AoS)","points",t,maxDiff(ref,out));
+    t = timePerElement(options,[&](){
+        parallel_xfmPoints(xfm,inX.data(),inY.data(),inZ.data(),
+                           outX.data(),outY.data(),outZ.data(),N); });
+    reportRate("parallel_xfmPoints (SoA)","points",t,maxDiff(ref,soaResult()));
+
+    t = timePerElement(options,[&](){
+        for (size_t i=0;i<N;i++) ref[i] = xfmNormal(xfm,in[i]); });
+    reportRate("xfmNormal (per normal)","normals",t);
+    t = timePerElement(options,[&](){ xfmNormals(xfm,in.data(),out.data(),N); });
+    reportRate("xfmNormals (AoS)","normals",t,maxDiff(ref,out));
+    t = timePerElement(options,[&](){
+        parallel_xfmNormals(xfm,inX.data(),inY.data(),inZ.data(),
+                            outX.data(),outY.data(),outZ.data(),N); });
+    reportRate("parallel_xfmNormals (SoA)","normals",t,maxDiff(ref,soaResult()));
+
+    // the reference here is the obvious way: extending by all 8
+    // transformed corners
+    t = timePerElement(options,[&](){
+        for (size_t i=0;i<N;i++) {
+          box3f bounds;
+          for (int c=0;c<8;c++)
+            bounds.extend(xfmPoint(xfm,vec3f((c&1) ? boxes[i].upper.x : boxes[i].lower.x,
+                                             (c&2) ? boxes[i].upper.y : boxes[i].lower.y,
+                                             (c&4) ? boxes[i].upper.z : boxes[i].lower.z)));
+          refBoxes[i] = bounds;
+        }
+      });
+    reportRate("xfmPoint (8 corners per box)","boxes",t);
+    t = timePerElement(options,[&](){
+        for (size_t i=0;i<N;i++) outBoxes[i] = xfmBox(xfm,boxes[i]); });
+    reportRate("xfmBox (per box)","boxes",t,maxDiff(refBoxes,outBoxes));
+    t = timePerElement(options,[&](){ xfmBoxes(xfm,boxes.data(),outBoxes.data(),N); });
+    reportRate("xfmBoxes","boxes",t,maxDiff(refBoxes,outBoxes));
+    t = timePerElement(options,[&](){ parallel_xfmBoxes(xfm,boxes.data(),outBoxes.data(),N); });
+    reportRate("parallel_xfmBoxes","boxes",t,maxDiff(refBoxes,outBoxes));
+  }
+  
+  void runRandom(const XfmOptions &options)
+  {
+    const size_t N = options.count;
+    std::cout << "#osc.mathbench: random numbers, " << prettyNumber(N)
+              << " samples, " << options.reps << " reps" << std::endl;
+    std::vector<float> out(N);
+    double t;
+    
+    LCG<16> lcg(0,0);
+    t = timePerElement(options,[&](){ for (size_t i=0;i<N;i++) out[i] = lcg(); });
+    reportRate("LCG","samples",t);
+    PCG32 pcg(0,0);
+    t = timePerElement(options,[&](){ for (size_t i=0;i<N;i++) out[i] = pcg(); });
+    reportRate("PCG32","samples",t);
+    t = timePerElement(options,[&](){ pcg.fill(out.data(),N); });
+    reportRate("PCG32::fill","samples",t);
+    Philox philox(0,0);
+    t = timePerElement(options,[&](){ for (size_t i=0;i<N;i++) out[i] = philox(); });
+    reportRate("Philox","samples",t);
+    t = timePerElement(options,[&](){ Philox::fill(0,0,0,out.data(),N); });
+    reportRate("Philox::fill","samples",t);
+    t = timePerElement(options,[&](){ sobolOwenFill(0,1,0,out.data(),N); });
+    reportRate("sobolOwenFill","samples",t);
+
+    const int tileSize = 64;
+    const double t0 = getCurrentTime();
+    const std::vector<float> blueNoise = makeBlueNoiseTile(tileSize);
+    const double blueNoiseTime = getCurrentTime()-t0;
+    std::cout << "#osc.mathbench: " << tileSize << "x" << tileSize
+              << " blue noise tile built in " << prettyDouble(blueNoiseTime)
+              << "s" << std::endl;
+  }
+  
+  extern "C" int main(int ac, char **av)
+  {
+    try {
+      Options options;
+      // small enough to stay in cache, so this measures the math, not
+      // memory bandwidth
+      options.count = 4096;
+      options.reps  = 2000;
+      XfmOptions xfmOptions;
+      xfmOptions.count = 1<<22;
+      xfmOptions.reps  = 10;
+      for (int i=1;i<ac;i++) {
+        const std::string arg = av[i];
+        if (arg == "--count" && i+1 < ac)
+          options.count = std::max(8,std::stoi(av[++i])) & ~7;
+        else if (arg == "--reps" && i+1 < ac)
+          options.reps = std::max(1,std::stoi(av[++i]));
+        else if (arg == "--xfm-count" && i+1 < ac)
+          xfmOptions.count = std::max(1,std::stoi(av[++i]));
+        else if (arg == "--xfm-reps" && i+1 < ac)
+          xfmOptions.reps = std::max(1,std::stoi(av[++i]));
+        else
+          throw std::runtime_error("unknown cmdline argument '"+arg+"'");
+      }
+#if GDT_SIMD_AVX
+      std::cout << "#osc.mathbench: simd backend: AVX" << std::endl;
+#elif GDT_SIMD_SSE
+      std::cout << "#osc.mathbench: simd backend: SSE" << std::endl;
+#elif GDT_SIMD_NEON
+      std::cout << "#osc.mathbench: simd backend: NEON" << std::endl;
+#else
+      std::cout << "#osc.mathbench: simd backend: none (scalar loops)" << std::endl;
+#endif
+      std::cout << "#osc.mathbench: " << prettyNumber(options.count) << " elements, "
+                << options.reps << " reps, time per element" << std::endl;
+      
+      const size_t N = options.count;
+      LCG<16> random(0,0);
+      std::vector<vec3fa> a(N), b(N);
+      std::vector<vec4f>  a4(N), b4(N);
+      for (size_t i=0;i<N;i++) {
+        a[i]  = vec3fa(2.f*random()-1.f,2.f*random()-1.f,2.f*random()-1.f);
+        b[i]  = vec3fa(2.f*random()-1.f,2.f*random()-1.f,2.f*random()-1.f);
+        a4[i] = vec4f(a[i],2.f*random()-1.f);
+        b4[i] = vec4f(b[i],2.f*random()-1.f);
+      }
+
+      // explicit template arguments leave out the non-template simd
+      // overloads, so 'dot<float>' is the generic scalar one
+      compare<float>(options,"dot(vec3fa)",
+                     [&](size_t i){ return dot<float>(a[i],b[i]); },
+                     [&](size_t i){ return dot(a[i],b[i]); });
+      compare<vec3f>(options,"cross(vec3fa)",
+                     [&](size_t i){ return cross<float>(a[i],b[i]); },
+                     [&](size_t i){ return vec3f(cross(a[i],b[i])); });
+      compare<vec3f>(options,"normalize(vec3fa)",
+                     [&](size_t i){ return normalize<float>(a[i]); },
+                     [&](size_t i){ return vec3f(normalize(a[i])); });
+      compare<vec3f>(options,"min(vec3fa)",
+                     [&](size_t i){ return min<float>(a[i],b[i]); },
+                     [&](size_t i){ return vec3f(min(a[i],b[i])); });
+      compare<vec3f>(options,"max(vec3fa)",
+                     [&](size_t i){ return max<float>(a[i],b[i]); },
+                     [&](size_t i){ return vec3f(max(a[i],b[i])); });
+      compare<float>(options,"dot(vec4f)",
+                     [&](size_t i){
+                       const vec4f &u = a4[i], &v = b4[i];
+                       return u.x*v.x + u.y*v.y + u.z*v.z + u.w*v.w; },
+                     [&](size_t i){ return dot(a4[i],b4[i]); });
+      compare<vec4f>(options,"min(vec4f)",
+                     [&](size_t i){ return min<float>(a4[i],b4[i]); },
+                     [&](size_t i){ return min(a4[i],b4[i]); });
+
+      // box3fa: one box extended by all points
+      {
+        box3fa scalarBox, simdBox;
+        const double scalarTime = timePerElement(options,[&](){
+            box3fa box;
+            for (size_t i=0;i<N;i++) {
+              box.lower = min<float>(box.lower,a[i]);
+              box.upper = max<float>(box.upper,a[i]);
+            }
+            scalarBox = box;
+          });
+        const double simdTime = timePerElement(options,[&](){
+            box3fa box;
+            for (size_t i=0;i<N;i++) box.extend(a[i]);
+            simdBox = box;
+          });
+        report("box3fa::extend",scalarTime,simdTime,maxDiff(scalarBox,simdBox));
+      }
+      compare<box3fa>(options,"intersection(box3fa)",
+                      [&](size_t i){
+                        const vec3fa &c = b[N-1-i];
+                        const box3fa p(min<float>(a[i],b[i]),max<float>(a[i],b[i]));
+                        const box3fa q(min<float>(a[i],c),max<float>(a[i],c));
+                        return box3fa(max<float>(p.lower,q.lower),min<float>(p.upper,q.upper)); },
+                      [&](size_t i){
+                        const vec3fa &c = b[N-1-i];
+                        const box3fa p(min(a[i],b[i]),max(a[i],b[i]));
+                        const box3fa q(min(a[i],c),max(a[i],c));
+                        return intersection(p,q); });
+
+      // vec3f8: the same kernel - normalize(cross(a,b)), and dot(a,b) -
+      // over AoS vec3f's one at a time, and over SoA arrays 8 at a time
+      {
+        std::vector<float> ax(N), ay(N), az(N), bx(N), by(N), bz(N);
+        std::vector<vec3f> a3(N), b3(N);
+        for (size_t i=0;i<N;i++) {
+          a3[i] = vec3f(a[i]); ax[i] = a[i].x; ay[i] = a[i].y; az[i] = a[i].z;
+          b3[i] = vec3f(b[i]); bx[i] = b[i].x; by[i] = b[i].y; bz[i] = b[i].z;
+        }
+        std::vector<vec3f> scalarN(N), simdN(N);
+        std::vector<float> scalarD(N), simdD(N);
+        std::vector<float> nx(N), ny(N), nz(N);
+        const double scalarTime = timePerElement(options,[&](){
+            for (size_t i=0;i<N;i++) {
+              scalarN[i] = normalize(cross(a3[i],b3[i]));
+              scalarD[i] = dot(a3[i],b3[i]);
+            }
+          });
+        const double simdTime = timePerElement(options,[&](){
+            for (size_t i=0;i<N;i+=8) {
+              const vec3f8 u = vec3f8::load(&ax[i],&ay[i],&az[i]);
+              const vec3f8 v = vec3f8::load(&bx[i],&by[i],&bz[i]);
+              normalize(cross(u,v)).store(&nx[i],&ny[i],&nz[i]);
+              dot(u,v).store(&simdD[i]);
+            }
+          });
+        for (size_t i=0;i<N;i++) simdN[i] = vec3f(nx[i],ny[i],nz[i]);
+        report("vec3f8 (SoA)",scalarTime,simdTime,
+               std::max(maxDiff(scalarN,simdN),maxDiff(scalarD,simdD)));
+      }
+
+      runTransforms(xfmOptions);
+      runRandom(xfmOptions);
+    } catch (std::runtime_error& e) {
+      std::cout << GDT_TERMINAL_RED << "FATAL ERROR: " << e.what()
+                << GDT_TERMINAL_DEFAULT << std::endl;
+      exit(1);
+    }
+    return 0;
+  }
+  
+} // ::osc
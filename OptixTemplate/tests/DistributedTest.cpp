@@ -0,0 +1,195 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! checks distributed rendering without a GPU: the pixel encoding on
+    its own, and then a coordinator with worker processes (copies of
+    this executable, started with --worker) that render with a small
+    CPU ray caster, against rendering the same frame in-process */
+
+#include "Distributed.h"
+#include "Testing.h"
+#include "gdt/random/random.h"
+#include <cstring>
+
+namespace osc {
+
+  // ------------------------------------------------------------------
+  // pixel encoding
+  // ------------------------------------------------------------------
+
+  void checkRoundTrip(const std::vector<uint32_t> &pixels)
+  {
+    const std::string bytes = compressPixels(pixels.data(),pixels.size());
+    std::vector<uint32_t> decoded(pixels.size(),0xdeadbeef);
+    decompressPixels(bytes,decoded.data(),decoded.size());
+    OSC_CHECK(decoded == pixels);
+
+    // the decoder has to be told the right size
+    std::vector<uint32_t> tooMany(pixels.size()+1);
+    bool threw = false;
+    try { decompressPixels(bytes,tooMany.data(),tooMany.size()); }
+    catch (std::runtime_error &) { threw = true; }
+    OSC_CHECK(threw);
+    if (pixels.empty()) return;
+    threw = false;
+    try { decompressPixels(bytes,decoded.data(),decoded.size()-1); }
+    catch (std::runtime_error &) { threw = true; }
+    OSC_CHECK(threw);
+  }
+
+  void checkPixelEncoding()
+  {
+    checkRoundTrip({});
+    checkRoundTrip({1});
+    checkRoundTrip({1,1});
+    checkRoundTrip({1,1,1});
+    checkRoundTrip({1,2,2,3,3,3,4,4,4,4,5});
+    checkRoundTrip(std::vector<uint32_t>(100000,0xff204080));
+    // literal runs ending right where a repeat starts, and vice versa
+    std::vector<uint32_t> mixed;
+    for (int i=0;i<1000;i++)
+      for (int j=0;j<=i%5;j++)
+        mixed.push_back(i%7 < 3 ? 42 : i);
+    checkRoundTrip(mixed);
+    // noise doesn't compress, but still has to round-trip
+    LCG<16> random(0,0);
+    std::vector<uint32_t> noise(5000);
+    for (auto &p : noise) p = uint32_t(random()*(1<<24)) | 0xff000000;
+    checkRoundTrip(noise);
+
+    // flat colors should compress well
+    const std::vector<uint32_t> flat(4096,0xff102030);
+    OSC_CHECK(compressPixels(flat.data(),flat.size()).size() < 64);
+  }
+
+  // ------------------------------------------------------------------
+  // a CPU stand-in for the GPU renderer
+  // ------------------------------------------------------------------
+
+  /*! brute-force ray casting of the scene's meshes, with the same
+      camera model as SampleRenderer, and (face-normal) flat shading */
+  RenderRowsFunction makeCPURenderer(const Geometry &scene)
+  {
+    std::shared_ptr<Geometry> meshes = std::make_shared<Geometry>();
+    meshes->meshes = scene.meshes;
+    return [meshes](const Camera &camera, const vec2i &frameSize,
+                    const RowRange &rows, uint32_t *pixels) {
+      const vec3f direction = normalize(camera.at-camera.from);
+      const float cosFovy = 0.66f;
+      const float aspect = frameSize.x/float(frameSize.y);
+      const vec3f horizontal = cosFovy*aspect*normalize(cross(direction,camera.up));
+      const vec3f vertical = cosFovy*normalize(cross(horizontal,direction));
+      for (int i=0;i<rows.numRows;i++)
+        for (int x=0;x<frameSize.x;x++) {
+          const int y = rows.rowOffset + i*rows.rowStride;
+          const vec2f screen = (vec2f(x,y)+vec2f(.5f))/vec2f(frameSize);
+          const vec3f dir = normalize(direction
+                                      + (screen.x-.5f)*horizontal
+                                      + (screen.y-.5f)*vertical);
+          float tHit = 1e30f;
+          vec3f color(1.f);
+          for (auto &mesh : meshes->meshes)
+            for (auto &index : mesh.index) {
+              const vec3f A = mesh.vertex[index.x];
+              const vec3f e1 = mesh.vertex[index.y]-A;
+              const vec3f e2 = mesh.vertex[index.z]-A;
+              const vec3f p = cross(dir,e2);
+              const float det = dot(e1,p);
+              if (fabsf(det) < 1e-12f) continue;
+              const vec3f s = camera.from-A;
+              const float u = dot(s,p)/det;
+              if (u < 0.f || u > 1.f) continue;
+              const vec3f q = cross(s,e1);
+              const float v = dot(dir,q)/det;
+              if (v < 0.f || u+v > 1.f) continue;
+              const float t = dot(e2,q)/det;
+              if (t <= 0.f || t >= tHit) continue;
+              tHit = t;
+              const vec3f N = normalize(cross(e1,e2));
+              color = (.2f+.8f*fabsf(dot(dir,N)))*mesh.color;
+            }
+          const uint32_t r = uint32_t(255.99f*std::min(color.x,1.f));
+          const uint32_t g = uint32_t(255.99f*std::min(color.y,1.f));
+          const uint32_t b = uint32_t(255.99f*std::min(color.z,1.f));
+          pixels[size_t(i)*frameSize.x+x] = 0xff000000 | r | (g<<8) | (b<<16);
+        }
+    };
+  }
+
+  Geometry makeTestScene()
+  {
+    Geometry scene;
+    scene.addCube(vec3f(0.f,-1.5f,0.f),vec3f(10.f,.1f,10.f),vec3f(.5f,1.f,.5f));
+    scene.addCube(vec3f(-1.f,0.f,0.f),vec3f(1.f),vec3f(1.f,.2f,.2f));
+    scene.addCube(vec3f(1.2f,.5f,-.5f),vec3f(1.5f,2.f,.5f),vec3f(.2f,.2f,1.f));
+    return scene;
+  }
+
+  // ------------------------------------------------------------------
+  // coordinator and workers
+  // ------------------------------------------------------------------
+
+  void checkDistributedFrame(const char *executable, int numWorkers, int tileRows)
+  {
+    const Geometry scene = makeTestScene();
+    Camera camera;
+    camera.from = vec3f(-2.f,3.f,6.f);
+    camera.at   = vec3f(0.f);
+    camera.up   = vec3f(0.f,1.f,0.f);
+    const vec2i frameSize(96,61);
+
+    std::vector<uint32_t> expected(size_t(frameSize.x)*frameSize.y);
+    makeCPURenderer(scene)(camera,frameSize,RowRange{0,frameSize.y,1},expected.data());
+    // a sanity check on the test itself: the scene is in view
+    OSC_CHECK(expected[frameSize.y/2*frameSize.x+frameSize.x/2] != 0xffffffff);
+
+    std::vector<uint32_t> pixels(expected.size(),0);
+    {
+      Coordinator coordinator;
+      spawnWorkers(executable,coordinator.port(),numWorkers);
+      coordinator.addWorkers(numWorkers,serializeScene(scene));
+      OSC_CHECK(coordinator.numWorkers() == numWorkers);
+      // twice, since workers keep state across frames
+      for (int frame=0;frame<2;frame++) {
+        std::fill(pixels.begin(),pixels.end(),0);
+        coordinator.renderFrame(camera,frameSize,tileRows,pixels.data());
+        OSC_CHECK(pixels == expected);
+      }
+      OSC_CHECK(coordinator.uncompressedBytes == 2*expected.size()*sizeof(uint32_t));
+      OSC_CHECK(coordinator.compressedBytes < coordinator.uncompressedBytes);
+    }
+    // the coordinator told them to quit
+    waitForWorkers();
+  }
+  
+  extern "C" int main(int ac, char **av)
+  {
+    try {
+      if (ac == 4 && std::string(av[1]) == "--worker") {
+        runWorker(av[2],std::stoi(av[3]),makeCPURenderer);
+        return 0;
+      }
+      checkPixelEncoding();
+      checkDistributedFrame(av[0],1,16);
+      checkDistributedFrame(av[0],3,7);
+    } catch (std::runtime_error &e) {
+      std::cout << "#osc.test: " << e.what() << std::endl;
+      testing::numFailures()++;
+    }
+    return testing::testResult("Distributed");
+  }
+  
+} // ::osc
@@ -0,0 +1,164 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! checks that ResolutionController, driven with synthetic frame
+    times (a fixed overhead plus a cost per pixel, plus some noise),
+    settles on the largest scale that fits the budget, and then stays
+    there rather than oscillating between neighboring steps */
+
+#include "DynamicResolution.h"
+#include "Testing.h"
+#include "gdt/random/random.h"
+#include <cmath>
+#include <vector>
+
+namespace osc {
+
+  /*! a simulated device: seconds for a frame of the given size */
+  struct SimulatedFrameTime {
+    double operator()(const vec2i &size)
+    {
+      const double jitter = 1. + noise*(2.*random()-1.);
+      return (overhead + timePerPixel*size.x*size.y)*jitter;
+    }
+    double   overhead;
+    double   timePerPixel;
+    double   noise;
+    LCG<16>  random { 0, 0 };
+  };
+
+  /*! the largest scale (a multiple of the controller's step) whose
+      frames fit the budget without noise */
+  float bestScale(const ResolutionController &controller,
+                  const SimulatedFrameTime &device,
+                  const vec2i &fullSize)
+  {
+    float best = controller.minScale;
+    for (float s=controller.minScale;s<=1.f+1e-6f;s+=controller.scaleStep) {
+      ResolutionController probe = controller;
+      probe.scale = s;
+      SimulatedFrameTime exact = device;
+      exact.noise = 0.;
+      if (exact(probe.renderSize(fullSize)) <= controller.frameTimeBudget)
+        best = s;
+    }
+    return best;
+  }
+  
+  /*! run 'numFrames' frames; returns the scales the controller picked
+      for each */
+  std::vector<float> run(ResolutionController &controller,
+                         SimulatedFrameTime &device,
+                         const vec2i &fullSize,
+                         int numFrames)
+  {
+    std::vector<float> scales;
+    for (int frame=0;frame<numFrames;frame++) {
+      const vec2i size = controller.renderSize(fullSize);
+      controller.update(device(size),size,fullSize);
+      scales.push_back(controller.scale);
+    }
+    return scales;
+  }
+
+  /*! number of times the scale changed over the given frames */
+  int numChanges(const std::vector<float> &scales, size_t begin)
+  {
+    int changes = 0;
+    for (size_t i=begin+1;i<scales.size();i++)
+      if (scales[i] != scales[i-1]) changes++;
+    return changes;
+  }
+  
+  void checkConvergence(double overhead, double fullFrameTime, double noise)
+  {
+    const vec2i fullSize(1920,1080);
+    ResolutionController controller(1./60.);
+    SimulatedFrameTime device;
+    device.overhead     = overhead;
+    device.timePerPixel = (fullFrameTime-overhead)/(fullSize.x*fullSize.y);
+    device.noise        = noise;
+
+    const float expected = bestScale(controller,device,fullSize);
+    const std::vector<float> scales = run(controller,device,fullSize,200);
+    // settled within a few frames ...
+    for (size_t i=10;i<scales.size();i++)
+      OSC_CHECK(fabsf(scales[i]-expected) <= controller.scaleStep+1e-6f);
+    // ... at the best scale, or (with noise) one step below it ...
+    OSC_CHECK(scales.back() <= expected+1e-6f);
+    if (noise == 0.)
+      OSC_CHECK(scales.back() == expected);
+    // ... and stays there
+    OSC_CHECK(numChanges(scales,20) == 0);
+  }
+
+  /*! when the scene gets more expensive (or cheaper), the scale
+      follows, quickly, and without overshooting */
+  void checkStepResponse()
+  {
+    const vec2i fullSize(1280,720);
+    ResolutionController controller(1./30.);
+    SimulatedFrameTime device;
+    device.overhead     = 1e-3;
+    device.timePerPixel = 2e-8;
+    device.noise        = .01;
+    run(controller,device,fullSize,30);
+    OSC_CHECK(controller.scale == 1.f);
+
+    device.timePerPixel = 1e-7;
+    const float expected = bestScale(controller,device,fullSize);
+    std::vector<float> scales = run(controller,device,fullSize,60);
+    OSC_CHECK(fabsf(scales[5]-expected) <= controller.scaleStep+1e-6f);
+    for (auto s : scales)
+      OSC_CHECK(s >= expected-controller.scaleStep-1e-6f);
+    OSC_CHECK(numChanges(scales,10) == 0);
+
+    device.timePerPixel = 2e-8;
+    scales = run(controller,device,fullSize,60);
+    OSC_CHECK(scales.back() == 1.f);
+    OSC_CHECK(numChanges(scales,10) == 0);
+  }
+
+  /*! frames that can't fit the budget at any scale bottom out at the
+      minimum scale */
+  void checkMinScale()
+  {
+    const vec2i fullSize(1920,1080);
+    ResolutionController controller(1./60.,.25f);
+    SimulatedFrameTime device;
+    device.overhead     = 20e-3;
+    device.timePerPixel = 1e-7;
+    device.noise        = 0.;
+    const std::vector<float> scales = run(controller,device,fullSize,20);
+    OSC_CHECK(scales.back() == .25f);
+    OSC_CHECK(controller.renderSize(fullSize) == vec2i(480,270));
+  }
+  
+  extern "C" int main(int ac, char **av)
+  {
+    // (overhead, full resolution frame time, noise)
+    checkConvergence(0.,    10e-3, 0.);
+    checkConvergence(0.,    40e-3, 0.);
+    checkConvergence(.5e-3, 40e-3, 0.);
+    checkConvergence(.5e-3, 40e-3, .02);
+    checkConvergence(2e-3,  100e-3,.02);
+    checkConvergence(5e-3,  30e-3, .05);
+    checkStepResponse();
+    checkMinScale();
+    return testing::testResult("DynamicResolution");
+  }
+  
+} // ::osc
@@ -0,0 +1,92 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! checks the slot arithmetic of FrameRing against the contract the
+    renderers rely on: frames come back for display in the order they
+    got submitted, numSlots-1 frames behind, and no frame submitted
+    after the displayed one lands in the displayed one's slot */
+
+#include "FrameRing.h"
+#include "Testing.h"
+#include <vector>
+
+namespace osc {
+
+  /*! drive a ring through 'numFrames' frames the way the renderers
+      do (render() = beginFrame()+endFrame(), then mapFrame() =
+      displaySlot()), keeping track of which frame each slot holds */
+  void checkOrdering(int numSlots, int numFrames)
+  {
+    FrameRing ring(numSlots);
+    // frame number last rendered into each slot
+    std::vector<int> slotFrame(numSlots,-1);
+    int nextToDisplay = 0;
+    for (int frame=0;frame<numFrames;frame++) {
+      const int slot = ring.beginFrame();
+      OSC_CHECK(slot >= 0 && slot < numSlots);
+      // the pointer from the last mapFrame() is valid until this
+      // render(), so that's the earliest its slot may get reused:
+      // the frame we overwrite has to have been displayed already
+      // (or never be displayed, at the very start)
+      OSC_CHECK(slotFrame[slot] < nextToDisplay);
+      slotFrame[slot] = frame;
+      ring.endFrame();
+      OSC_CHECK(ring.newestSlot() == slot);
+
+      const int displaySlot = ring.displaySlot();
+      if (frame < numSlots-1) {
+        // pipeline not primed yet
+        OSC_CHECK(displaySlot == -1);
+        continue;
+      }
+      OSC_CHECK(displaySlot >= 0 && displaySlot < numSlots);
+      // in submission order, numSlots-1 frames behind, none skipped
+      OSC_CHECK(slotFrame[displaySlot] == nextToDisplay);
+      OSC_CHECK(slotFrame[displaySlot] == frame-(numSlots-1));
+      // and not in a slot that any newer frame (still in flight)
+      // got rendered into
+      for (int s=0;s<numSlots;s++)
+        if (s != displaySlot)
+          OSC_CHECK(slotFrame[s] > slotFrame[displaySlot]);
+      nextToDisplay++;
+    }
+    OSC_CHECK(nextToDisplay == numFrames-(numSlots-1));
+  }
+
+  /*! after reset(), the ring starts over as if new */
+  void checkReset(int numSlots)
+  {
+    FrameRing ring(numSlots);
+    for (int i=0;i<2*numSlots+1;i++) {
+      ring.beginFrame();
+      ring.endFrame();
+    }
+    ring.reset();
+    OSC_CHECK(ring.newestSlot() == -1);
+    OSC_CHECK(ring.displaySlot() == -1);
+    OSC_CHECK(ring.beginFrame() == 0);
+  }
+  
+  extern "C" int main(int ac, char **av)
+  {
+    for (int numSlots=1;numSlots<=4;numSlots++) {
+      checkOrdering(numSlots,100);
+      checkReset(numSlots);
+    }
+    return testing::testResult("FrameRing");
+  }
+  
+} // ::osc
@@ -0,0 +1,184 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! checks FrameSplitter and compositeFrame() with simulated devices:
+    that band heights converge to the devices' (simulated) speeds,
+    that devices nobody has measured yet get a sensible share, and
+    that compositing the devices' packed rows gives the full frame */
+
+#include "FrameSplit.h"
+#include "Testing.h"
+#include <cmath>
+
+namespace osc {
+
+  /*! every row of every split covered exactly once */
+  bool coversAllRows(const std::vector<RowRange> &ranges, int height)
+  {
+    std::vector<int> count(height,0);
+    for (auto &range : ranges)
+      for (int i=0;i<range.numRows;i++) {
+        const int row = range.rowOffset + i*range.rowStride;
+        if (row < 0 || row >= height) return false;
+        count[row]++;
+      }
+    for (int c : count)
+      if (c != 1) return false;
+    return true;
+  }
+
+  /*! simulated frame time of a device with the given speed (rows per
+      second) for a range; plus some fixed overhead per frame, like a
+      real device's launch and readback */
+  double simulatedTime(const RowRange &range, double speed)
+  {
+    return 1e-4 + range.numRows/speed;
+  }
+  
+  void checkConvergence(const std::vector<double> &speeds, int height)
+  {
+    const int numDevices = (int)speeds.size();
+    FrameSplitter splitter(numDevices);
+    double totalSpeed = 0.;
+    for (double s : speeds) totalSpeed += s;
+
+    std::vector<RowRange> ranges;
+    for (int frame=0;frame<100;frame++) {
+      ranges = splitter.split(height);
+      OSC_CHECK(coversAllRows(ranges,height));
+      std::vector<double> times(numDevices);
+      for (int d=0;d<numDevices;d++)
+        times[d] = simulatedTime(ranges[d],speeds[d]);
+      splitter.update(ranges,times);
+    }
+    // rows proportional to speed, give or take the rounding and the
+    // per-frame overhead
+    for (int d=0;d<numDevices;d++) {
+      const double expected = height*speeds[d]/totalSpeed;
+      OSC_CHECK(fabs(ranges[d].numRows-expected) <= 2.+.02*expected);
+    }
+    // and hence all devices take about equally long
+    double minTime = 1e20, maxTime = 0.;
+    for (int d=0;d<numDevices;d++) {
+      const double t = simulatedTime(ranges[d],speeds[d]);
+      minTime = std::min(minTime,t);
+      maxTime = std::max(maxTime,t);
+    }
+    OSC_CHECK(maxTime < 1.05*minTime);
+  }
+
+  /*! with fewer rows than devices, some devices get none, and so
+      can't be measured; they have to come out of the next frame's
+      split with a share like the others' rather than whatever their
+      initial guess makes of it */
+  void checkUnmeasuredDevice()
+  {
+    FrameSplitter splitter(3);
+    std::vector<RowRange> ranges = splitter.split(2);
+    OSC_CHECK(coversAllRows(ranges,2));
+    int idle = -1;
+    for (int d=0;d<3;d++)
+      if (ranges[d].numRows == 0) idle = d;
+    OSC_CHECK(idle >= 0);
+    if (idle < 0) return;
+    // the measured devices do a row in 1ms, ie, 1000 rows/s
+    std::vector<double> times(3);
+    for (int d=0;d<3;d++) times[d] = 1e-3*ranges[d].numRows;
+    splitter.update(ranges,times);
+    ranges = splitter.split(900);
+    OSC_CHECK(coversAllRows(ranges,900));
+    for (int d=0;d<3;d++)
+      OSC_CHECK(ranges[d].numRows >= 299 && ranges[d].numRows <= 301);
+
+    // once it's measured, it keeps its own speed
+    for (int d=0;d<3;d++) times[d] = d == idle ? .15 : .3;
+    splitter.update(ranges,times);
+    ranges = splitter.split(900);
+    OSC_CHECK(ranges[idle].numRows > ranges[(idle+1)%3].numRows);
+  }
+
+  void checkInterleaved()
+  {
+    FrameSplitter splitter(3,SPLIT_INTERLEAVED);
+    for (int height : {1,2,3,10,11}) {
+      const std::vector<RowRange> ranges = splitter.split(height);
+      OSC_CHECK(coversAllRows(ranges,height));
+    }
+    // and measurements don't change it
+    const std::vector<RowRange> before = splitter.split(10);
+    splitter.update(before,{1.,2.,3.});
+    const std::vector<RowRange> after = splitter.split(10);
+    for (int d=0;d<3;d++)
+      OSC_CHECK(after[d].numRows == before[d].numRows
+                && after[d].rowOffset == before[d].rowOffset);
+  }
+
+  /*! composite the devices' packed buffers, each pixel of which says
+      where it belongs, and check every pixel lands there */
+  void checkComposite(FrameSplitMode mode, int numDevices, const vec2i &size)
+  {
+    FrameSplitter splitter(numDevices,mode);
+    if (mode == SPLIT_BANDS) {
+      // some uneven bands
+      std::vector<RowRange> ranges = splitter.split(size.y);
+      std::vector<double> times(numDevices);
+      for (int d=0;d<numDevices;d++) times[d] = (d+1)*ranges[d].numRows;
+      splitter.update(ranges,times);
+    }
+    const std::vector<RowRange> ranges = splitter.split(size.y);
+    
+    auto pixelValue = [&](int x, int y) { return uint32_t(y*size.x+x+1); };
+    std::vector<std::vector<uint32_t>> devicePixels(numDevices);
+    std::vector<const uint32_t *> pointers(numDevices);
+    for (int d=0;d<numDevices;d++) {
+      const RowRange &range = ranges[d];
+      for (int i=0;i<range.numRows;i++)
+        for (int x=0;x<size.x;x++)
+          devicePixels[d].push_back(pixelValue(x,range.rowOffset+i*range.rowStride));
+      pointers[d] = devicePixels[d].data();
+    }
+
+    std::vector<uint32_t> frame(size.x*size.y,0);
+    compositeFrame(frame.data(),size,ranges,pointers);
+    bool allRight = true;
+    for (int y=0;y<size.y;y++)
+      for (int x=0;x<size.x;x++)
+        allRight &= frame[y*size.x+x] == pixelValue(x,y);
+    OSC_CHECK(allRight);
+
+    // a device without a buffer leaves its rows alone
+    std::fill(frame.begin(),frame.end(),0);
+    pointers[0] = nullptr;
+    compositeFrame(frame.data(),size,ranges,pointers);
+    for (int i=0;i<ranges[0].numRows;i++)
+      OSC_CHECK(frame[(ranges[0].rowOffset+i*ranges[0].rowStride)*size.x] == 0);
+  }
+  
+  extern "C" int main(int ac, char **av)
+  {
+    checkConvergence({1000.,1000.},720);
+    checkConvergence({1000.,3000.},720);
+    checkConvergence({5000.,1000.,2500.,800.},1080);
+    checkUnmeasuredDevice();
+    checkInterleaved();
+    for (int numDevices=1;numDevices<=4;numDevices++) {
+      checkComposite(SPLIT_BANDS,numDevices,vec2i(13,37));
+      checkComposite(SPLIT_INTERLEAVED,numDevices,vec2i(13,37));
+    }
+    return testing::testResult("FrameSplit");
+  }
+  
+} // ::osc
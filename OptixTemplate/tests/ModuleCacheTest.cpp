@@ -0,0 +1,171 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! checks ModuleCache, in a scratch directory: that keys change with
+    every input, that store() and lookup() round-trip, that an entry
+    stored under another key reads as stale, and that eviction keeps
+    only the most recently used entries */
+
+#include "ModuleCache.h"
+#include "Testing.h"
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <set>
+#include <vector>
+#ifdef _WIN32
+# include <direct.h>
+# include <sys/utime.h>
+# define utime _utime
+# define utimbuf _utimbuf
+#else
+# include <unistd.h>
+# include <utime.h>
+#endif
+
+namespace osc {
+
+  /*! a key as SampleRenderer makes them, with one input varied */
+  ModuleCacheKey makeKey(const std::string &ptx, int optLevel, const std::string &device)
+  {
+    ModuleCacheKey key;
+    key.add(ptx).add(optLevel).add(device);
+    return key;
+  }
+
+  void checkKeys()
+  {
+    const ModuleCacheKey base = makeKey("ptx",3,"gpu");
+    OSC_CHECK(base.str() == makeKey("ptx",3,"gpu").str());
+    OSC_CHECK(base.checkStr() == makeKey("ptx",3,"gpu").checkStr());
+    OSC_CHECK(base.str().size() == 16);
+
+    std::set<std::string> names = { base.str() };
+    names.insert(makeKey("ptx ",3,"gpu").str());
+    names.insert(makeKey("ptx",2,"gpu").str());
+    names.insert(makeKey("ptx",3,"gpu2").str());
+    OSC_CHECK(names.size() == 4);
+
+    // strings carry their size, so where one ends matters
+    ModuleCacheKey ab_c, a_bc;
+    ab_c.add(std::string("ab")).add(std::string("c"));
+    a_bc.add(std::string("a")).add(std::string("bc"));
+    OSC_CHECK(ab_c.str() != a_bc.str());
+    OSC_CHECK(ab_c.checkStr() != a_bc.checkStr());
+  }
+
+  void checkRoundTrip(const ModuleCache &cache)
+  {
+    const ModuleCacheKey key = makeKey("round trip",3,"gpu");
+    double time = 0.;
+    OSC_CHECK(!cache.lookup(key,time));
+    cache.prepare(key);
+    // a directory without an entry file is still cold
+    OSC_CHECK(!cache.lookup(key,time));
+    cache.store(key,1.25);
+    OSC_CHECK(cache.lookup(key,time));
+    OSC_CHECK(time == 1.25);
+    // other keys don't see it
+    OSC_CHECK(!cache.lookup(makeKey("round trip",2,"gpu"),time));
+  }
+
+  /*! an entry file that belongs to another key (as after a collision
+      in the directory name, or entries copied around) is stale */
+  void checkStaleEntry(const ModuleCache &cache)
+  {
+    const ModuleCacheKey key   = makeKey("stale",3,"gpu");
+    const ModuleCacheKey other = makeKey("other",3,"gpu");
+    cache.prepare(other);
+    cache.store(other,2.);
+    const std::string dir = cache.prepare(key);
+    {
+      std::ifstream in(cache.entryDir(other)+"/entry.txt");
+      std::ofstream out(dir+"/entry.txt");
+      out << in.rdbuf();
+    }
+    double time = 0.;
+    OSC_CHECK(!cache.lookup(key,time));
+    // and storing over it makes it valid again
+    cache.store(key,3.);
+    OSC_CHECK(cache.lookup(key,time));
+    OSC_CHECK(time == 3.);
+  }
+
+  /*! mark an entry as last used the given number of seconds ago
+      (file time stamps may be too coarse to tell apart entries used
+      right after each other) */
+  void setLastUsed(const ModuleCache &cache, const ModuleCacheKey &key, int secondsAgo)
+  {
+    struct utimbuf times;
+    times.actime = times.modtime = time(nullptr)-secondsAgo;
+    utime((cache.entryDir(key)+"/entry.txt").c_str(),&times);
+  }
+  
+  void checkEviction(ModuleCache &cache)
+  {
+    cache.evict(0);
+    cache.maxEntries = 3;
+    std::vector<ModuleCacheKey> keys;
+    for (int i=0;i<5;i++) {
+      keys.push_back(makeKey("evict",i,"gpu"));
+      cache.prepare(keys[i]);
+      // some files of optix' own, which have to go along
+      std::ofstream(cache.entryDir(keys[i])+"/optix7cache.db") << "data";
+      cache.store(keys[i],1.);
+      setLastUsed(cache,keys[i],100-i);
+    }
+    // storing the last two evicted the first two (ie, oldest) ones
+    double time = 0.;
+    OSC_CHECK(!cache.lookup(keys[0],time));
+    OSC_CHECK(!cache.lookup(keys[1],time));
+    OSC_CHECK(cache.lookup(keys[2],time));
+    OSC_CHECK(cache.lookup(keys[3],time));
+    OSC_CHECK(cache.lookup(keys[4],time));
+    
+    // using an entry makes it the most recent one
+    for (int i=2;i<5;i++)
+      setLastUsed(cache,keys[i],100-i);
+    OSC_CHECK(cache.lookup(keys[2],time));
+    cache.prepare(keys[0]);
+    cache.store(keys[0],1.);
+    OSC_CHECK(cache.lookup(keys[2],time));
+    OSC_CHECK(!cache.lookup(keys[3],time));
+    OSC_CHECK(cache.lookup(keys[0],time));
+    
+    cache.evict(0);
+    for (auto &key : keys)
+      OSC_CHECK(!cache.lookup(key,time));
+  }
+  
+  extern "C" int main(int ac, char **av)
+  {
+    const std::string dir
+      = "moduleCacheTest."+std::to_string((long long)time(nullptr));
+    ModuleCache cache(dir);
+    checkKeys();
+    checkRoundTrip(cache);
+    checkStaleEntry(cache);
+    checkEviction(cache);
+    cache.evict(0);
+#ifdef _WIN32
+    _rmdir(dir.c_str());
+#else
+    rmdir(dir.c_str());
+#endif
+    return testing::testResult("ModuleCache");
+  }
+  
+} // ::osc
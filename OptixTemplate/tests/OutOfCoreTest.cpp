@@ -0,0 +1,208 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! writes meshes to a chunk file and reads them back, through
+    ChunkFile and through a ChunkCache with a budget that doesn't fit
+    everything */
+
+#include "OutOfCore.h"
+#include "Testing.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+
+namespace osc {
+
+  /*! a (numQuads x numQuads) grid of quads in the y=0 plane, at the
+      given x offset, with per-triangle colors and vertex normals */
+  TriangleMesh makeGrid(int numQuads, float x0, const vec3f &color)
+  {
+    TriangleMesh mesh;
+    mesh.color = color;
+    for (int j=0;j<=numQuads;j++)
+      for (int i=0;i<=numQuads;i++) {
+        mesh.vertex.push_back(vec3f(x0+i,0.f,float(j)));
+        mesh.normal.push_back(vec3f(0.f,1.f,0.f));
+      }
+    for (int j=0;j<numQuads;j++)
+      for (int i=0;i<numQuads;i++) {
+        const int v00 = j*(numQuads+1)+i, v01 = v00+1;
+        const int v10 = v00+numQuads+1,   v11 = v10+1;
+        mesh.index.push_back(vec3i(v00,v01,v11));
+        mesh.index.push_back(vec3i(v00,v11,v10));
+        mesh.triangleColor.push_back(vec3f(i/float(numQuads),j/float(numQuads),0.f));
+        mesh.triangleColor.push_back(vec3f(i/float(numQuads),j/float(numQuads),1.f));
+      }
+    return mesh;
+  }
+
+  typedef std::array<float,13> TriangleKey;
+
+  /*! all triangles of the given meshes, in world space, with their
+      colors, in a canonical order */
+  std::vector<TriangleKey> triangleKeys(const std::vector<const TriangleMesh *> &meshes)
+  {
+    std::vector<TriangleKey> keys;
+    for (auto mesh : meshes)
+      for (size_t t=0;t<mesh->index.size();t++) {
+        TriangleKey key;
+        for (int c=0;c<3;c++)
+          for (int d=0;d<3;d++)
+            key[3*c+d] = mesh->vertex[mesh->index[t][c]][d];
+        for (int d=0;d<3;d++)
+          key[9+d] = mesh->triangleColor[t][d];
+        key[12] = mesh->color.x;
+        keys.push_back(key);
+      }
+    std::sort(keys.begin(),keys.end());
+    return keys;
+  }
+
+  void checkRoundTrip(const std::string &fileName)
+  {
+    const size_t maxTrianglesPerChunk = 100;
+    std::vector<TriangleMesh> meshes;
+    meshes.push_back(makeGrid(20,0.f,vec3f(.25f)));
+    meshes.push_back(TriangleMesh());
+    meshes.push_back(makeGrid(7,100.f,vec3f(.75f)));
+
+    {
+      ChunkFileWriter writer(fileName,maxTrianglesPerChunk);
+      for (auto &mesh : meshes) writer.add(mesh);
+      writer.close();
+    }
+
+    ChunkFile file(fileName);
+    OSC_CHECK(file.chunks.size() >= (800+98)/maxTrianglesPerChunk);
+    size_t numTriangles = 0;
+    std::vector<std::shared_ptr<const TriangleMesh>> chunks;
+    std::vector<const TriangleMesh *> chunkPointers;
+    for (size_t chunkID=0;chunkID<file.chunks.size();chunkID++) {
+      const MeshChunk &chunk = file.chunks[chunkID];
+      OSC_CHECK(chunk.numTriangles > 0 && chunk.numTriangles <= maxTrianglesPerChunk);
+      OSC_CHECK(chunk.hasTriangleColors && chunk.hasNormals);
+      OSC_CHECK(!chunk.hasVertexColors && !chunk.hasTexcoords);
+      numTriangles += chunk.numTriangles;
+
+      std::shared_ptr<const TriangleMesh> mesh = file.load(chunkID);
+      OSC_CHECK(mesh->vertex.size() == chunk.numVertices);
+      OSC_CHECK(mesh->index.size() == chunk.numTriangles);
+      OSC_CHECK(mesh->normal.size() == chunk.numVertices);
+      bool inBounds = true, indicesValid = true;
+      for (auto &v : mesh->vertex)
+        inBounds &= chunk.bounds.contains(v);
+      for (auto &idx : mesh->index)
+        for (int c=0;c<3;c++)
+          indicesValid &= idx[c] >= 0 && idx[c] < (int)mesh->vertex.size();
+      OSC_CHECK(inBounds);
+      OSC_CHECK(indicesValid);
+      // grids are flat, so spatial splits never mix the two meshes
+      OSC_CHECK(chunk.bounds.lower.x >= 100.f || chunk.bounds.upper.x <= 20.f);
+      chunks.push_back(mesh);
+      chunkPointers.push_back(mesh.get());
+    }
+    OSC_CHECK(numTriangles == 800+98);
+
+    // the same triangles, with the same colors, as went in
+    OSC_CHECK(triangleKeys(chunkPointers)
+              == triangleKeys({ &meshes[0],&meshes[1],&meshes[2] }));
+  }
+
+  void checkCache(const std::string &fileName)
+  {
+    ChunkFile file(fileName);
+    const size_t numChunks = file.chunks.size();
+    size_t largest = 0;
+    for (auto &chunk : file.chunks)
+      largest = std::max(largest,chunk.sizeInBytes());
+    // always room for three chunks, never for all of them
+    const size_t budget = 3*largest;
+    OSC_CHECK(numChunks > 6);
+    ChunkCache cache(file,budget);
+
+    // more chunks than fit in one frame: the ones that don't fit get
+    // skipped, none that got requested in this frame get evicted
+    cache.beginFrame();
+    std::vector<std::shared_ptr<const TriangleMesh>> frame;
+    for (size_t chunkID=0;chunkID<numChunks;chunkID++)
+      frame.push_back(cache.get(chunkID));
+    OSC_CHECK(cache.memoryUsed <= budget);
+    OSC_CHECK(cache.stats.numEvictions == 0);
+    OSC_CHECK(cache.stats.numSkipped > 0);
+    OSC_CHECK(cache.stats.numPageIns + cache.stats.numSkipped == numChunks);
+    OSC_CHECK(frame[0] && frame[1] && frame[2]);
+    OSC_CHECK(!frame.back());
+
+    // the same chunk again is a hit, on the very same mesh
+    OSC_CHECK(cache.get(0) == frame[0]);
+    OSC_CHECK(cache.stats.numHits == 1);
+
+    // next frame, other chunks: the old ones make room
+    cache.beginFrame();
+    for (size_t chunkID=numChunks-3;chunkID<numChunks;chunkID++)
+      OSC_CHECK(cache.get(chunkID) != nullptr);
+    OSC_CHECK(cache.memoryUsed <= budget);
+    OSC_CHECK(cache.stats.numEvictions > 0);
+    OSC_CHECK(cache.stats.numSkipped == 0);
+  }
+
+  void checkCulling(const std::string &fileName)
+  {
+    ChunkFile file(fileName);
+    ChunkCache cache(file,0);
+    // looking down at the first grid from above its center ...
+    const Camera down{ vec3f(10.f,5.f,10.f), vec3f(10.f,0.f,10.f), vec3f(0.f,0.f,1.f) };
+    const std::vector<size_t> visible = cache.findVisibleChunks(down,1.f);
+    OSC_CHECK(!visible.empty() && visible.size() < file.chunks.size());
+    for (auto chunkID : visible)
+      OSC_CHECK(file.chunks[chunkID].bounds.upper.x <= 20.f);
+    // ... and front to back
+    for (size_t i=1;i<visible.size();i++)
+      OSC_CHECK(length(file.chunks[visible[i-1]].bounds.center()-down.from)
+                <= length(file.chunks[visible[i]].bounds.center()-down.from));
+    // and up, away from everything
+    const Camera up{ vec3f(10.f,5.f,10.f), vec3f(10.f,10.f,10.f), vec3f(0.f,0.f,1.f) };
+    OSC_CHECK(cache.findVisibleChunks(up,1.f).empty());
+  }
+
+  void checkInvalidFiles(const std::string &fileName)
+  {
+    {
+      std::ofstream out(fileName,std::ios::binary);
+      out << "not a chunk file at all";
+    }
+    bool threw = false;
+    try { ChunkFile file(fileName); } catch (std::runtime_error &) { threw = true; }
+    OSC_CHECK(threw);
+
+    threw = false;
+    try { ChunkFile file(fileName+".doesNotExist"); } catch (std::runtime_error &) { threw = true; }
+    OSC_CHECK(threw);
+  }
+  
+  extern "C" int main(int ac, char **av)
+  {
+    const std::string fileName
+      = "outOfCoreTest."+std::to_string((long long)time(nullptr))+".chunks";
+    checkRoundTrip(fileName);
+    checkCache(fileName);
+    checkCulling(fileName);
+    checkInvalidFiles(fileName);
+    std::remove(fileName.c_str());
+    return testing::testResult("outOfCore");
+  }
+  
+} // ::osc
@@ -0,0 +1,235 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! statistical and known-answer checks for the generators in
+    gdt/random/random.h (mathbench only measures their throughput):
+    reference outputs, uniformity (chi-square), integration error of
+    the quasi-random points against plain random ones, the blue noise
+    tile's spectrum, and that the batch/skip-ahead paths agree with
+    generating one number at a time. the thresholds are loose enough
+    for fixed seeds never to fail by chance, and tight enough to catch
+    a generator going bad */
+
+#include "gdt/random/random.h"
+#include "Testing.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace osc {
+  using namespace gdt;
+
+  /*! chi-square statistic of 'count' samples over 'numBins' equal
+      bins; for uniform samples, this should be around numBins-1,
+      give or take sqrt(2*(numBins-1)) */
+  template<typename Lambda>
+  double chiSquare(size_t count, int numBins, const Lambda &sample)
+  {
+    std::vector<size_t> bins(numBins,0);
+    for (size_t i=0;i<count;i++)
+      bins[std::min(numBins-1,int(sample(i)*numBins))]++;
+    const double expected = double(count)/numBins;
+    double chi2 = 0.;
+    for (auto b : bins) chi2 += (b-expected)*(b-expected)/expected;
+    return chi2;
+  }
+
+  /*! rms error of estimating pi/4 (the area of the quarter disk)
+      from 'numSamples' 2D points, over 'numTrials' independently
+      seeded sets */
+  template<typename Lambda>
+  double quarterDiskRMSE(int numSamples, int numTrials, const Lambda &sample2D)
+  {
+    constexpr double pi = 3.14159265358979;
+    double sumSqrError = 0.;
+    for (int trial=0;trial<numTrials;trial++) {
+      int inside = 0;
+      for (int i=0;i<numSamples;i++) {
+        const vec2f p = sample2D(trial,i);
+        if (p.x*p.x+p.y*p.y < 1.f) inside++;
+      }
+      const double error = double(inside)/numSamples - pi/4.;
+      sumSqrError += error*error;
+    }
+    return sqrt(sumSqrError/numTrials);
+  }
+
+  /*! fraction of a tile's (DC-free) spectral power at the lowest
+      eighth of frequencies, relative to what white noise has there
+      (1 for white noise, much less for blue noise) */
+  double lowFrequencyPower(const std::vector<float> &tile, int size)
+  {
+    constexpr double pi = 3.14159265358979;
+    double mean = 0.;
+    for (float f : tile) mean += f;
+    mean /= tile.size();
+    double lowPower = 0., totalPower = 0.;
+    int numLow = 0, numTotal = 0;
+    for (int v=0;v<size;v++)
+      for (int u=0;u<size;u++) {
+        if (u == 0 && v == 0) continue;
+        double re = 0., im = 0.;
+        for (int y=0;y<size;y++)
+          for (int x=0;x<size;x++) {
+            const double phase = -2.*pi*(double(u*x)/size+double(v*y)/size);
+            re += (tile[y*size+x]-mean)*cos(phase);
+            im += (tile[y*size+x]-mean)*sin(phase);
+          }
+        const double power = re*re+im*im;
+        const int fu = std::min(u,size-u), fv = std::min(v,size-v);
+        if (fu*fu+fv*fv <= (size/8)*(size/8)) { lowPower += power; numLow++; }
+        totalPower += power; numTotal++;
+      }
+    return (lowPower/numLow)/(totalPower/numTotal);
+  }
+
+  /*! outputs of the reference implementations */
+  void checkKnownAnswers()
+  {
+    // pcg32_srandom_r(42,54), from the pcg-c demo
+    PCG32 pcg(42,54);
+    const uint32_t pcgExpected[] = { 0xa15c02b7u, 0x7b47f409u, 0xba1d3330u,
+                                     0x83d2f293u, 0xbfa4784bu, 0xcbed606eu };
+    for (uint32_t expected : pcgExpected)
+      OSC_CHECK(pcg.next() == expected);
+
+    // Random123's kat_vectors for philox4x32_10
+    struct { vec4ui ctr; vec2ui key; vec4ui expected; } philoxKAT[] = {
+      { vec4ui(0u), vec2ui(0u),
+        vec4ui(0x6627e8d5u,0xe169c58du,0xbc57ac4cu,0x9b00dbd8u) },
+      { vec4ui(0xffffffffu), vec2ui(0xffffffffu),
+        vec4ui(0x408f276du,0x41c83b0eu,0xa20bc7c6u,0x6d5451fdu) },
+      { vec4ui(0x243f6a88u,0x85a308d3u,0x13198a2eu,0x03707344u),
+        vec2ui(0xa4093822u,0x299f31d0u),
+        vec4ui(0xd16cfe09u,0x94fdccebu,0x5001e420u,0x24126ea1u) }
+    };
+    for (auto &kat : philoxKAT) {
+      const vec4ui result = Philox::generate(kat.ctr,kat.key);
+      OSC_CHECK(result.x == kat.expected.x && result.y == kat.expected.y
+                && result.z == kat.expected.z && result.w == kat.expected.w);
+    }
+  }
+
+  /*! skip-ahead and the batch fill functions give the same numbers as
+      generating them one by one */
+  void checkConsistency()
+  {
+    const size_t N = 10000;
+    std::vector<float> one(N), batch(N);
+
+    PCG32 pcg(7,3);
+    for (auto &f : one) f = pcg();
+    pcg.init(7,3);
+    pcg.fill(batch.data(),N);
+    OSC_CHECK(one == batch);
+    pcg.init(7,3);
+    pcg.advance(1234);
+    OSC_CHECK(pcg() == one[1234]);
+
+    Philox philox(7,3);
+    for (auto &f : one) f = philox();
+    Philox::fill(7,3,0,batch.data(),N);
+    OSC_CHECK(one == batch);
+    // any range of the sequence, including ones not starting at a
+    // block boundary
+    Philox::fill(7,3,4097,batch.data(),100);
+    OSC_CHECK(std::equal(batch.begin(),batch.begin()+100,one.begin()+4097));
+
+    for (size_t i=0;i<N;i++) one[i] = sobolOwen(uint32_t(i+5),2,11);
+    sobolOwenFill(5,2,11,batch.data(),N);
+    OSC_CHECK(one == batch);
+  }
+  
+  void checkUniformity()
+  {
+    const size_t N = 1<<20;
+    const int numBins = 1024;
+    // expected numBins-1, with a standard deviation of about 45;
+    // allow five of those
+    const double lo = numBins-1 - 5*sqrt(2.*(numBins-1));
+    const double hi = numBins-1 + 5*sqrt(2.*(numBins-1));
+    
+    LCG<16> lcg(0,0);
+    const double lcgChi2 = chiSquare(N,numBins,[&](size_t){ return lcg(); });
+    OSC_CHECK(lcgChi2 > lo && lcgChi2 < hi);
+    PCG32 pcg(0,0);
+    const double pcgChi2 = chiSquare(N,numBins,[&](size_t){ return pcg(); });
+    OSC_CHECK(pcgChi2 > lo && pcgChi2 < hi);
+    Philox philox(0,0);
+    const double philoxChi2 = chiSquare(N,numBins,[&](size_t){ return philox(); });
+    OSC_CHECK(philoxChi2 > lo && philoxChi2 < hi);
+    // sobol points are perfectly stratified, for any power of two
+    // points in every dimension, scrambled or not
+    for (int dim=0;dim<4;dim++) {
+      const double sobolChi2
+        = chiSquare(N,numBins,[&](size_t i){ return sobolOwen(uint32_t(i),dim,1); });
+      OSC_CHECK(sobolChi2 < 1e-6);
+    }
+    // [0,1), never 1
+    bool inRange = true;
+    pcg.init(1,1);
+    for (size_t i=0;i<N;i++) { const float f = pcg(); inRange &= f >= 0.f && f < 1.f; }
+    OSC_CHECK(inRange);
+    OSC_CHECK(toUnitFloat(0xffffffffu) < 1.f);
+  }
+
+  void checkIntegration()
+  {
+    const int numSamples = 256, numTrials = 256;
+    PCG32 pcg;
+    const double pcgError = quarterDiskRMSE(numSamples,numTrials,[&](int trial, int i){
+        if (i == 0) pcg.init(trial,0);
+        const float x = pcg(); return vec2f(x,pcg()); });
+    // sqrt(p(1-p)/n) for plain monte carlo, with p = pi/4
+    OSC_CHECK(pcgError > .02 && pcgError < .032);
+    const double sobolError = quarterDiskRMSE(numSamples,numTrials,[&](int trial, int i){
+        return vec2f(sobolOwen(i,0,trial),sobolOwen(i,1,trial)); });
+    // (about a quarter of that, measured)
+    OSC_CHECK(sobolError < .5*pcgError);
+  }
+
+  void checkBlueNoise()
+  {
+    const int tileSize = 32;
+    const std::vector<float> blueNoise = makeBlueNoiseTile(tileSize);
+    // every rank once, at the center of its interval
+    std::vector<float> sorted = blueNoise;
+    std::sort(sorted.begin(),sorted.end());
+    bool allValues = true;
+    for (size_t i=0;i<sorted.size();i++)
+      allValues &= fabsf(sorted[i]-(i+.5f)/sorted.size()) < 1e-6f;
+    OSC_CHECK(allValues);
+
+    std::vector<float> whiteNoise(tileSize*tileSize);
+    PCG32 pcg(0,0);
+    pcg.fill(whiteNoise.data(),whiteNoise.size());
+    const double white = lowFrequencyPower(whiteNoise,tileSize);
+    const double blue  = lowFrequencyPower(blueNoise,tileSize);
+    OSC_CHECK(white > .5 && white < 1.5);
+    OSC_CHECK(blue < .05);
+  }
+  
+  extern "C" int main(int ac, char **av)
+  {
+    checkKnownAnswers();
+    checkConsistency();
+    checkUniformity();
+    checkIntegration();
+    checkBlueNoise();
+    return testing::testResult("Random");
+  }
+  
+} // ::osc
@@ -0,0 +1,55 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <iostream>
+
+/*! minimal checking for the host-only tests in this directory: every
+    test is its own executable, which runs its checks (each failing
+    one prints where and what), and returns testResult() from main(),
+    so ctest sees the failures */
+
+namespace osc {
+  namespace testing {
+
+    inline int &numFailures() { static int n = 0; return n; }
+
+    inline bool check(bool ok, const char *what, const char *file, int line)
+    {
+      if (!ok) {
+        std::cout << "#osc.test: " << file << ":" << line
+                  << ": check failed: " << what << std::endl;
+        numFailures()++;
+      }
+      return ok;
+    }
+
+    /*! what main() should return */
+    inline int testResult(const char *testName)
+    {
+      if (numFailures())
+        std::cout << "#osc.test: " << testName << ": "
+                  << numFailures() << " check(s) FAILED" << std::endl;
+      else
+        std::cout << "#osc.test: " << testName << ": passed" << std::endl;
+      return numFailures() ? 1 : 0;
+    }
+    
+  } // ::osc::testing
+} // ::osc
+
+#define OSC_CHECK(cond) ::osc::testing::check((cond),#cond,__FILE__,__LINE__)
@@ -36,6 +36,9 @@
 
 #include "LinearSpace.h"
 #include "box.h"
+#ifndef __CUDACC__
+# include "gdt/parallel/parallel_for.h"
+#endif
 
 namespace gdt {
 
@@ -177,6 +180,178 @@ namespace gdt {
   template<> inline AffineSpace2f AffineSpace2f::rotate(const vec2f& p, const float& r)
   { return translate(+p) * AffineSpace2f(LinearSpace2f::rotate(r)) * translate(-p); }
 
+  ////////////////////////////////////////////////////////////////////////////////
+  // Box Transforms
+  ////////////////////////////////////////////////////////////////////////////////
+
+  /*! bounds of the transformed box; the same as extending by all 8
+      transformed corners, to the bit: per output dimension, each of
+      xfmPoint's terms is picked from whichever of lower/upper makes
+      it smallest (largest), and float mul and add are monotonic */
+  inline __both__ box3f xfmBox(const affine3f &m, const box3f &b)
+  {
+    if (b.empty()) return box3f();
+    const vec3f xl = b.lower.x*m.l.vx, xu = b.upper.x*m.l.vx;
+    const vec3f yl = b.lower.y*m.l.vy, yu = b.upper.y*m.l.vy;
+    const vec3f zl = b.lower.z*m.l.vz, zu = b.upper.z*m.l.vz;
+    return box3f(min(xl,xu) + (min(yl,yu) + (min(zl,zu) + m.p)),
+                 max(xl,xu) + (max(yl,yu) + (max(zl,zu) + m.p)));
+  }
+  
+#ifndef __CUDACC__
+  ////////////////////////////////////////////////////////////////////////////////
+  // Batch Transforms (host only)
+  ////////////////////////////////////////////////////////////////////////////////
+
+  // all of these give the same results as calling xfmPoint /
+  // xfmNormal / xfmBox on each element, but do eight elements at a
+  // time (see vec3f8); 'out' may be the same array as 'in'. the
+  // parallel_ versions additionally split the work across threads
+
+  /*! number of elements per parallel_ task */
+  enum { XFM_BLOCK_SIZE = 16*1024 };
+  
+  /*! xfmPoint for SoA arrays */
+  inline void xfmPoints(const affine3f &m,
+                        const float *inX, const float *inY, const float *inZ,
+                        float *outX, float *outY, float *outZ,
+                        size_t count)
+  {
+    const vec3f8 vx(m.l.vx), vy(m.l.vy), vz(m.l.vz), p(m.p);
+    size_t i = 0;
+    for (;i+8<=count;i+=8) {
+      const vec3f8 v = vec3f8::load(inX+i,inY+i,inZ+i);
+      // same order of operations as xfmPoint's nested madd's
+      (v.x*vx + (v.y*vy + (v.z*vz + p))).store(outX+i,outY+i,outZ+i);
+    }
+    for (;i<count;i++) {
+      const vec3f v = xfmPoint(m,vec3f(inX[i],inY[i],inZ[i]));
+      outX[i] = v.x; outY[i] = v.y; outZ[i] = v.z;
+    }
+  }
+
+  /*! xfmPoint for an AoS array, such as a mesh's vertices */
+  inline void xfmPoints(const affine3f &m, const vec3f *in, vec3f *out, size_t count)
+  {
+    const vec3f8 vx(m.l.vx), vy(m.l.vy), vz(m.l.vz), p(m.p);
+    size_t i = 0;
+    for (;i+8<=count;i+=8) {
+      const vec3f8 v = vec3f8::load(in+i);
+      (v.x*vx + (v.y*vy + (v.z*vz + p))).store(out+i);
+    }
+    for (;i<count;i++)
+      out[i] = xfmPoint(m,in[i]);
+  }
+
+  /*! xfmNormal for SoA arrays; the inverse transpose gets computed
+      once, rather than per normal */
+  inline void xfmNormals(const affine3f &m,
+                         const float *inX, const float *inY, const float *inZ,
+                         float *outX, float *outY, float *outZ,
+                         size_t count)
+  {
+    const LinearSpace3f n = m.l.inverse().transposed();
+    const vec3f8 vx(n.vx), vy(n.vy), vz(n.vz);
+    size_t i = 0;
+    for (;i+8<=count;i+=8) {
+      const vec3f8 v = vec3f8::load(inX+i,inY+i,inZ+i);
+      (v.x*vx + (v.y*vy + v.z*vz)).store(outX+i,outY+i,outZ+i);
+    }
+    for (;i<count;i++) {
+      const vec3f v = xfmVector(n,vec3f(inX[i],inY[i],inZ[i]));
+      outX[i] = v.x; outY[i] = v.y; outZ[i] = v.z;
+    }
+  }
+
+  /*! xfmNormal for an AoS array */
+  inline void xfmNormals(const affine3f &m, const vec3f *in, vec3f *out, size_t count)
+  {
+    const LinearSpace3f n = m.l.inverse().transposed();
+    const vec3f8 vx(n.vx), vy(n.vy), vz(n.vz);
+    size_t i = 0;
+    for (;i+8<=count;i+=8) {
+      const vec3f8 v = vec3f8::load(in+i);
+      (v.x*vx + (v.y*vy + v.z*vz)).store(out+i);
+    }
+    for (;i<count;i++)
+      out[i] = xfmVector(n,in[i]);
+  }
+
+  /*! xfmBox for an array of boxes */
+  inline void xfmBoxes(const affine3f &m, const box3f *in, box3f *out, size_t count)
+  {
+    const vec3f8 vx(m.l.vx), vy(m.l.vy), vz(m.l.vz), p(m.p);
+    size_t i = 0;
+    for (;i+8<=count;i+=8) {
+      bool anyEmpty = false;
+      vec3f lower[8], upper[8];
+      for (int j=0;j<8;j++) {
+        lower[j] = in[i+j].lower;
+        upper[j] = in[i+j].upper;
+        anyEmpty |= in[i+j].empty();
+      }
+      if (anyEmpty) {
+        // those need special-casing; rare enough to not bother
+        for (int j=0;j<8;j++) out[i+j] = xfmBox(m,in[i+j]);
+        continue;
+      }
+      const vec3f8 lo = vec3f8::load(lower), hi = vec3f8::load(upper);
+      const vec3f8 xl = lo.x*vx, xu = hi.x*vx;
+      const vec3f8 yl = lo.y*vy, yu = hi.y*vy;
+      const vec3f8 zl = lo.z*vz, zu = hi.z*vz;
+      (min(xl,xu) + (min(yl,yu) + (min(zl,zu) + p))).store(lower);
+      (max(xl,xu) + (max(yl,yu) + (max(zl,zu) + p))).store(upper);
+      for (int j=0;j<8;j++)
+        out[i+j] = box3f(lower[j],upper[j]);
+    }
+    for (;i<count;i++)
+      out[i] = xfmBox(m,in[i]);
+  }
+
+  inline void parallel_xfmPoints(const affine3f &m,
+                                 const float *inX, const float *inY, const float *inZ,
+                                 float *outX, float *outY, float *outZ,
+                                 size_t count)
+  {
+    parallel_for_blocked(0,count,XFM_BLOCK_SIZE,[&](size_t begin, size_t end){
+        xfmPoints(m,inX+begin,inY+begin,inZ+begin,
+                  outX+begin,outY+begin,outZ+begin,end-begin);
+      });
+  }
+
+  inline void parallel_xfmPoints(const affine3f &m, const vec3f *in, vec3f *out, size_t count)
+  {
+    parallel_for_blocked(0,count,XFM_BLOCK_SIZE,[&](size_t begin, size_t end){
+        xfmPoints(m,in+begin,out+begin,end-begin);
+      });
+  }
+
+  inline void parallel_xfmNormals(const affine3f &m,
+                                  const float *inX, const float *inY, const float *inZ,
+                                  float *outX, float *outY, float *outZ,
+                                  size_t count)
+  {
+    parallel_for_blocked(0,count,XFM_BLOCK_SIZE,[&](size_t begin, size_t end){
+        xfmNormals(m,inX+begin,inY+begin,inZ+begin,
+                   outX+begin,outY+begin,outZ+begin,end-begin);
+      });
+  }
+
+  inline void parallel_xfmNormals(const affine3f &m, const vec3f *in, vec3f *out, size_t count)
+  {
+    parallel_for_blocked(0,count,XFM_BLOCK_SIZE,[&](size_t begin, size_t end){
+        xfmNormals(m,in+begin,out+begin,end-begin);
+      });
+  }
+
+  inline void parallel_xfmBoxes(const affine3f &m, const box3f *in, box3f *out, size_t count)
+  {
+    parallel_for_blocked(0,count,XFM_BLOCK_SIZE,[&](size_t begin, size_t end){
+        xfmBoxes(m,in+begin,out+begin,end-begin);
+      });
+  }
+#endif
+
 #undef VectorT
 #undef ScalarT
 
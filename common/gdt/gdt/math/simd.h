@@ -0,0 +1,379 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+/*! host-only SIMD versions of the hot vec3fa/vec4f functions (dot,
+    cross, normalize, length, min, max - and through those, box3fa
+    extend/including/intersection), plus 'vec3f8', eight vec3f's in
+    SoA layout for batch kernels.
+
+    the vec3fa/vec4f overloads are plain (non-template) functions, so
+    they're picked over the generic vec_t templates in functors.h
+    without callers having to change anything; they compute exactly
+    the same values (same operation order, same NaN behavior as
+    std::min/std::max), just four lanes at a time. this gets pulled
+    in by vec.h for all host code; device code never sees it.
+
+    backends are SSE2 (always there on x86-64), AVX (for the 8-wide
+    type, if enabled at compile time), and NEON; anything else falls
+    back to plain loops */
+
+#include "gdt/math/vec.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define GDT_SIMD_SSE 1
+# include <immintrin.h>
+# if defined(__AVX__)
+#  define GDT_SIMD_AVX 1
+# endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# define GDT_SIMD_NEON 1
+# include <arm_neon.h>
+#endif
+
+namespace gdt {
+
+  static_assert(sizeof(vec3fa) == 4*sizeof(float),
+                "vec3fa has to be exactly one 4-wide vector");
+  static_assert(sizeof(vec4f) == 4*sizeof(float),
+                "vec4f has to be exactly one 4-wide vector");
+  
+  /*! the per-backend 4-wide primitives everything below is built
+      from; not meant to be used directly */
+  namespace simd {
+    
+#if GDT_SIMD_SSE
+    typedef __m128 vfloat4;
+    
+    inline vfloat4 load4(const float *ptr)        { return _mm_loadu_ps(ptr); }
+    inline void    store4(float *ptr, vfloat4 v)  { _mm_storeu_ps(ptr,v); }
+    inline vfloat4 splat4(float f)                { return _mm_set1_ps(f); }
+    inline vfloat4 add4(vfloat4 a, vfloat4 b)     { return _mm_add_ps(a,b); }
+    inline vfloat4 sub4(vfloat4 a, vfloat4 b)     { return _mm_sub_ps(a,b); }
+    inline vfloat4 mul4(vfloat4 a, vfloat4 b)     { return _mm_mul_ps(a,b); }
+    inline vfloat4 div4(vfloat4 a, vfloat4 b)     { return _mm_div_ps(a,b); }
+    inline vfloat4 sqrt4(vfloat4 a)               { return _mm_sqrt_ps(a); }
+    // operands swapped on purpose: minps returns its second operand
+    // if the compare fails, std::min(a,b) returns a
+    inline vfloat4 min4(vfloat4 a, vfloat4 b)     { return _mm_min_ps(b,a); }
+    inline vfloat4 max4(vfloat4 a, vfloat4 b)     { return _mm_max_ps(b,a); }
+    /*! (y,z,x,w) */
+    inline vfloat4 yzx4(vfloat4 v)
+    { return _mm_shuffle_ps(v,v,_MM_SHUFFLE(3,0,2,1)); }
+    /*! (x+y)+z, same order as the scalar dot() */
+    inline float hsum3(vfloat4 v)
+    {
+      const vfloat4 y = _mm_shuffle_ps(v,v,_MM_SHUFFLE(1,1,1,1));
+      const vfloat4 z = _mm_movehl_ps(v,v);
+      return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(v,y),z));
+    }
+    /*! ((x+y)+z)+w */
+    inline float hsum4(vfloat4 v)
+    {
+      const vfloat4 w = _mm_shuffle_ps(v,v,_MM_SHUFFLE(3,3,3,3));
+      return _mm_cvtss_f32(_mm_add_ss(_mm_set_ss(hsum3(v)),w));
+    }
+#elif GDT_SIMD_NEON
+    typedef float32x4_t vfloat4;
+    
+    inline vfloat4 load4(const float *ptr)        { return vld1q_f32(ptr); }
+    inline void    store4(float *ptr, vfloat4 v)  { vst1q_f32(ptr,v); }
+    inline vfloat4 splat4(float f)                { return vdupq_n_f32(f); }
+    inline vfloat4 add4(vfloat4 a, vfloat4 b)     { return vaddq_f32(a,b); }
+    inline vfloat4 sub4(vfloat4 a, vfloat4 b)     { return vsubq_f32(a,b); }
+    inline vfloat4 mul4(vfloat4 a, vfloat4 b)     { return vmulq_f32(a,b); }
+# if defined(__aarch64__)
+    inline vfloat4 div4(vfloat4 a, vfloat4 b)     { return vdivq_f32(a,b); }
+    inline vfloat4 sqrt4(vfloat4 a)               { return vsqrtq_f32(a); }
+# else
+    // armv7 has neither a vector divide nor a vector sqrt that's
+    // exact, so do those per lane
+    inline vfloat4 div4(vfloat4 a, vfloat4 b)
+    {
+      float fa[4], fb[4];
+      vst1q_f32(fa,a); vst1q_f32(fb,b);
+      for (int i=0;i<4;i++) fa[i] /= fb[i];
+      return vld1q_f32(fa);
+    }
+    inline vfloat4 sqrt4(vfloat4 a)
+    {
+      float fa[4];
+      vst1q_f32(fa,a);
+      for (int i=0;i<4;i++) fa[i] = sqrtf(fa[i]);
+      return vld1q_f32(fa);
+    }
+# endif
+    // vminq/vmaxq propagate NaNs, std::min/max don't; select instead
+    inline vfloat4 min4(vfloat4 a, vfloat4 b)     { return vbslq_f32(vcltq_f32(b,a),b,a); }
+    inline vfloat4 max4(vfloat4 a, vfloat4 b)     { return vbslq_f32(vcltq_f32(a,b),b,a); }
+    /*! (y,z,x,x) - the w lane is don't care */
+    inline vfloat4 yzx4(vfloat4 v)
+    { return vsetq_lane_f32(vgetq_lane_f32(v,0),vextq_f32(v,v,1),2); }
+    inline float hsum3(vfloat4 v)
+    { return (vgetq_lane_f32(v,0)+vgetq_lane_f32(v,1))+vgetq_lane_f32(v,2); }
+    inline float hsum4(vfloat4 v)
+    { return hsum3(v)+vgetq_lane_f32(v,3); }
+#else
+    struct vfloat4 { float f[4]; };
+    
+    inline vfloat4 load4(const float *ptr)
+    { vfloat4 r; for (int i=0;i<4;i++) r.f[i] = ptr[i]; return r; }
+    inline void    store4(float *ptr, vfloat4 v)
+    { for (int i=0;i<4;i++) ptr[i] = v.f[i]; }
+    inline vfloat4 splat4(float f)
+    { vfloat4 r; for (int i=0;i<4;i++) r.f[i] = f; return r; }
+# define _define_vfloat4_op(name,expr)                                   \
+    inline vfloat4 name(vfloat4 a, vfloat4 b)                           \
+    { vfloat4 r; for (int i=0;i<4;i++) r.f[i] = expr; return r; }
+    _define_vfloat4_op(add4,a.f[i]+b.f[i])
+    _define_vfloat4_op(sub4,a.f[i]-b.f[i])
+    _define_vfloat4_op(mul4,a.f[i]*b.f[i])
+    _define_vfloat4_op(div4,a.f[i]/b.f[i])
+    _define_vfloat4_op(min4,std::min(a.f[i],b.f[i]))
+    _define_vfloat4_op(max4,std::max(a.f[i],b.f[i]))
+# undef _define_vfloat4_op
+    inline vfloat4 sqrt4(vfloat4 a)
+    { vfloat4 r; for (int i=0;i<4;i++) r.f[i] = sqrtf(a.f[i]); return r; }
+    inline vfloat4 yzx4(vfloat4 v)
+    { vfloat4 r = {{ v.f[1],v.f[2],v.f[0],v.f[3] }}; return r; }
+    inline float hsum3(vfloat4 v) { return (v.f[0]+v.f[1])+v.f[2]; }
+    inline float hsum4(vfloat4 v) { return hsum3(v)+v.f[3]; }
+#endif
+
+    inline vfloat4 load4(const vec3fa &v) { return load4(&v.x); }
+    inline vfloat4 load4(const vec4f  &v) { return load4(&v.x); }
+    
+    inline vec3fa make_vec3fa(vfloat4 v)
+    { vec3fa r; store4(&r.x,v); return r; }
+    inline vec4f make_vec4f(vfloat4 v)
+    { vec4f r; store4(&r.x,v); return r; }
+    
+  } // ::gdt::simd
+
+  // =======================================================
+  // vec3fa
+  // =======================================================
+
+  // note the 'a' lane of a vec3fa is padding; the results below
+  // leave whatever comes out of it in there
+  
+  inline float dot(const vec3fa &a, const vec3fa &b)
+  { return simd::hsum3(simd::mul4(simd::load4(a),simd::load4(b))); }
+
+  inline float length(const vec3fa &v)
+  { return sqrtf(dot(v,v)); }
+
+  inline vec3fa normalize(const vec3fa &v)
+  { return simd::make_vec3fa(simd::div4(simd::load4(v),simd::splat4(length(v)))); }
+  
+  inline vec3fa cross(const vec3fa &a, const vec3fa &b)
+  {
+    using namespace simd;
+    const vfloat4 va = load4(a), vb = load4(b);
+    // a*b.yzx - a.yzx*b is the cross product, rotated by one lane
+    return make_vec3fa(yzx4(sub4(mul4(va,yzx4(vb)),mul4(yzx4(va),vb))));
+  }
+  
+  inline vec3fa min(const vec3fa &a, const vec3fa &b)
+  { return simd::make_vec3fa(simd::min4(simd::load4(a),simd::load4(b))); }
+  
+  inline vec3fa max(const vec3fa &a, const vec3fa &b)
+  { return simd::make_vec3fa(simd::max4(simd::load4(a),simd::load4(b))); }
+
+  // =======================================================
+  // vec4f
+  // =======================================================
+
+  /*! ((x+y)+z)+w; there's no generic dot() for 4-vectors, so this
+      is the only one */
+  inline float dot(const vec4f &a, const vec4f &b)
+  { return simd::hsum4(simd::mul4(simd::load4(a),simd::load4(b))); }
+  
+  inline float length(const vec4f &v)
+  { return sqrtf(dot(v,v)); }
+  
+  inline vec4f normalize(const vec4f &v)
+  { return simd::make_vec4f(simd::div4(simd::load4(v),simd::splat4(length(v)))); }
+  
+  inline vec4f min(const vec4f &a, const vec4f &b)
+  { return simd::make_vec4f(simd::min4(simd::load4(a),simd::load4(b))); }
+  
+  inline vec4f max(const vec4f &a, const vec4f &b)
+  { return simd::make_vec4f(simd::max4(simd::load4(a),simd::load4(b))); }
+
+  // =======================================================
+  // float8 / vec3f8
+  // =======================================================
+
+  /*! eight floats, one per lane; a single AVX register if that's
+      enabled, two 4-wide ones otherwise */
+  struct float8 {
+    inline float8() {}
+    inline float8(float f)
+    {
+#if GDT_SIMD_AVX
+      v = _mm256_set1_ps(f);
+#else
+      lo = hi = simd::splat4(f);
+#endif
+    }
+    
+    /*! unaligned load of ptr[0..7] */
+    static inline float8 load(const float *ptr)
+    {
+      float8 r;
+#if GDT_SIMD_AVX
+      r.v = _mm256_loadu_ps(ptr);
+#else
+      r.lo = simd::load4(ptr);
+      r.hi = simd::load4(ptr+4);
+#endif
+      return r;
+    }
+    
+    /*! unaligned store to ptr[0..7] */
+    inline void store(float *ptr) const
+    {
+#if GDT_SIMD_AVX
+      _mm256_storeu_ps(ptr,v);
+#else
+      simd::store4(ptr,lo);
+      simd::store4(ptr+4,hi);
+#endif
+    }
+    
+    inline float operator[](int lane) const
+    { float f[8]; store(f); return f[lane]; }
+    
+#if GDT_SIMD_AVX
+    __m256 v;
+#else
+    simd::vfloat4 lo, hi;
+#endif
+  };
+
+#if GDT_SIMD_AVX
+# define _define_float8_binary(name,avx_op,op4)                          \
+  inline float8 name(const float8 &a, const float8 &b)                  \
+  { float8 r; r.v = avx_op; return r; }
+#else
+# define _define_float8_binary(name,avx_op,op4)                          \
+  inline float8 name(const float8 &a, const float8 &b)                  \
+  { float8 r; r.lo = simd::op4(a.lo,b.lo); r.hi = simd::op4(a.hi,b.hi); return r; }
+#endif
+  
+  _define_float8_binary(operator+,_mm256_add_ps(a.v,b.v),add4)
+  _define_float8_binary(operator-,_mm256_sub_ps(a.v,b.v),sub4)
+  _define_float8_binary(operator*,_mm256_mul_ps(a.v,b.v),mul4)
+  _define_float8_binary(operator/,_mm256_div_ps(a.v,b.v),div4)
+  // same operand order as in min4/max4
+  _define_float8_binary(min,_mm256_min_ps(b.v,a.v),min4)
+  _define_float8_binary(max,_mm256_max_ps(b.v,a.v),max4)
+  
+#undef _define_float8_binary
+  
+  inline float8 sqrt(const float8 &a)
+  {
+    float8 r;
+#if GDT_SIMD_AVX
+    r.v = _mm256_sqrt_ps(a.v);
+#else
+    r.lo = simd::sqrt4(a.lo);
+    r.hi = simd::sqrt4(a.hi);
+#endif
+    return r;
+  }
+
+  /*! eight vec3f's, in SoA layout: all x's, then all y's, then all
+      z's. meant for kernels that do the same thing to lots of
+      vectors; the functions below compute the same values as the
+      scalar vec3f ones, for each lane */
+  struct vec3f8 {
+    inline vec3f8() {}
+    inline vec3f8(const float8 &x, const float8 &y, const float8 &z)
+      : x(x), y(y), z(z)
+    {}
+    /*! the same vector in all lanes */
+    inline explicit vec3f8(const vec3f &v) : x(v.x), y(v.y), z(v.z) {}
+
+    /*! load from three separate (SoA) arrays of (at least) 8 floats */
+    static inline vec3f8 load(const float *x, const float *y, const float *z)
+    { return vec3f8(float8::load(x),float8::load(y),float8::load(z)); }
+    
+    inline void store(float *x, float *y, float *z) const
+    { this->x.store(x); this->y.store(y); this->z.store(z); }
+
+    /*! gather 8 consecutive (AoS) vec3f's; for data that isn't in SoA
+        layout already - that's slower than the SoA load, so only do
+        this once per batch */
+    static inline vec3f8 load(const vec3f *v)
+    {
+      float x[8], y[8], z[8];
+      for (int i=0;i<8;i++) { x[i] = v[i].x; y[i] = v[i].y; z[i] = v[i].z; }
+      return load(x,y,z);
+    }
+    
+    /*! scatter to 8 consecutive (AoS) vec3f's */
+    inline void store(vec3f *v) const
+    {
+      float x[8], y[8], z[8];
+      store(x,y,z);
+      for (int i=0;i<8;i++) v[i] = vec3f(x[i],y[i],z[i]);
+    }
+
+    inline vec3f operator[](int lane) const
+    { return vec3f(x[lane],y[lane],z[lane]); }
+    
+    float8 x, y, z;
+  };
+
+  inline vec3f8 operator+(const vec3f8 &a, const vec3f8 &b)
+  { return vec3f8(a.x+b.x,a.y+b.y,a.z+b.z); }
+  inline vec3f8 operator-(const vec3f8 &a, const vec3f8 &b)
+  { return vec3f8(a.x-b.x,a.y-b.y,a.z-b.z); }
+  inline vec3f8 operator*(const vec3f8 &a, const vec3f8 &b)
+  { return vec3f8(a.x*b.x,a.y*b.y,a.z*b.z); }
+  inline vec3f8 operator*(const vec3f8 &a, const float8 &b)
+  { return vec3f8(a.x*b,a.y*b,a.z*b); }
+  inline vec3f8 operator*(const float8 &a, const vec3f8 &b)
+  { return vec3f8(a*b.x,a*b.y,a*b.z); }
+  
+  inline vec3f8 min(const vec3f8 &a, const vec3f8 &b)
+  { return vec3f8(min(a.x,b.x),min(a.y,b.y),min(a.z,b.z)); }
+  inline vec3f8 max(const vec3f8 &a, const vec3f8 &b)
+  { return vec3f8(max(a.x,b.x),max(a.y,b.y),max(a.z,b.z)); }
+  
+  inline float8 dot(const vec3f8 &a, const vec3f8 &b)
+  { return a.x*b.x + a.y*b.y + a.z*b.z; }
+  
+  inline float8 length(const vec3f8 &v)
+  { return sqrt(dot(v,v)); }
+
+  inline vec3f8 normalize(const vec3f8 &v)
+  {
+    const float8 len = length(v);
+    return vec3f8(v.x/len,v.y/len,v.z/len);
+  }
+  
+  inline vec3f8 cross(const vec3f8 &a, const vec3f8 &b)
+  {
+    return vec3f8(a.y*b.z-b.y*a.z,
+                  a.z*b.x-b.z*a.x,
+                  a.x*b.y-b.x*a.y);
+  }
+  
+} // ::gdt
@@ -178,11 +178,11 @@ namespace gdt {
   template<typename T>
   struct GDT_INTERFACE vec3a_t : public vec_t<T,3> {
     inline vec3a_t() {}
-    inline vec3a_t(const T &t) : vec_t<T,3>(t) {}
-    inline vec3a_t(const T &x, const T &y, const T &z) : vec_t<T,3>(x,y,z) {}
+    inline vec3a_t(const T &t) : vec_t<T,3>(t), a(0) {}
+    inline vec3a_t(const T &x, const T &y, const T &z) : vec_t<T,3>(x,y,z), a(0) {}
 
     template<typename OT>
-    inline vec3a_t(const vec_t<OT,3> &v) : vec_t<T,3>(v.x,v.y,v.z) {}
+    inline vec3a_t(const vec_t<OT,3> &v) : vec_t<T,3>(v.x,v.y,v.z), a(0) {}
     
     T a;
   };
@@ -379,3 +379,7 @@ using vec3##t##a = vec3a_t<T>; \
 // comparison operators
 #include "vec/compare.h"
 #include "vec/rotate.h"
+#ifndef __CUDACC__
+// SIMD versions of the vec3fa/vec4f functions, and vec3f8
+# include "simd.h"
+#endif
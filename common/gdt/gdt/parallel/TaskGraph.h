@@ -0,0 +1,196 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "gdt/gdt.h"
+#include "gdt/parallel/parallel_for.h"
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gdt {
+
+  /*! a set of named tasks with dependencies between them. run()
+      starts every task as soon as all tasks it depends on are done,
+      on a fixed number of threads, and records when (and on which
+      thread) each task ran */
+  struct TaskGraph {
+    typedef int TaskID;
+
+    struct Timing {
+      std::string name;
+      /*! in seconds, relative to when run() started */
+      double begin, end;
+      int    threadID;
+    };
+    
+    /*! add a task that may only start once all of 'dependencies' (as
+        returned by earlier add()s) are done */
+    TaskID add(const std::string &name,
+               const std::function<void()> &function,
+               const std::vector<TaskID> &dependencies = std::vector<TaskID>())
+    {
+      const TaskID taskID = (TaskID)tasks.size();
+      tasks.push_back(Task());
+      tasks.back().name     = name;
+      tasks.back().function = function;
+      for (auto dep : dependencies) {
+        if (dep < 0 || dep >= taskID)
+          throw std::runtime_error("TaskGraph: task '"+name+"' depends on an unknown task");
+        tasks[dep].dependents.push_back(taskID);
+        tasks.back().numDependencies++;
+      }
+      return taskID;
+    }
+
+    /*! run all tasks, and wait for them. if any task throws, no more
+        tasks get started, and the (first) exception gets re-thrown
+        once the running ones are done */
+    void run(size_t numThreads = getNumThreads())
+    {
+      std::vector<TaskID> ready;
+      for (TaskID taskID=0;taskID<(TaskID)tasks.size();taskID++) {
+        tasks[taskID].numPending = tasks[taskID].numDependencies;
+        if (tasks[taskID].numPending == 0) ready.push_back(taskID);
+      }
+      timings.assign(tasks.size(),Timing());
+      size_t numDone = 0, numRunning = 0;
+      std::exception_ptr error;
+      std::mutex mutex;
+      std::condition_variable changed;
+      const double t0 = getCurrentTime();
+
+      auto worker = [&](int threadID) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (1) {
+          changed.wait(lock,[&]{
+              return !ready.empty() || numDone == tasks.size()
+                || (error && numRunning == 0);
+            });
+          if (numDone == tasks.size() || error) {
+            changed.notify_all();
+            return;
+          }
+          const TaskID taskID = ready.back();
+          ready.pop_back();
+          numRunning++;
+          
+          lock.unlock();
+          Timing timing;
+          timing.name     = tasks[taskID].name;
+          timing.threadID = threadID;
+          timing.begin    = getCurrentTime()-t0;
+          std::exception_ptr taskError;
+          try {
+            tasks[taskID].function();
+          } catch (...) {
+            taskError = std::current_exception();
+          }
+          timing.end = getCurrentTime()-t0;
+          lock.lock();
+
+          numRunning--;
+          timings[taskID] = timing;
+          if (taskError) {
+            if (!error) error = taskError;
+          } else {
+            numDone++;
+            for (auto dependent : tasks[taskID].dependents)
+              if (--tasks[dependent].numPending == 0)
+                ready.push_back(dependent);
+          }
+          changed.notify_all();
+        }
+      };
+      
+      std::vector<std::thread> threads;
+      for (size_t i=1;i<std::max(numThreads,size_t(1));i++)
+        threads.push_back(std::thread(worker,(int)i));
+      worker(0);
+      for (auto &t : threads) t.join();
+      wallTime = getCurrentTime()-t0;
+      
+      if (error)
+        std::rethrow_exception(error);
+    }
+
+    /*! per task (in order of add()), when it ran in the last run() */
+    const std::vector<Timing> &getTimings() const { return timings; }
+
+    /*! time from when the first of the given tasks started until the
+        last of them was done */
+    double span(const std::vector<TaskID> &taskIDs) const
+    {
+      double begin = 1e20, end = 0.;
+      for (auto taskID : taskIDs) {
+        begin = std::min(begin,timings[taskID].begin);
+        end   = std::max(end,timings[taskID].end);
+      }
+      return taskIDs.empty() ? 0. : end-begin;
+    }
+
+    /*! print one line per task, with a little time line, so overlap
+        between tasks can be seen at a glance */
+    void printTimings(std::ostream &out, const std::string &prefix) const
+    {
+      double busy = 0.;
+      size_t nameWidth = 0;
+      for (auto &timing : timings) {
+        busy += timing.end-timing.begin;
+        nameWidth = std::max(nameWidth,timing.name.size());
+      }
+      out << prefix << "took " << prettyDouble(wallTime) << "s for "
+          << prettyDouble(busy) << "s of tasks ("
+          << std::fixed << std::setprecision(2) << busy/std::max(wallTime,1e-9)
+          << "x overlap):" << std::endl;
+      const int barWidth = 40;
+      for (auto &timing : timings) {
+        const int from = int(barWidth*timing.begin/std::max(wallTime,1e-9));
+        const int to   = std::max(from+1,int(barWidth*timing.end/std::max(wallTime,1e-9)));
+        std::string bar(barWidth,' ');
+        for (int i=from;i<std::min(to,barWidth);i++) bar[i] = '#';
+        out << prefix << "  " << std::left << std::setw(nameWidth) << timing.name
+            << std::right << " |" << bar << "| "
+            << std::setprecision(1) << std::setw(8) << 1000.*timing.begin << " .. "
+            << std::setw(8) << 1000.*timing.end << "ms [thread " << timing.threadID
+            << "]" << std::endl;
+      }
+      out.unsetf(std::ios::floatfield);
+      out << std::setprecision(6);
+    }
+
+  private:
+    struct Task {
+      std::string           name;
+      std::function<void()> function;
+      std::vector<TaskID>   dependents;
+      int numDependencies = 0;
+      int numPending = 0;
+    };
+    std::vector<Task>   tasks;
+    std::vector<Timing> timings;
+    double              wallTime = 0.;
+  };
+  
+} // ::gdt
@@ -0,0 +1,106 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "gdt/gdt.h"
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gdt {
+
+  /*! number of worker threads the parallel_for helpers will use */
+  inline size_t getNumThreads()
+  {
+    const size_t n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+  }
+  
+  template<typename INDEX_T, typename TASK_T>
+  inline void serial_for(INDEX_T nTasks, TASK_T&& taskFunction)
+  {
+    for (INDEX_T taskIndex = 0; taskIndex < nTasks; ++taskIndex)
+      taskFunction(taskIndex);
+  }
+
+  /*! execute taskFunction(taskIndex) for all taskIndex in [0,nTasks),
+      in parallel. tasks get handed out to the worker threads
+      dynamically, so this is fine for tasks of varying cost (eg, one
+      task per mesh). if a task throws, no further tasks get handed
+      out, and (once all threads are done) the first exception gets
+      rethrown on the calling thread */
+  template<typename INDEX_T, typename TASK_T>
+  inline void parallel_for(INDEX_T nTasks, TASK_T&& taskFunction)
+  {
+    if (nTasks == 0) return;
+    const size_t numThreads = min(getNumThreads(),(size_t)nTasks);
+    if (numThreads == 1) {
+      serial_for(nTasks,taskFunction);
+      return;
+    }
+    
+    std::atomic<size_t> nextTask(0);
+    std::exception_ptr firstException;
+    std::mutex exceptionMutex;
+    auto worker = [&]() {
+      try {
+        while (true) {
+          const size_t taskIndex = nextTask++;
+          if (taskIndex >= (size_t)nTasks) break;
+          taskFunction((INDEX_T)taskIndex);
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(exceptionMutex);
+        if (!firstException)
+          firstException = std::current_exception();
+        nextTask = (size_t)nTasks;
+      }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i=1;i<numThreads;i++)
+      threads.push_back(std::thread(worker));
+    worker();
+    for (auto &t : threads) t.join();
+    if (firstException)
+      std::rethrow_exception(firstException);
+  }
+
+  template<typename TASK_T>
+  inline void serial_for_blocked(size_t begin, size_t end, size_t blockSize,
+                                 TASK_T &&taskFunction)
+  {
+    for (size_t block_begin=begin; block_begin < end; block_begin += blockSize)
+      taskFunction(block_begin, min(block_begin+blockSize,end));
+  }
+
+  /*! execute taskFunction(block_begin,block_end) over [begin,end),
+      chopped into blocks of (at most) blockSize items each */
+  template<typename TASK_T>
+  inline void parallel_for_blocked(size_t begin, size_t end, size_t blockSize,
+                                   TASK_T &&taskFunction)
+  {
+    if (end <= begin) return;
+    const size_t numBlocks = divRoundUp(end-begin,blockSize);
+    parallel_for(numBlocks,[&](size_t blockID){
+        const size_t block_begin = begin+blockID*blockSize;
+        taskFunction(block_begin, min(block_begin+blockSize,end));
+      });
+  }
+  
+} // ::gdt
@@ -0,0 +1,258 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "Profiler.h"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace gdt {
+  namespace profile {
+
+    /*! one recorded scope, or counter sample */
+    struct Event {
+      const char *name;
+      uint64_t    begin;
+      /*! end of the scope, or noEnd for counter samples */
+      uint64_t    end;
+      double      value;
+      uint32_t    threadID;
+    };
+    static const uint64_t noEnd = ~uint64_t(0);
+
+    /*! one entry of a ring: an event, behind a sequence lock so
+        readers can tell when they raced with the owning thread
+        overwriting it. 'seq' is 2*i+1 while the i'th event of the
+        ring gets written, and 2*i+2 once it's complete. (all fields
+        are relaxed atomics, so that racing reads are well-defined,
+        just possibly torn) */
+    struct EventSlot {
+      std::atomic<uint64_t>     seq;
+      std::atomic<const char *> name;
+      std::atomic<uint64_t>     begin;
+      std::atomic<uint64_t>     end;
+      std::atomic<double>       value;
+      std::atomic<uint32_t>     threadID;
+    };
+
+    /*! the events of one thread; only ever written by that thread */
+    struct ThreadRing {
+      static const size_t capacity = 1<<16;
+      
+      ThreadRing() : slots(new EventSlot[capacity]()) {}
+      
+      std::unique_ptr<EventSlot[]> slots;
+      std::atomic<uint64_t>        numWritten { 0 };
+    };
+
+    /*! all rings ever created; rings of threads that have exited go
+        to the free list and get handed to the next new thread, since
+        parallel_for() spawns fresh threads on every call */
+    static std::mutex                ringsMutex;
+    static std::vector<ThreadRing *> allRings;
+    static std::vector<ThreadRing *> freeRings;
+    static uint32_t                  numThreadsSeen = 0;
+    
+    struct ThreadRingHandle {
+      ~ThreadRingHandle()
+      {
+        if (!ring) return;
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        freeRings.push_back(ring);
+      }
+      ThreadRing *get()
+      {
+        if (ring) return ring;
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        if (freeRings.empty()) {
+          ring = new ThreadRing;
+          allRings.push_back(ring);
+        } else {
+          ring = freeRings.back();
+          freeRings.pop_back();
+        }
+        threadID = numThreadsSeen++;
+        return ring;
+      }
+      ThreadRing *ring     { nullptr };
+      uint32_t    threadID { 0 };
+    };
+    static thread_local ThreadRingHandle threadRing;
+
+    uint64_t now()
+    {
+      static const std::chrono::steady_clock::time_point epoch
+        = std::chrono::steady_clock::now();
+      return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now()-epoch).count();
+    }
+    
+    static inline void push(Event event)
+    {
+      ThreadRing *ring = threadRing.get();
+      event.threadID = threadRing.threadID;
+      const uint64_t i = ring->numWritten.load(std::memory_order_relaxed);
+      EventSlot &slot = ring->slots[i % ThreadRing::capacity];
+      slot.seq.store(2*i+1,std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      slot.name    .store(event.name,    std::memory_order_relaxed);
+      slot.begin   .store(event.begin,   std::memory_order_relaxed);
+      slot.end     .store(event.end,     std::memory_order_relaxed);
+      slot.value   .store(event.value,   std::memory_order_relaxed);
+      slot.threadID.store(event.threadID,std::memory_order_relaxed);
+      slot.seq.store(2*i+2,std::memory_order_release);
+      ring->numWritten.store(i+1,std::memory_order_release);
+    }
+
+    /*! read the i'th event of the ring; false if it's been (or is
+        being) overwritten by a newer one */
+    static inline bool read(const ThreadRing &ring, uint64_t i, Event &event)
+    {
+      const EventSlot &slot = ring.slots[i % ThreadRing::capacity];
+      const uint64_t seq = slot.seq.load(std::memory_order_acquire);
+      if (seq != 2*i+2)
+        return false;
+      event.name     = slot.name    .load(std::memory_order_relaxed);
+      event.begin    = slot.begin   .load(std::memory_order_relaxed);
+      event.end      = slot.end     .load(std::memory_order_relaxed);
+      event.value    = slot.value   .load(std::memory_order_relaxed);
+      event.threadID = slot.threadID.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return slot.seq.load(std::memory_order_relaxed) == seq;
+    }
+
+    void recordScope(const char *name, uint64_t begin, uint64_t end)
+    {
+#if GDT_PROFILING
+      Event event = { name, begin, end, 0., 0 };
+      push(event);
+#else
+      (void)name; (void)begin; (void)end;
+#endif
+    }
+    
+    void recordCounter(const char *name, double value)
+    {
+#if GDT_PROFILING
+      Event event = { name, now(), noEnd, value, 0 };
+      push(event);
+#else
+      (void)name; (void)value;
+#endif
+    }
+
+    /*! call 'f(event)' for the events still in all rings, newest
+        first per ring, until it returns false; skips the ones the
+        owning thread overwrites while we look */
+    template<typename Lambda>
+    static void forEachRecentEvent(const Lambda &f)
+    {
+      std::vector<ThreadRing *> rings;
+      {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings = allRings;
+      }
+      for (auto ring : rings) {
+        const uint64_t end   = ring->numWritten.load(std::memory_order_acquire);
+        const uint64_t begin = end > ThreadRing::capacity
+          ? end - ThreadRing::capacity
+          : 0;
+        Event event;
+        for (uint64_t i=end;i>begin;--i) {
+          if (!read(*ring,i-1,event))
+            continue;
+          if (!f(event))
+            break;
+        }
+      }
+    }
+    
+    std::vector<StageStats> summarize(double seconds)
+    {
+      const uint64_t cutoff = (uint64_t)std::max(0.,double(now())-seconds*1e9);
+      std::map<std::string,StageStats> stats;
+      forEachRecentEvent([&](const Event &event) {
+          const bool isCounter = event.end == noEnd;
+          // per ring, scopes get recorded in order of their end, and
+          // counters in order of their (only) time stamp
+          if ((isCounter ? event.begin : event.end) < cutoff)
+            return false;
+          auto it = stats.find(event.name);
+          if (it == stats.end()) {
+            StageStats s = { event.name, 0, 0., event.value, isCounter };
+            it = stats.insert(std::make_pair(std::string(event.name),s)).first;
+          }
+          StageStats &s = it->second;
+          s.count++;
+          s.total += isCounter ? event.value : (event.end-event.begin)*1e-9;
+          return true;
+        });
+      
+      std::vector<StageStats> result;
+      for (auto &it : stats)
+        result.push_back(it.second);
+      return result;
+    }
+
+    static void writeJSONString(std::ostream &out, const char *s)
+    {
+      out << '"';
+      for (;*s;s++) {
+        if (*s == '"' || *s == '\\') out << '\\';
+        out << *s;
+      }
+      out << '"';
+    }
+    
+    void writeChromeTrace(const std::string &fileName)
+    {
+      std::ofstream out(fileName);
+      if (!out.good())
+        throw std::runtime_error("could not open trace file '"+fileName+"'");
+
+      // time stamps are in microseconds, and we want to keep the
+      // nanoseconds
+      out << std::fixed << std::setprecision(3);
+      out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+      bool first = true;
+      size_t numEvents = 0;
+      forEachRecentEvent([&](const Event &event) {
+          out << (first ? "\n" : ",\n");
+          first = false;
+          out << "{\"name\":";
+          writeJSONString(out,event.name);
+          out << ",\"pid\":0,\"tid\":" << event.threadID
+              << ",\"ts\":" << event.begin*1e-3;
+          if (event.end == noEnd)
+            out << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+          else
+            out << ",\"ph\":\"X\",\"dur\":" << (event.end-event.begin)*1e-3 << "}";
+          numEvents++;
+          return true;
+        });
+      out << "\n]}\n";
+      
+      std::cout << "#gdt: wrote " << numEvents << " profile events to '"
+                << fileName << "'" << std::endl;
+    }
+    
+  } // ::gdt::profile
+} // ::gdt
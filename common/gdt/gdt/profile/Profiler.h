@@ -0,0 +1,89 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "gdt/gdt.h"
+#include <vector>
+
+/*! compile-time switch for all profiling; with this off, the macros
+    below expand to nothing, and the functions in gdt::profile are
+    no-ops */
+#ifndef GDT_PROFILING
+# define GDT_PROFILING 0
+#endif
+
+#define GDT_PROFILE_CONCAT_(a,b) a##b
+#define GDT_PROFILE_CONCAT(a,b) GDT_PROFILE_CONCAT_(a,b)
+
+#if GDT_PROFILING
+/*! time the rest of the enclosing scope; 'name' has to be a string
+    literal (only the pointer gets stored) */
+# define GDT_PROFILE_SCOPE(name)                                        \
+  ::gdt::profile::ScopedTimer GDT_PROFILE_CONCAT(gdt_profile_scope_,__LINE__)(name)
+/*! record the current value of some counter */
+# define GDT_PROFILE_COUNTER(name,value)                                \
+  ::gdt::profile::recordCounter(name,double(value))
+#else
+# define GDT_PROFILE_SCOPE(name)         ((void)0)
+# define GDT_PROFILE_COUNTER(name,value) ((void)0)
+#endif
+
+namespace gdt {
+  /*! a lightweight recorder for timed scopes and counters. every
+      thread writes into its own fixed-size ring buffer, without any
+      locking; readers (trace export, summaries) just look at the
+      most recent entries of all rings, and skip the ones that get
+      overwritten while they look */
+  namespace profile {
+
+    /*! nanoseconds since the profiler got initialized */
+    uint64_t now();
+    
+    void recordScope(const char *name, uint64_t begin, uint64_t end);
+    void recordCounter(const char *name, double value);
+    
+    struct ScopedTimer {
+      ScopedTimer(const char *name) : name(name), begin(now()) {}
+      ~ScopedTimer() { recordScope(name,begin,now()); }
+      const char *const name;
+      const uint64_t    begin;
+    };
+
+    /*! per-name statistics over a recent window of time */
+    struct StageStats {
+      const char *name;
+      /*! number of scopes (or counter samples) in the window */
+      size_t      count;
+      /*! summed duration of all scopes, in seconds; for counters,
+          the sum of all values */
+      double      total;
+      /*! for counters, the most recent value */
+      double      last;
+      bool        isCounter;
+    };
+    
+    /*! statistics of everything that ended in the last 'seconds'
+        seconds, sorted by name */
+    std::vector<StageStats> summarize(double seconds);
+
+    /*! write everything still in the ring buffers as a chrome trace
+        (viewable in chrome://tracing or perfetto) */
+    void writeChromeTrace(const std::string &fileName);
+    
+  } // ::gdt::profile
+} // ::gdt
@@ -0,0 +1,110 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "gdt/random/random.h"
+#include <algorithm>
+
+namespace gdt {
+
+  /*! the void-and-cluster method (Ulichney 1993). 'energy' is each
+      pixel's gaussian-weighted (and toroidally wrapped) sum over all
+      pixels currently set; the "tightest cluster" is the set pixel
+      with the highest energy, the "largest void" the unset one with
+      the lowest */
+  std::vector<float> makeBlueNoiseTile(int size, uint32_t seed)
+  {
+    if (size < 4)
+      throw std::runtime_error("makeBlueNoiseTile: size has to be at least 4");
+    const int numPixels = size*size;
+    const float sigma = 1.5f;
+    
+    // filter weights by (wrapped) offset
+    std::vector<float> weight(numPixels);
+    for (int dy=0;dy<size;dy++)
+      for (int dx=0;dx<size;dx++) {
+        const int wx = std::min(dx,size-dx), wy = std::min(dy,size-dy);
+        weight[dy*size+dx] = expf(-(wx*wx+wy*wy)/(2.f*sigma*sigma));
+      }
+    
+    std::vector<uint8_t> isSet(numPixels,0);
+    std::vector<float>   energy(numPixels,0.f);
+    auto toggle = [&](int pixel) {
+      isSet[pixel] = !isSet[pixel];
+      const float sign = isSet[pixel] ? 1.f : -1.f;
+      const int px = pixel % size, py = pixel / size;
+      for (int y=0;y<size;y++) {
+        const int dy = (y-py+size) % size;
+        for (int x=0;x<size;x++)
+          energy[y*size+x] += sign*weight[dy*size+(x-px+size)%size];
+      }
+    };
+    auto tightestCluster = [&]() {
+      int best = -1;
+      for (int i=0;i<numPixels;i++)
+        if (isSet[i] && (best < 0 || energy[i] > energy[best])) best = i;
+      return best;
+    };
+    auto largestVoid = [&]() {
+      int best = -1;
+      for (int i=0;i<numPixels;i++)
+        if (!isSet[i] && (best < 0 || energy[i] < energy[best])) best = i;
+      return best;
+    };
+
+    // initial pattern: a random 10% of the pixels, then moved around
+    // until the tightest cluster is the same pixel as the largest
+    // void, ie, the pattern is as even as it gets (with a cap, in
+    // case it ends up alternating between two patterns)
+    PCG32 random(seed,0x626c7565u);
+    const int numInitial = std::max(1,numPixels/10);
+    for (int n=0;n<numInitial;) {
+      const int pixel = int(random.next() % uint32_t(numPixels));
+      if (!isSet[pixel]) { toggle(pixel); n++; }
+    }
+    for (int iteration=0;iteration<numPixels;iteration++) {
+      const int cluster = tightestCluster();
+      toggle(cluster);
+      const int gap = largestVoid();
+      toggle(gap);
+      if (gap == cluster) break;
+    }
+    const std::vector<uint8_t> initialSet = isSet;
+    const std::vector<float>   initialEnergy = energy;
+
+    std::vector<int> rank(numPixels);
+    // ranks below the initial pattern: remove tightest clusters first
+    for (int r=numInitial-1;r>=0;r--) {
+      const int cluster = tightestCluster();
+      toggle(cluster);
+      rank[cluster] = r;
+    }
+    // ranks from there on up: fill the largest voids first
+    isSet  = initialSet;
+    energy = initialEnergy;
+    for (int r=numInitial;r<numPixels;r++) {
+      const int gap = largestVoid();
+      toggle(gap);
+      rank[gap] = r;
+    }
+
+    std::vector<float> tile(numPixels);
+    for (int i=0;i<numPixels;i++)
+      tile[i] = (rank[i]+.5f)/numPixels;
+    return tile;
+  }
+  
+} // ::gdt
@@ -48,6 +48,8 @@
 #pragma once
 
 #include "gdt/gdt.h"
+#include "gdt/math/vec.h"
+#include <vector>
 
 namespace gdt {
 
@@ -88,4 +90,343 @@ namespace gdt {
     uint32_t state;
   };
 
+  // =======================================================
+  // helpers
+  // =======================================================
+
+  /*! top 24 bits of a 32-bit random number, as a float in [0,1) */
+  inline __both__ float toUnitFloat(uint32_t bits)
+  { return (bits >> 8) * (1.f/16777216.f); }
+
+  /*! a good 32-bit integer hash ("lowbias32"), for turning seeds and
+      indices into well-mixed bits */
+  inline __both__ uint32_t hash32(uint32_t x)
+  {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+  }
+
+  inline __both__ uint32_t hashCombine(uint32_t seed, uint32_t v)
+  { return seed ^ (v + (seed << 6) + (seed >> 2)); }
+
+  inline __both__ uint32_t reverseBits(uint32_t x)
+  {
+#ifdef __CUDA_ARCH__
+    return __brev(x);
+#else
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+#endif
+  }
+  
+  // =======================================================
+  // PCG32
+  // =======================================================
+
+  /*! O'Neill's PCG32 (XSH-RR, 64-bit state): much better statistics
+      than the LCG above, at about the same cost per number, and
+      seeding doesn't need any rounds - so it's cheap to seed one per
+      pixel. different 'stream's give independent sequences for the
+      same seed */
+  struct PCG32 {
+    inline __both__ PCG32()
+    { /* intentionally empty, see LCG */ }
+    inline __both__ PCG32(uint64_t seed, uint64_t stream = 0)
+    { init(seed,stream); }
+
+    inline __both__ void init(uint64_t seed, uint64_t stream = 0)
+    {
+      state = 0u;
+      inc   = (stream << 1u) | 1u;
+      next();
+      state += seed;
+      next();
+    }
+
+    inline __both__ uint32_t next()
+    {
+      const uint64_t oldState = state;
+      state = oldState * 6364136223846793005ULL + inc;
+      const uint32_t xorShifted = uint32_t(((oldState >> 18u) ^ oldState) >> 27u);
+      const uint32_t rot = uint32_t(oldState >> 59u);
+      return (xorShifted >> rot) | (xorShifted << ((0u-rot) & 31u));
+    }
+
+    /*! float in [0,1) */
+    inline __both__ float operator() () { return toUnitFloat(next()); }
+
+    /*! skip ahead by 'delta' numbers, in O(log delta) - for giving
+        each of several threads its own part of the same sequence */
+    inline __both__ void advance(uint64_t delta)
+    {
+      uint64_t curMult = 6364136223846793005ULL, curPlus = inc;
+      uint64_t accMult = 1u, accPlus = 0u;
+      while (delta > 0) {
+        if (delta & 1) {
+          accMult *= curMult;
+          accPlus  = accPlus * curMult + curPlus;
+        }
+        curPlus  = (curMult + 1) * curPlus;
+        curMult *= curMult;
+        delta  >>= 1;
+      }
+      state = accMult * state + accPlus;
+    }
+
+    /*! host-side batch version of operator(), for filling large
+        arrays */
+    inline void fill(float *out, size_t count)
+    {
+      // on a local copy, so the state can live in a register
+      PCG32 rng = *this;
+      for (size_t i=0;i<count;i++) out[i] = rng();
+      *this = rng;
+    }
+    
+    uint64_t state, inc;
+  };
+
+  // =======================================================
+  // Philox
+  // =======================================================
+
+  /*! Philox4x32-10 (Salmon et al, "Parallel Random Numbers: As Easy
+      as 1, 2, 3"): counter-based, ie, a pure function of (counter,
+      key) - there's no state to carry around, any number of the
+      sequence can be computed directly, and batches are trivially
+      parallel. the struct is a convenience wrapper that walks the
+      counter, four numbers per block */
+  struct Philox {
+    inline __both__ Philox()
+    { /* intentionally empty, see LCG */ }
+    inline __both__ Philox(uint64_t seed, uint64_t stream = 0)
+    { init(seed,stream); }
+
+    inline __both__ void init(uint64_t seed, uint64_t stream = 0)
+    {
+      key     = vec2ui(uint32_t(seed),uint32_t(seed >> 32));
+      counter = vec4ui(0u,0u,uint32_t(stream),uint32_t(stream >> 32));
+      numUsed = 4;
+    }
+
+    static inline __both__ uint32_t mulhi(uint32_t a, uint32_t b)
+    {
+#ifdef __CUDA_ARCH__
+      return __umulhi(a,b);
+#else
+      return uint32_t((uint64_t(a)*b) >> 32);
+#endif
+    }
+    
+    /*! the four random numbers for given counter and key */
+    static inline __both__ vec4ui generate(vec4ui ctr, vec2ui k)
+    {
+      const uint32_t M0 = 0xD2511F53u, M1 = 0xCD9E8D57u;
+      const uint32_t W0 = 0x9E3779B9u, W1 = 0xBB67AE85u;
+      for (int round=0;round<10;round++) {
+        if (round > 0) { k.x += W0; k.y += W1; }
+        const uint32_t hi0 = mulhi(M0,ctr.x), lo0 = M0*ctr.x;
+        const uint32_t hi1 = mulhi(M1,ctr.z), lo1 = M1*ctr.z;
+        ctr = vec4ui(hi1^ctr.y^k.x, lo1, hi0^ctr.w^k.y, lo0);
+      }
+      return ctr;
+    }
+
+    inline __both__ uint32_t next()
+    {
+      if (numUsed == 4) {
+        block = generate(counter,key);
+        if (++counter.x == 0) ++counter.y;
+        numUsed = 0;
+      }
+      return block[numUsed++];
+    }
+    
+    /*! float in [0,1) */
+    inline __both__ float operator() () { return toUnitFloat(next()); }
+
+    /*! host-side batch generation: numbers [first,first+count) of
+        the sequence for (seed,stream), as floats in [0,1). every
+        block of four is independent, so this vectorizes */
+    static inline void fill(uint64_t seed, uint64_t stream, uint64_t first,
+                            float *out, size_t count)
+    {
+      const vec2ui k(uint32_t(seed),uint32_t(seed >> 32));
+      auto block = [&](uint64_t blockID) {
+        return generate(vec4ui(uint32_t(blockID),uint32_t(blockID >> 32),
+                               uint32_t(stream),uint32_t(stream >> 32)),k);
+      };
+      size_t i = 0;
+      // partial first block ...
+      if (first % 4) {
+        const vec4ui bits = block(first/4);
+        for (int j=int(first%4);j<4 && i<count;j++)
+          out[i++] = toUnitFloat(bits[j]);
+      }
+      // ... whole blocks - the part that vectorizes ...
+      const uint64_t firstBlock = (first+i)/4;
+      const size_t numBlocks = (count-i)/4;
+      float *blockOut = out+i;
+      for (size_t b=0;b<numBlocks;b++) {
+        const vec4ui bits = block(firstBlock+b);
+        blockOut[4*b+0] = toUnitFloat(bits.x);
+        blockOut[4*b+1] = toUnitFloat(bits.y);
+        blockOut[4*b+2] = toUnitFloat(bits.z);
+        blockOut[4*b+3] = toUnitFloat(bits.w);
+      }
+      i += 4*numBlocks;
+      // ... and what's left
+      if (i < count) {
+        const vec4ui bits = block((first+i)/4);
+        for (int j=0;i<count;j++)
+          out[i++] = toUnitFloat(bits[j]);
+      }
+    }
+    
+    vec2ui   key;
+    vec4ui   counter;
+    vec4ui   block;
+    uint32_t numUsed;
+  };
+
+  // =======================================================
+  // Sobol, with Owen scrambling
+  // =======================================================
+
+  /*! generator matrices of the first four Sobol dimensions (Joe and
+      Kuo's direction numbers), one column per index bit */
+#ifdef __CUDA_ARCH__
+  static __constant__
+#else
+  static
+#endif
+  const uint32_t sobolDirections[4][32] = {
+    {
+      0x80000000u, 0x40000000u, 0x20000000u, 0x10000000u,
+      0x08000000u, 0x04000000u, 0x02000000u, 0x01000000u,
+      0x00800000u, 0x00400000u, 0x00200000u, 0x00100000u,
+      0x00080000u, 0x00040000u, 0x00020000u, 0x00010000u,
+      0x00008000u, 0x00004000u, 0x00002000u, 0x00001000u,
+      0x00000800u, 0x00000400u, 0x00000200u, 0x00000100u,
+      0x00000080u, 0x00000040u, 0x00000020u, 0x00000010u,
+      0x00000008u, 0x00000004u, 0x00000002u, 0x00000001u
+    },
+    {
+      0x80000000u, 0xc0000000u, 0xa0000000u, 0xf0000000u,
+      0x88000000u, 0xcc000000u, 0xaa000000u, 0xff000000u,
+      0x80800000u, 0xc0c00000u, 0xa0a00000u, 0xf0f00000u,
+      0x88880000u, 0xcccc0000u, 0xaaaa0000u, 0xffff0000u,
+      0x80008000u, 0xc000c000u, 0xa000a000u, 0xf000f000u,
+      0x88008800u, 0xcc00cc00u, 0xaa00aa00u, 0xff00ff00u,
+      0x80808080u, 0xc0c0c0c0u, 0xa0a0a0a0u, 0xf0f0f0f0u,
+      0x88888888u, 0xccccccccu, 0xaaaaaaaau, 0xffffffffu
+    },
+    {
+      0x80000000u, 0xc0000000u, 0x60000000u, 0x90000000u,
+      0xe8000000u, 0x5c000000u, 0x8e000000u, 0xc5000000u,
+      0x68800000u, 0x9cc00000u, 0xee600000u, 0x55900000u,
+      0x80680000u, 0xc09c0000u, 0x60ee0000u, 0x90550000u,
+      0xe8808000u, 0x5cc0c000u, 0x8e606000u, 0xc5909000u,
+      0x6868e800u, 0x9c9c5c00u, 0xeeee8e00u, 0x5555c500u,
+      0x8000e880u, 0xc0005cc0u, 0x60008e60u, 0x9000c590u,
+      0xe8006868u, 0x5c009c9cu, 0x8e00eeeeu, 0xc5005555u
+    },
+    {
+      0x80000000u, 0xc0000000u, 0x20000000u, 0x50000000u,
+      0xf8000000u, 0x74000000u, 0xa2000000u, 0x93000000u,
+      0xd8800000u, 0x25400000u, 0x59e00000u, 0xe6d00000u,
+      0x78080000u, 0xb40c0000u, 0x82020000u, 0xc3050000u,
+      0x208f8000u, 0x51474000u, 0xfbea2000u, 0x75d93000u,
+      0xa0858800u, 0x914e5400u, 0xdbe79e00u, 0x25db6d00u,
+      0x58800080u, 0xe54000c0u, 0x79e00020u, 0xb6d00050u,
+      0x800800f8u, 0xc00c0074u, 0x200200a2u, 0x50050093u
+    }
+  };
+
+  /*! dimension 'dim' (0..3) of the index-th Sobol point, as 32 bits */
+  inline __both__ uint32_t sobol(uint32_t index, int dim)
+  {
+    // branch-free and with a fixed trip count: index bits are random
+    // after shuffling, so any branch on them would mispredict half
+    // the time; this way, the compiler can also unroll (and on the
+    // host, vectorize) the loop
+    uint32_t bits = 0;
+    for (int bit=0;bit<32;bit++)
+      bits ^= sobolDirections[dim][bit] & (0u-((index >> bit) & 1u));
+    return bits;
+  }
+
+  /*! hash-based Owen scrambling (Burley 2020, "Practical Hash-based
+      Owen Scrambling"): a nested uniform scramble - each bit gets
+      flipped depending on all the bits above it */
+  inline __both__ uint32_t owenScramble(uint32_t bits, uint32_t seed)
+  {
+    bits = reverseBits(bits);
+    bits += seed;
+    bits ^= bits * 0x6c50b47cu;
+    bits ^= bits * 0xb82f1e52u;
+    bits ^= bits * 0xc7afe638u;
+    bits ^= bits * 0x8d22f6e6u;
+    return reverseBits(bits);
+  }
+  
+  /*! dimension 'dim' of the index-th point of an Owen-scrambled,
+      shuffled Sobol sequence, in [0,1). different seeds give
+      independent (but equally well stratified) point sets - use
+      one per pixel. only the first four dimensions come from one
+      Sobol set; higher ones come from independently scrambled
+      further 4D sets, which is what Burley recommends (padding) */
+  inline __both__ float sobolOwen(uint32_t index, int dim, uint32_t seed)
+  {
+    seed = hashCombine(seed,hash32(uint32_t(dim/4)));
+    const uint32_t shuffled = owenScramble(index,hash32(seed));
+    return toUnitFloat(owenScramble(sobol(shuffled,dim%4),
+                                    hash32(hashCombine(seed,uint32_t(dim%4)))));
+  }
+
+  /*! host-side batch version of sobolOwen, for points
+      [first,first+count) */
+  inline void sobolOwenFill(uint32_t first, int dim, uint32_t seed,
+                            float *out, size_t count)
+  {
+    for (size_t i=0;i<count;i++)
+      out[i] = sobolOwen(first+uint32_t(i),dim,seed);
+  }
+
+  // =======================================================
+  // blue noise
+  // =======================================================
+
+  /*! builds a (size x size, tileable) blue-noise dither mask with the
+      void-and-cluster method: every value in [0,1) appears once, and
+      pixels with similar values are spread out evenly. meant to be
+      built once on the host (it's O(size^4)), uploaded, and then
+      sampled with blueNoise() below. host only, see random.cpp */
+  std::vector<float> makeBlueNoiseTile(int size, uint32_t seed = 0);
+
+  /*! sample 'dim' of sample 'sampleIndex' for the given pixel, from a
+      tile built by makeBlueNoiseTile: each dimension looks at the
+      tile at a different (hashed) offset, and consecutive samples
+      shift all values by the golden ratio (mod 1), so they keep the
+      blue-noise distribution across the screen while still covering
+      [0,1) well over time */
+  inline __both__ float blueNoise(const float *tile, int tileSize,
+                                  vec2i pixel, uint32_t sampleIndex, int dim)
+  {
+    const uint32_t offset = hash32(uint32_t(dim));
+    const int x = int((uint32_t(pixel.x) + (offset & 0xffffu)) % uint32_t(tileSize));
+    const int y = int((uint32_t(pixel.y) + (offset >> 16))     % uint32_t(tileSize));
+    // golden ratio times sampleIndex, in 32-bit fixed point, so this
+    // doesn't lose precision for large sample indices
+    const float v = tile[y*tileSize+x] + toUnitFloat(sampleIndex*2654435769u);
+    return v - floorf(v);
+  }
+
 } // ::gdt
@@ -0,0 +1,192 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "GLDisplay.h"
+#include <GL/gl.h>
+#include <cstring>
+
+// the buffer object bits are GL 1.5/2.1, which not all platforms'
+// gl.h (or GL libraries) export, so we look those up at runtime
+#ifndef GL_ARRAY_BUFFER
+# define GL_ARRAY_BUFFER         0x8892
+#endif
+#ifndef GL_PIXEL_UNPACK_BUFFER
+# define GL_PIXEL_UNPACK_BUFFER  0x88EC
+#endif
+#ifndef GL_WRITE_ONLY
+# define GL_WRITE_ONLY           0x88B9
+#endif
+#ifndef GL_STREAM_DRAW
+# define GL_STREAM_DRAW          0x88E0
+#endif
+#ifndef GL_STATIC_DRAW
+# define GL_STATIC_DRAW          0x88E4
+#endif
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  typedef void      (APIENTRY *GenBuffersFn)(GLsizei, GLuint *);
+  typedef void      (APIENTRY *DeleteBuffersFn)(GLsizei, const GLuint *);
+  typedef void      (APIENTRY *BindBufferFn)(GLenum, GLuint);
+  typedef void      (APIENTRY *BufferDataFn)(GLenum, ptrdiff_t, const void *, GLenum);
+  typedef void     *(APIENTRY *MapBufferFn)(GLenum, GLenum);
+  typedef GLboolean (APIENTRY *UnmapBufferFn)(GLenum);
+  
+  static struct {
+    GenBuffersFn    genBuffers    { nullptr };
+    DeleteBuffersFn deleteBuffers { nullptr };
+    BindBufferFn    bindBuffer    { nullptr };
+    BufferDataFn    bufferData    { nullptr };
+    MapBufferFn     mapBuffer     { nullptr };
+    UnmapBufferFn   unmapBuffer   { nullptr };
+  } gl;
+
+  /*! does the current context do pixel buffer objects (ie, is it GL
+      2.1+, or has the ARB extension)? */
+  static bool havePixelBufferObjects()
+  {
+    const char *version = (const char *)glGetString(GL_VERSION);
+    int major = 0, minor = 0;
+    if (version && sscanf(version,"%d.%d",&major,&minor) == 2
+        && (major > 2 || (major == 2 && minor >= 1)))
+      return true;
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+    return extensions && strstr(extensions,"GL_ARB_pixel_buffer_object");
+  }
+  
+  void GLDisplay::init()
+  {
+    gl.genBuffers    = (GenBuffersFn)glfwGetProcAddress("glGenBuffers");
+    gl.deleteBuffers = (DeleteBuffersFn)glfwGetProcAddress("glDeleteBuffers");
+    gl.bindBuffer    = (BindBufferFn)glfwGetProcAddress("glBindBuffer");
+    gl.bufferData    = (BufferDataFn)glfwGetProcAddress("glBufferData");
+    gl.mapBuffer     = (MapBufferFn)glfwGetProcAddress("glMapBuffer");
+    gl.unmapBuffer   = (UnmapBufferFn)glfwGetProcAddress("glUnmapBuffer");
+    if (!gl.genBuffers || !gl.deleteBuffers || !gl.bindBuffer ||
+        !gl.bufferData || !gl.mapBuffer || !gl.unmapBuffer)
+      throw std::runtime_error("GL context does not support buffer objects");
+
+    glGenTextures(1,&texture);
+    glBindTexture(GL_TEXTURE_2D,texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    if (numPBOs > 0 && havePixelBufferObjects()) {
+      pbo.resize(numPBOs);
+      gl.genBuffers(numPBOs,pbo.data());
+    }
+
+    // unit square, interleaved position and texcoord
+    const float quad[] = {
+      0.f, 0.f,   0.f, 0.f,
+      1.f, 0.f,   1.f, 0.f,
+      0.f, 1.f,   0.f, 1.f,
+      1.f, 1.f,   1.f, 1.f
+    };
+    gl.genBuffers(1,&quadVBO);
+    gl.bindBuffer(GL_ARRAY_BUFFER,quadVBO);
+    gl.bufferData(GL_ARRAY_BUFFER,sizeof(quad),quad,GL_STATIC_DRAW);
+    gl.bindBuffer(GL_ARRAY_BUFFER,0);
+    
+    initialized = true;
+  }
+
+  GLDisplay::~GLDisplay()
+  {
+    if (!initialized) return;
+    glDeleteTextures(1,&texture);
+    if (!pbo.empty())
+      gl.deleteBuffers((GLsizei)pbo.size(),pbo.data());
+    gl.deleteBuffers(1,&quadVBO);
+  }
+
+  void GLDisplay::upload(const uint32_t *pixels, const vec2i &frameSize)
+  {
+    glBindTexture(GL_TEXTURE_2D,texture);
+    if (frameSize != textureSize) {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frameSize.x, frameSize.y, 0,
+                   GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+      textureSize = frameSize;
+    }
+
+    const size_t sizeInBytes = frameSize.x*frameSize.y*sizeof(uint32_t);
+    if (!pbo.empty()) {
+      gl.bindBuffer(GL_PIXEL_UNPACK_BUFFER,pbo[nextPBO]);
+      nextPBO = (nextPBO+1) % (int)pbo.size();
+      // re-specifying the storage lets the driver hand us fresh
+      // memory instead of waiting for a transfer still reading the
+      // old one
+      gl.bufferData(GL_PIXEL_UNPACK_BUFFER,(ptrdiff_t)sizeInBytes,nullptr,GL_STREAM_DRAW);
+      void *mapped = gl.mapBuffer(GL_PIXEL_UNPACK_BUFFER,GL_WRITE_ONLY);
+      if (mapped) {
+        memcpy(mapped,pixels,sizeInBytes);
+        gl.unmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        // with a PBO bound, the 'pointer' is an offset into it
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frameSize.x, frameSize.y,
+                        GL_RGBA, GL_UNSIGNED_BYTE, (const void *)0);
+        gl.bindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+        return;
+      }
+      gl.bindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+    }
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frameSize.x, frameSize.y,
+                    GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  }
+  
+  void GLDisplay::draw(const uint32_t *pixels,
+                       const vec2i &frameSize,
+                       const vec2i &viewportSize)
+  {
+    if (!initialized) init();
+
+    if (pixels) {
+      const double t0 = getCurrentTime();
+      upload(pixels,frameSize);
+      uploadTime += getCurrentTime()-t0;
+      numFramesUploaded++;
+    }
+    if (textureSize.x == 0) return;
+    
+    glDisable(GL_LIGHTING);
+    glColor3f(1, 1, 1);
+
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glDisable(GL_DEPTH_TEST);
+
+    glViewport(0, 0, viewportSize.x, viewportSize.y);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0.f, 1.f, 0.f, 1.f, -1.f, 1.f);
+
+    gl.bindBuffer(GL_ARRAY_BUFFER,quadVBO);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 4*sizeof(float), (const void *)0);
+    glTexCoordPointer(2, GL_FLOAT, 4*sizeof(float), (const void *)(2*sizeof(float)));
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    gl.bindBuffer(GL_ARRAY_BUFFER,0);
+  }
+  
+} // ::osc
@@ -0,0 +1,62 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "GLFWindow.h"
+#include <vector>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+  using namespace gdt;
+
+  /*! puts frames of RGBA8 pixels on the screen. the texture gets
+      allocated only once per frame size and then updated with
+      glTexSubImage2D, through a ring of pixel buffer objects so the
+      upload doesn't have to wait for the previous one; the quad it
+      gets drawn on lives in a vertex buffer. needs the window's GL
+      context to be current. if the context has no PBOs (or numPBOs
+      is 0), the texture is updated straight from client memory */
+  struct GLDisplay {
+    GLDisplay(int numPBOs = 3) : numPBOs(numPBOs) {}
+    ~GLDisplay();
+
+    /*! upload the given frame (unless null, in which case the last
+        one gets redrawn), and draw it across the whole viewport */
+    void draw(const uint32_t *pixels,
+              const vec2i &frameSize,
+              const vec2i &viewportSize);
+
+    /*! seconds spent in uploading frames so far */
+    double uploadTime      { 0. };
+    int    numFramesUploaded { 0 };
+    
+  private:
+    /*! create the GL objects; done lazily, on first draw */
+    void init();
+    void upload(const uint32_t *pixels, const vec2i &frameSize);
+    
+    const int                 numPBOs;
+    bool                      initialized { false };
+    unsigned int              texture     { 0 };
+    vec2i                     textureSize { 0 };
+    std::vector<unsigned int> pbo;
+    int                       nextPBO     { 0 };
+    unsigned int              quadVBO     { 0 };
+  };
+  
+} // ::osc